@@ -4,18 +4,93 @@
  */
 #include "client.hpp"
 #include "command.hpp"
+#include "download.hpp"
 #include "protocol.hpp"
 #include "terminal.hpp"
 
 #include <unistd.h>
 #include <iostream>
 
+/**
+ * @brief  Reads and executes a command, showing the error if it fails.
+ * @param  manager The command manager.
+ * @param  client The client.
+ * @param  command The command line.
+ */
+static void RunCommand(CommandManager &manager, Client &client,
+                       std::string command) {
+    try {
+        manager.readCommand(
+            command,
+            client);  // Reads the command  and its arguments, sending it to
+                      // the correct handler
+    } catch (CommandException const &
+                 e) {  // If an exception is thrown, print the error message
+        std::cout << e.what() << std::endl;
+    } catch (ProtocolViolationException const
+                 &e) {  // If there is an error in the protocol
+        std::cout << e.what() << std::endl;
+    } catch (ProtocolMessageErrorException const
+                 &e) {  // If the server sends an error message
+        std::cout << e.what() << std::endl;
+    } catch (TimeoutException const &e) {  // If the server doesn't respond in
+                                           // time, print the error message
+        std::cout << e.what() << std::endl;
+    } catch (SocketException const &e) {  // Problems with the socket
+        std::cout << e.what() << std::endl;
+    } catch (DownloadInterruptedException const
+                 &e) {  // If a download stopped, it can be resumed
+        std::cout << e.what() << std::endl;
+    }
+}
+
+/**
+ * @brief  Executes the commands of a script, one per line, until its end or
+ * the exit command.
+ *
+ * The queries that follow the command being executed, up to the first
+ * command that is not a query, are sent ahead, CLIENT_SCRIPT_WINDOW at most,
+ * so that their responses are awaited at once. They only read the state of
+ * the server, so sending them early changes none of the responses.
+ * @param  manager The command manager.
+ * @param  client The client.
+ * @param  script The script.
+ */
+static void RunScript(CommandManager &manager, Client &client,
+                      std::istream &script) {
+    std::vector<std::string> lines;
+    std::string line;
+
+    while (std::getline(script, line)) {
+        lines.push_back(line);
+    }
+
+    size_t prefetched = 0;  // The lines sent ahead are those before it
+
+    for (size_t i = 0; i < lines.size() && !client._toExit; i++) {
+        if (prefetched <= i) {  // The run of queries sent ahead ended
+            client.dropPrefetched();
+            prefetched = i;
+        }
+
+        // Keep the queries that follow in flight, while they are queries
+        while (prefetched < lines.size() &&
+               prefetched < i + CLIENT_SCRIPT_WINDOW &&
+               manager.prefetchCommand(lines[prefetched], client)) {
+            prefetched++;
+        }
+
+        RunCommand(manager, client, lines[i]);
+    }
+
+    client.dropPrefetched();
+}
+
 int main(int argc, char **argv) {
     Client client(argc,
                   argv);     // Create object Client, parsing command line
                              // arguments in the construction
     CommandManager manager;  // Create object CommandManager
-    Terminal terminal;       // Create object Terminal
     struct sigaction act;
 
     act.sa_handler = SIG_IGN;
@@ -39,30 +114,27 @@ int main(int argc, char **argv) {
     manager.registerCommand(std::make_shared<BidCommand>());
     manager.registerCommand(std::make_shared<ShowRecordCommand>());
 
-    while (!client._toExit) {  // While the client is not exiting
-        try {
-            std::string command = terminal.readLine(
-                client.getPrompt().c_str());  // Read a line from the terminal
-            manager.readCommand(
-                command,
-                client);  // Reads the command  and its arguments, sending it to
-                          // the correct handler
-        } catch (CommandException const &
-                     e) {  // If an exception is thrown, print the error message
-            std::cout << e.what() << std::endl;
-        } catch (ProtocolViolationException const
-                     &e) {  // If there is an error in the protocol
-            std::cout << e.what() << std::endl;
-        } catch (ProtocolMessageErrorException const
-                     &e) {  // If the server sends an error message
-            std::cout << e.what() << std::endl;
-        } catch (
-            TimeoutException const &e) {  // If the server doesn't respond in
-                                          // time, print the error message
-            std::cout << e.what() << std::endl;
-        } catch (SocketException const &e) {  // Problems with the socket
-            std::cout << e.what() << std::endl;
+    if (client.getScriptPath() == "-") {  // Non-interactive, from stdin
+        RunScript(manager, client, std::cin);
+        return 0;
+    } else if (!client.getScriptPath().empty()) {  // Non-interactive
+        std::ifstream script(client.getScriptPath());
+
+        if (!script.is_open()) {
+            std::cout << "Couldn't open the script" << std::endl;
+            return 1;
         }
+        RunScript(manager, client, script);
+        return 0;
+    }
+
+    Terminal terminal;  // Create object Terminal
+
+    while (!client._toExit) {  // While the client is not exiting
+        std::string command = terminal.readLine(
+            client.getPrompt().c_str());  // Read a line from the terminal
+        RunCommand(manager, client, command);
+        client.dropPrefetched();  // Never used by a later command
     }
 
     return 0;
@@ -99,7 +171,7 @@ std::string User::getPassword() {
 Client::Client(int argc, char **argv) {
     char c;
     // Parse the command line arguments
-    while ((c = (char)getopt(argc, argv, "n:p:")) != -1) {
+    while ((c = (char)getopt(argc, argv, "n:p:s:kf:")) != -1) {
         switch (c) {
             case 'n':  // If the argument is -n, set the hostname
                 _hostname = optarg;
@@ -107,30 +179,75 @@ Client::Client(int argc, char **argv) {
             case 'p':  // If the argument is -p, set the port
                 _port = optarg;
                 break;
+            case 's':  // If the argument is -s, set the servers of the shards
+                parseShards(optarg);
+                break;
+            case 'k':  // If the argument is -k, keep TCP connections open
+                _keepAlive = true;
+                break;
+            case 'f':  // If the argument is -f, read the commands from a file
+                _scriptPath = optarg;
+                break;
             default:
                 break;
         }
     }
+
+    if (_shards.empty()) {  // Not sharded, a single server has every auction
+        _shards.push_back({_hostname, _port});
+    }
+    _sessions.resize(_shards.size());
+    _udpClients.resize(_shards.size());
+    _conditional.resize(_shards.size(), true);
+}
+
+void Client::parseShards(std::string list) {
+    std::stringstream stream(list);
+    std::string address;
+
+    while (std::getline(stream, address, ',')) {
+        auto position = address.rfind(':');
+
+        if (position == std::string::npos) {  // Only the hostname is given
+            _shards.push_back({address, DEFAULT_PORT});
+        } else {
+            _shards.push_back(
+                {address.substr(0, position), address.substr(position + 1)});
+        }
+    }
 }
 
 void Client::ShowInfo() {
-    // Print the hostname and port
-    std::cout << "Hostname: " << _hostname << std::endl
-              << "Port: " << _port << std::endl;
+    // Print the hostname and port of every shard
+    for (auto &shard : _shards) {
+        std::cout << "Hostname: " << shard.hostname << std::endl
+                  << "Port: " << shard.port << std::endl;
+    }
 }
 
-void Client::processRequest(ProtocolCommunication &comm) {
+void Client::processRequest(ProtocolCommunication &comm, size_t shard) {
     std::stringstream reqMessage = comm.encodeRequest(),
                       resMessage;  // Encode the request
+    std::string hostname = getHostname(shard), port = getPort(shard);
+
+    if (comm.isTcp() && _keepAlive) {  // Reuse the TCP connection
+        processKeptAlive(comm, reqMessage, shard);
+        return;
+    }
 
     if (comm.isTcp()) {  // If the communication is TCP, use TCP
-        TcpClient tcpClient(_hostname, _port);  // Create a TCP client
-        tcpClient.send(reqMessage);             // Send the request
-        resMessage = tcpClient.receive();       // Receive the response
-    } else {  // If the communication is UDP, use UDP
-        UdpClient udpClient(_hostname, _port);  // Create a UDP client
-        udpClient.send(reqMessage);             // Send the request
-        resMessage = udpClient.receive();       // Receive the response
+        TcpClient tcpClient(hostname, port);  // Create a TCP client
+        tcpClient.send(reqMessage);           // Send the request
+        resMessage = tcpClient.receive();     // Receive the response
+    } else {  // If the communication is UDP, take it from those in flight
+        ConditionalCommunication *conditional =
+            dynamic_cast<ConditionalCommunication *>(&comm);
+
+        if (conditional != NULL) {  // Its response may be cached
+            processConditional(*conditional, shard);
+            return;
+        }
+        resMessage = exchangeUdp(reqMessage, shard);
     }
 
     StreamMessage resStreamMessage(
@@ -138,6 +255,179 @@ void Client::processRequest(ProtocolCommunication &comm) {
     comm.decodeResponse(resStreamMessage);  // Decode the response
 }
 
+void Client::prefetchRequest(ProtocolCommunication &comm, size_t shard) {
+    if (comm.isTcp()) {
+        return;
+    }
+
+    ConditionalCommunication *conditional =
+        dynamic_cast<ConditionalCommunication *>(&comm);
+
+    if (conditional != NULL) {  // Sent as it would be when processed
+        setCondition(*conditional, shard);
+    }
+
+    std::stringstream reqMessage = comm.encodeRequest();
+
+    if (_prefetched.count({shard, reqMessage.str()}) != 0) {
+        return;  // Already in flight
+    }
+
+    size_t tag = getUdpClient(shard).submit(reqMessage);
+    _prefetched.insert({{shard, reqMessage.str()}, tag});
+}
+
+std::stringstream Client::exchangeUdp(std::stringstream &request,
+                                      size_t shard) {
+    AsyncUdpClient &udpClient = getUdpClient(shard);
+    auto prefetched = _prefetched.find({shard, request.str()});
+    size_t tag;
+
+    if (prefetched != _prefetched.end()) {  // Already sent ahead
+        tag = prefetched->second;
+        _prefetched.erase(prefetched);
+    } else {
+        tag = udpClient.submit(request);  // Send the request
+    }
+
+    return udpClient.complete(tag);  // Receive the response
+}
+
+std::string Client::setCondition(ConditionalCommunication &comm,
+                                 size_t shard) {
+    comm._conditional = false;  // The responses are cached by plain request
+
+    std::string key = comm.encodeRequest().str();
+    auto cached = _responses.find({shard, key});
+
+    comm._conditional = _conditional[shard];
+    comm._knownGeneration =
+        (cached != _responses.end()) ? cached->second.generation : 0;
+
+    return key;
+}
+
+void Client::processConditional(ConditionalCommunication &comm,
+                                size_t shard) {
+    bool retried = false;  // Whether it was asked for all of the response
+
+    while (1) {
+        std::string key = setCondition(comm, shard);
+        std::stringstream reqMessage = comm.encodeRequest();
+        std::stringstream resMessage = exchangeUdp(reqMessage, shard);
+        StreamMessage resStreamMessage(resMessage);
+
+        try {
+            comm.decodeResponse(resStreamMessage);  // Decode the response
+        } catch (ProtocolException const &e) {
+            if (!comm._conditional) {
+                throw;
+            }
+            // A server without the extension, sent plain requests from now on
+            _conditional[shard] = false;
+            continue;
+        }
+
+        if (!comm._conditional) {
+            return;
+        }
+
+        auto cached = _responses.find({shard, key});
+
+        if (comm._status != PROTOCOL_UNCHANGED_STATUS) {
+            if (comm._generation != 0) {  // Sent with the generation next time
+                if (_responses.size() >= CLIENT_RESPONSE_CACHE_ENTRIES &&
+                    cached == _responses.end()) {
+                    _responses.clear();  // Full, the old ones go with the rest
+                }
+                _responses[{shard, key}] = {comm._generation,
+                                            resMessage.str()};
+            } else if (cached != _responses.end()) {
+                _responses.erase(cached);  // Nothing to be sent back
+            }
+            return;
+        }
+
+        if (cached != _responses.end() &&
+            cached->second.generation == comm._generation) {
+            std::stringstream cachedMessage(cached->second.response);
+            StreamMessage cachedStreamMessage(cachedMessage);
+
+            comm.decodeResponse(cachedStreamMessage);  // Decode the one cached
+            return;
+        }
+
+        if (retried) {  // Unchanged even with nothing cached
+            throw ProtocolViolationException();
+        }
+
+        // Unchanged since a response no longer cached, asked for all of it
+        if (cached != _responses.end()) {
+            _responses.erase(cached);
+        }
+        retried = true;
+    }
+}
+
+void Client::dropPrefetched() {
+    for (auto &prefetched : _prefetched) {
+        getUdpClient(prefetched.first.first).cancel(prefetched.second);
+    }
+    _prefetched.clear();
+}
+
+AsyncUdpClient &Client::getUdpClient(size_t shard) {
+    std::unique_ptr<AsyncUdpClient> &udpClient = _udpClients.at(shard);
+
+    if (udpClient == nullptr) {
+        udpClient = std::make_unique<AsyncUdpClient>(getHostname(shard),
+                                                     getPort(shard));
+    }
+
+    return *udpClient;
+}
+
+void Client::processKeptAlive(ProtocolCommunication &comm,
+                              std::stringstream &request, size_t shard) {
+    std::unique_ptr<TcpClient> &session = _sessions[shard];
+
+    while (1) {
+        bool reused = session != nullptr;
+
+        if (!reused) {
+            session = std::make_unique<TcpClient>(getHostname(shard),
+                                                   getPort(shard));
+            try {
+                session->keepAlive();  // Ask for the connection to stay open
+            } catch (ProtocolMessageErrorException const &e) {
+                session.reset();  // Not supported, one connection per request
+                _keepAlive = false;
+                processRequest(comm, shard);
+                return;
+            }
+        }
+
+        size_t received = session->getResponses().getBytesReceived();
+
+        try {
+            session->send(request);                        // Send it
+            comm.decodeResponse(session->getResponses());  // Decode it
+            return;
+        } catch (std::exception const &e) {
+            bool answered =
+                session->getResponses().getBytesReceived() != received;
+            session.reset();  // The connection is not usable anymore
+
+            if (!reused || answered) {
+                throw;
+            }
+        }
+
+        request.clear();  // Send it again, from the start, on a new connection
+        request.seekg(0);
+    }
+}
+
 void Client::writeFile(std::string fName, std::stringstream &content) {
     assureDirectory();  // Assure that the directory exists
 
@@ -208,6 +498,33 @@ std::string Client::getPrompt() {
     return "[" + _user.getUsername() + "] > ";
 }
 
+std::string Client::getScriptPath() {
+    return _scriptPath;
+}
+
 std::string Client::getDownloadPath() {
     return _downloadPath;
+}
+
+std::string Client::getHostname(size_t shard) {
+    return _shards.at(shard).hostname;
+}
+
+std::string Client::getPort(size_t shard) {
+    return _shards.at(shard).port;
+}
+
+size_t Client::getShardCount() {
+    return _shards.size();
+}
+
+size_t Client::getAuctionShard(std::string aid) {
+    return (size_t)atoi(aid.c_str()) % _shards.size();
+}
+
+size_t Client::nextShard() {
+    size_t shard = _nextShard;
+
+    _nextShard = (_nextShard + 1) % _shards.size();
+    return shard;
 }
\ No newline at end of file
@@ -7,7 +7,10 @@
 
 #include <filesystem>
 #include <fstream>
+#include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include <signal.h>
 #include <sys/stat.h>
@@ -57,7 +60,25 @@ class User {
 };
 
 /**
- * @brief Represents a client that interacts with a server.
+ * @brief The address of a server owning a shard of the auctions.
+ */
+struct ShardAddress {
+    std::string hostname;  // The hostname of the server
+    std::string port;      // The port of the server
+};
+
+/**
+ * @brief A response to a conditional request, decoded again for as long as
+ * the server answers that it is unchanged.
+ */
+struct CachedResponse {
+    uint64_t generation;   // The generation of the response
+    std::string response;  // The encoded response
+};
+
+/**
+ * @brief Represents a client that interacts with a server, or with the
+ * servers the auctions are sharded across.
  */
 class Client {
   private:
@@ -66,6 +87,77 @@ class Client {
     std::string _downloadPath =
         "./auction_files/";  // The path to the directory where the downloaded
                              // files are stored
+    std::vector<ShardAddress> _shards;  // The servers, by shard index
+    size_t _nextShard = 0;  // The shard the next auction is opened in
+    bool _keepAlive = false;  // Whether the TCP requests share a connection
+    std::vector<std::unique_ptr<TcpClient>>
+        _sessions;  // The connection kept alive with each shard, if any
+    std::vector<std::unique_ptr<AsyncUdpClient>>
+        _udpClients;  // The UDP requests in flight to each shard
+    std::multimap<std::pair<size_t, std::string>, size_t>
+        _prefetched;  // The tags of the requests sent ahead, by shard and
+                      // request
+    std::vector<bool>
+        _conditional;  // Whether the server of each shard answers the
+                       // conditional requests
+    std::map<std::pair<size_t, std::string>, CachedResponse>
+        _responses;  // The responses of the conditional requests, by shard
+                     // and request
+    std::string _scriptPath;  // The script the commands are read from, if any
+
+    /**
+     * @brief Gets the client of the UDP requests to a shard, creating it
+     * first if needed.
+     * @param shard The shard index.
+     * @return The client.
+     */
+    AsyncUdpClient &getUdpClient(size_t shard);
+
+    /**
+     * @brief Sends a UDP request, unless the same one was already sent
+     * ahead, and receives its response.
+     * @param request The encoded request.
+     * @param shard The shard the request is sent to.
+     * @return The response.
+     */
+    std::stringstream exchangeUdp(std::stringstream &request, size_t shard);
+
+    /**
+     * @brief Makes a request conditional on the response cached for it, if
+     * the server of the shard answers conditional requests.
+     * @param comm The communication of the request.
+     * @param shard The shard the request is sent to.
+     * @return The request as encoded without a condition, the key of the
+     * response cached.
+     */
+    std::string setCondition(ConditionalCommunication &comm, size_t shard);
+
+    /**
+     * @brief Sends a request that may be conditional, decoding the response
+     * cached for it when the server answers that it is unchanged, and
+     * caching the new ones. A server that does not answer conditional
+     * requests is only sent plain ones from then on.
+     * @param comm The communication of the request.
+     * @param shard The shard the request is sent to.
+     */
+    void processConditional(ConditionalCommunication &comm, size_t shard);
+
+    /**
+     * @brief Sends a TCP request over the connection kept alive, opening it
+     * first if needed. A request that finds the connection closed by the
+     * server, having gone idle, is sent again over a new one.
+     * @param comm The communication protocol used for the request.
+     * @param request The encoded request.
+     * @param shard The shard the request is sent to.
+     */
+    void processKeptAlive(ProtocolCommunication &comm,
+                          std::stringstream &request, size_t shard);
+
+    /**
+     * @brief Parses the comma separated list of hostname:port of the shards.
+     * @param list The list.
+     */
+    void parseShards(std::string list);
 
   public:
     User _user;            // The user of the client
@@ -86,8 +178,53 @@ class Client {
     /**
      * @brief Processes a request received from the server.
      * @param comm The communication protocol used for the request.
+     * @param shard The shard the request is sent to, the only one unless the
+     * auctions are sharded.
+     */
+    void processRequest(ProtocolCommunication &comm, size_t shard = 0);
+
+    /**
+     * @brief Sends a UDP request ahead of time, without waiting for its
+     * response. The next processRequest() of the same request to the same
+     * shard takes that response instead of sending it again. TCP requests
+     * are ignored.
+     * @param comm The communication protocol used for the request.
+     * @param shard The shard the request is sent to.
+     */
+    void prefetchRequest(ProtocolCommunication &comm, size_t shard = 0);
+
+    /**
+     * @brief Abandons the requests sent ahead that were not processed, so
+     * that their responses, possibly out of date, are never used.
+     */
+    void dropPrefetched();
+
+    /**
+     * @brief  Gets the path of the script the commands are read from.
+     * @retval the path, "-" for the standard input, empty to read them from
+     * the terminal.
+     */
+    std::string getScriptPath();
+
+    /**
+     * @brief Gets the number of shards the auctions are spread across.
+     * @return The number of shards, 1 unless they are sharded.
+     */
+    size_t getShardCount();
+
+    /**
+     * @brief Gets the shard that owns an auction, the AID modulo the number
+     * of shards.
+     * @param aid The AID of the auction.
+     * @return The shard index.
+     */
+    size_t getAuctionShard(std::string aid);
+
+    /**
+     * @brief Gets the shard the next auction is opened in, each one in turn.
+     * @return The shard index.
      */
-    void processRequest(ProtocolCommunication &comm);
+    size_t nextShard();
 
     /**
      * @brief Writes content to a file with the given name.
@@ -128,6 +265,20 @@ class Client {
      * @retval string containing the folder name
      */
     std::string getDownloadPath();
+
+    /**
+     * @brief  Gets the hostname of the server of a shard.
+     * @param  shard The shard index.
+     * @retval the hostname
+     */
+    std::string getHostname(size_t shard = 0);
+
+    /**
+     * @brief  Gets the port of the server of a shard.
+     * @param  shard The shard index.
+     * @retval the port
+     */
+    std::string getPort(size_t shard = 0);
 };
 
 #endif
\ No newline at end of file
@@ -10,6 +10,20 @@
  * exception messages are thrown.
  */
 #include "command.hpp"
+#include "download.hpp"
+
+/**
+ * @brief  Merges the status of the response of a shard to a list request
+ * into the status of the list merged from every shard, which is OK as soon
+ * as one of them is, and otherwise the status of the first shard.
+ * @param  merged The status of the merged list, empty before the first shard.
+ * @param  status The status of the shard.
+ */
+static void MergeListStatus(std::string &merged, std::string status) {
+    if (merged.empty() || status == "OK") {
+        merged = status;
+    }
+}
 
 void CommandManager::registerCommand(std::shared_ptr<CommandHandler> handler) {
     // Insert the handler into the map
@@ -21,14 +35,14 @@ void CommandManager::registerCommand(std::shared_ptr<CommandHandler> handler) {
     }
 }
 
-void CommandManager::readCommand(std::string command, Client &receiver) {
+std::shared_ptr<CommandHandler> CommandManager::parseCommand(
+    std::string command, std::vector<std::string> &args) {
     if (command.length() == 0) {
-        // If the command is empty, return
-        return;
+        // If the command is empty, there is no handler
+        return NULL;
     }
 
     std::string name;
-    std::vector<std::string> args;
 
     auto position = command.find(" ");  // Find the first space in the command
 
@@ -64,8 +78,31 @@ void CommandManager::readCommand(std::string command, Client &receiver) {
         throw UnknownCommandException();
     }
 
-    handler->second->handle(
-        args, receiver);  // Call the handle function of the handler
+    return handler->second;
+}
+
+void CommandManager::readCommand(std::string command, Client &receiver) {
+    std::vector<std::string> args;
+    std::shared_ptr<CommandHandler> handler = parseCommand(command, args);
+
+    if (handler == NULL) {  // If the command is empty, return
+        return;
+    }
+
+    handler->handle(args,
+                    receiver);  // Call the handle function of the handler
+}
+
+bool CommandManager::prefetchCommand(std::string command, Client &receiver) {
+    std::vector<std::string> args;
+
+    try {
+        std::shared_ptr<CommandHandler> handler = parseCommand(command, args);
+
+        return handler == NULL || handler->prefetch(args, receiver);
+    } catch (CommandException const &e) {  // Left for readCommand to report
+        return false;
+    }
 }
 
 void LoginCommand::handle(std::vector<std::string> args, Client &receiver) {
@@ -98,6 +135,17 @@ void LoginCommand::handle(std::vector<std::string> args, Client &receiver) {
         loginCommunication);  // Send the request to the server, receiving its
                               // response
 
+    if (loginCommunication._status == "OK" ||
+        loginCommunication._status == "REG") {
+        // The user is registered separately by the server of every shard
+        for (size_t shard = 1; shard < receiver.getShardCount(); shard++) {
+            LoginCommunication shardCommunication;
+            shardCommunication._uid = UID;
+            shardCommunication._password = password;
+            receiver.processRequest(shardCommunication, shard);
+        }
+    }
+
     if (loginCommunication._status == "OK") {
         // If the response is OK, show a message and login the user
         Message::UserLoginSuccess();
@@ -135,6 +183,13 @@ void LogoutCommand::handle(std::vector<std::string> args, Client &receiver) {
         logoutCommunication);  // Send the request to the server, receiving its
                                // response
 
+    for (size_t shard = 1; shard < receiver.getShardCount(); shard++) {
+        LogoutCommunication shardCommunication;  // Logged in on every shard
+        shardCommunication._uid = logoutCommunication._uid;
+        shardCommunication._password = logoutCommunication._password;
+        receiver.processRequest(shardCommunication, shard);
+    }
+
     if (logoutCommunication._status == "OK") {
         // If the response is OK, show a message and logout the user
         Message::UserLogoutSucess();
@@ -171,6 +226,13 @@ void UnregisterCommand::handle(std::vector<std::string> args,
         unregisterCommunication);  // Send the request to the server, receiving
                                    // its response
 
+    for (size_t shard = 1; shard < receiver.getShardCount(); shard++) {
+        UnregisterCommunication shardCommunication;  // Registered on every one
+        shardCommunication._uid = unregisterCommunication._uid;
+        shardCommunication._password = unregisterCommunication._password;
+        receiver.processRequest(shardCommunication, shard);
+    }
+
     if (unregisterCommunication._status == "OK") {
         // If the response is OK, show a message and logout the user
         Message::UserUnregisterSucess();
@@ -249,7 +311,8 @@ void OpenCommand::handle(std::vector<std::string> args, Client &receiver) {
     }
 
     receiver.processRequest(
-        comm);  // Send the request to the server, receiving its response
+        comm, receiver.nextShard());  // Send the request to the server of the
+                                      // next shard, receiving its response
 
     if (comm._status == "OK") {
         // If the response is OK, show a message
@@ -291,7 +354,9 @@ void CloseCommand::handle(std::vector<std::string> args, Client &receiver) {
     comm._aid = AID;
 
     receiver.processRequest(
-        comm);  // Send the request to the server, receiving its response
+        comm, receiver.getAuctionShard(AID));  // Send the request to the
+                                               // server of the auction,
+                                               // receiving its response
 
     if (comm._status == "OK") {
         // If the response is OK, show a message
@@ -331,9 +396,23 @@ void ListUserAuctionsCommand::handle(std::vector<std::string> args,
     ListUserAuctionsCommunication listUserAuctionsCommunication;
     listUserAuctionsCommunication._uid = receiver._user.getUsername();
 
-    receiver.processRequest(
-        listUserAuctionsCommunication);  // Send the request to the server,
-                                         // receiving its response
+    prefetch({}, receiver);  // Query every shard at once
+
+    for (size_t shard = 0; shard < receiver.getShardCount(); shard++) {
+        ListUserAuctionsCommunication shardCommunication;
+        shardCommunication._uid = listUserAuctionsCommunication._uid;
+
+        receiver.processRequest(
+            shardCommunication, shard);  // Send the request to the server of
+                                         // the shard, receiving its response
+
+        // Merge the auctions of every shard, their AIDs never collide
+        MergeListStatus(listUserAuctionsCommunication._status,
+                        shardCommunication._status);
+        listUserAuctionsCommunication._auctions.insert(
+            shardCommunication._auctions.begin(),
+            shardCommunication._auctions.end());
+    }
 
     if (listUserAuctionsCommunication._status == "NOK") {
         // If the response is NOK, show a message
@@ -348,6 +427,22 @@ void ListUserAuctionsCommand::handle(std::vector<std::string> args,
     }
 }
 
+bool ListUserAuctionsCommand::prefetch(std::vector<std::string> args,
+                                       Client &receiver) {
+    if (args.size() != 0 || !receiver._user.isLoggedIn()) {
+        return false;
+    }
+
+    for (size_t shard = 0; shard < receiver.getShardCount(); shard++) {
+        ListUserAuctionsCommunication shardCommunication;
+        shardCommunication._uid = receiver._user.getUsername();
+
+        receiver.prefetchRequest(shardCommunication, shard);
+    }
+
+    return true;
+}
+
 void ListUserBidsCommand::handle(std::vector<std::string> args,
                                  Client &receiver) {
     if (args.size() != 0) {
@@ -365,9 +460,22 @@ void ListUserBidsCommand::handle(std::vector<std::string> args,
     ListUserBidsCommunication listUserBidsCommunication;
     listUserBidsCommunication._uid = receiver._user.getUsername();
 
-    receiver.processRequest(
-        listUserBidsCommunication);  // Send the request to the server,
-                                     // receiving its response
+    prefetch({}, receiver);  // Query every shard at once
+
+    for (size_t shard = 0; shard < receiver.getShardCount(); shard++) {
+        ListUserBidsCommunication shardCommunication;
+        shardCommunication._uid = listUserBidsCommunication._uid;
+
+        receiver.processRequest(
+            shardCommunication, shard);  // Send the request to the server of
+                                         // the shard, receiving its response
+
+        // Merge the bids of every shard, their AIDs never collide
+        MergeListStatus(listUserBidsCommunication._status,
+                        shardCommunication._status);
+        listUserBidsCommunication._bids.insert(
+            shardCommunication._bids.begin(), shardCommunication._bids.end());
+    }
 
     if (listUserBidsCommunication._status == "NOK") {
         // If the response is NOK, show a message
@@ -382,6 +490,22 @@ void ListUserBidsCommand::handle(std::vector<std::string> args,
     }
 }
 
+bool ListUserBidsCommand::prefetch(std::vector<std::string> args,
+                                   Client &receiver) {
+    if (args.size() != 0 || !receiver._user.isLoggedIn()) {
+        return false;
+    }
+
+    for (size_t shard = 0; shard < receiver.getShardCount(); shard++) {
+        ListUserBidsCommunication shardCommunication;
+        shardCommunication._uid = receiver._user.getUsername();
+
+        receiver.prefetchRequest(shardCommunication, shard);
+    }
+
+    return true;
+}
+
 void ListAllAuctionsCommand::handle(std::vector<std::string> args,
                                     Client &receiver) {
     if (args.size() != 0) {
@@ -392,8 +516,21 @@ void ListAllAuctionsCommand::handle(std::vector<std::string> args,
     // Create a ListAllAuctionsCommunication object
     ListAllAuctionsCommunication listAllAuctionsCommunication;
 
-    // Send the request to the server, receiving its response
-    receiver.processRequest(listAllAuctionsCommunication);
+    prefetch({}, receiver);  // Query every shard at once
+
+    for (size_t shard = 0; shard < receiver.getShardCount(); shard++) {
+        ListAllAuctionsCommunication shardCommunication;
+
+        // Send the request to the server of the shard, receiving its response
+        receiver.processRequest(shardCommunication, shard);
+
+        // Merge the auctions of every shard, their AIDs never collide
+        MergeListStatus(listAllAuctionsCommunication._status,
+                        shardCommunication._status);
+        listAllAuctionsCommunication._auctions.insert(
+            shardCommunication._auctions.begin(),
+            shardCommunication._auctions.end());
+    }
 
     if (listAllAuctionsCommunication._status == "NOK") {
         // If the response is NOK, show a message
@@ -404,6 +541,21 @@ void ListAllAuctionsCommand::handle(std::vector<std::string> args,
     }
 }
 
+bool ListAllAuctionsCommand::prefetch(std::vector<std::string> args,
+                                      Client &receiver) {
+    if (args.size() != 0) {
+        return false;
+    }
+
+    for (size_t shard = 0; shard < receiver.getShardCount(); shard++) {
+        ListAllAuctionsCommunication shardCommunication;
+
+        receiver.prefetchRequest(shardCommunication, shard);
+    }
+
+    return true;
+}
+
 void ShowAssetCommand::handle(std::vector<std::string> args, Client &receiver) {
     if (args.size() != 1) {
         // If the number of arguments is not 1, throw an exception
@@ -417,12 +569,32 @@ void ShowAssetCommand::handle(std::vector<std::string> args, Client &receiver) {
         throw CommandArgumentException(_usage);
     }
 
+    receiver.assureDirectory();  // The ranges are written straight to it
+
+    size_t shard = receiver.getAuctionShard(AID);  // The server of the auction
+
+    AssetDownload download(receiver.getHostname(shard), receiver.getPort(shard),
+                           AID, receiver.getDownloadPath());
+    try {
+        if (download.run()) {
+            // If the asset is complete, show a message
+            Message::DownloadAsset(download.getPath(), download.getFileSize());
+        } else {
+            // If there is no such asset, show a message
+            Message::ErrorDownloadAsset();
+        }
+        return;
+    } catch (ProtocolMessageErrorException const &e) {
+        // The server does not send ranges, the asset is sent whole instead
+    }
+
     // Create a ShowAssetCommunication object and set the AID
     ShowAssetCommunication comm;
     comm._aid = AID;
 
     receiver.processRequest(
-        comm);  // Send the request to the server, receiving its response
+        comm, shard);  // Send the request to the server of the auction,
+                       // receiving its response
 
     if (comm._status == "OK") {
         // If the response is OK, show a message and download the asset
@@ -471,7 +643,9 @@ void BidCommand::handle(std::vector<std::string> args, Client &receiver) {
     comm._value = atoi(value.c_str());
 
     receiver.processRequest(
-        comm);  // Send the request to the server, receiving its response
+        comm, receiver.getAuctionShard(AID));  // Send the request to the
+                                               // server of the auction,
+                                               // receiving its response
 
     if (comm._status == "NLG") {
         // If the response is NLG, show a message
@@ -512,8 +686,9 @@ void ShowRecordCommand::handle(std::vector<std::string> args,
     showRecordCommunication._aid = AID;
 
     receiver.processRequest(
-        showRecordCommunication);  // Send the request to the server, receiving
-                                   // its response
+        showRecordCommunication,
+        receiver.getAuctionShard(AID));  // Send the request to the server of
+                                         // the auction, receiving its response
 
     if (showRecordCommunication._status == "NOK") {
         // If the response is NOK, show a message
@@ -538,3 +713,18 @@ void ShowRecordCommand::handle(std::vector<std::string> args,
         }
     }
 }
+
+bool ShowRecordCommand::prefetch(std::vector<std::string> args,
+                                 Client &receiver) {
+    if (args.size() != 1 || args[0].length() != 3 || !isNumeric(args[0])) {
+        return false;
+    }
+
+    ShowRecordCommunication showRecordCommunication;
+    showRecordCommunication._aid = args[0];
+
+    receiver.prefetchRequest(showRecordCommunication,
+                             receiver.getAuctionShard(args[0]));
+
+    return true;
+}
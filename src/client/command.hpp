@@ -35,6 +35,25 @@ class CommandHandler {
      */
     virtual void handle(std::vector<std::string> args, Client &receiver) = 0;
 
+    /**
+     * @brief Sends the requests of the command ahead, if it is a query that
+     * only reads the state of the server, so that handle() finds them in
+     * flight.
+     *
+     * Commands that change the state of the server or of the client are not
+     * queries, which is what this default says.
+     *
+     * @param args The arguments passed to the command.
+     * @param receiver The client object that receives the command.
+     * @return true if the command is a query with valid arguments, false
+     * otherwise.
+     */
+    virtual bool prefetch(std::vector<std::string> args, Client &receiver) {
+        (void)args;
+        (void)receiver;
+        return false;
+    }
+
     std::string _name;                // The name of the command
     std::string _description;         // The description of the command
     std::string _usage;               // The usage information of the command
@@ -66,6 +85,16 @@ class CommandManager {
     std::unordered_map<std::string, std::shared_ptr<CommandHandler>> handlers =
         {};  // The registered command handlers
 
+    /**
+     * @brief Splits a command in its name and arguments, and finds its
+     * handler. Throws UnknownCommandException if there is none.
+     * @param command The command.
+     * @param args Where the arguments are stored.
+     * @return The handler, NULL if the command is empty.
+     */
+    std::shared_ptr<CommandHandler> parseCommand(
+        std::string command, std::vector<std::string> &args);
+
   public:
     /**
      * @brief Registers a command handler.
@@ -78,6 +107,14 @@ class CommandManager {
      * @param state The client state.
      */
     void readCommand(std::string command, Client &state);
+
+    /**
+     * @brief Sends the requests of a command ahead, if it is a query.
+     * @param command The command.
+     * @param state The client state.
+     * @return true if the command is a query or empty, false otherwise.
+     */
+    bool prefetchCommand(std::string command, Client &state);
 };
 
 /**
@@ -226,6 +263,15 @@ class ListUserAuctionsCommand : public CommandHandler {
      */
     void handle(std::vector<std::string> args, Client &receiver);
 
+    /**
+     * @brief Sends the requests of the command ahead.
+     *
+     * @param args The command arguments.
+     * @param receiver The client object.
+     * @return true if the arguments are valid, false otherwise.
+     */
+    bool prefetch(std::vector<std::string> args, Client &receiver);
+
     /**
      * @brief Constructs a ListUserAuctionsCommand object.
      */
@@ -249,6 +295,15 @@ class ListUserBidsCommand : public CommandHandler {
      */
     void handle(std::vector<std::string> args, Client &receiver);
 
+    /**
+     * @brief Sends the requests of the command ahead.
+     *
+     * @param args The command arguments.
+     * @param receiver The client object.
+     * @return true if the arguments are valid, false otherwise.
+     */
+    bool prefetch(std::vector<std::string> args, Client &receiver);
+
     /**
      * @brief Constructs a new ListUserBidsCommand object.
      */
@@ -271,6 +326,15 @@ class ListAllAuctionsCommand : public CommandHandler {
      */
     void handle(std::vector<std::string> args, Client &receiver);
 
+    /**
+     * @brief Sends the requests of the command ahead.
+     *
+     * @param args The command arguments.
+     * @param receiver The client object.
+     * @return true if the arguments are valid, false otherwise.
+     */
+    bool prefetch(std::vector<std::string> args, Client &receiver);
+
     /**
      * @brief Constructs a new ListAllAuctionsCommand object.
      */
@@ -339,6 +403,15 @@ class ShowRecordCommand : public CommandHandler {
      */
     void handle(std::vector<std::string> args, Client &receiver);
 
+    /**
+     * @brief Sends the requests of the command ahead.
+     *
+     * @param args The command arguments.
+     * @param receiver The client object.
+     * @return true if the arguments are valid, false otherwise.
+     */
+    bool prefetch(std::vector<std::string> args, Client &receiver);
+
     /**
      * @brief Constructs a ShowRecordCommand object.
      */
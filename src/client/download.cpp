@@ -0,0 +1,201 @@
+/**
+ * @file download.cpp
+ * @brief Implementation of the AssetDownload class.
+ */
+#include "download.hpp"
+
+#include <fstream>
+
+AssetDownload::AssetDownload(std::string hostname, std::string port,
+                             std::string aid, std::string directory)
+    : _hostname(hostname), _port(port), _aid(aid), _directory(directory) {}
+
+AssetDownload::~AssetDownload() {
+    if (_fd != -1) {
+        close(_fd);
+    }
+    if (_progressFd != -1) {
+        close(_progressFd);
+    }
+}
+
+std::unique_ptr<TcpClient> AssetDownload::connect() {
+    auto session = std::make_unique<TcpClient>(_hostname, _port);
+    session->keepAlive();  // Every range fetched goes over the same one
+
+    return session;
+}
+
+bool AssetDownload::run() {
+    // An empty range gets the name and size of the asset file
+    std::unique_ptr<TcpClient> session = connect();
+    ShowAssetRangeCommunication probe;
+    probe._aid = _aid;
+    probe._offset = 0;
+    probe._length = 0;
+
+    std::stringstream request = probe.encodeRequest();
+    session->send(request);
+    probe.decodeResponse(session->getResponses());
+
+    if (probe._status != "OK") {
+        return false;
+    }
+
+    _fileName = probe._fileName;
+    _fileSize = probe._fileSize;
+    _chunks = ((size_t)_fileSize + CLIENT_DOWNLOAD_CHUNK_SIZE - 1) /
+              CLIENT_DOWNLOAD_CHUNK_SIZE;
+
+    open();
+
+    size_t connections =
+        std::min(_pending.size(), (size_t)CLIENT_DOWNLOAD_CONNECTIONS);
+    std::vector<std::thread> threads;
+
+    for (size_t i = 0; i < connections; i++) {
+        // The first thread keeps the connection of the probe
+        threads.emplace_back(&AssetDownload::fetch, this,
+                             (i == 0) ? std::move(session) : nullptr);
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    if (_written != _chunks) {
+        throw DownloadInterruptedException();  // The files are kept
+    }
+
+    std::string path = getPath();
+
+    close(_fd);
+    close(_progressFd);
+    _fd = -1;
+    _progressFd = -1;
+
+    std::error_code error;
+    fs::rename(path + CLIENT_DOWNLOAD_PART_SUFFIX, path, error);
+    fs::remove(path + CLIENT_DOWNLOAD_PROGRESS_SUFFIX, error);
+
+    if (error) {
+        throw std::runtime_error("Couldn't write file");
+    }
+
+    return true;
+}
+
+void AssetDownload::open() {
+    std::string path = getPath();
+    std::string partPath = path + CLIENT_DOWNLOAD_PART_SUFFIX;
+    std::string progressPath = path + CLIENT_DOWNLOAD_PROGRESS_SUFFIX;
+    std::string header = _aid + " " + std::to_string(_fileSize) + " " +
+                         std::to_string(CLIENT_DOWNLOAD_CHUNK_SIZE);
+    std::vector<bool> done(_chunks, false);
+
+    // A partial file is resumed if its progress is of the same asset
+    std::ifstream progress(progressPath);
+    std::string line;
+    bool resumed = fs::exists(partPath) && std::getline(progress, line) &&
+                   line == header;
+    bool cut = false;  // Whether the last line has no delimiter
+
+    while (resumed && std::getline(progress, line)) {
+        cut = progress.eof();
+        if (cut || line.length() > 9 || !isNumeric(line)) {
+            continue;  // Cut short when the previous download stopped
+        }
+
+        size_t chunk = std::stoul(line);
+        if (chunk < _chunks && !done[chunk]) {
+            done[chunk] = true;
+            _written++;
+        }
+    }
+    progress.close();
+
+    int flags = O_RDWR | O_CREAT | O_CLOEXEC | (resumed ? 0 : O_TRUNC);
+    _fd = ::open(partPath.c_str(), flags, 0644);
+    _progressFd = ::open(progressPath.c_str(), flags | O_APPEND, 0644);
+
+    if (_fd == -1 || _progressFd == -1 ||
+        ftruncate(_fd, (off_t)_fileSize) == -1) {
+        throw std::runtime_error("Couldn't write file");
+    }
+
+    if (!resumed) {
+        header.push_back('\n');
+        if (write(_progressFd, header.data(), header.size()) !=
+            (ssize_t)header.size()) {
+            throw std::runtime_error("Couldn't write file");
+        }
+    } else if (cut) {
+        // Ends the line cut short, so that the next range starts its own
+        if (write(_progressFd, "\n", 1) != 1) {
+            throw std::runtime_error("Couldn't write file");
+        }
+    }
+
+    for (size_t chunk = 0; chunk < _chunks; chunk++) {
+        if (!done[chunk]) {
+            _pending.push_back(chunk);
+        }
+    }
+}
+
+void AssetDownload::fetch(std::unique_ptr<TcpClient> session) {
+    while (1) {
+        size_t chunk;
+
+        {
+            std::lock_guard<std::mutex> guard(_mutex);
+            if (_pending.empty()) {
+                return;
+            }
+            chunk = _pending.front();
+            _pending.pop_front();
+        }
+
+        size_t offset = chunk * CLIENT_DOWNLOAD_CHUNK_SIZE;
+        int length = (int)std::min((size_t)CLIENT_DOWNLOAD_CHUNK_SIZE,
+                                   (size_t)_fileSize - offset);
+
+        try {
+            if (session == nullptr) {
+                session = connect();
+            }
+
+            ShowAssetRangeCommunication comm;
+            comm._aid = _aid;
+            comm._offset = (int)offset;
+            comm._length = length;
+
+            std::stringstream request = comm.encodeRequest();
+            session->send(request);
+            comm.decodeResponse(session->getResponses(), _fd);
+
+            if (comm._status != "OK" || comm._fileSize != _fileSize ||
+                comm._length != length) {
+                throw std::runtime_error("The asset changed");
+            }
+
+            complete(chunk);
+        } catch (std::exception const &e) {
+            // Left to the other connections, or to the next download
+            std::lock_guard<std::mutex> guard(_mutex);
+            _pending.push_back(chunk);
+            return;
+        }
+    }
+}
+
+void AssetDownload::complete(size_t chunk) {
+    std::string line = std::to_string(chunk) + "\n";
+    std::lock_guard<std::mutex> guard(_mutex);
+
+    if (write(_progressFd, line.data(), line.size()) != (ssize_t)line.size()) {
+        throw std::runtime_error("Couldn't write file");
+    }
+
+    _written++;
+}
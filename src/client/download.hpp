@@ -0,0 +1,132 @@
+/**
+ * @file download.hpp
+ * @brief Header file of the AssetDownload class.
+ *
+ * This file contains the declaration of the class that downloads the asset of
+ * an auction in byte ranges, fetched in parallel over several connections.
+ */
+#ifndef __DOWNLOAD_HPP__
+#define __DOWNLOAD_HPP__
+
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "network.hpp"
+#include "protocol.hpp"
+
+namespace fs = std::filesystem;
+
+/**
+ * @class DownloadInterruptedException
+ * @brief Represents an exception that is thrown when a download stopped
+ * before every range of the asset was written.
+ */
+class DownloadInterruptedException : public std::runtime_error {
+  public:
+    /**
+     * @brief Constructs a DownloadInterruptedException object.
+     */
+    DownloadInterruptedException()
+        : std::runtime_error(
+              "The download was interrupted, show_asset resumes it."){};
+};
+
+/**
+ * @class AssetDownload
+ * @brief Downloads the asset of an auction in ranges of
+ * CLIENT_DOWNLOAD_CHUNK_SIZE bytes, fetched over up to
+ * CLIENT_DOWNLOAD_CONNECTIONS kept alive connections at once.
+ *
+ * Every range is written with pwrite() at its offset in a partial file, and
+ * recorded in a progress file once written. The partial file is renamed to
+ * the asset file once complete, so an interrupted download leaves both files
+ * behind, and the next download of the same asset only fetches the ranges
+ * missing.
+ */
+class AssetDownload {
+  private:
+    std::string _hostname;        // The hostname of the server
+    std::string _port;            // The port of the server
+    std::string _aid;             // The auction whose asset is downloaded
+    std::string _directory;       // The directory the asset is written to
+    std::string _fileName;        // The name of the asset file
+    int _fileSize = 0;            // The size of the asset file
+    size_t _chunks = 0;           // The number of ranges of the asset file
+    int _fd = -1;                 // The partial file
+    int _progressFd = -1;         // The progress file, one line per range
+    std::mutex _mutex;            // Guards the ranges and the progress file
+    std::deque<size_t> _pending;  // The ranges not written yet
+    size_t _written = 0;          // The ranges written so far
+
+    /**
+     * @brief Opens a kept alive connection to the server.
+     * @return The connection.
+     */
+    std::unique_ptr<TcpClient> connect();
+
+    /**
+     * @brief Opens the partial and progress files, resuming them if they
+     * belong to the same asset, and queues the ranges missing.
+     */
+    void open();
+
+    /**
+     * @brief Fetches ranges until none is left, or the connection fails. A
+     * range that fails is queued again for the other connections.
+     * @param session The connection, opened again if it fails.
+     */
+    void fetch(std::unique_ptr<TcpClient> session);
+
+    /**
+     * @brief Records a range as written in the progress file.
+     * @param chunk The index of the range.
+     */
+    void complete(size_t chunk);
+
+  public:
+    /**
+     * @brief Constructs an AssetDownload object.
+     * @param hostname The hostname of the server.
+     * @param port The port of the server.
+     * @param aid The auction whose asset is downloaded.
+     * @param directory The directory the asset is written to, which exists.
+     */
+    AssetDownload(std::string hostname, std::string port, std::string aid,
+                  std::string directory);
+
+    /**
+     * @brief Closes the partial and progress files.
+     */
+    ~AssetDownload();
+
+    /**
+     * @brief Downloads the asset. Throws ProtocolMessageErrorException if the
+     * server does not support ranges, and DownloadInterruptedException if the
+     * connections failed before every range was written.
+     * @return false if the auction or its asset do not exist, true once the
+     * asset file is complete.
+     */
+    bool run();
+
+    /**
+     * @brief Gets the path of the asset file.
+     * @return The path.
+     */
+    std::string getPath() { return _directory + _fileName; }
+
+    /**
+     * @brief Gets the size of the asset file.
+     * @return The size in bytes.
+     */
+    int getFileSize() { return _fileSize; }
+};
+
+#endif
@@ -1,11 +1,13 @@
 /**
  * @file network.cpp
- * @brief Implementation of the UdpClient and TcpClient classes for network
- * communication.
+ * @brief Implementation of the UdpClient, AsyncUdpClient and TcpClient classes
+ * for network communication.
  */
 
 #include "network.hpp"
 
+#include <algorithm>
+
 UdpClient::UdpClient(std::string hostname, std::string port) {
     _fd = socket(AF_INET, SOCK_DGRAM, 0);  // Create a UDP socket
 
@@ -85,6 +87,239 @@ std::stringstream UdpClient::receive() {
     return message;
 }
 
+AsyncUdpClient::AsyncUdpClient(std::string hostname, std::string port) {
+    // Set the flags of the sockets
+    memset(&_hints, 0, sizeof(_hints));
+    _hints.ai_family = AF_INET;
+    _hints.ai_socktype = SOCK_DGRAM;
+
+    if (getaddrinfo(hostname.c_str(), port.c_str(), &_hints, &_res) != 0) {
+        throw SocketException();
+    }
+}
+
+AsyncUdpClient::~AsyncUdpClient() {
+    for (auto &pending : _pending) {
+        if (pending.second.state == RequestState::InFlight) {
+            close(pending.second.fd);
+        }
+    }
+    for (int fd : _idle) {
+        close(fd);
+    }
+    freeaddrinfo(_res);  // Free the address info
+}
+
+int AsyncUdpClient::acquireSocket() {
+    if (!_idle.empty()) {
+        int fd = _idle.back();
+        _idle.pop_back();
+        return fd;
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);  // Create a UDP socket
+
+    if (fd == -1) {
+        throw SocketException();
+    }
+
+    // Only the datagrams of the server are received from then on
+    if (connect(fd, _res->ai_addr, _res->ai_addrlen) == -1) {
+        close(fd);
+        throw SocketException();
+    }
+
+    return fd;
+}
+
+void AsyncUdpClient::releaseSocket(PendingRequest &request) {
+    if (request.retransmitted || request.state != RequestState::Answered) {
+        close(request.fd);  // Another response may still arrive
+    } else {
+        _idle.push_back(request.fd);
+    }
+    _inFlight--;
+}
+
+void AsyncUdpClient::transmit(PendingRequest &request) {
+    request.lastSent = Clock::now();
+
+    // A failed send is handled like a lost datagram, and sent again
+    ::send(request.fd, request.request.data(), request.request.size(), 0);
+}
+
+void AsyncUdpClient::measure(Clock::duration rtt) {
+    double sample =
+        std::chrono::duration<double, std::milli>(rtt).count();  // In ms
+
+    if (!_timed) {  // The first measurement, as in RFC 6298
+        _smoothedRtt = sample;
+        _rttVariation = sample / 2;
+        _timed = true;
+        return;
+    }
+
+    _rttVariation =
+        0.75 * _rttVariation + 0.25 * std::abs(_smoothedRtt - sample);
+    _smoothedRtt = 0.875 * _smoothedRtt + 0.125 * sample;
+}
+
+AsyncUdpClient::Clock::duration AsyncUdpClient::getInitialTimeout() {
+    double timeout = CLIENT_UDP_INITIAL_RTO;
+
+    if (_timed) {
+        timeout = std::clamp(_smoothedRtt + 4 * _rttVariation,
+                             (double)CLIENT_UDP_MIN_RTO,
+                             (double)CLIENT_UDP_MAX_RTO);
+    }
+
+    return std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double, std::milli>(timeout));
+}
+
+void AsyncUdpClient::progress() {
+    std::vector<struct pollfd> fds;
+    std::vector<PendingRequest *> requests;
+    Clock::time_point now = Clock::now(), next = Clock::time_point::max();
+
+    for (auto &pending : _pending) {
+        PendingRequest &request = pending.second;
+
+        if (request.state != RequestState::InFlight) {
+            continue;
+        }
+
+        fds.push_back({request.fd, POLLIN, 0});
+        requests.push_back(&request);
+        next = std::min(next, request.lastSent + request.timeout);
+    }
+
+    if (fds.empty()) {
+        return;
+    }
+
+    // Rounded up, so that the earliest timeout has expired on waking up
+    auto wait = std::chrono::ceil<std::chrono::milliseconds>(
+        std::max(next - now, Clock::duration::zero()));
+
+    if (poll(fds.data(), fds.size(), (int)wait.count()) == -1 &&
+        errno != EINTR) {
+        throw SocketException();
+    }
+
+    now = Clock::now();
+
+    for (size_t i = 0; i < fds.size(); i++) {
+        PendingRequest &request = *requests[i];
+
+        if (fds[i].revents != 0) {  // The response, or an error
+            char buffer[SOCKETS_MAX_DATAGRAM_SIZE_CLIENT +
+                        1];  // size+1 to check if the server sent a message
+                             // bigger than it is supposed
+            ssize_t n = recv(request.fd, buffer, sizeof(buffer), 0);
+
+            if (n == -1 && (errno == EAGAIN || errno == EINTR)) {
+                continue;
+            }
+
+            if (n >= 0 && n <= SOCKETS_MAX_DATAGRAM_SIZE_CLIENT) {
+                request.response.assign(buffer, (size_t)n);
+                request.state = RequestState::Answered;
+
+                if (!request.retransmitted) {  // Unambiguous round trip
+                    measure(now - request.lastSent);
+                }
+            } else {
+                request.state = RequestState::Failed;
+            }
+            releaseSocket(request);
+            continue;
+        }
+
+        if (now < request.lastSent + request.timeout) {
+            continue;
+        }
+
+        if (now - request.firstSent >=
+            std::chrono::seconds(SOCKETS_UDP_TIMEOUT)) {  // Give up
+            request.state = RequestState::TimedOut;
+            releaseSocket(request);
+            continue;
+        }
+
+        // Lost, back off and send it again
+        request.timeout =
+            std::min(request.timeout * 2,
+                     std::chrono::duration_cast<Clock::duration>(
+                         std::chrono::milliseconds(CLIENT_UDP_MAX_RTO)));
+        request.retransmitted = true;
+        transmit(request);
+    }
+}
+
+size_t AsyncUdpClient::submit(std::stringstream &message) {
+    std::string request = message.str();
+
+    if (request.empty() || request.size() > SOCKETS_MAX_DATAGRAM_SIZE_SERVER) {
+        throw SocketException();
+    }
+
+    while (_inFlight >= CLIENT_UDP_MAX_PENDING) {  // Make room for it first
+        progress();
+    }
+
+    PendingRequest &pending = _pending[_nextTag];
+    pending.fd = acquireSocket();
+    pending.request = request;
+    pending.state = RequestState::InFlight;
+    pending.retransmitted = false;
+    pending.firstSent = Clock::now();
+    pending.timeout = getInitialTimeout();
+    _inFlight++;
+
+    transmit(pending);
+
+    return _nextTag++;
+}
+
+std::stringstream AsyncUdpClient::complete(size_t tag) {
+    auto pending = _pending.find(tag);
+
+    if (pending == _pending.end()) {
+        throw SocketException();
+    }
+
+    while (pending->second.state == RequestState::InFlight) {
+        progress();
+    }
+
+    PendingRequest request = std::move(pending->second);
+    _pending.erase(pending);
+
+    if (request.state == RequestState::TimedOut) {
+        throw TimeoutException();
+    }
+    if (request.state == RequestState::Failed) {
+        throw SocketException();
+    }
+
+    return std::stringstream(request.response);
+}
+
+void AsyncUdpClient::cancel(size_t tag) {
+    auto pending = _pending.find(tag);
+
+    if (pending == _pending.end()) {
+        return;
+    }
+
+    if (pending->second.state == RequestState::InFlight) {
+        pending->second.state = RequestState::Failed;  // Not reused
+        releaseSocket(pending->second);
+    }
+    _pending.erase(pending);
+}
+
 TcpClient::TcpClient(std::string hostname, std::string port) {
     _fd = socket(AF_INET, SOCK_STREAM, 0);  // Create a TCP socket
     if (_fd == -1) {
@@ -155,4 +390,16 @@ std::stringstream TcpClient::receive() {
     }
 
     return message;
-}
\ No newline at end of file
+}
+void TcpClient::keepAlive() {
+    KeepAliveCommunication keepAliveCommunication;
+    std::stringstream request = keepAliveCommunication.encodeRequest();
+    int enabled = 1;
+
+    // Pipelined requests go out as soon as they are written
+    setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+
+    _responses = std::make_unique<TcpMessage>(_fd);
+    send(request);
+    keepAliveCommunication.decodeResponse(*_responses);  // Throws if refused
+}
@@ -1,18 +1,24 @@
 /**
  * @file network.hpp
- * @brief This file contains the declaration of the UdpClient, TcpClient,
- * SocketException, and TimeoutException classes.
+ * @brief This file contains the declaration of the UdpClient,
+ * AsyncUdpClient, TcpClient, SocketException, and TimeoutException classes.
  */
 
 #ifndef __NETWORK_HPP__
 #define __NETWORK_HPP__
 
+#include <chrono>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -20,6 +26,7 @@
 #include <cstring>
 
 #include "config.hpp"
+#include "protocol.hpp"
 
 /**
  * @class UdpClient
@@ -60,6 +67,147 @@ class UdpClient {
     std::stringstream receive();
 };
 
+/**
+ * @class AsyncUdpClient
+ * @brief Sends UDP requests to a server without waiting for each response
+ * before the next, retransmitting the ones whose response is lost.
+ *
+ * Every request in flight is kept in a table of pending requests, under the
+ * tag submit() returns. The protocol has no field to tag a request with, so
+ * each request in flight has a socket of its own, connected to the server,
+ * and its response is the datagram that socket receives.
+ *
+ * A request is sent again when its retransmission timeout expires, with the
+ * timeout doubled each time, until SOCKETS_UDP_TIMEOUT seconds passed since
+ * it was first sent. The timeout starts from the round trip time of the
+ * previous responses, smoothed like TCP does, timing only the requests that
+ * were sent once.
+ */
+class AsyncUdpClient {
+  private:
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+     * @brief The states of a pending request.
+     */
+    enum class RequestState {
+        InFlight, /**< Waiting for the response. */
+        Answered, /**< The response was received. */
+        TimedOut, /**< No response in SOCKETS_UDP_TIMEOUT seconds. */
+        Failed,   /**< The socket failed, or the response was too big. */
+    };
+
+    /**
+     * @brief A request in the table of pending requests.
+     */
+    struct PendingRequest {
+        int fd;                       // The socket of the request
+        std::string request;          // The request, kept to send it again
+        std::string response;         // The response, once answered
+        RequestState state;           // The state of the request
+        bool retransmitted;           // Whether it was sent more than once
+        Clock::time_point firstSent;  // When it was first sent
+        Clock::time_point lastSent;   // When it was last sent
+        Clock::duration timeout;      // The current retransmission timeout
+    };
+
+    struct addrinfo _hints;  // The address flags
+    struct addrinfo *_res;   // The address info
+    std::unordered_map<size_t, PendingRequest>
+        _pending;               // The pending requests, by tag
+    size_t _nextTag = 0;        // The tag of the next request
+    size_t _inFlight = 0;       // The number of requests in flight
+    std::vector<int> _idle;     // The sockets free to be reused
+    bool _timed = false;        // Whether a round trip was timed yet
+    double _smoothedRtt = 0;    // The smoothed round trip time, in ms
+    double _rttVariation = 0;   // The variation of the round trip time, in ms
+
+    /**
+     * @brief Gets a socket connected to the server, reusing an idle one if
+     * there is any.
+     * @return The file descriptor of the socket.
+     */
+    int acquireSocket();
+
+    /**
+     * @brief Frees the socket of a request that is no longer in flight.
+     *
+     * A socket whose request was sent more than once may still receive the
+     * response to another copy, so it is closed instead of reused.
+     *
+     * @param request The request.
+     */
+    void releaseSocket(PendingRequest &request);
+
+    /**
+     * @brief Sends a request, or sends it again.
+     * @param request The request.
+     */
+    void transmit(PendingRequest &request);
+
+    /**
+     * @brief Updates the round trip time estimates with a new measurement.
+     * @param rtt The round trip time of a request sent once.
+     */
+    void measure(Clock::duration rtt);
+
+    /**
+     * @brief Gets the retransmission timeout of a new request.
+     * @return The timeout.
+     */
+    Clock::duration getInitialTimeout();
+
+    /**
+     * @brief Waits until a request in flight is answered, or needs to be sent
+     * again, and handles it.
+     */
+    void progress();
+
+  public:
+    /**
+     * @brief Constructs an AsyncUdpClient object with the specified hostname
+     * and port, with no request in flight.
+     * @param hostname The hostname or IP address of the server.
+     * @param port The port number to connect to.
+     */
+    AsyncUdpClient(std::string hostname, std::string port);
+
+    /**
+     * @brief Destroys the AsyncUdpClient object, abandoning the requests in
+     * flight, and closes the sockets.
+     */
+    ~AsyncUdpClient();
+
+    /**
+     * @brief Sends a request, without waiting for its response.
+     *
+     * If CLIENT_UDP_MAX_PENDING requests are already in flight, waits until
+     * one of them is answered or gives up first.
+     *
+     * @param message The request.
+     * @return The tag of the request.
+     */
+    size_t submit(std::stringstream &message);
+
+    /**
+     * @brief Waits for the response of a request, and removes the request
+     * from the table. The other requests in flight make progress meanwhile.
+     *
+     * Throws TimeoutException if the server did not answer, and
+     * SocketException if the request failed otherwise.
+     *
+     * @param tag The tag of the request.
+     * @return The response as a stringstream.
+     */
+    std::stringstream complete(size_t tag);
+
+    /**
+     * @brief Abandons a request, whose response is no longer wanted.
+     * @param tag The tag of the request.
+     */
+    void cancel(size_t tag);
+};
+
 /**
  * @class TcpClient
  * @brief Represents a TCP client that can send and receive data over the
@@ -70,6 +218,7 @@ class TcpClient {
     int _fd;                 // The file descriptor of the socket
     struct addrinfo _hints;  // The address flags
     struct addrinfo *_res;   // The address info
+    std::unique_ptr<TcpMessage> _responses;  // Read from once kept alive
 
   public:
     /**
@@ -96,6 +245,23 @@ class TcpClient {
      * @return The received message as a stringstream.
      */
     std::stringstream receive();
+
+    /**
+     * @brief Asks the server to keep the connection open for more requests.
+     *
+     * The responses are then read one at a time from getResponses(), instead
+     * of with receive(), and may be waited for after sending several
+     * requests. Throws ProtocolMessageErrorException if the server does not
+     * support keep-alive.
+     */
+    void keepAlive();
+
+    /**
+     * @brief Gets the source the responses of a kept alive connection are
+     * decoded from, in the order the requests were sent.
+     * @return The message source.
+     */
+    TcpMessage &getResponses() { return *_responses; }
 };
 
 /**
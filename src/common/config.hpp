@@ -20,18 +20,160 @@
     "ERR"  // The identifier used to indicate an error in the protocol.
 #define PROTOCOL_MAX_FILE_SIZE \
     10000000  // The maximum size of a file in the protocol.
+#define PROTOCOL_MAX_RECORD_BIDS \
+    (50)  // The maximum number of bids in the record of an auction.
+#define PROTOCOL_FILE_CHUNK_SIZE \
+    (65536)  // The size of the chunks in which file data is decoded.
+#define PROTOCOL_MESSAGE_BUFFER_SIZE \
+    (4096)  // The size of the read ahead buffer of the message sources.
+#define PROTOCOL_KEEPALIVE_REQUEST \
+    "KAL\n"  // The request that keeps a TCP connection open for more.
+#define PROTOCOL_GENERATION_SIZE \
+    (19)  // The maximum number of digits of a generation in the protocol.
+#define PROTOCOL_UNCHANGED_STATUS \
+    "UNC"  // The status of a response to a condition that still holds.
 
 #define DEFAULT_HOSTNAME \
     "127.0.0.1"               // The default hostname for network connections.
 #define DEFAULT_PORT "58085"  // The default port for network connections.
+#define CLIENT_DOWNLOAD_CHUNK_SIZE \
+    (1048576)  // The size of the ranges an asset is downloaded in.
+#define CLIENT_DOWNLOAD_CONNECTIONS \
+    (4)  // The maximum number of connections an asset is downloaded over.
+#define CLIENT_DOWNLOAD_PART_SUFFIX \
+    ".part"  // Appended to the name of an asset file until it is complete.
+#define CLIENT_DOWNLOAD_PROGRESS_SUFFIX \
+    ".progress"  // Appended to the name of the ranges written of a download.
+#define CLIENT_UDP_MAX_PENDING \
+    (64)  // The maximum number of UDP requests in flight at once.
+#define CLIENT_UDP_INITIAL_RTO \
+    (250)  // The retransmission timeout in ms before any round trip is timed.
+#define CLIENT_UDP_MIN_RTO \
+    (20)  // The minimum retransmission timeout in ms.
+#define CLIENT_UDP_MAX_RTO \
+    (2000)  // The maximum retransmission timeout in ms, after backing off.
+#define CLIENT_SCRIPT_WINDOW \
+    (32)  // The maximum number of queries of a script sent ahead.
+#define CLIENT_RESPONSE_CACHE_ENTRIES \
+    (1024)  // The maximum number of list and record responses cached.
 
 #define SOCKETS_MAX_DATAGRAM_SIZE_CLIENT \
     (6001)  // The maximum size of a datagram for a client socket.
 #define SOCKETS_MAX_DATAGRAM_SIZE_SERVER \
-    (20)  // The maximum size of a datagram for a server socket.
+    (32)  // The maximum size of a datagram for a server socket.
 #define SOCKETS_TCP_BUFFER_SIZE \
     (512)  // The size of the TCP buffer for socket communication.
+#define SOCKETS_TCP_BACKLOG \
+    (20)  // The listen backlog of the TCP socket in the fork server mode.
+#define SOCKETS_TCP_TIMEOUT \
+    (5)  // The idle timeout value for TCP socket communication.
+#define SOCKETS_TCP_READ_CHUNK_SIZE \
+    (65536)  // The size of each read done by the event-driven server.
 #define SOCKETS_UDP_TIMEOUT \
     (5)  // The timeout value for UDP socket communication.
+#define SOCKETS_UDP_BATCH_SIZE \
+    (32)  // The maximum number of datagrams handled per recvmmsg() call.
+
+#define SERVER_EVENT_MAX_EVENTS \
+    (64)  // The maximum number of events handled per epoll_wait() call.
+#define SERVER_EVENT_MAX_HEADER_SIZE \
+    (128)  // The maximum size of a TCP request header before its payload.
+#define SERVER_RESPONSE_CACHE_ENTRIES \
+    (4096)  // The maximum number of list responses cached by a process.
+#define SERVER_ASSET_CACHE_SIZE \
+    (67108864)  // The default bytes of assets each process keeps mapped.
+#define SERVER_LOG_RECORDS \
+    (1024)  // The number of records of the ring of an asynchronous logger.
+#define SERVER_LOG_RECORD_SIZE \
+    (240)  // The maximum size of a logged message, longer ones are cut.
+#define SERVER_LOG_BATCH_SIZE \
+    (65536)  // The size of the buffer of lines written at once by a logger.
+#define SERVER_LOG_IDLE_TIMEOUT \
+    (100)  // The milliseconds an idle log writer sleeps before checking again.
+#define SERVER_METRICS_MAX_COMMANDS \
+    (16)  // The maximum number of command codes with metrics of their own.
+#define SERVER_METRICS_SUB_BUCKETS \
+    (8)  // The number of histogram buckets per power of 2 of a latency.
+#define SERVER_METRICS_BUCKETS \
+    (320)  // The number of buckets of a latency histogram, up to ~36 minutes.
+#define SERVER_RATE_LIMIT \
+    (0)  // The default requests per second admitted per client, 0 for all.
+#define SERVER_RATE_BURST \
+    (0)  // The default requests a client can send at once, with a limit.
+#define SERVER_MAX_TCP_SESSIONS \
+    (256)  // The maximum number of TCP sessions open at once.
+#define SERVER_MAX_CLIENT_SESSIONS \
+    (32)  // The maximum number of TCP sessions of a client open at once.
+#define SERVER_MAX_UPLOAD_BYTES \
+    (100000000)  // The maximum bytes of the uploads received at once.
+#define SERVER_ADMISSION_CLIENTS \
+    (16384)  // The number of clients the admission control keeps track of.
+#define SERVER_ADMISSION_WAYS \
+    (4)  // The number of slots of the set each client can be kept in.
+#define SERVER_ADMISSION_LOCKS \
+    (256)  // The number of locks shared by the sets of clients.
+#define SERVER_URING_ENTRIES \
+    (64)  // The submission queue entries of the rings of the file writes.
+#define SERVER_URING_EVENT_ENTRIES \
+    (1024)  // The submission queue entries of the ring of the event loop.
+
+#define BENCH_DEFAULT_THREADS \
+    (8)  // The default number of threads of the load generator.
+#define BENCH_MAX_THREADS \
+    (1000)  // The maximum number of threads, each bidder has a 6 digit UID.
+#define BENCH_DEFAULT_DURATION \
+    (10)  // The default number of seconds the load generator runs for.
+#define BENCH_DEFAULT_ASSET_SIZE \
+    (1000000)  // The default size of the asset downloaded by the generator.
+#define BENCH_PASSWORD \
+    "benchpwd"  // The password of every user of the load generator.
+#define BENCH_OWNER_UID \
+    "100000"  // The UID of the user that opens the auction of the generator.
+#define BENCH_BIDDER_UID \
+    (200000)  // The UID of the bidder of the first thread, one per thread.
+#define BENCH_LOGIN_UID \
+    (300000)  // The first UID of the users logged in by the generator.
+#define BENCH_LOGIN_USERS \
+    (10000)  // The number of users logged in by the generator.
+#define BENCH_AUCTION_TIME \
+    (99999)  // The seconds the auction of the generator is active for.
+#define BENCH_MAX_BID_VALUE \
+    (999999)  // The largest value that fits the 6 digits of a bid.
+#define BENCH_MAX_PIPELINE \
+    (1000)  // The maximum number of TCP requests sent at once by a thread.
+
+#define MICROBENCH_MIN_TIME \
+    (200)  // The default milliseconds each microbenchmark runs for.
+#define MICROBENCH_FIELDS \
+    (1000)  // The number of fields read or written per protocol batch.
+#define MICROBENCH_MESSAGES \
+    (100)  // The number of requests decoded per communication batch.
+#define MICROBENCH_LIST_AUCTIONS \
+    (500)  // The number of auctions of the list responses encoded.
+#define MICROBENCH_ASSET_SIZE \
+    (65536)  // The size of the assets of the requests and responses encoded.
+
+#define DATABASE_MAX_AUCTIONS \
+    (1000)  // The number of auctions the 3 digit AIDs can address.
+#define DATABASE_MAX_USERS \
+    (1000000)  // The number of users the 6 digit UIDs can address.
+#define DATABASE_RECORD_MAGIC \
+    "ASDB"  // The first bytes of the binary record files of the database.
+#define DATABASE_RECORD_VERSION \
+    (1)  // The version of the binary record files written by the server.
+#define DATABASE_JOURNAL_VERSION \
+    (1)  // The version of the records of the write-ahead journal.
+#define DATABASE_JOURNAL_CHECKPOINT_SIZE \
+    (4194304)  // The size past which the journal is emptied, when it can be.
+#define DATABASE_CHECKPOINT_MAGIC \
+    "ASIX"  // The first bytes of the checkpoint of the in-memory tables.
+#define DATABASE_CHECKPOINT_VERSION \
+    (4)  // The version of the checkpoint of the in-memory tables.
+#define DATABASE_CHECKPOINT_INTERVAL \
+    (10)  // Every how many seconds the checkpoint is written, if it changed.
+#define DATABASE_PASSWORD_SALT_SIZE \
+    (16)  // The size of the random salt of the password hashes in memory.
+#define DATABASE_USER_LOCKS \
+    (1024)  // The number of locks shared by the users of the database.
 
 #endif
\ No newline at end of file
@@ -5,6 +5,201 @@
  */
 #include "protocol.hpp"
 
+#include <cctype>
+#include <charconv>
+#include <cstring>
+
+#include "schema.hpp"
+
+using namespace schema;
+
+// The schemas of the requests, after the code read by the server
+typedef Schema<Space, Uid, Space, Password, Delimiter> UserRequest;
+typedef Schema<Space, Uid, Delimiter> UserListRequest;
+typedef Schema<Delimiter> EmptyRequest;
+typedef Schema<Space, Aid, Delimiter> AuctionRequest;
+typedef Schema<Space, Aid> AuctionRequestHeader;
+typedef Schema<Space, Generation, Delimiter> ConditionRequest;
+typedef Schema<Space, Uid, Space, Password, Space, Aid, Delimiter> CloseRequest;
+typedef Schema<Space, Aid, Space, Number<PROTOCOL_FSIZE_SIZE>, Space,
+               Number<PROTOCOL_FSIZE_SIZE>, Delimiter>
+    AssetRangeRequest;
+typedef Schema<Space, Uid, Space, Password, Space, Aid, Space,
+               Number<PROTOCOL_STARTVALUE_SIZE>, Delimiter>
+    BidRequest;
+typedef Schema<Space, Uid, Space, Password, Space, AuctionName, Space,
+               Number<PROTOCOL_STARTVALUE_SIZE>, Space,
+               Number<PROTOCOL_AUCTIONTIME_SIZE>, Space, FileName, Space,
+               Number<PROTOCOL_FSIZE_SIZE>, Space>
+    OpenRequestHeader;
+
+bool BufferedMessage::require(size_t count) {
+    while (_end - _begin < count) {
+        if (_end == PROTOCOL_MESSAGE_BUFFER_SIZE) {
+            if (_begin <= 1) {
+                return false;  // The buffer is full, nothing can be dropped
+            }
+
+            // Drop the characters already read, but the last one for unget()
+            size_t kept = _end - _begin + 1;
+            memmove(_buffer, _buffer + _begin - 1, kept);
+            _begin = 1;
+            _end = kept;
+        }
+
+        size_t n = fill(_buffer + _end, PROTOCOL_MESSAGE_BUFFER_SIZE - _end);
+
+        if (n == 0) {
+            return false;
+        }
+
+        _end += n;
+        _received += n;
+    }
+
+    return true;
+}
+
+char BufferedMessage::get() {
+    if (!require(1)) {
+        _good = false;
+        return (char)EOF;
+    }
+
+    return _buffer[_begin++];
+}
+
+void BufferedMessage::unget() {
+    if (_begin > 0) {
+        _begin--;
+        _good = true;
+    }
+}
+
+size_t BufferedMessage::readSome(char *buffer, size_t size) {
+    if (_begin == _end) {  // Large reads skip the buffer altogether
+        size_t n = fill(buffer, size);
+
+        if (n == 0) {
+            throw ProtocolViolationException();
+        }
+
+        _received += n;
+        return n;
+    }
+
+    size_t n = std::min(size, _end - _begin);
+
+    memcpy(buffer, _buffer + _begin, n);
+    _begin += n;
+
+    return n;
+}
+
+std::string_view BufferedMessage::readUntil(std::string_view stops,
+                                            size_t limit) {
+    size_t length = 0;
+
+    while (length < limit) {
+        if (_begin + length == _end && !require(length + 1)) {
+            // The source ended, or the field does not fit in the buffer
+            throw ProtocolViolationException();
+        }
+
+        if (stops.find(_buffer[_begin + length]) != std::string_view::npos) {
+            break;
+        }
+
+        length++;
+    }
+
+    std::string_view field(_buffer + _begin, length);
+    _begin += length;
+
+    return field;
+}
+
+std::string_view BufferedMessage::readExact(size_t count) {
+    if (!require(count)) {
+        throw ProtocolViolationException();
+    }
+
+    std::string_view field(_buffer + _begin, count);
+    _begin += count;
+
+    return field;
+}
+
+bool BufferedMessage::peek(std::string_view expected) {
+    for (size_t i = 0; i < expected.size(); i++) {
+        if (_begin + i == _end && !require(i + 1)) {
+            return false;
+        }
+
+        if (_buffer[_begin + i] != expected[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief  Checks if a field only has digits.
+ * @param  field The field.
+ * @retval true if it is not empty and only has digits, false otherwise.
+ */
+static bool IsDigits(std::string_view field) {
+    if (field.empty()) {
+        return false;
+    }
+
+    for (char c : field) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief  Checks if a field only has letters and digits.
+ * @param  field The field.
+ * @retval true if it only has letters and digits, false otherwise.
+ */
+static bool IsAlphaNumeric(std::string_view field) {
+    for (char c : field) {
+        if (!isalnum((unsigned char)c)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief  Parses a field with a number, in place.
+ * @param  field The field.
+ * @retval the number.
+ */
+static int ParseNumber(std::string_view field) {
+    int number = 0;
+
+    if (!IsDigits(field)) {
+        throw ProtocolViolationException();
+    }
+
+    auto result =
+        std::from_chars(field.data(), field.data() + field.size(), number);
+
+    if (result.ec != std::errc()) {  // Too big to be an int
+        throw ProtocolViolationException();
+    }
+
+    return number;
+}
+
 char ProtocolCommunication::readChar(std::stringstream &message) {
     char c = (char)message
                  .get();  // get() returns an int, so we need to cast it to char
@@ -64,6 +259,12 @@ std::string ProtocolCommunication::readString(MessageSource &message) {
 
 std::string ProtocolCommunication::readString(MessageSource &message,
                                               size_t n) {
+    BufferedMessage *buffered = dynamic_cast<BufferedMessage *>(&message);
+
+    if (buffered != NULL) {  // The whole field is taken from the buffer
+        return std::string(buffered->readUntil(PROTOCOL_FIELD_STOPS, n));
+    }
+
     std::string result;
 
     for (size_t i = 0; i < n; i++) {  // read n chars
@@ -111,6 +312,13 @@ std::string ProtocolCommunication::readString(
 }
 
 int ProtocolCommunication::readNumber(MessageSource &message) {
+    BufferedMessage *buffered = dynamic_cast<BufferedMessage *>(&message);
+
+    if (buffered != NULL) {  // Parsed in place, without making a string
+        return ParseNumber(
+            buffered->readUntil(PROTOCOL_FIELD_STOPS, std::string::npos));
+    }
+
     std::string string = readString(message);
 
     // Check if string only contains digits
@@ -122,6 +330,12 @@ int ProtocolCommunication::readNumber(MessageSource &message) {
 }
 
 int ProtocolCommunication::readNumber(MessageSource &message, size_t size) {
+    BufferedMessage *buffered = dynamic_cast<BufferedMessage *>(&message);
+
+    if (buffered != NULL) {  // Parsed in place, without making a string
+        return ParseNumber(buffered->readUntil(PROTOCOL_FIELD_STOPS, size));
+    }
+
     std::string string = readString(message, size);
 
     // Check if string only contains digits
@@ -132,6 +346,14 @@ int ProtocolCommunication::readNumber(MessageSource &message, size_t size) {
     return stoi(string);  // Convert string to int
 }
 
+uint64_t ProtocolCommunication::readGeneration(MessageSource &message) {
+    uint64_t generation;
+
+    Schema<Generation>::decode(message, generation);
+
+    return generation;
+}
+
 std::time_t ProtocolCommunication::readDateTime(MessageSource &message) {
     std::stringstream stream;
     std::string aux;
@@ -185,6 +407,19 @@ std::time_t ProtocolCommunication::readDateTime(MessageSource &message) {
 }
 
 std::string ProtocolCommunication::readUid(MessageSource &message) {
+    BufferedMessage *buffered = dynamic_cast<BufferedMessage *>(&message);
+
+    if (buffered != NULL) {  // Checked in place, before making a string
+        std::string_view field =
+            buffered->readUntil(PROTOCOL_FIELD_STOPS, PROTOCOL_UID_SIZE);
+
+        if (!IsDigits(field) || field.length() != PROTOCOL_UID_SIZE) {
+            throw ProtocolViolationException();
+        }
+
+        return std::string(field);
+    }
+
     std::string uid = readString(message, PROTOCOL_UID_SIZE);  // Read a string
 
     if (!isNumeric(uid) || uid.length() != PROTOCOL_UID_SIZE) {
@@ -209,6 +444,19 @@ std::string ProtocolCommunication::readPassword(MessageSource &message) {
 }
 
 std::string ProtocolCommunication::readAid(MessageSource &message) {
+    BufferedMessage *buffered = dynamic_cast<BufferedMessage *>(&message);
+
+    if (buffered != NULL) {  // Checked in place, before making a string
+        std::string_view field =
+            buffered->readUntil(PROTOCOL_FIELD_STOPS, PROTOCOL_AID_SIZE);
+
+        if (!IsAlphaNumeric(field) || field.length() != PROTOCOL_AID_SIZE) {
+            throw ProtocolViolationException();
+        }
+
+        return std::string(field);
+    }
+
     std::string aid = readString(message, PROTOCOL_AID_SIZE);  // Read a string
 
     if (!isAlphaNumeric(aid) || aid.length() != PROTOCOL_AID_SIZE) {
@@ -241,7 +489,12 @@ std::string ProtocolCommunication::readAuctionName(MessageSource &message) {
 
 void ProtocolCommunication::readIdentifier(MessageSource &message,
                                            std::string identifier) {
-    std::string identifierRecieved = readString(message, 3);  // Read a string
+    BufferedMessage *buffered = dynamic_cast<BufferedMessage *>(&message);
+
+    // Identifiers have a fixed size, so they are read at once when possible
+    std::string identifierRecieved =
+        (buffered != NULL) ? std::string(buffered->readExact(3))
+                           : readString(message, 3);  // Read a string
 
     if (identifierRecieved == PROTOCOL_ERROR_IDENTIFIER) {
         // If the identifier is the error identifier, throw an exception
@@ -283,6 +536,15 @@ void ProtocolCommunication::writeNumber(std::stringstream &message,
     writeString(message, value);  // write the string
 }
 
+void ProtocolCommunication::writeGeneration(std::stringstream &message,
+                                            uint64_t generation) {
+    char digits[PROTOCOL_GENERATION_SIZE];  // Any generation that is sent
+    MessageBuffer buffer(digits, sizeof(digits));
+
+    writeGeneration(buffer, generation);
+    message.write(buffer.data(), (std::streamsize)buffer.size());
+}
+
 void ProtocolCommunication::writeDateTime(std::stringstream &message,
                                           std::time_t time) {
     std::tm tm = *(std::localtime(&time));  // convert the time_t to a tm struct
@@ -341,6 +603,87 @@ void ProtocolCommunication::writeAuctionName(std::stringstream &message,
     writeString(message, name);
 }
 
+void ProtocolCommunication::writeChar(MessageBuffer &message, char c) {
+    message.write(&c, 1);
+}
+
+void ProtocolCommunication::writeDelimiter(MessageBuffer &message) {
+    writeChar(message, PROTOCOL_MESSAGE_DELIMITER);  // write the delimiter
+}
+
+void ProtocolCommunication::writeSpace(MessageBuffer &message) {
+    writeChar(message, ' ');  // write a space
+}
+
+void ProtocolCommunication::writeString(MessageBuffer &message,
+                                        std::string_view string) {
+    message.write(string.data(), string.size());
+}
+
+void ProtocolCommunication::writeNumber(MessageBuffer &message, int number) {
+    char digits[16];  // Enough for any int and its sign
+
+    auto result = std::to_chars(digits, digits + sizeof(digits), number);
+
+    message.write(digits, (size_t)(result.ptr - digits));
+}
+
+void ProtocolCommunication::writeGeneration(MessageBuffer &message,
+                                            uint64_t generation) {
+    char digits[24];  // Enough for any uint64_t
+
+    auto result = std::to_chars(digits, digits + sizeof(digits), generation);
+    size_t n = (size_t)(result.ptr - digits);
+
+    if (n > PROTOCOL_GENERATION_SIZE) {  // The other side could not read it
+        throw ProtocolViolationException();
+    }
+
+    message.write(digits, n);
+}
+
+void ProtocolCommunication::writeDateTime(MessageBuffer &message,
+                                          std::time_t time) {
+    char dateTime[20];  // YYYY-MM-DD HH:MM:SS and the terminator
+    std::tm tm;
+
+    localtime_r(&time, &tm);  // The thread safe localtime()
+
+    size_t n = strftime(dateTime, sizeof(dateTime), "%Y-%m-%d %H:%M:%S", &tm);
+
+    message.write(dateTime, n);
+}
+
+void ProtocolCommunication::writeUid(MessageBuffer &message,
+                                     const std::string &uid) {
+    if (!IsDigits(uid) || uid.length() != PROTOCOL_UID_SIZE) {
+        // check if the string only contains digits and has the correct size
+        throw ProtocolViolationException();
+    }
+
+    writeString(message, uid);  // write the string
+}
+
+void ProtocolCommunication::writeAid(MessageBuffer &message,
+                                     const std::string &aid) {
+    if (!IsDigits(aid) || aid.length() != PROTOCOL_AID_SIZE) {
+        // check if the string only contains digits and has the correct size
+        throw ProtocolViolationException();
+    }
+
+    writeString(message, aid);  // write the string
+}
+
+void ProtocolCommunication::writeAuctionName(MessageBuffer &message,
+                                             const std::string &name) {
+    if (!isValidAuctionName(name) ||
+        name.length() > PROTOCOL_AUCTIONNAME_SIZE) {
+        throw ProtocolViolationException();
+    }
+
+    writeString(message, name);
+}
+
 std::stringstream LoginCommunication::encodeRequest() {
     std::stringstream message;
 
@@ -359,18 +702,8 @@ std::stringstream LoginCommunication::encodeRequest() {
 }
 
 void LoginCommunication::decodeRequest(MessageSource &message) {
-    // readIdentifier(message, "LIN"); The identifier is already read by the
-    // server
-
-    readSpace(message);
-
-    _uid = readUid(message);
-
-    readSpace(message);
-
-    _password = readPassword(message);
-
-    readDelimiter(message);
+    // The identifier is already read by the server
+    UserRequest::decode(message, _uid, _password);
 }
 
 std::stringstream LoginCommunication::encodeResponse() {
@@ -410,18 +743,8 @@ std::stringstream LogoutCommunication::encodeRequest() {
 }
 
 void LogoutCommunication::decodeRequest(MessageSource &message) {
-    // readIdentifier(message, "LOU"); The identifier is already read by the
-    // server
-
-    readSpace(message);
-
-    _uid = readUid(message);
-
-    readSpace(message);
-
-    _password = readPassword(message);
-
-    readDelimiter(message);  // Read the delimiter
+    // The identifier is already read by the server
+    UserRequest::decode(message, _uid, _password);
 }
 
 std::stringstream LogoutCommunication::encodeResponse() {
@@ -461,18 +784,8 @@ std::stringstream UnregisterCommunication::encodeRequest() {
 }
 
 void UnregisterCommunication::decodeRequest(MessageSource &message) {
-    // readIdentifier(message, "UNR"); The identifier is already read by the
-    // server
-
-    readSpace(message);
-
-    _uid = readUid(message);
-
-    readSpace(message);
-
-    _password = readPassword(message);
-
-    readDelimiter(message);  // Read the delimiter
+    // The identifier is already read by the server
+    UserRequest::decode(message, _uid, _password);
 }
 
 std::stringstream UnregisterCommunication::encodeResponse() {
@@ -508,25 +821,33 @@ std::stringstream ListUserAuctionsCommunication::encodeRequest() {
 }
 
 void ListUserAuctionsCommunication::decodeRequest(MessageSource &message) {
-    // readIdentifier(message, "LMA"); The identifier is already read by the
-    // server
+    // The identifier is already read by the server
+    UserListRequest::decode(message, _uid);
+}
 
-    readSpace(message);
+std::stringstream ListUserAuctionsCommunication::encodeResponse() {
+    char data[SOCKETS_MAX_DATAGRAM_SIZE_CLIENT];
+    MessageBuffer buffer(data, sizeof(data));
 
-    _uid = readUid(message);
+    encodeResponse(buffer);
 
-    readDelimiter(message);  // Read the delimiter
-}
+    if (buffer.overflowed()) {  // It could not be sent in a single datagram
+        throw ProtocolViolationException();
+    }
 
-std::stringstream ListUserAuctionsCommunication::encodeResponse() {
     std::stringstream message;
+    message.write(buffer.data(), (std::streamsize)buffer.size());
+
+    return message;
+}
 
+void ListUserAuctionsCommunication::encodeResponse(MessageBuffer &message) {
     writeString(message, "RMA");  // Write the identifier "RMA"
 
     writeSpace(message);
     writeString(message, _status);
 
-    for (auto auction : _auctions) {  // Write each auction
+    for (auto &auction : _auctions) {  // Write each auction
         if (auction.second != "0" && auction.second != "1") {
             throw ProtocolViolationException();
         }
@@ -537,8 +858,6 @@ std::stringstream ListUserAuctionsCommunication::encodeResponse() {
     }
 
     writeDelimiter(message);  // Put delimiter at the end
-
-    return message;
 }
 
 void ListUserAuctionsCommunication::decodeResponse(MessageSource &message) {
@@ -590,19 +909,27 @@ std::stringstream ListUserBidsCommunication::encodeRequest() {
 }
 
 void ListUserBidsCommunication::decodeRequest(MessageSource &message) {
-    // readIdentifier(message, "LMB"); The identifier is already read by the
-    // server
+    // The identifier is already read by the server
+    UserListRequest::decode(message, _uid);
+}
 
-    readSpace(message);
+std::stringstream ListUserBidsCommunication::encodeResponse() {
+    char data[SOCKETS_MAX_DATAGRAM_SIZE_CLIENT];
+    MessageBuffer buffer(data, sizeof(data));
 
-    _uid = readUid(message);
+    encodeResponse(buffer);
 
-    readDelimiter(message);  // Read the delimiter
-}
+    if (buffer.overflowed()) {  // It could not be sent in a single datagram
+        throw ProtocolViolationException();
+    }
 
-std::stringstream ListUserBidsCommunication::encodeResponse() {
     std::stringstream message;
+    message.write(buffer.data(), (std::streamsize)buffer.size());
+
+    return message;
+}
 
+void ListUserBidsCommunication::encodeResponse(MessageBuffer &message) {
     writeString(message, "RMB");  // Write the identifier "RMB"
 
     writeSpace(message);
@@ -620,8 +947,6 @@ std::stringstream ListUserBidsCommunication::encodeResponse() {
     }
 
     writeDelimiter(message);  // Put delimiter at the end
-
-    return message;
 }
 
 void ListUserBidsCommunication::decodeResponse(MessageSource &message) {
@@ -659,32 +984,72 @@ void ListUserBidsCommunication::decodeResponse(MessageSource &message) {
     }
 }
 
+void ConditionalCommunication::decodeCondition(MessageSource &message) {
+    char c = readChar(message);
+
+    message.unget();  // Only peeked, it belongs to the schema read next
+
+    if (c != ' ') {  // Not conditional, the delimiter follows
+        EmptyRequest::decode(message);
+        return;
+    }
+
+    ConditionRequest::decode(message, _knownGeneration);
+    _conditional = true;  // Only once it is known to be well formed
+}
+
+void ConditionalCommunication::encodeCondition(std::stringstream &message) {
+    if (_conditional) {
+        writeSpace(message);
+        writeGeneration(message, _knownGeneration);
+    }
+}
+
 std::stringstream ListAllAuctionsCommunication::encodeRequest() {
     std::stringstream message;
 
     writeString(message, "LST");  // Write the identifier "LST"
 
+    encodeCondition(message);  // Write the generation known, if conditional
+
     writeDelimiter(message);  // Put delimiter at the end
 
     return message;
 }
 
 void ListAllAuctionsCommunication::decodeRequest(MessageSource &message) {
-    // readIdentifier(message, "LST"); The identifier is already read by the
-    // server
-
-    readDelimiter(message);  // Read the delimiter
+    // The identifier is already read by the server
+    decodeCondition(message);
 }
 
 std::stringstream ListAllAuctionsCommunication::encodeResponse() {
+    char data[SOCKETS_MAX_DATAGRAM_SIZE_CLIENT];
+    MessageBuffer buffer(data, sizeof(data));
+
+    encodeResponse(buffer);
+
+    if (buffer.overflowed()) {  // It could not be sent in a single datagram
+        throw ProtocolViolationException();
+    }
+
     std::stringstream message;
+    message.write(buffer.data(), (std::streamsize)buffer.size());
+
+    return message;
+}
 
+void ListAllAuctionsCommunication::encodeResponse(MessageBuffer &message) {
     writeString(message, "RLS");  // Write the identifier "RLS"
 
     writeSpace(message);
     writeString(message, _status);
 
-    for (auto auction : _auctions) {  // Write each auction
+    if (_conditional && _status != "ERR") {  // Write the generation
+        writeSpace(message);
+        writeGeneration(message, _generation);
+    }
+
+    for (auto &auction : _auctions) {  // Write each auction
         if (auction.second != "0" && auction.second != "1") {
             throw ProtocolViolationException();
         }
@@ -695,8 +1060,6 @@ std::stringstream ListAllAuctionsCommunication::encodeResponse() {
     }
 
     writeDelimiter(message);  // Put delimiter at the end
-
-    return message;
 }
 
 void ListAllAuctionsCommunication::decodeResponse(MessageSource &message) {
@@ -704,8 +1067,19 @@ void ListAllAuctionsCommunication::decodeResponse(MessageSource &message) {
 
     readSpace(message);
 
+    std::vector<std::string> statuses = {"OK", "NOK"};
+
+    if (_conditional) {  // The response may only say nothing changed
+        statuses.push_back(PROTOCOL_UNCHANGED_STATUS);
+    }
+
     // Read the status, checking if it is one of the options
-    _status = readString(message, std::vector<std::string>({"OK", "NOK"}));
+    _status = readString(message, statuses);
+
+    if (_conditional) {  // Read the generation
+        readSpace(message);
+        _generation = readGeneration(message);
+    }
 
     if (_status != "OK") {
         // If the status is not OK, read the delimiter and return
@@ -742,35 +1116,51 @@ std::stringstream ShowRecordCommunication::encodeRequest() {
 
     writeAid(message, _aid);
 
+    encodeCondition(message);  // Write the generation known, if conditional
+
     writeDelimiter(message);  // Put delimiter at the end
 
     return message;
 }
 
 void ShowRecordCommunication::decodeRequest(MessageSource &message) {
-    // readIdentifier(message, "SRC"); The identifier is already read by the
-    // server
+    // The identifier is already read by the server
+    AuctionRequestHeader::decode(message, _aid);
+    decodeCondition(message);
+}
 
-    readSpace(message);
+std::stringstream ShowRecordCommunication::encodeResponse() {
+    char data[SOCKETS_MAX_DATAGRAM_SIZE_CLIENT];
+    MessageBuffer buffer(data, sizeof(data));
 
-    _aid = readAid(message);
+    encodeResponse(buffer);
 
-    readDelimiter(message);  // Read the delimiter
-}
+    if (buffer.overflowed()) {  // It could not be sent in a single datagram
+        throw ProtocolViolationException();
+    }
 
-std::stringstream ShowRecordCommunication::encodeResponse() {
     std::stringstream message;
+    message.write(buffer.data(), (std::streamsize)buffer.size());
+
+    return message;
+}
 
+void ShowRecordCommunication::encodeResponse(MessageBuffer &message) {
     writeString(message, "RRC");  // Write the identifier "RRC"
 
     writeSpace(message);
 
     writeString(message, _status);
 
+    if (_conditional && _status != "ERR") {  // Write the generation
+        writeSpace(message);
+        writeGeneration(message, _generation);
+    }
+
     if (_status != "OK") {
         // If the status is not OK, read the delimiter and return
         writeDelimiter(message);
-        return message;
+        return;
     }
 
     writeSpace(message);
@@ -841,8 +1231,6 @@ std::stringstream ShowRecordCommunication::encodeResponse() {
     }
 
     writeDelimiter(message);  // Put delimiter at the end
-
-    return message;
 }
 
 void ShowRecordCommunication::decodeResponse(MessageSource &message) {
@@ -850,8 +1238,19 @@ void ShowRecordCommunication::decodeResponse(MessageSource &message) {
 
     readSpace(message);
 
+    std::vector<std::string> statuses = {"OK", "NOK"};
+
+    if (_conditional) {  // The response may only say nothing changed
+        statuses.push_back(PROTOCOL_UNCHANGED_STATUS);
+    }
+
     // Read the status, checking if it is one of the options
-    _status = readString(message, std::vector<std::string>({"OK", "NOK"}));
+    _status = readString(message, statuses);
+
+    if (_conditional) {  // Read the generation
+        readSpace(message);
+        _generation = readGeneration(message);
+    }
 
     if (_status != "OK") {
         // If the status is not OK, read the delimiter and return
@@ -1001,56 +1400,46 @@ std::stringstream OpenAuctionCommunication::encodeRequest() {
 }
 
 void OpenAuctionCommunication::decodeRequest(MessageSource &message) {
-    // readIdentifier(message, "OPA"); The identifier is already read by the
-    // server
-
-    readSpace(message);
-
-    _uid = readUid(message);  // Read the UID
-
-    readSpace(message);
-
-    _password = readPassword(message);  // Read the password
-
-    readSpace(message);
-
-    _name = readAuctionName(message);  // Read the auction name
-
-    readSpace(message);
-
-    _startValue =
-        readNumber(message, PROTOCOL_STARTVALUE_SIZE);  // Read the start value
-
-    readSpace(message);
-
-    _timeActive =
-        readNumber(message, PROTOCOL_AUCTIONTIME_SIZE);  // Read the time active
-
-    readSpace(message);
-
-    _fileName = readFileName(message);  // Read the asset file name
+    decodeRequest(message, _fileData);
+}
 
-    readSpace(message);
+void OpenAuctionCommunication::decodeRequest(MessageSource &message,
+                                             std::ostream &file) {
+    decodeRequestHeader(message);
+    decodeRequestFile(message, file);
+}
 
-    _fileSize =
-        readNumber(message, PROTOCOL_FSIZE_SIZE);  // Read the asset file size
+void OpenAuctionCommunication::decodeRequestHeader(MessageSource &message) {
+    // The identifier is already read by the server
+    OpenRequestHeader::decode(message, _uid, _password, _name, _startValue,
+                              _timeActive, _fileName, _fileSize);
 
     if (_fileSize > PROTOCOL_MAX_FILE_SIZE) {
         throw ProtocolViolationException();
     }
+}
 
-    readSpace(message);
+void OpenAuctionCommunication::decodeRequestFile(MessageSource &message,
+                                                 std::ostream &file) {
+    char buffer[PROTOCOL_FILE_CHUNK_SIZE];
+    size_t remaining = (size_t)_fileSize;
 
-    for (int i = 0; i < _fileSize; i++) {
-        // Read each char of the asset file
-        char c = readChar(message);
+    while (remaining > 0) {
+        // Read the asset file in chunks, as much as the source has at once
+        size_t n = message.readSome(
+            buffer, std::min(remaining, (size_t)PROTOCOL_FILE_CHUNK_SIZE));
 
-        writeChar(_fileData, c);
+        file.write(buffer, (std::streamsize)n);
+        remaining -= n;
     }
 
     readDelimiter(message);  // Read the delimiter
 }
 
+void OpenAuctionCommunication::decodeRequestEnd(MessageSource &message) {
+    readDelimiter(message);  // Read the delimiter
+}
+
 std::stringstream OpenAuctionCommunication::encodeResponse() {
     std::stringstream message;
 
@@ -1112,22 +1501,8 @@ std::stringstream CloseAuctionCommunication::encodeRequest() {
 }
 
 void CloseAuctionCommunication::decodeRequest(MessageSource &message) {
-    // readIdentifier(message, "CLS"); The identifier is already read by the
-    // server
-
-    readSpace(message);
-
-    _uid = readUid(message);
-
-    readSpace(message);
-
-    _password = readPassword(message);
-
-    readSpace(message);
-
-    _aid = readAid(message);
-
-    readDelimiter(message);  // Read the delimiter
+    // The identifier is already read by the server
+    CloseRequest::decode(message, _uid, _password, _aid);
 }
 
 std::stringstream CloseAuctionCommunication::encodeResponse() {
@@ -1170,17 +1545,30 @@ std::stringstream ShowAssetCommunication::encodeRequest() {
 }
 
 void ShowAssetCommunication::decodeRequest(MessageSource &message) {
-    // readIdentifier(message, "SAS"); The identifier is already read by the
-    // server
+    // The identifier is already read by the server
+    AuctionRequest::decode(message, _aid);
+}
 
-    readSpace(message);
+std::stringstream ShowAssetCommunication::encodeResponse() {
+    std::stringstream message = encodeResponseHeader();
 
-    _aid = readAid(message);
+    if (_status != "OK") {
+        return message;
+    }
 
-    readDelimiter(message);  // Read the delimiter
+    for (int i = 0; i < _fileSize; i++) {
+        // Write each char of the asset file
+        char c = readChar(_fileData);
+
+        writeChar(message, c);
+    }
+
+    writeDelimiter(message);  // Put delimiter at the end
+
+    return message;
 }
 
-std::stringstream ShowAssetCommunication::encodeResponse() {
+std::stringstream ShowAssetCommunication::encodeResponseHeader() {
     std::stringstream message;
 
     writeString(message, "RSA");  // Write the identifier "RSA"
@@ -1212,16 +1600,7 @@ std::stringstream ShowAssetCommunication::encodeResponse() {
 
     writeNumber(message, _fileSize);  // Write the asset file size
 
-    writeSpace(message);
-
-    for (int i = 0; i < _fileSize; i++) {
-        // Write each char of the asset file
-        char c = readChar(_fileData);
-
-        writeChar(message, c);
-    }
-
-    writeDelimiter(message);  // Put delimiter at the end
+    writeSpace(message);  // The file data follows
 
     return message;
 }
@@ -1266,55 +1645,194 @@ void ShowAssetCommunication::decodeResponse(MessageSource &message) {
     readDelimiter(message);  // Read the delimiter
 }
 
-std::stringstream BidCommunication::encodeRequest() {
+std::stringstream ShowAssetRangeCommunication::encodeRequest() {
     std::stringstream message;
 
-    writeString(message, "BID");  // Write the identifier "BID"
+    writeString(message, "SAR");  // Write the identifier "SAR"
 
     writeSpace(message);
 
-    writeUid(message, _uid);
+    writeAid(message, _aid);
 
     writeSpace(message);
 
-    writePassword(message, _password);
+    writeNumber(message, _offset);  // Write the offset of the range
 
     writeSpace(message);
 
-    writeAid(message, _aid);
+    writeNumber(message, _length);  // Write the length of the range
 
-    writeSpace(message);
+    writeDelimiter(message);  // Put delimiter at the end
 
-    writeNumber(message, _value);  // Write the bid value
+    return message;
+}
+
+void ShowAssetRangeCommunication::decodeRequest(MessageSource &message) {
+    // The identifier is already read by the server
+    AssetRangeRequest::decode(message, _aid, _offset, _length);
+}
+
+std::stringstream ShowAssetRangeCommunication::encodeResponse() {
+    std::stringstream message = encodeResponseHeader();
+
+    if (_status != "OK") {
+        return message;
+    }
+
+    for (int i = 0; i < _length; i++) {
+        // Write each char of the range
+        char c = readChar(_fileData);
+
+        writeChar(message, c);
+    }
 
     writeDelimiter(message);  // Put delimiter at the end
 
     return message;
 }
 
-void BidCommunication::decodeRequest(MessageSource &message) {
-    // readString(message, "BID"); The identifier is already read by the server
+std::stringstream ShowAssetRangeCommunication::encodeResponseHeader() {
+    std::stringstream message;
+
+    writeString(message, "RSR");  // Write the identifier "RSR"
+
+    writeSpace(message);
+
+    writeString(message, _status);  // Write the status
+
+    if (_status != "OK") {
+        // If the status is not OK, write the delimiter and return
+        writeDelimiter(message);
+        return message;
+    }
+
+    writeSpace(message);
+
+    if (_fileName.length() > PROTOCOL_FNAME_SIZE) {
+        // If the asset file name is too big, throw an exception
+        throw ProtocolViolationException();
+    }
+
+    writeFileName(message, _fileName);  // Write the asset file name
+
+    writeSpace(message);
+
+    if (_fileSize > PROTOCOL_MAX_FILE_SIZE || _offset < 0 || _length < 0 ||
+        _offset + _length > _fileSize) {
+        throw ProtocolViolationException();
+    }
+
+    writeNumber(message, _fileSize);  // Write the asset file size
+
+    writeSpace(message);
+
+    writeNumber(message, _offset);  // Write the offset of the range
+
+    writeSpace(message);
+
+    writeNumber(message, _length);  // Write the length of the range
+
+    writeSpace(message);  // The bytes of the range follow
+
+    return message;
+}
+
+void ShowAssetRangeCommunication::decodeResponse(MessageSource &message) {
+    decodeResponse(message, -1);
+}
+
+void ShowAssetRangeCommunication::decodeResponse(MessageSource &message,
+                                                 int fd) {
+    readIdentifier(message, "RSR");  // Read the identifier "RSR"
 
     readSpace(message);
 
-    _uid = readUid(message);
+    // Read the status, checking if it is one of the options
+    _status = readString(message, std::vector<std::string>({"OK", "NOK"}));
+
+    if (_status != "OK") {
+        // If the status is not OK, write the delimiter and return
+        readDelimiter(message);
+
+        return;
+    }
+
+    readSpace(message);
+
+    _fileName = readFileName(message);  // Read the asset file name
 
     readSpace(message);
 
-    _password = readPassword(message);
+    _fileSize =
+        readNumber(message, PROTOCOL_FSIZE_SIZE);  // Read the asset file size
 
     readSpace(message);
 
-    _aid = readAid(message);
+    _offset = readNumber(message, PROTOCOL_FSIZE_SIZE);  // Read the offset
 
     readSpace(message);
 
-    _value =
-        readNumber(message, PROTOCOL_STARTVALUE_SIZE);  // Read the bid value
+    _length = readNumber(message, PROTOCOL_FSIZE_SIZE);  // Read the length
+
+    if (_fileSize > PROTOCOL_MAX_FILE_SIZE || _offset + _length > _fileSize) {
+        throw ProtocolViolationException();
+    }
+
+    readSpace(message);
+
+    char buffer[PROTOCOL_FILE_CHUNK_SIZE];
+    size_t done = 0;
+
+    while (done < (size_t)_length) {
+        // Read the range in chunks, as much as the source has at once
+        size_t n = message.readSome(
+            buffer,
+            std::min((size_t)_length - done, (size_t)PROTOCOL_FILE_CHUNK_SIZE));
+
+        if (fd == -1) {
+            _fileData.write(buffer, (std::streamsize)n);
+        } else if (pwrite(fd, buffer, n, (off_t)((size_t)_offset + done)) !=
+                   (ssize_t)n) {
+            throw std::runtime_error("Couldn't write file");
+        }
+
+        done += n;
+    }
 
     readDelimiter(message);  // Read the delimiter
 }
 
+std::stringstream BidCommunication::encodeRequest() {
+    std::stringstream message;
+
+    writeString(message, "BID");  // Write the identifier "BID"
+
+    writeSpace(message);
+
+    writeUid(message, _uid);
+
+    writeSpace(message);
+
+    writePassword(message, _password);
+
+    writeSpace(message);
+
+    writeAid(message, _aid);
+
+    writeSpace(message);
+
+    writeNumber(message, _value);  // Write the bid value
+
+    writeDelimiter(message);  // Put delimiter at the end
+
+    return message;
+}
+
+void BidCommunication::decodeRequest(MessageSource &message) {
+    // The identifier is already read by the server
+    BidRequest::decode(message, _uid, _password, _aid, _value);
+}
+
 std::stringstream BidCommunication::encodeResponse() {
     std::stringstream message;
 
@@ -1339,3 +1857,42 @@ void BidCommunication::decodeResponse(MessageSource &message) {
 
     readDelimiter(message);  // Read the delimiter
 }
+
+std::stringstream KeepAliveCommunication::encodeRequest() {
+    std::stringstream message;
+
+    writeString(message, "KAL");  // Write the identifier "KAL"
+
+    writeDelimiter(message);  // Put delimiter at the end
+
+    return message;
+}
+
+void KeepAliveCommunication::decodeRequest(MessageSource &message) {
+    // The identifier is already read by the server
+    EmptyRequest::decode(message);
+}
+
+std::stringstream KeepAliveCommunication::encodeResponse() {
+    std::stringstream message;
+
+    writeString(message, "RKA");  // Write the identifier "RKA"
+
+    writeSpace(message);
+
+    writeString(message, _status);  // Write the status
+
+    writeDelimiter(message);
+
+    return message;
+}
+
+void KeepAliveCommunication::decodeResponse(MessageSource &message) {
+    readIdentifier(message, "RKA");  // Read the identifier "RKA"
+
+    readSpace(message);
+
+    _status = readString(message, std::vector<std::string>{"OK"});
+
+    readDelimiter(message);  // Read the delimiter
+}
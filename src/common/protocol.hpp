@@ -7,6 +7,9 @@
 #define __PROTOCOL_HPP__
 
 #include <unistd.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <ctime>
 #include <deque>
 #include <iomanip>
@@ -14,6 +17,7 @@
 #include <map>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "config.hpp"
@@ -79,121 +83,258 @@ class MessageSource {
      * return the same character that was previously read.
      */
     virtual void unget() = 0;
+
+    /**
+     * @brief Read up to size characters from the message source at once.
+     *
+     * Blocks until at least one character is available. This default reads a
+     * single character, sources that can do better read as many as they have.
+     *
+     * @param buffer The buffer to read to.
+     * @param size The size of the buffer, at least 1.
+     * @return The number of characters read.
+     */
+    virtual size_t readSome(char *buffer, size_t size) {
+        (void)size;
+        buffer[0] = get();
+        return 1;
+    };
 };
 
 /**
- * @brief Represents a message source that reads from a stringstream.
+ * @brief Message source that reads its underlying source in bulk into a
+ * contiguous buffer.
+ *
+ * Besides the character interface, fields can be taken from the buffer in
+ * place with readUntil() and readExact(). The buffer is compacted when it
+ * runs out of room, always keeping the last character read so that unget()
+ * keeps working.
  */
-class StreamMessage : public MessageSource {
+class BufferedMessage : public MessageSource {
   private:
-    std::stringstream &_stream;
+    char _buffer[PROTOCOL_MESSAGE_BUFFER_SIZE];  // The characters read ahead
+    size_t _begin = 0;     // The position of the next character to be read
+    size_t _end = 0;       // The position after the last buffered character
+    bool _good = true;     // Cleared when a character is read past the end
+    size_t _received = 0;  // The characters read from the source so far
+
+    /**
+     * @brief Buffers characters until at least count of them are unread.
+     *
+     * @param count The number of unread characters wanted.
+     * @return true if there are enough, false if the source ended first.
+     */
+    bool require(size_t count);
+
+  protected:
+    /**
+     * @brief Reads characters from the underlying source.
+     *
+     * @param buffer The buffer to read to.
+     * @param size The size of the buffer.
+     * @return The number of characters read, 0 at the end of the source.
+     */
+    virtual size_t fill(char *buffer, size_t size) = 0;
 
   public:
     /**
-     * @brief Constructs a StreamMessage object with the given stringstream.
+     * @brief Gets the next character, buffering more if needed.
      *
-     * @param stream The stringstream to read from.
+     * @return The next character.
      */
-    StreamMessage(std::stringstream &stream) : _stream(stream){};
+    char get();
+
+    /**
+     * @brief Checks if no character was read past the end of the source.
+     *
+     * @return true if the message source is in a good state, false otherwise.
+     */
+    bool good() { return _good; };
+
+    /**
+     * @brief Gets the number of characters read from the underlying source,
+     * whether or not they were consumed.
+     *
+     * @return The number of characters.
+     */
+    size_t getBytesReceived() { return _received; };
+
+    /**
+     * @brief Puts the last character read back.
+     */
+    void unget();
+
+    /**
+     * @brief Reads up to size characters, from the buffer while it has any
+     * and straight from the underlying source afterwards.
+     *
+     * @param buffer The buffer to read to.
+     * @param size The size of the buffer.
+     * @return The number of characters read.
+     */
+    size_t readSome(char *buffer, size_t size);
 
     /**
-     * @brief Reads the next character from the stringstream.
+     * @brief Reads the characters before the first of the given stops,
+     * without consuming the stop, or the first limit characters.
      *
-     * @return The next character from the stringstream.
+     * @param stops The characters that end the field.
+     * @param limit The maximum number of characters read.
+     * @return A view of the characters, valid until the next read.
      */
-    char get() { return (char)_stream.get(); };
+    std::string_view readUntil(std::string_view stops, size_t limit);
 
     /**
-     * @brief Checks if the stringstream is in a good state.
+     * @brief Reads exactly count characters.
      *
-     * @return True if the stringstream is in a good state, false otherwise.
+     * @param count The number of characters, at most the size of the buffer.
+     * @return A view of the characters, valid until the next read.
      */
-    bool good() { return _stream.good(); };
+    std::string_view readExact(size_t count);
 
     /**
-     * @brief Puts the last character extracted from the stringstream back.
+     * @brief Checks if the next characters are the given ones, without
+     * consuming them.
+     *
+     * @param expected The characters, at most the size of the buffer.
+     * @return true if they are, false if they differ or the source ended.
      */
-    void unget() { _stream.unget(); };
+    bool peek(std::string_view expected);
 };
 
 /**
- * @brief Represents a TCP message source.
- *
- * This class provides functionality to read characters from a TCP socket
- * and store them in a buffer. It also allows ungetting characters from the
- * buffer.
+ * @brief Represents a message source that reads from a stringstream.
  */
-class TcpMessage : public MessageSource {
+class StreamMessage : public BufferedMessage {
   private:
-    int _fd;  // The file descriptor of the TCP socket.
-    // The buffer to store characters read from the TCP socket.
-    std::deque<char> _buffer;
-    char _last;  // The last character read from the buffer.
+    std::stringstream &_stream;
 
-  public:
+  protected:
     /**
-     * @brief Constructs a TcpMessage object with the given file descriptor.
+     * @brief Reads a block of characters from the stringstream.
      *
-     * @param fd The file descriptor of the TCP socket.
+     * @param buffer The buffer to read to.
+     * @param size The size of the buffer.
+     * @return The number of characters read, 0 at the end of the stream.
      */
-    TcpMessage(int fd) : _fd(fd){};
+    size_t fill(char *buffer, size_t size) {
+        _stream.read(buffer, (std::streamsize)size);
 
+        return (size_t)_stream.gcount();
+    };
+
+  public:
     /**
-     * @brief Fills the buffer with characters read from the TCP socket.
+     * @brief Constructs a StreamMessage object with the given stringstream.
      *
-     * This function reads characters from the TCP socket and stores them in the
-     * buffer. If an error occurs during reading, a ProtocolException is thrown.
+     * @param stream The stringstream to read from.
      */
-    void fillBuffer() {
-        char buf[128];
+    StreamMessage(std::stringstream &stream) : _stream(stream){};
+};
+
+/**
+ * @brief Represents a message source that reads from a TCP socket.
+ */
+class TcpMessage : public BufferedMessage {
+  private:
+    int _fd;  // The file descriptor of the TCP socket.
 
-        ssize_t n = read(_fd, buf, 128);
+  protected:
+    /**
+     * @brief Reads the characters available on the TCP socket.
+     *
+     * If an error occurs during reading, or the connection was closed, a
+     * ProtocolException is thrown.
+     *
+     * @param buffer The buffer to read to.
+     * @param size The size of the buffer.
+     * @return The number of characters read.
+     */
+    size_t fill(char *buffer, size_t size) {
+        ssize_t n = read(_fd, buffer, size);
 
         if (n <= 0) {
             throw ProtocolViolationException();
         }
 
-        for (int i = 0; i < n; i++) {
-            _buffer.push_back(buf[i]);
-        }
-    }
+        return (size_t)n;
+    };
+
+  public:
+    /**
+     * @brief Constructs a TcpMessage object with the given file descriptor.
+     *
+     * @param fd The file descriptor of the TCP socket.
+     */
+    TcpMessage(int fd) : _fd(fd){};
+};
 
+/**
+ * @brief Byte buffer provided by the caller that messages are encoded to, so
+ * that encoding a message allocates nothing.
+ *
+ * The buffer has a fixed capacity. Like the bytes of a datagram that does not
+ * fit, the bytes written past it are dropped, which overflowed() reports.
+ */
+class MessageBuffer {
+  private:
+    char *_data;               // The storage, owned by the caller
+    size_t _capacity;          // The size of the storage
+    size_t _size = 0;          // The number of bytes written
+    bool _overflowed = false;  // Whether any byte was dropped
+
+  public:
     /**
-     * @brief Gets the next character from the buffer.
+     * @brief Constructs an empty MessageBuffer over the given storage.
      *
-     * If the buffer is empty, this function calls fillBuffer() to read more
-     * characters from the TCP socket. The last character read is stored in the
-     * _last member variable.
+     * @param data The storage.
+     * @param capacity The size of the storage.
+     */
+    MessageBuffer(char *data, size_t capacity)
+        : _data(data), _capacity(capacity){};
+
+    /**
+     * @brief Appends bytes to the buffer, as many as fit.
      *
-     * @return The next character from the buffer.
+     * @param data The bytes.
+     * @param size The number of bytes.
      */
-    char get() {
-        if (_buffer.size() == 0) {
-            fillBuffer();
-        }
+    void write(const char *data, size_t size) {
+        size_t n = std::min(size, _capacity - _size);
+
+        memcpy(_data + _size, data, n);
+        _size += n;
+        _overflowed = _overflowed || n < size;
+    };
 
-        _last = _buffer.front();
-        _buffer.pop_front();
-        return _last;
+    /**
+     * @brief Empties the buffer so that it can be reused.
+     */
+    void clear() {
+        _size = 0;
+        _overflowed = false;
     };
 
     /**
-     * @brief Checks if the TcpMessage is in a good state.
+     * @brief Gets the bytes written.
      *
-     * This function always returns true, indicating that the TcpMessage is in a
-     * good state.
+     * @return The bytes written.
+     */
+    const char *data() { return _data; };
+
+    /**
+     * @brief Gets the number of bytes written.
      *
-     * @return true if the TcpMessage is in a good state, false otherwise.
+     * @return The number of bytes written.
      */
-    bool good() { return true; };
+    size_t size() { return _size; };
 
     /**
-     * @brief Puts the last character back into the buffer.
+     * @brief Checks if bytes were dropped because they did not fit.
      *
-     * This function adds the last character read back to the front of the
-     * buffer. The character can then be read again by calling get().
+     * @return true if the message is incomplete, false otherwise.
      */
-    void unget() { _buffer.push_front(_last); };
+    bool overflowed() { return _overflowed; };
 };
 
 /**
@@ -343,6 +484,14 @@ class ProtocolCommunication {
      */
     int readNumber(MessageSource &message, size_t size);
 
+    /**
+     * @brief Reads a generation from a MessageSource.
+     *
+     * @param message The MessageSource to read from.
+     * @return The generation read from the MessageSource.
+     */
+    uint64_t readGeneration(MessageSource &message);
+
     /**
      * @brief Reads a DateTime from a MessageSource.
      *
@@ -437,6 +586,14 @@ class ProtocolCommunication {
      */
     void writeNumber(std::stringstream &message, int number);
 
+    /**
+     * @brief Writes a generation to stringstream.
+     *
+     * @param message The stringstream to write to.
+     * @param generation The generation to write.
+     */
+    void writeGeneration(std::stringstream &message, uint64_t generation);
+
     /**
      * @brief Writes a DateTime to stringstream.
      *
@@ -485,6 +642,86 @@ class ProtocolCommunication {
      */
     void writeAuctionName(std::stringstream &message, std::string name);
 
+    // The same writers for MessageBuffer, none of them allocates.
+
+    /**
+     * @brief Writes a character to a buffer.
+     *
+     * @param message The buffer to write to.
+     * @param c The character to write.
+     */
+    void writeChar(MessageBuffer &message, char c);
+
+    /**
+     * @brief Writes a delimiter to a buffer.
+     *
+     * @param message The buffer to write to.
+     */
+    void writeDelimiter(MessageBuffer &message);
+
+    /**
+     * @brief Writes a space to a buffer.
+     *
+     * @param message The buffer to write to.
+     */
+    void writeSpace(MessageBuffer &message);
+
+    /**
+     * @brief Writes a string to a buffer.
+     *
+     * @param message The buffer to write to.
+     * @param string The string to write.
+     */
+    void writeString(MessageBuffer &message, std::string_view string);
+
+    /**
+     * @brief Writes a number to a buffer, formatted with to_chars.
+     *
+     * @param message The buffer to write to.
+     * @param number The number to write.
+     */
+    void writeNumber(MessageBuffer &message, int number);
+
+    /**
+     * @brief Writes a generation to a buffer, formatted with to_chars.
+     *
+     * @param message The buffer to write to.
+     * @param generation The generation to write.
+     */
+    void writeGeneration(MessageBuffer &message, uint64_t generation);
+
+    /**
+     * @brief Writes a DateTime to a buffer.
+     *
+     * @param message The buffer to write to.
+     * @param time The time to write.
+     */
+    void writeDateTime(MessageBuffer &message, std::time_t time);
+
+    /**
+     * @brief Writes a UID to a buffer.
+     *
+     * @param message The buffer to write to.
+     * @param uid The UID to write.
+     */
+    void writeUid(MessageBuffer &message, const std::string &uid);
+
+    /**
+     * @brief Writes an AID to a buffer.
+     *
+     * @param message The buffer to write to.
+     * @param aid The AID to write.
+     */
+    void writeAid(MessageBuffer &message, const std::string &aid);
+
+    /**
+     * @brief Writes the auction name to a buffer.
+     *
+     * @param message The buffer to write to.
+     * @param name The name of the auction.
+     */
+    void writeAuctionName(MessageBuffer &message, const std::string &name);
+
     /**
      * @brief Checks if the communication protocol uses TCP.
      *
@@ -684,6 +921,14 @@ class ListUserAuctionsCommunication : public ProtocolCommunication {
      */
     std::stringstream encodeResponse();
 
+    /**
+     * @brief Encodes a list user auctions response into a buffer, without
+     * allocating.
+     *
+     * @param message The buffer to write the response to.
+     */
+    void encodeResponse(MessageBuffer &message);
+
     /**
      * @brief Decodes a list user auctions response from a stringstream.
      *
@@ -736,6 +981,14 @@ class ListUserBidsCommunication : public ProtocolCommunication {
      */
     std::stringstream encodeResponse();
 
+    /**
+     * @brief Encodes a list user bids response into a buffer, without
+     * allocating.
+     *
+     * @param message The buffer to write the response to.
+     */
+    void encodeResponse(MessageBuffer &message);
+
     /**
      * @brief Decodes a list user bids response from a stringstream.
      *
@@ -751,20 +1004,57 @@ class ListUserBidsCommunication : public ProtocolCommunication {
     bool isTcp() { return false; };
 };
 
+/**
+ * @brief Represents a query that may be sent on the condition that its
+ * answer changed.
+ *
+ * A conditional request carries the generation of the response the client
+ * already has, 0 if none, and the server answers with the status "UNC" if
+ * that is still the current generation. Every other response to it carries
+ * the generation right after its status, so that the client can send it back
+ * the next time. Requests that are not conditional, and their responses, are
+ * the same as without the extension.
+ */
+class ConditionalCommunication : public ProtocolCommunication {
+  public:
+    // Request parameters:
+    bool _conditional = false;      // Whether the request is conditional.
+    uint64_t _knownGeneration = 0;  // The generation the client has.
+
+    // Response parameters:
+    std::string _status;       // The status of the response.
+    uint64_t _generation = 0;  // The generation of the response, if any.
+
+    /**
+     * @brief Reads the generation of a conditional request, if the request
+     * has one after the fields read so far.
+     *
+     * @param message The MessageSource to read from.
+     */
+    void decodeCondition(MessageSource &message);
+
+    /**
+     * @brief Writes the generation of a conditional request, if it is one.
+     *
+     * @param message The stringstream to write to.
+     */
+    void encodeCondition(std::stringstream &message);
+};
+
 /**
  * @brief Represents a communication protocol for list all auctions
  * functionality.
  *
- * This class extends the ProtocolCommunication class and provides
+ * This class extends the ConditionalCommunication class and provides
  * request and response parameters for list all auctions communication.
  */
-class ListAllAuctionsCommunication : public ProtocolCommunication {
+class ListAllAuctionsCommunication : public ConditionalCommunication {
   public:
     // Request parameters:
-    // None
+    // Only the condition
 
     // Response parameters:
-    std::string _status;  // The status of the list all auctions response.
+    // _status, and _generation if conditional
     std::map<std::string, std::string> _auctions;  // The list of auctions.
 
     /**
@@ -788,6 +1078,14 @@ class ListAllAuctionsCommunication : public ProtocolCommunication {
      */
     std::stringstream encodeResponse();
 
+    /**
+     * @brief Encodes a list all auctions response into a buffer, without
+     * allocating.
+     *
+     * @param message The buffer to write the response to.
+     */
+    void encodeResponse(MessageBuffer &message);
+
     /**
      * @brief Decodes a list all auctions response from a stringstream.
      *
@@ -807,17 +1105,17 @@ class ListAllAuctionsCommunication : public ProtocolCommunication {
 /**
  * @brief Represents a communication protocol for show record functionality.
  *
- * This class extends the ProtocolCommunication class and provides
+ * This class extends the ConditionalCommunication class and provides
  * request and response parameters for show record communication.
  */
-class ShowRecordCommunication : public ProtocolCommunication {
+class ShowRecordCommunication : public ConditionalCommunication {
   public:
     // Request parameters:
     std::string _aid;  // The auction ID for show record request.
 
     // Response parameters:
+    // _status, and _generation if conditional
     // Auction info
-    std::string _status;         // The status of the show record response.
     std::string _hostUid;        // The host user ID.
     std::string _auctionName;    // The auction name.
     std::string _assetFname;     // The asset file name.
@@ -857,6 +1155,14 @@ class ShowRecordCommunication : public ProtocolCommunication {
      */
     std::stringstream encodeResponse();
 
+    /**
+     * @brief Encodes a show record response into a buffer, without
+     * allocating.
+     *
+     * @param message The buffer to write the response to.
+     */
+    void encodeResponse(MessageBuffer &message);
+
     /**
      * @brief Decodes a show record response from a stringstream.
      *
@@ -909,6 +1215,43 @@ class OpenAuctionCommunication : public ProtocolCommunication {
      */
     void decodeRequest(MessageSource &message);
 
+    /**
+     * @brief Decodes an open auction request, writing the asset file data to
+     * a stream instead of keeping it in _fileData.
+     *
+     * The file data is copied in chunks, so the request is decoded in
+     * constant memory whatever the size of the asset.
+     *
+     * @param message The source containing the open auction request.
+     * @param file The stream that receives the asset file data.
+     */
+    void decodeRequest(MessageSource &message, std::ostream &file);
+
+    /**
+     * @brief Decodes the fields of an open auction request, up to the size of
+     * the asset file, so the request can be rejected before its data is read.
+     *
+     * @param message The source containing the open auction request.
+     */
+    void decodeRequestHeader(MessageSource &message);
+
+    /**
+     * @brief Decodes the rest of an open auction request, once its header is
+     * decoded, writing the asset file data to a stream.
+     *
+     * @param message The source containing the open auction request.
+     * @param file The stream that receives the asset file data.
+     */
+    void decodeRequestFile(MessageSource &message, std::ostream &file);
+
+    /**
+     * @brief Decodes the end of an open auction request, once its header is
+     * decoded, when the asset file data was already received elsewhere.
+     *
+     * @param message The source containing the open auction request.
+     */
+    void decodeRequestEnd(MessageSource &message);
+
     /**
      * @brief Encodes an open auction response into a stringstream.
      *
@@ -1021,6 +1364,14 @@ class ShowAssetCommunication : public ProtocolCommunication {
      */
     std::stringstream encodeResponse();
 
+    /**
+     * @brief Encodes the part of a show asset response that comes before the
+     * asset file data, which is the whole response unless the status is OK.
+     *
+     * @return The encoded response header as a stringstream.
+     */
+    std::stringstream encodeResponseHeader();
+
     /**
      * @brief Decodes a show asset response from a stringstream.
      *
@@ -1036,6 +1387,82 @@ class ShowAssetCommunication : public ProtocolCommunication {
     bool isTcp() { return true; };
 };
 
+/**
+ * @brief Represents a communication protocol for show asset range
+ * functionality.
+ *
+ * This class extends the ProtocolCommunication class and provides request
+ * and response parameters for show asset range communication, which sends
+ * the bytes of the asset file from an offset, so that a download can be split
+ * over several connections and resumed.
+ */
+class ShowAssetRangeCommunication : public ProtocolCommunication {
+  public:
+    // Request parameters:
+    std::string _aid;  // The auction ID for show asset range request.
+    int _offset;       // The offset of the first byte of the range.
+    int _length;       // The requested length, cut at the end of the file.
+
+    // Response parameters:
+    std::string _status;          // The status of the response.
+    std::string _fileName;        // The asset file name.
+    int _fileSize;                // The size of the whole asset file.
+    std::stringstream _fileData;  // The bytes of the range.
+
+    /**
+     * @brief Encodes a show asset range request into a stringstream.
+     *
+     * @return The encoded show asset range request as a stringstream.
+     */
+    std::stringstream encodeRequest();
+
+    /**
+     * @brief Decodes a show asset range request from a stringstream.
+     *
+     * @param message The stringstream containing the request.
+     */
+    void decodeRequest(MessageSource &message);
+
+    /**
+     * @brief Encodes a show asset range response into a stringstream.
+     *
+     * @return The encoded show asset range response as a stringstream.
+     */
+    std::stringstream encodeResponse();
+
+    /**
+     * @brief Encodes the part of a show asset range response that comes
+     * before the bytes of the range, which is the whole response unless the
+     * status is OK.
+     *
+     * @return The encoded response header as a stringstream.
+     */
+    std::stringstream encodeResponseHeader();
+
+    /**
+     * @brief Decodes a show asset range response from a stringstream.
+     *
+     * @param message The stringstream containing the response.
+     */
+    void decodeResponse(MessageSource &message);
+
+    /**
+     * @brief Decodes a show asset range response, writing the bytes of the
+     * range with pwrite() at their offset in a file instead of keeping them.
+     *
+     * @param message The stringstream containing the response.
+     * @param fd The file descriptor of the file written to.
+     */
+    void decodeResponse(MessageSource &message, int fd);
+
+    /**
+     * @brief Checks if the communication protocol uses TCP.
+     *
+     * @return True if the protocol uses TCP, false otherwise.
+     */
+    bool isTcp() { return true; };
+};
+
 /**
  * @brief Represents a communication protocol for bid functionality.
  *
@@ -1089,4 +1516,53 @@ class BidCommunication : public ProtocolCommunication {
     bool isTcp() { return true; };
 };
 
+/**
+ * @brief Represents a communication protocol for keep-alive functionality.
+ *
+ * This class extends the ProtocolCommunication class and provides the
+ * response parameters for keep-alive communication. Once accepted, the TCP
+ * connection stays open for the requests that follow, which may be sent
+ * without waiting for the responses, answered in the order they were sent.
+ */
+class KeepAliveCommunication : public ProtocolCommunication {
+  public:
+    // Response parameters:
+    std::string _status;  // The status of the keep-alive response.
+
+    /**
+     * @brief Encodes a keep-alive request into a stringstream.
+     *
+     * @return The encoded keep-alive request as a stringstream.
+     */
+    std::stringstream encodeRequest();
+
+    /**
+     * @brief Decodes a keep-alive request from a stringstream.
+     *
+     * @param message The stringstream containing the keep-alive request.
+     */
+    void decodeRequest(MessageSource &message);
+
+    /**
+     * @brief Encodes a keep-alive response into a stringstream.
+     *
+     * @return The encoded keep-alive response as a stringstream.
+     */
+    std::stringstream encodeResponse();
+
+    /**
+     * @brief Decodes a keep-alive response from a stringstream.
+     *
+     * @param message The stringstream containing the keep-alive response.
+     */
+    void decodeResponse(MessageSource &message);
+
+    /**
+     * @brief Checks if the communication protocol uses TCP.
+     *
+     * @return True if the protocol uses TCP, false otherwise.
+     */
+    bool isTcp() { return true; };
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,327 @@
+/**
+ * @file schema.hpp
+ * @brief Compile time schemas of the protocol messages.
+ *
+ * This file contains the field types the requests are declared with, and the
+ * Schema template that generates the decoder of a message from the list of
+ * its fields. The widths of the fields are checked when the schema is
+ * compiled, and each decoder reads its fields straight from the buffer of the
+ * message source, without the lookups and checks of the generic helpers.
+ */
+#ifndef __SCHEMA_HPP__
+#define __SCHEMA_HPP__
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "config.hpp"
+#include "protocol.hpp"
+#include "utils.hpp"
+
+#define PROTOCOL_FIELD_STOPS " \n"  // The characters that end a field
+
+/**
+ * @brief  Packs a code of up to 3 characters in an integer, so that codes
+ * can be compared at once, and used as the labels of a switch.
+ * @param  code The code.
+ * @retval the packed code, 0 if it is longer than 3 characters.
+ */
+constexpr uint32_t PackCode(std::string_view code) {
+    if (code.size() > 3) {
+        return 0;
+    }
+
+    uint32_t packed = 0;
+
+    for (char c : code) {
+        packed = (packed << 8) | (unsigned char)c;
+    }
+
+    return packed;
+}
+
+namespace schema {
+
+/**
+ * @brief Character class of the digits.
+ */
+struct Digits {
+    static constexpr bool match(char c) { return c >= '0' && c <= '9'; }
+};
+
+/**
+ * @brief Character class of the letters and digits.
+ */
+struct AlphaNumeric {
+    static constexpr bool match(char c) {
+        return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+               (c >= 'A' && c <= 'Z');
+    }
+};
+
+/**
+ * @brief  Reads a single character, failing past the end of the message.
+ * @param  message The message source.
+ * @retval the character.
+ */
+inline char ReadChar(BufferedMessage &message) {
+    return message.readExact(1)[0];
+}
+
+inline char ReadChar(MessageSource &message) {
+    char c = message.get();
+
+    if (!message.good()) {
+        throw ProtocolViolationException();
+    }
+
+    return c;
+}
+
+/**
+ * @brief Field made of a single expected character.
+ *
+ * @tparam C The character.
+ */
+template <char C> struct Literal {
+    static constexpr bool valued = false;  // Stores nothing
+
+    template <typename Source> static void read(Source &message) {
+        if (ReadChar(message) != C) {
+            throw ProtocolViolationException();
+        }
+    }
+};
+
+typedef Literal<' '> Space;
+typedef Literal<PROTOCOL_MESSAGE_DELIMITER> Delimiter;
+
+/**
+ * @brief Field with exactly Width characters of a character class.
+ *
+ * @tparam Width The width of the field.
+ * @tparam Class The character class, with a static match(char).
+ */
+template <size_t Width, typename Class> struct Fixed {
+    static_assert(Width > 0, "A fixed field has characters");
+    static_assert(Width <= PROTOCOL_MESSAGE_BUFFER_SIZE,
+                  "A fixed field is read from the buffer at once");
+
+    typedef std::string Value;
+    static constexpr bool valued = true;
+
+    static Value read(BufferedMessage &message) {
+        std::string_view field = message.readExact(Width);
+
+        for (char c : field) {
+            if (!Class::match(c)) {  // Also too short, the stop is read
+                throw ProtocolViolationException();
+            }
+        }
+
+        return Value(field);
+    }
+
+    static Value read(MessageSource &message) {
+        Value field;
+
+        for (size_t i = 0; i < Width; i++) {
+            char c = ReadChar(message);
+
+            if (!Class::match(c)) {
+                throw ProtocolViolationException();
+            }
+            field.push_back(c);
+        }
+
+        return field;
+    }
+};
+
+typedef Fixed<PROTOCOL_UID_SIZE, Digits> Uid;
+typedef Fixed<PROTOCOL_PASSWORD_SIZE, AlphaNumeric> Password;
+typedef Fixed<PROTOCOL_AID_SIZE, AlphaNumeric> Aid;
+
+/**
+ * @brief Field with a decimal number of 1 to MaxWidth digits.
+ *
+ * @tparam MaxWidth The maximum number of digits.
+ * @tparam Type The integer type of the number.
+ */
+template <size_t MaxWidth, typename Type = int> struct Number {
+    static_assert(MaxWidth > 0, "A number has digits");
+    static_assert(MaxWidth <= (size_t)std::numeric_limits<Type>::digits10,
+                  "Every number of the field fits its type");
+
+    typedef Type Value;
+    static constexpr bool valued = true;
+
+    /**
+     * @brief  Converts the digits of the field, that cannot overflow.
+     * @param  field The field.
+     * @retval the number.
+     */
+    static Value parse(std::string_view field) {
+        if (field.empty()) {
+            throw ProtocolViolationException();
+        }
+
+        Value number = 0;
+
+        for (char c : field) {
+            if (!Digits::match(c)) {
+                throw ProtocolViolationException();
+            }
+            number = number * 10 + (Value)(c - '0');
+        }
+
+        return number;
+    }
+
+    static Value read(BufferedMessage &message) {
+        return parse(message.readUntil(PROTOCOL_FIELD_STOPS, MaxWidth));
+    }
+
+    static Value read(MessageSource &message) {
+        char field[MaxWidth];
+        size_t size = 0;
+
+        while (size < MaxWidth) {
+            char c = ReadChar(message);
+
+            if (c == ' ' || c == PROTOCOL_MESSAGE_DELIMITER) {
+                message.unget();  // The stop belongs to the next field
+                break;
+            }
+            field[size++] = c;
+        }
+
+        return parse(std::string_view(field, size));
+    }
+};
+
+typedef Number<PROTOCOL_GENERATION_SIZE, uint64_t> Generation;
+
+/**
+ * @brief Field with a name of 1 to MaxWidth characters, checked as a whole.
+ *
+ * @tparam MaxWidth The maximum number of characters.
+ * @tparam Valid The check of the name.
+ */
+template <size_t MaxWidth, bool (*Valid)(std::string)> struct Name {
+    static_assert(MaxWidth > 0, "A name has characters");
+    static_assert(MaxWidth <= PROTOCOL_MESSAGE_BUFFER_SIZE,
+                  "A name is read from the buffer at once");
+
+    typedef std::string Value;
+    static constexpr bool valued = true;
+
+    static Value check(Value name) {
+        if (name.empty() || !Valid(name)) {
+            throw ProtocolViolationException();
+        }
+
+        return name;
+    }
+
+    static Value read(BufferedMessage &message) {
+        return check(
+            Value(message.readUntil(PROTOCOL_FIELD_STOPS, MaxWidth)));
+    }
+
+    static Value read(MessageSource &message) {
+        Value name;
+
+        while (name.size() < MaxWidth) {
+            char c = ReadChar(message);
+
+            if (c == ' ' || c == PROTOCOL_MESSAGE_DELIMITER) {
+                message.unget();  // The stop belongs to the next field
+                break;
+            }
+            name.push_back(c);
+        }
+
+        return check(name);
+    }
+};
+
+typedef Name<PROTOCOL_AUCTIONNAME_SIZE, isValidAuctionName> AuctionName;
+typedef Name<PROTOCOL_FNAME_SIZE, isValidFileName> FileName;
+
+/**
+ * @brief Decoder of a list of fields, peeling one field at a time.
+ */
+template <typename... Fields> struct FieldList {
+    static constexpr size_t valueCount = 0;
+
+    template <typename Source> static void decode(Source &message) {
+        (void)message;
+    }
+};
+
+template <typename Field, typename... Rest> struct FieldList<Field, Rest...> {
+    static constexpr size_t valueCount =
+        (Field::valued ? 1 : 0) + FieldList<Rest...>::valueCount;
+
+    template <typename Source, typename... Values>
+    static void decode(Source &message, Values &...values) {
+        if constexpr (Field::valued) {
+            decodeValue(message, values...);
+        } else {
+            Field::read(message);
+            FieldList<Rest...>::decode(message, values...);
+        }
+    }
+
+    template <typename Source, typename Value, typename... Values>
+    static void decodeValue(Source &message, Value &value,
+                            Values &...values) {
+        static_assert(std::is_same<Value, typename Field::Value>::value,
+                      "The value has the type of its field");
+
+        value = Field::read(message);
+        FieldList<Rest...>::decode(message, values...);
+    }
+};
+
+/**
+ * @brief Schema of a message, declared as the list of its fields, that
+ * decodes the message to one value per valued field, in order.
+ *
+ * @tparam Fields The fields of the message, after its code.
+ */
+template <typename... Fields> struct Schema {
+    static constexpr size_t valueCount = FieldList<Fields...>::valueCount;
+
+    /**
+     * @brief Decodes a message from a message source.
+     *
+     * Reads from the buffer of the message source when it has one, and a
+     * character at a time otherwise. A ProtocolViolationException is thrown
+     * if the message does not match the schema.
+     *
+     * @param message The message source.
+     * @param values Where the values of the fields are stored.
+     */
+    template <typename... Values>
+    static void decode(MessageSource &message, Values &...values) {
+        static_assert(sizeof...(Values) == valueCount,
+                      "Every valued field is stored");
+
+        BufferedMessage *buffered = dynamic_cast<BufferedMessage *>(&message);
+
+        if (buffered != NULL) {
+            FieldList<Fields...>::decode(*buffered, values...);
+        } else {
+            FieldList<Fields...>::decode(message, values...);
+        }
+    }
+};
+
+}  // namespace schema
+
+#endif
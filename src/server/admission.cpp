@@ -0,0 +1,225 @@
+/**
+ * @file admission.cpp
+ * @brief Implementation of the admission control of the server.
+ */
+#include "admission.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+#include <time.h>
+
+#include "database.hpp"
+
+#define ADMISSION_SETS (SERVER_ADMISSION_CLIENTS / SERVER_ADMISSION_WAYS)
+
+static_assert(SERVER_ADMISSION_CLIENTS % SERVER_ADMISSION_WAYS == 0,
+              "The buckets are split in whole sets");
+
+/**
+ * @brief  Gets the time of the monotonic clock, shared by every process.
+ * @retval the time in ns.
+ */
+static int64_t Now() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * @brief  Adds to a counter of the shared table, unless it would go past a
+ * limit.
+ * @param  counter The counter.
+ * @param  value The value added.
+ * @param  limit The maximum value of the counter.
+ * @retval true if it was added, false otherwise.
+ */
+static bool AddWithin(uint64_t &counter, uint64_t value, uint64_t limit) {
+    uint64_t current = __atomic_load_n(&counter, __ATOMIC_RELAXED);
+
+    do {
+        if (current + value > limit) {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&counter, &current, current + value,
+                                          true, __ATOMIC_RELAXED,
+                                          __ATOMIC_RELAXED));
+
+    return true;
+}
+
+AdmissionControl::AdmissionControl(double rate, double burst)
+    : _rate(rate), _burst(std::max(burst, 1.0)) {
+    // Anonymous shared mapping, inherited by every process forked afterwards
+    void *table = mmap(NULL, sizeof(AdmissionTable), PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (table == MAP_FAILED) {
+        throw DatabaseException("Could not allocate the admission control");
+    }
+
+    _table = (AdmissionTable *)table;
+
+    pthread_mutexattr_t attributes;
+
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+
+    bool failed = false;
+    for (size_t i = 0; i < SERVER_ADMISSION_LOCKS; i++) {
+        failed = failed ||
+                 pthread_mutex_init(&_table->locks[i], &attributes) != 0;
+    }
+
+    pthread_mutexattr_destroy(&attributes);
+
+    if (failed) {
+        munmap(_table, sizeof(AdmissionTable));
+        throw DatabaseException("Could not initialize the admission control");
+    }
+}
+
+AdmissionControl::~AdmissionControl() {
+    // The mutexes are not destroyed, other processes may still be using them
+    munmap(_table, sizeof(AdmissionTable));
+}
+
+size_t AdmissionControl::lockSet(const std::string &ip) {
+    size_t set = std::hash<std::string>()(ip) % ADMISSION_SETS;
+
+    pthread_mutex_lock(&_table->locks[set % SERVER_ADMISSION_LOCKS]);
+    return set * SERVER_ADMISSION_WAYS;
+}
+
+void AdmissionControl::unlockSet(size_t set) {
+    size_t index = set / SERVER_ADMISSION_WAYS;
+
+    pthread_mutex_unlock(&_table->locks[index % SERVER_ADMISSION_LOCKS]);
+}
+
+ClientBucket *AdmissionControl::findBucket(size_t set, const std::string &ip,
+                                           int64_t now) {
+    ClientBucket *buckets = &_table->buckets[set];
+    ClientBucket *bucket = NULL;  // The bucket of the client
+    ClientBucket *victim = NULL;  // The slot taken over otherwise
+
+    for (size_t i = 0; i < SERVER_ADMISSION_WAYS && bucket == NULL; i++) {
+        if (strncmp(buckets[i].ip, ip.c_str(), sizeof(buckets[i].ip)) == 0) {
+            bucket = &buckets[i];
+        } else if (buckets[i].sessions == 0 &&
+                   (victim == NULL ||
+                    buckets[i].refilled < victim->refilled)) {
+            victim = &buckets[i];  // Free slots were never refilled
+        }
+    }
+
+    if (bucket == NULL) {
+        if (victim == NULL) {  // Every client of the set has sessions open
+            return NULL;
+        }
+
+        bucket = victim;
+        memset(bucket, 0, sizeof(ClientBucket));
+        strncpy(bucket->ip, ip.c_str(), sizeof(bucket->ip) - 1);
+        bucket->tokens = _burst;
+        bucket->refilled = now;
+    }
+
+    double elapsed = (double)(now - bucket->refilled) / 1e9;
+
+    bucket->tokens = std::min(_burst, bucket->tokens + elapsed * _rate);
+    bucket->refilled = now;
+
+    return bucket;
+}
+
+bool AdmissionControl::admitRequest(const std::string &ip) {
+    if (_rate <= 0) {  // The requests are not limited
+        return true;
+    }
+
+    size_t set = lockSet(ip);
+    ClientBucket *bucket = findBucket(set, ip, Now());
+    bool admitted = false;
+
+    if (bucket != NULL && bucket->tokens >= 1) {
+        bucket->tokens -= 1;
+        admitted = true;
+    }
+
+    unlockSet(set);
+    return admitted;
+}
+
+bool AdmissionControl::openSession(const std::string &ip) {
+    if (!AddWithin(_table->sessions, 1, SERVER_MAX_TCP_SESSIONS)) {
+        return false;
+    }
+
+    size_t set = lockSet(ip);
+    ClientBucket *bucket = findBucket(set, ip, Now());
+    bool admitted = false;
+
+    if (bucket != NULL && bucket->sessions < SERVER_MAX_CLIENT_SESSIONS &&
+        (_rate <= 0 || bucket->tokens >= 1)) {
+        if (_rate > 0) {
+            bucket->tokens -= 1;
+        }
+        bucket->sessions++;
+        admitted = true;
+    }
+
+    unlockSet(set);
+
+    if (!admitted) {
+        __atomic_fetch_sub(&_table->sessions, 1, __ATOMIC_RELAXED);
+    }
+
+    return admitted;
+}
+
+void AdmissionControl::closeSession(const std::string &ip) {
+    size_t set = lockSet(ip);
+    ClientBucket *bucket = findBucket(set, ip, Now());
+
+    // Never evicted while it has sessions, so the bucket is still there
+    if (bucket != NULL && bucket->sessions > 0) {
+        bucket->sessions--;
+    }
+
+    unlockSet(set);
+    __atomic_fetch_sub(&_table->sessions, 1, __ATOMIC_RELAXED);
+}
+
+bool AdmissionControl::reserveUpload(size_t bytes) {
+    return AddWithin(_table->uploadBytes, bytes, SERVER_MAX_UPLOAD_BYTES);
+}
+
+void AdmissionControl::releaseUpload(size_t bytes) {
+    __atomic_fetch_sub(&_table->uploadBytes, bytes, __ATOMIC_RELAXED);
+}
+
+thread_local size_t UploadReservation::_covered = 0;
+
+UploadReservation::UploadReservation(AdmissionControl &admission,
+                                     size_t bytes)
+    : _admission(admission), _bytes(bytes) {
+    if (_bytes <= _covered) {  // Reserved once the header was received
+        _bytes = 0;
+        return;
+    }
+
+    if (!_admission.reserveUpload(_bytes)) {
+        throw AdmissionException();
+    }
+}
+
+UploadReservation::~UploadReservation() {
+    _admission.releaseUpload(_bytes);
+}
+
+void UploadReservation::setCovered(size_t bytes) {
+    _covered = bytes;
+}
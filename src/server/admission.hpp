@@ -0,0 +1,195 @@
+/**
+ * @file admission.hpp
+ * @brief Header file for the admission control of the server.
+ *
+ * This file contains the declaration of the AdmissionControl class, that
+ * decides whether the requests and connections of a client are handled at
+ * all, before any of their bytes are parsed, so that a client flooding the
+ * server cannot take the processes and workers of the others.
+ */
+#ifndef __ADMISSION_HPP__
+#define __ADMISSION_HPP__
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "config.hpp"
+
+/**
+ * @brief The token bucket and the sessions of a single client.
+ */
+struct ClientBucket {
+    char ip[INET_ADDRSTRLEN];  // The IP address, empty if the slot is free
+    double tokens;             // The requests the client can still send
+    int64_t refilled;          // When the tokens were refilled, in ns
+    uint32_t sessions;         // The TCP sessions the client has open
+};
+
+/**
+ * @brief The shared memory table of the admission control.
+ *
+ * The buckets are split in sets of SERVER_ADMISSION_WAYS, and a client is
+ * only ever kept in the set its address hashes to, guarded by one of the
+ * striped locks.
+ */
+struct AdmissionTable {
+    pthread_mutex_t locks[SERVER_ADMISSION_LOCKS];  // Guard the sets
+    uint64_t sessions;     // The TCP sessions open, updated atomically
+    uint64_t uploadBytes;  // The bytes of the uploads being received
+    ClientBucket buckets[SERVER_ADMISSION_CLIENTS];
+};
+
+/**
+ * @brief Admission control shared by every process of the server.
+ *
+ * Every client has a token bucket, refilled at the rate of the server up to
+ * its burst, and each request takes a token. The TCP sessions are capped in
+ * total and per client, and so are the bytes of the uploads received at
+ * once. The table is mapped as shared memory before the server forks, so
+ * the limits hold across every process and thread.
+ *
+ * A client whose bucket is full and that has no sessions is no different
+ * from one never seen, so its slot is reused by the next client of the set.
+ * If the whole set is in use, the slot refilled the longest ago is taken
+ * over, unless every client of the set has sessions open, in which case the
+ * new client is rejected.
+ */
+class AdmissionControl {
+  private:
+    AdmissionTable *_table;  // The shared table
+    double _rate;            // The tokens added per second, 0 for no limit
+    double _burst;           // The maximum number of tokens of a bucket
+
+    /**
+     * @brief  Gets the set of a client, with its lock held.
+     * @param  ip The IP address of the client.
+     * @retval the index of the first bucket of the set.
+     */
+    size_t lockSet(const std::string &ip);
+
+    /**
+     * @brief  Releases the lock of a set.
+     * @param  set The index of the first bucket of the set.
+     */
+    void unlockSet(size_t set);
+
+    /**
+     * @brief  Finds the bucket of a client in its locked set, taking a slot
+     * for it if it has none, and refills its tokens.
+     * @param  set The index of the first bucket of the set.
+     * @param  ip The IP address of the client.
+     * @param  now The current time, in ns.
+     * @retval the bucket, NULL if every slot of the set has sessions open.
+     */
+    ClientBucket *findBucket(size_t set, const std::string &ip, int64_t now);
+
+  public:
+    /**
+     * @brief  Maps the shared memory table, with every bucket free.
+     * @param  rate The requests per second of each client, 0 for no limit.
+     * @param  burst The requests a client can send at once.
+     */
+    AdmissionControl(double rate = SERVER_RATE_LIMIT,
+                     double burst = SERVER_RATE_BURST);
+
+    /**
+     * @brief  Unmaps the shared memory table.
+     */
+    ~AdmissionControl();
+
+    AdmissionControl(const AdmissionControl &) = delete;
+    AdmissionControl &operator=(const AdmissionControl &) = delete;
+
+    /**
+     * @brief  Takes a token from the bucket of a client for a request.
+     * @param  ip The IP address of the client.
+     * @retval true if the request is admitted, false if it is rejected.
+     */
+    bool admitRequest(const std::string &ip);
+
+    /**
+     * @brief  Opens a TCP session of a client, which counts as its first
+     * request, within the caps of sessions.
+     * @param  ip The IP address of the client.
+     * @retval true if the session is admitted, false if it is rejected.
+     */
+    bool openSession(const std::string &ip);
+
+    /**
+     * @brief  Closes a TCP session opened by openSession.
+     * @param  ip The IP address of the client.
+     */
+    void closeSession(const std::string &ip);
+
+    /**
+     * @brief  Reserves the bytes of an upload, within the cap of the bytes
+     * received at once.
+     * @param  bytes The size of the upload.
+     * @retval true if the upload is admitted, false if it is rejected.
+     */
+    bool reserveUpload(size_t bytes);
+
+    /**
+     * @brief  Releases the bytes reserved by reserveUpload.
+     * @param  bytes The size of the upload.
+     */
+    void releaseUpload(size_t bytes);
+};
+
+/**
+ * @brief Reservation of the bytes of an upload, released when destroyed.
+ */
+class UploadReservation {
+  private:
+    static thread_local size_t _covered;  // Reserved for the thread's request
+    AdmissionControl &_admission;  // The admission control reserved from
+    size_t _bytes;                 // The bytes reserved
+
+  public:
+    /**
+     * @brief  Reserves the bytes of an upload, unless they were reserved
+     * already for the request handled by the thread.
+     * @param  admission The admission control.
+     * @param  bytes The size of the upload.
+     * @throws AdmissionException if the upload is rejected.
+     */
+    UploadReservation(AdmissionControl &admission, size_t bytes);
+
+    /**
+     * @brief  Releases the bytes reserved.
+     */
+    ~UploadReservation();
+
+    /**
+     * @brief  Gets the bytes reserved.
+     * @retval the bytes.
+     */
+    size_t getBytes() { return _bytes; };
+
+    /**
+     * @brief  Sets the bytes reserved before the request handled by the
+     * thread was parsed, which its upload then takes without reserving them
+     * again.
+     * @param  bytes The bytes, 0 for none.
+     */
+    static void setCovered(size_t bytes);
+
+    UploadReservation(const UploadReservation &) = delete;
+    UploadReservation &operator=(const UploadReservation &) = delete;
+};
+
+/**
+ * @brief Exception thrown when a request is rejected by the admission
+ * control.
+ */
+class AdmissionException : public std::runtime_error {
+  public:
+    AdmissionException() : std::runtime_error("Request rejected") {}
+};
+
+#endif
@@ -0,0 +1,82 @@
+/**
+ * @file asset.cpp
+ * @brief Implementation of the cache of the auction assets.
+ */
+#include "asset.hpp"
+
+#include <fcntl.h>
+
+CachedAsset::CachedAsset(std::string fileName, int fd, size_t size)
+    : _fileName(fileName), _fd(fd), _size(size), _data(NULL) {
+    if (_size > 0) {  // Empty files cannot be mapped
+        _data = mmap(NULL, _size, PROT_READ, MAP_SHARED, _fd, 0);
+
+        if (_data == MAP_FAILED) {  // Still usable through the file
+            _data = NULL;
+        }
+    }
+}
+
+CachedAsset::~CachedAsset() {
+    if (_data != NULL) {
+        munmap(_data, _size);
+    }
+    close(_fd);
+}
+
+int CachedAsset::duplicate() {
+    return fcntl(_fd, F_DUPFD_CLOEXEC, 0);
+}
+
+AssetCache::AssetCache(size_t budget) : _budget(budget) {}
+
+void AssetCache::setBudget(size_t budget) {
+    std::lock_guard<std::mutex> guard(_mutex);
+
+    _budget = budget;
+
+    while (_used > _budget) {  // Evict the least recently used
+        _used -= _entries.back().second->getSize();
+        _lookup.erase(_entries.back().first);
+        _entries.pop_back();
+    }
+}
+
+std::shared_ptr<CachedAsset> AssetCache::get(std::string aid) {
+    std::lock_guard<std::mutex> guard(_mutex);
+
+    auto entry = _lookup.find(aid);
+
+    if (entry == _lookup.end()) {
+        return NULL;
+    }
+
+    _entries.splice(_entries.begin(), _entries, entry->second);
+    return entry->second->second;
+}
+
+void AssetCache::put(std::string aid, std::shared_ptr<CachedAsset> asset) {
+    std::lock_guard<std::mutex> guard(_mutex);
+
+    if (asset->getSize() > _budget || _lookup.count(aid) != 0) {
+        return;  // Too big, or cached by another thread in the meantime
+    }
+
+    while (_used + asset->getSize() > _budget) {  // Evict the least recently
+        _used -= _entries.back().second->getSize();
+        _lookup.erase(_entries.back().first);
+        _entries.pop_back();
+    }
+
+    _entries.emplace_front(aid, asset);
+    _lookup[aid] = _entries.begin();
+    _used += asset->getSize();
+}
+
+void AssetCache::clear() {
+    std::lock_guard<std::mutex> guard(_mutex);
+
+    _entries.clear();
+    _lookup.clear();
+    _used = 0;
+}
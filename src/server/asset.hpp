@@ -0,0 +1,131 @@
+/**
+ * @file asset.hpp
+ * @brief Header file for the cache of the auction assets.
+ *
+ * This file contains the declaration of the AssetCache class, that keeps the
+ * assets requested recently open and mapped in memory, so that sending them
+ * again never looks them up on the disk.
+ */
+#ifndef __ASSET_HPP__
+#define __ASSET_HPP__
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "config.hpp"
+
+/**
+ * @brief An asset kept open by the cache.
+ *
+ * The file is unmapped and closed once the cache and every request using it
+ * let it go, so an asset evicted while it is being sent stays valid.
+ */
+class CachedAsset {
+  private:
+    std::string _fileName;  // The name of the asset file
+    int _fd;                // The open asset file
+    size_t _size;           // The size of the asset file
+    void *_data;            // The mapping of the file, NULL if not mapped
+
+  public:
+    /**
+     * @brief  Maps an open asset file, taking ownership of it.
+     * @param  fileName The name of the asset file.
+     * @param  fd The file descriptor.
+     * @param  size The size of the file.
+     */
+    CachedAsset(std::string fileName, int fd, size_t size);
+
+    /**
+     * @brief  Unmaps and closes the asset file.
+     */
+    ~CachedAsset();
+
+    CachedAsset(const CachedAsset &) = delete;
+    CachedAsset &operator=(const CachedAsset &) = delete;
+
+    /**
+     * @brief  Gets the name of the asset file.
+     * @retval the name.
+     */
+    std::string getFileName() { return _fileName; }
+
+    /**
+     * @brief  Gets the size of the asset file.
+     * @retval the size in bytes.
+     */
+    size_t getSize() { return _size; }
+
+    /**
+     * @brief  Gets the contents of the asset file.
+     * @retval pointer to the mapping, NULL if the file is empty or could not
+     * be mapped.
+     */
+    const char *getData() { return (const char *)_data; }
+
+    /**
+     * @brief  Opens the asset file again, for a caller that closes it.
+     * @retval a new file descriptor of the file, -1 on failure.
+     */
+    int duplicate();
+};
+
+/**
+ * @brief Least recently used cache of the assets, addressed by AID.
+ *
+ * The assets never change once their auction exists, so entries are only
+ * evicted to stay within the byte budget, or dropped when the database is
+ * wiped. The cache is shared by the threads of a process, and guarded by a
+ * mutex of its own; the mappings share the page cache of the files with every
+ * other process.
+ */
+class AssetCache {
+  private:
+    typedef std::pair<std::string, std::shared_ptr<CachedAsset>> Entry;
+
+    std::mutex _mutex;
+    size_t _budget;     // The maximum number of bytes mapped
+    size_t _used = 0;   // The number of bytes mapped
+    std::list<Entry> _entries;  // The most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> _lookup;
+
+  public:
+    /**
+     * @brief  Constructs an empty cache.
+     * @param  budget The maximum number of bytes mapped, 0 to cache nothing.
+     */
+    AssetCache(size_t budget = SERVER_ASSET_CACHE_SIZE);
+
+    /**
+     * @brief  Sets the byte budget, evicting the assets past it.
+     * @param  budget The maximum number of bytes mapped, 0 to cache nothing.
+     */
+    void setBudget(size_t budget);
+
+    /**
+     * @brief  Gets the asset of an auction, marking it as recently used.
+     * @param  aid The auction's AID.
+     * @retval the asset, NULL if it is not cached.
+     */
+    std::shared_ptr<CachedAsset> get(std::string aid);
+
+    /**
+     * @brief  Caches the asset of an auction, if it fits the budget.
+     * @param  aid The auction's AID.
+     * @param  asset The asset.
+     */
+    void put(std::string aid, std::shared_ptr<CachedAsset> asset);
+
+    /**
+     * @brief  Drops every asset.
+     */
+    void clear();
+};
+
+#endif
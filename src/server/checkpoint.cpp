@@ -0,0 +1,331 @@
+/**
+ * @file checkpoint.cpp
+ * @brief Implementation of the checkpoint of the in-memory tables.
+ */
+#include "checkpoint.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief  Computes the checksum of a checkpoint, of every byte after the
+ * checksum field.
+ * @param  data The checkpoint.
+ * @retval the FNV-1a hash of the bytes.
+ */
+static uint32_t Checksum(const std::string &data) {
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = sizeof(uint32_t); i < data.size(); i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief  Syncs a directory, so that the entries added or removed survive a
+ * crash.
+ * @param  path The directory.
+ * @retval true if it was synced, false otherwise.
+ */
+static bool SyncDirectory(fs::path path) {
+    int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (fd == -1) {
+        return false;
+    }
+
+    bool synced = fsync(fd) == 0;
+    close(fd);
+
+    return synced;
+}
+
+IndexCheckpoint::IndexCheckpoint(fs::path path, AuctionIndex &index,
+                                 SessionTable &sessions, bool journaled)
+    : _path(path), _index(index), _sessions(sessions), _journaled(journaled) {
+    // Anonymous shared mapping, inherited by every process forked afterwards
+    void *state = mmap(NULL, sizeof(CheckpointState), PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (state == MAP_FAILED) {
+        throw DatabaseException("Could not allocate the checkpoint");
+    }
+
+    _state = (CheckpointState *)state;
+    memset(_state, 0, sizeof(CheckpointState));
+
+    pthread_mutexattr_t attributes;
+
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+
+    bool failed = pthread_mutex_init(&_state->mutex, &attributes) != 0;
+
+    pthread_mutexattr_destroy(&attributes);
+
+    if (failed) {
+        munmap(_state, sizeof(CheckpointState));
+        throw DatabaseException("Could not initialize the checkpoint");
+    }
+}
+
+IndexCheckpoint::~IndexCheckpoint() {
+    // The mutex is not destroyed, other processes may still be using it
+    munmap(_state, sizeof(CheckpointState));
+}
+
+bool IndexCheckpoint::load() {
+    int fd = open(_path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat fileStat;
+    std::string data;
+
+    if (fd == -1) {
+        return false;
+    }
+
+    if (fstat(fd, &fileStat) == 0) {
+        data.resize((size_t)fileStat.st_size);
+        if (pread(fd, data.data(), data.size(), 0) != (ssize_t)data.size()) {
+            data.clear();
+        }
+    }
+    close(fd);
+
+    CheckpointHeader header;
+
+    if (data.size() < sizeof(header)) {  // Missing, or cut short
+        return false;
+    }
+
+    memcpy(&header, data.data(), sizeof(header));
+
+    size_t size = sizeof(header) +
+                  (size_t)header.auctions * sizeof(CheckpointAuction) +
+                  (size_t)header.users * sizeof(CheckpointUser);
+
+    if (memcmp(header.magic, DATABASE_CHECKPOINT_MAGIC,
+               sizeof(header.magic)) != 0 ||
+        header.version != DATABASE_CHECKPOINT_VERSION ||
+        header.auctions > DATABASE_MAX_AUCTIONS ||
+        header.users > DATABASE_MAX_USERS || data.size() != size ||
+        header.checksum != Checksum(data)) {
+        return false;
+    }
+
+    if (header.journaled != 0 && !_journaled) {
+        return false;  // The changes after it are only in the journal
+    }
+
+    const char *next = data.data() + sizeof(header);
+
+    for (uint32_t i = 0; i < header.auctions; i++) {
+        CheckpointAuction auction;
+        memcpy(&auction, next, sizeof(auction));
+        next += sizeof(auction);
+
+        if (auction.aid < 0 || auction.aid >= DATABASE_MAX_AUCTIONS) {
+            _index.clear();
+            return false;
+        }
+        _index.restoreEntry(auction.aid, auction.entry);
+    }
+
+    for (uint32_t i = 0; i < header.users; i++) {
+        CheckpointUser user;
+        memcpy(&user, next, sizeof(user));
+        next += sizeof(user);
+
+        if (user.uid < 0 || user.uid >= DATABASE_MAX_USERS) {
+            _index.clear();
+            _sessions.clear();
+            return false;
+        }
+        _sessions.restoreEntry(user.uid, user.entry);
+    }
+
+    // Without a journal nothing changed since, it is only written again once
+    // something does; with one, the records replayed are not in it
+    _state->current = !_journaled;
+    _state->saved = _state->changes;
+
+    return true;
+}
+
+bool IndexCheckpoint::save() {
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    header.version = DATABASE_CHECKPOINT_VERSION;
+    header.journaled = _journaled ? 1 : 0;
+    memcpy(header.magic, DATABASE_CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.written = (int64_t)time(NULL);
+
+    std::string data((const char *)&header, sizeof(header));
+
+    for (int aid = 0; aid <= _index.getLastAid(); aid++) {
+        CheckpointAuction auction;
+        memset(&auction, 0, sizeof(auction));
+        auction.aid = aid;
+        auction.entry = _index.copyEntry(aid);
+
+        if (auction.entry.exists) {
+            data.append((const char *)&auction, sizeof(auction));
+            header.auctions++;
+        }
+    }
+
+    for (int uid = 0; uid < DATABASE_MAX_USERS; uid++) {
+        CheckpointUser user;
+        memset(&user, 0, sizeof(user));
+        user.uid = uid;
+        user.entry = _sessions.copyEntry(uid);
+
+        if (user.entry.state != SessionState::Absent) {
+            data.append((const char *)&user, sizeof(user));
+            header.users++;
+        }
+    }
+
+    memcpy(data.data(), &header, sizeof(header));
+    header.checksum = Checksum(data);
+    memcpy(data.data(), &header.checksum, sizeof(header.checksum));
+
+    fs::path temporaryPath = _path.string() + ".tmp";
+    int fd = open(temporaryPath.c_str(),
+                  O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd == -1) {
+        return false;
+    }
+
+    bool written =
+        ::write(fd, data.data(), data.size()) == (ssize_t)data.size() &&
+        fsync(fd) == 0;
+    close(fd);
+
+    // Replaces the old checkpoint at once, a crash leaves one or the other
+    if (!written || rename(temporaryPath.c_str(), _path.c_str()) == -1) {
+        unlink(temporaryPath.c_str());
+        return false;
+    }
+
+    return SyncDirectory(_path.parent_path());
+}
+
+void IndexCheckpoint::remove() {
+    if (unlink(_path.c_str()) == -1 && errno != ENOENT) {
+        throw DatabaseException("Could not remove the checkpoint");
+    }
+
+    // Gone before the change is made, or it would be loaded after a crash
+    if (!SyncDirectory(_path.parent_path())) {
+        throw DatabaseException("Could not remove the checkpoint");
+    }
+}
+
+bool IndexCheckpoint::write() {
+    pthread_mutex_lock(&_state->mutex);
+
+    uint64_t changes = __atomic_load_n(&_state->changes, __ATOMIC_SEQ_CST);
+
+    if (_state->current && _state->saved == changes) {
+        pthread_mutex_unlock(&_state->mutex);
+        return true;  // Nothing changed since it was written
+    }
+
+    // Changes that start from now on wait for the file to be written, then
+    // remove it
+    __atomic_store_n(&_state->writing, true, __ATOMIC_SEQ_CST);
+    changes = __atomic_load_n(&_state->changes, __ATOMIC_SEQ_CST);
+
+    // The journal has the changes the copy may have caught halfway, without
+    // it the copy is only consistent if no change is being made
+    bool written = (_journaled || __atomic_load_n(&_state->active,
+                                                  __ATOMIC_SEQ_CST) == 0) &&
+                   save();
+    bool outdated;  // Whether a file left on the disk misses changes
+
+    if (_journaled) {  // The journal is emptied next, even if it failed
+        outdated = !written;
+    } else {  // A change may have started while the tables were copied
+        outdated = written &&
+                   __atomic_load_n(&_state->changes, __ATOMIC_SEQ_CST) !=
+                       changes;
+    }
+
+    if (outdated) {
+        written = false;
+        try {
+            remove();
+        } catch (DatabaseException const &e) {
+            __atomic_store_n(&_state->writing, false, __ATOMIC_SEQ_CST);
+            pthread_mutex_unlock(&_state->mutex);
+            throw;
+        }
+    }
+
+    _state->current = written;
+    _state->saved = changes;
+    __atomic_store_n(&_state->writing, false, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_unlock(&_state->mutex);
+
+    return written;
+}
+
+void IndexCheckpoint::beginChange() {
+    __atomic_add_fetch(&_state->active, 1, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&_state->changes, 1, __ATOMIC_SEQ_CST);
+
+    if (_journaled) {  // Recorded by the journal, the checkpoint stays valid
+        return;
+    }
+
+    if (!__atomic_load_n(&_state->writing, __ATOMIC_SEQ_CST) &&
+        !__atomic_load_n(&_state->current, __ATOMIC_SEQ_CST)) {
+        return;  // No checkpoint on the disk, nor one about to be
+    }
+
+    pthread_mutex_lock(&_state->mutex);
+
+    try {
+        if (_state->current) {
+            remove();
+            _state->current = false;
+        }
+    } catch (DatabaseException const &e) {
+        pthread_mutex_unlock(&_state->mutex);
+        endChange();
+        throw;
+    }
+
+    pthread_mutex_unlock(&_state->mutex);
+}
+
+void IndexCheckpoint::endChange() {
+    __atomic_sub_fetch(&_state->active, 1, __ATOMIC_SEQ_CST);
+}
+
+void IndexCheckpoint::invalidate() {
+    __atomic_add_fetch(&_state->changes, 1, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_lock(&_state->mutex);
+    _state->current = false;  // The file was removed along with the rest
+    pthread_mutex_unlock(&_state->mutex);
+}
+
+CheckpointChange::CheckpointChange(IndexCheckpoint &checkpoint)
+    : _checkpoint(checkpoint) {
+    _checkpoint.beginChange();
+}
+
+CheckpointChange::~CheckpointChange() {
+    _checkpoint.endChange();
+}
@@ -0,0 +1,178 @@
+/**
+ * @file checkpoint.hpp
+ * @brief Header file for the checkpoint of the in-memory tables.
+ *
+ * This file contains the declaration of the IndexCheckpoint class, that saves
+ * the auction index and the session table to a single checksummed file, so
+ * that the server starts from it instead of reading the directory of every
+ * auction and user ever created.
+ */
+#ifndef __CHECKPOINT_HPP__
+#define __CHECKPOINT_HPP__
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "config.hpp"
+#include "database.hpp"
+#include "index.hpp"
+#include "session.hpp"
+
+namespace fs = std::filesystem;
+
+/**
+ * @brief Header of the checkpoint file, followed by its auction entries and
+ * then by its user entries.
+ */
+struct CheckpointHeader {
+    uint32_t checksum;   // Of every byte after it
+    uint16_t version;    // DATABASE_CHECKPOINT_VERSION
+    uint16_t journaled;  // 1 if only valid along with the journal
+    char magic[4];       // Always DATABASE_CHECKPOINT_MAGIC
+    uint32_t auctions;   // The number of auction entries
+    uint32_t users;      // The number of user entries
+    uint32_t reserved;   // Always 0, keeps the time aligned
+    int64_t written;     // When it was written
+};
+
+/**
+ * @brief Entry of an auction in the checkpoint file.
+ */
+struct CheckpointAuction {
+    int32_t aid;       // The auction's AID
+    int32_t reserved;  // Always 0
+    AuctionIndexEntry entry;
+};
+
+/**
+ * @brief Entry of a user in the checkpoint file.
+ */
+struct CheckpointUser {
+    int32_t uid;  // The user's UID
+    SessionEntry entry;
+};
+
+/**
+ * @brief The shared memory state of the checkpoint.
+ */
+struct CheckpointState {
+    pthread_mutex_t mutex;  // Guards the checkpoint file
+    uint64_t changes;       // Bumped by every change, before it is made
+    uint64_t active;        // The changes being made
+    uint64_t saved;         // The changes counted when the file was written
+    bool writing;           // Whether a process is writing the file
+    bool current;           // Whether the file has every change made
+};
+
+/**
+ * @brief Checkpoint of the auction index and of the session table.
+ *
+ * With a journal, the checkpoint is written every time the journal is
+ * emptied, so the journal holds every change made after it, and the entries
+ * those changes touched are read again from the disk on the next start.
+ * Without one, it is only written while no change is being made, and removed
+ * from the disk by the first change that follows, so a checkpoint found on
+ * the disk always has every change. In both cases a checkpoint that is
+ * missing, cut short or corrupted is ignored, and the tables are rebuilt from
+ * the whole database directory.
+ */
+class IndexCheckpoint {
+  private:
+    fs::path _path;           // The checkpoint file
+    AuctionIndex &_index;     // The index saved
+    SessionTable &_sessions;  // The session table saved
+    bool _journaled;          // Whether the changes are journaled
+    CheckpointState *_state;  // The shared state
+
+    /**
+     * @brief  Writes the tables to a temporary file, synced and then renamed
+     * over the checkpoint file.
+     * @retval true if it was written, false otherwise.
+     */
+    bool save();
+
+    /**
+     * @brief  Removes the checkpoint file, syncing its directory so that it
+     * does not come back after a crash. The mutex must be held.
+     */
+    void remove();
+
+  public:
+    /**
+     * @brief  Maps the shared state, with no checkpoint current.
+     * @param  path The checkpoint file.
+     * @param  index The auction index.
+     * @param  sessions The session table.
+     * @param  journaled Whether every change is journaled.
+     */
+    IndexCheckpoint(fs::path path, AuctionIndex &index, SessionTable &sessions,
+                    bool journaled);
+
+    /**
+     * @brief  Unmaps the shared state.
+     */
+    ~IndexCheckpoint();
+
+    IndexCheckpoint(const IndexCheckpoint &) = delete;
+    IndexCheckpoint &operator=(const IndexCheckpoint &) = delete;
+
+    /**
+     * @brief  Loads the tables from the checkpoint file, if it is valid. No
+     * other process may be using them.
+     * @retval true if they were loaded, false if they were left untouched.
+     */
+    bool load();
+
+    /**
+     * @brief  Writes the checkpoint file, unless it already has every change.
+     * Without a journal, it is not written while a change is being made.
+     * @retval true if the file has every change, false otherwise.
+     * @throws DatabaseException if an outdated file could not be removed.
+     */
+    bool write();
+
+    /**
+     * @brief  Marks the start of a change, removing the checkpoint file first
+     * if the change is not journaled.
+     */
+    void beginChange();
+
+    /**
+     * @brief  Marks the end of a change started by beginChange.
+     */
+    void endChange();
+
+    /**
+     * @brief  Forgets the checkpoint file, after the database was wiped.
+     */
+    void invalidate();
+};
+
+/**
+ * @brief A change of the tables, while it is being made.
+ */
+class CheckpointChange {
+  private:
+    IndexCheckpoint &_checkpoint;  // The checkpoint of the tables
+
+  public:
+    /**
+     * @brief  Starts a change.
+     * @param  checkpoint The checkpoint of the tables.
+     */
+    CheckpointChange(IndexCheckpoint &checkpoint);
+
+    /**
+     * @brief  Ends the change, made or not.
+     */
+    ~CheckpointChange();
+
+    CheckpointChange(const CheckpointChange &) = delete;
+    CheckpointChange &operator=(const CheckpointChange &) = delete;
+};
+
+#endif
@@ -11,58 +11,85 @@
 
 void CommandManager::registerCommand(std::shared_ptr<CommandHandler> handler,
                                      bool isTCP) {
+    CommandSlot slot = GetCommandSlot(PackCode(handler->_code));
+
+    if (slot == UnknownSlot) {
+        throw std::invalid_argument("Unknown command " + handler->_code);
+    }
+
     if (isTCP) {  // Checks if the command is TCP or UDP
-        this->_handlersTCP.insert(
-            {handler->_code, handler});  // Inserts the handler for TCP command
+        this->_handlersTCP[slot] = handler;
     } else {
-        this->_handlersUDP.insert(
-            {handler->_code, handler});  // Inserts the handler for UDP command
+        this->_handlersUDP[slot] = handler;
     }
 }
 
-void CommandManager::readCommand(MessageSource &message,
-                                 std::stringstream &response, Server &receiver,
-                                 bool isTCP) {
-    std::string code;
+void CommandManager::registerMetrics(Metrics &metrics) {
+    std::set<std::string> codes;  // Reported in alphabetical order
+
+    for (size_t slot = 0; slot < UnknownSlot; slot++) {
+        if (_handlersUDP[slot] != NULL) {
+            codes.insert(_handlersUDP[slot]->_code);
+        }
+        if (_handlersTCP[slot] != NULL) {
+            codes.insert(_handlersTCP[slot]->_code);
+        }
+    }
+
+    for (auto &code : codes) {
+        metrics.addCommand(code);
+    }
+}
+
+CommandHandler *CommandManager::findHandler(MessageSource &message,
+                                            bool isTCP) {
+    char code[3];
     try {
-        for (size_t i = 0; i < 3;
-             i++) {  // Reads the 3 digit code from the message
-            char c = message.get();
-            code.push_back(c);
+        for (size_t i = 0; i < 3; i++) {  // Reads the 3 digit code
+            code[i] = message.get();
         }
     } catch (ProtocolViolationException const &e) {
+        return NULL;
+    }
+
+    CommandSlot slot = GetCommandSlot(PackCode(std::string_view(code, 3)));
+    if (slot == UnknownSlot) {  // The command is not valid
+        return NULL;
+    }
+
+    return isTCP ? _handlersTCP[slot].get() : _handlersUDP[slot].get();
+}
+
+void CommandManager::readCommand(MessageSource &message,
+                                 std::stringstream &response, Server &receiver,
+                                 bool isTCP, FileAttachment *attachment) {
+    CommandHandler *handler = findHandler(message, isTCP);
+    if (handler == NULL) {  // The command is not valid for the transport
         protocolError(response);
         receiver.log(Message::ServerRequestDetails("Unknown", "ERR"));
         return;
     }
 
-    if (isTCP) {
-        auto handler = this->_handlersTCP.find(
-            code);  // Finds the correct handler for the command
-        if (handler ==
-            this->_handlersTCP.end()) {  // If the handler is not found, the
-                                         // command is not valid
-            protocolError(response);
-            receiver.log(Message::ServerRequestDetails("Unknown", "ERR"));
-            return;
-        }
-        handler->second->handle(
-            message, response,
-            receiver);  // Executes the command on the correct handler
-    } else {
-        auto handler = this->_handlersUDP.find(
-            code);  // Finds the correct handler for the command
-        if (handler ==
-            this->_handlersUDP.end()) {  // If the handler is not found, the
-                                         // command is not valid
-            protocolError(response);
-            receiver.log(Message::ServerRequestDetails("Unknown", "ERR"));
-            return;
-        }
-        handler->second->handle(
-            message, response,
-            receiver);  // Executes the command on the correct handler
+    RequestTimer::setCurrentCommand(handler->_code);
+    if (attachment != NULL) {  // The handler may stream a file
+        handler->handle(message, response, *attachment, receiver);
+        return;
     }
+    handler->handle(message, response,
+                    receiver);  // Executes the command on the correct handler
+}
+
+void CommandManager::readCommand(MessageSource &message,
+                                 MessageBuffer &response, Server &receiver) {
+    CommandHandler *handler = findHandler(message, false);
+    if (handler == NULL) {  // The command is not valid
+        protocolError(response);
+        receiver.log(Message::ServerRequestDetails("Unknown", "ERR"));
+        return;
+    }
+
+    RequestTimer::setCurrentCommand(handler->_code);
+    handler->handle(message, response, receiver);
 }
 
 void LoginCommand::handle(MessageSource &message, std::stringstream &response,
@@ -73,6 +100,7 @@ void LoginCommand::handle(MessageSource &message, std::stringstream &response,
     std::string result;
     try {
         loginCommunication.decodeRequest(message);  // Decode the request
+        RequestTimer::markCurrent(MetricPhase::Decode);
 
         if (!receiver._database->loginUser(
                 loginCommunication._uid,
@@ -93,6 +121,7 @@ void LoginCommand::handle(MessageSource &message, std::stringstream &response,
         loginCommunication._status = "ERR";
         result = "Protocol Error";
     }
+    RequestTimer::markCurrent(MetricPhase::Database);
     response = loginCommunication.encodeResponse();  // Encode the response
     receiver.log(Message::ServerRequestDetails(loginCommunication._uid, "Login",
                                                result));  // Display the message
@@ -105,6 +134,7 @@ void LogoutCommand::handle(MessageSource &message, std::stringstream &response,
     std::string result;
     try {
         logoutCommunication.decodeRequest(message);  // Decode the request
+        RequestTimer::markCurrent(MetricPhase::Decode);
         receiver._database->logoutUser(
             logoutCommunication._uid,
             logoutCommunication._password);  // Logout the user
@@ -124,6 +154,7 @@ void LogoutCommand::handle(MessageSource &message, std::stringstream &response,
         logoutCommunication._status = "ERR";
         result = "Protocol Error";
     }
+    RequestTimer::markCurrent(MetricPhase::Database);
     response = logoutCommunication.encodeResponse();  // Encode the response
     receiver.log(Message::ServerRequestDetails(logoutCommunication._uid,
                                                "Logout",
@@ -138,6 +169,7 @@ void UnregisterCommand::handle(MessageSource &message,
     std::string result;
     try {
         unregisterCommunication.decodeRequest(message);  // Decode the request
+        RequestTimer::markCurrent(MetricPhase::Decode);
         receiver._database->unregisterUser(
             unregisterCommunication._uid,
             unregisterCommunication._password);  // Unregister the user
@@ -157,23 +189,77 @@ void UnregisterCommand::handle(MessageSource &message,
         unregisterCommunication._status = "ERR";
         result = "Protocol Error";
     }
+    RequestTimer::markCurrent(MetricPhase::Database);
     response = unregisterCommunication.encodeResponse();
     receiver.log(Message::ServerRequestDetails(unregisterCommunication._uid,
                                                "Unregister",
                                                result));  // Display the message
 }
 
-void ListUserAuctionsCommand::handle(MessageSource &message,
-                                     std::stringstream &response,
-                                     Server &receiver) {
+/**
+ * @brief  Checks if a list response can be cached, which is only the case when
+ * it lists the auctions, without errors.
+ * @param  status The status of the response.
+ * @retval true if the response can be cached, false otherwise.
+ */
+static bool IsCacheable(const std::string &status) {
+    return status == "OK" || status == "NOK";
+}
 
-    ListUserAuctionsCommunication
-        listUserAuctionsCommunication;  // Initialize the list user auctions
-                                        // communication object
+/**
+ * @brief  Gets the generation of the state listed by LMB, the bids of a user
+ * and whether their auctions ended. Both counters only grow, so their sum
+ * moves on whenever either of them does.
+ * @param  generation The generation of the database.
+ * @retval the generation of the bids listed.
+ */
+static uint64_t ListUserBidsGeneration(DatabaseGeneration generation) {
+    return generation.auctions + generation.bids;
+}
+
+const CachedResponse *ResponseCache::find(const std::string &key,
+                                          uint64_t generation) {
+    auto entry = _entries.find(key);
+
+    if (entry == _entries.end() || entry->second.generation != generation) {
+        return NULL;
+    }
+
+    return &entry->second;
+}
+
+void ResponseCache::store(const std::string &key, uint64_t generation,
+                          std::string response, std::string result) {
+    if (_entries.size() >= SERVER_RESPONSE_CACHE_ENTRIES &&
+        _entries.count(key) == 0) {
+        _entries.clear();  // Full, the entries of idle users go with the rest
+    }
+
+    CachedResponse &entry = _entries[key];
+
+    entry.generation = generation;
+    entry.response = std::move(response);
+    entry.result = std::move(result);
+}
+
+std::string ListUserAuctionsCommand::execute(
+    MessageSource &message,
+    ListUserAuctionsCommunication &listUserAuctionsCommunication,
+    Server &receiver, DatabaseGeneration generation,
+    const CachedResponse *&cached) {
     std::string result;
     try {
         listUserAuctionsCommunication.decodeRequest(
             message);  // Decode the request
+        RequestTimer::markCurrent(MetricPhase::Decode);
+        cached = _cache.find(listUserAuctionsCommunication._uid,
+                             generation.auctions);
+        if (cached != NULL &&
+            receiver._database->isUserLoggedIn(
+                listUserAuctionsCommunication._uid)) {  // Nothing changed
+            return cached->result;
+        }
+        cached = NULL;
         listUserAuctionsCommunication._auctions =
             receiver._database->getUserAuctions(
                 listUserAuctionsCommunication._uid);  // Get the user auctions
@@ -195,23 +281,82 @@ void ListUserAuctionsCommand::handle(MessageSource &message,
         listUserAuctionsCommunication._status = "ERR";
         result = "Protocol Error";
     }
-    response =
-        listUserAuctionsCommunication.encodeResponse();  // Encode the response
+
+    return result;
+}
+
+void ListUserAuctionsCommand::handle(MessageSource &message,
+                                     std::stringstream &response,
+                                     Server &receiver) {
+    ListUserAuctionsCommunication
+        listUserAuctionsCommunication;  // Initialize the list user auctions
+                                        // communication object
+    const CachedResponse *cached = NULL;
+    DatabaseGeneration generation = receiver._database->getGeneration();
+    std::string result = execute(message, listUserAuctionsCommunication,
+                                 receiver, generation, cached);
+    RequestTimer::markCurrent(MetricPhase::Database);
+    if (cached != NULL) {  // Send the response encoded before
+        response << cached->response;
+    } else {
+        response = listUserAuctionsCommunication
+                       .encodeResponse();  // Encode the response
+        if (IsCacheable(listUserAuctionsCommunication._status)) {
+            _cache.store(listUserAuctionsCommunication._uid,
+                         generation.auctions,
+                         response.str(), result);
+        }
+    }
     receiver.log(Message::ServerRequestDetails(
         listUserAuctionsCommunication._uid, "List User Auctions",
         result));  // Display the message
 }
 
-void ListUserBidsCommand::handle(MessageSource &message,
-                                 std::stringstream &response,
-                                 Server &receiver) {
+void ListUserAuctionsCommand::handle(MessageSource &message,
+                                     MessageBuffer &response,
+                                     Server &receiver) {
+    ListUserAuctionsCommunication
+        listUserAuctionsCommunication;  // Initialize the list user auctions
+                                        // communication object
+    const CachedResponse *cached = NULL;
+    DatabaseGeneration generation = receiver._database->getGeneration();
+    std::string result = execute(message, listUserAuctionsCommunication,
+                                 receiver, generation, cached);
+    RequestTimer::markCurrent(MetricPhase::Database);
+    if (cached != NULL) {  // Send the response encoded before
+        response.write(cached->response.data(), cached->response.size());
+    } else {
+        listUserAuctionsCommunication.encodeResponse(
+            response);  // Encode the response
+        if (IsCacheable(listUserAuctionsCommunication._status) &&
+            !response.overflowed()) {
+            _cache.store(listUserAuctionsCommunication._uid,
+                         generation.auctions,
+                         std::string(response.data(), response.size()),
+                         result);
+        }
+    }
+    receiver.log(Message::ServerRequestDetails(
+        listUserAuctionsCommunication._uid, "List User Auctions",
+        result));  // Display the message
+}
 
-    ListUserBidsCommunication
-        listUserBidsCommunication;  // Initialize the list user bids
-                                    // communication object
+std::string ListUserBidsCommand::execute(
+    MessageSource &message,
+    ListUserBidsCommunication &listUserBidsCommunication, Server &receiver,
+    DatabaseGeneration generation, const CachedResponse *&cached) {
     std::string result;
     try {
         listUserBidsCommunication.decodeRequest(message);  // Decode the request
+        RequestTimer::markCurrent(MetricPhase::Decode);
+        cached = _cache.find(listUserBidsCommunication._uid,
+                             ListUserBidsGeneration(generation));
+        if (cached != NULL &&
+            receiver._database->isUserLoggedIn(
+                listUserBidsCommunication._uid)) {  // Nothing changed
+            return cached->result;
+        }
+        cached = NULL;
         listUserBidsCommunication._bids = receiver._database->getUserBids(
             listUserBidsCommunication._uid);  // Get the user bids
         if (listUserBidsCommunication._bids
@@ -231,23 +376,101 @@ void ListUserBidsCommand::handle(MessageSource &message,
         listUserBidsCommunication._status = "ERR";
         result = "Protocol Error";
     }
-    response =
-        listUserBidsCommunication.encodeResponse();  // Encode the response
+
+    return result;
+}
+
+void ListUserBidsCommand::handle(MessageSource &message,
+                                 std::stringstream &response,
+                                 Server &receiver) {
+    ListUserBidsCommunication
+        listUserBidsCommunication;  // Initialize the list user bids
+                                    // communication object
+    const CachedResponse *cached = NULL;
+    DatabaseGeneration generation = receiver._database->getGeneration();
+    std::string result = execute(message, listUserBidsCommunication, receiver,
+                                 generation, cached);
+    RequestTimer::markCurrent(MetricPhase::Database);
+    if (cached != NULL) {  // Send the response encoded before
+        response << cached->response;
+    } else {
+        response =
+            listUserBidsCommunication.encodeResponse();  // Encode the response
+        if (IsCacheable(listUserBidsCommunication._status)) {
+            _cache.store(listUserBidsCommunication._uid,
+                         ListUserBidsGeneration(generation),
+                         response.str(), result);
+        }
+    }
     receiver.log(Message::ServerRequestDetails(listUserBidsCommunication._uid,
                                                "List User Bids",
                                                result));  // Display the message
 }
 
-void ListAllAuctionsCommand::handle(MessageSource &message,
-                                    std::stringstream &response,
-                                    Server &receiver) {
-    ListAllAuctionsCommunication
-        listAllAuctionsCommunication;  // Initialize the list all auctions
-                                       // communication object
+void ListUserBidsCommand::handle(MessageSource &message,
+                                 MessageBuffer &response, Server &receiver) {
+    ListUserBidsCommunication
+        listUserBidsCommunication;  // Initialize the list user bids
+                                    // communication object
+    const CachedResponse *cached = NULL;
+    DatabaseGeneration generation = receiver._database->getGeneration();
+    std::string result = execute(message, listUserBidsCommunication, receiver,
+                                 generation, cached);
+    RequestTimer::markCurrent(MetricPhase::Database);
+    if (cached != NULL) {  // Send the response encoded before
+        response.write(cached->response.data(), cached->response.size());
+    } else {
+        listUserBidsCommunication.encodeResponse(
+            response);  // Encode the response
+        if (IsCacheable(listUserBidsCommunication._status) &&
+            !response.overflowed()) {
+            _cache.store(listUserBidsCommunication._uid,
+                         ListUserBidsGeneration(generation),
+                         std::string(response.data(), response.size()),
+                         result);
+        }
+    }
+    receiver.log(Message::ServerRequestDetails(listUserBidsCommunication._uid,
+                                               "List User Bids",
+                                               result));  // Display the message
+}
+
+/**
+ * @brief  Gets the key of the cached response to a list all auctions request,
+ * as the response to a conditional one also has the generation.
+ * @param  communication The list all auctions communication.
+ * @retval the key.
+ */
+static std::string ListAllAuctionsKey(
+    ListAllAuctionsCommunication &communication) {
+    return communication._conditional ? "G" : "";
+}
+
+std::string ListAllAuctionsCommand::execute(
+    MessageSource &message,
+    ListAllAuctionsCommunication &listAllAuctionsCommunication,
+    Server &receiver, DatabaseGeneration generation,
+    const CachedResponse *&cached) {
     std::string result;
     try {
         listAllAuctionsCommunication.decodeRequest(
             message);  // Decode the request
+        RequestTimer::markCurrent(MetricPhase::Decode);
+        if (listAllAuctionsCommunication._conditional) {
+            listAllAuctionsCommunication._generation = generation.auctions;
+            if (listAllAuctionsCommunication._knownGeneration ==
+                generation.auctions) {
+                // The client has the list already
+                listAllAuctionsCommunication._status =
+                    PROTOCOL_UNCHANGED_STATUS;
+                return "Auctions Unchanged";
+            }
+        }
+        cached = _cache.find(ListAllAuctionsKey(listAllAuctionsCommunication),
+                             generation.auctions);
+        if (cached != NULL) {  // Nothing changed
+            return cached->result;
+        }
         listAllAuctionsCommunication._auctions =
             receiver._database->getAllAuctions();  // Get all the auctions
         if (listAllAuctionsCommunication._auctions
@@ -263,23 +486,101 @@ void ListAllAuctionsCommand::handle(MessageSource &message,
         listAllAuctionsCommunication._status = "ERR";
         result = "Protocol Error";
     }
-    response =
-        listAllAuctionsCommunication.encodeResponse();  // Encode the response
+
+    return result;
+}
+
+void ListAllAuctionsCommand::handle(MessageSource &message,
+                                    std::stringstream &response,
+                                    Server &receiver) {
+    ListAllAuctionsCommunication
+        listAllAuctionsCommunication;  // Initialize the list all auctions
+                                       // communication object
+    const CachedResponse *cached = NULL;
+    DatabaseGeneration generation = receiver._database->getGeneration();
+    std::string result = execute(message, listAllAuctionsCommunication,
+                                 receiver, generation, cached);
+    RequestTimer::markCurrent(MetricPhase::Database);
+    if (cached != NULL) {  // Send the response encoded before
+        response << cached->response;
+    } else {
+        try {
+            response = listAllAuctionsCommunication
+                           .encodeResponse();  // Encode the response
+        } catch (ProtocolViolationException const &e) {
+            if (!listAllAuctionsCommunication._conditional) {
+                throw;
+            }
+            // The generation does not fit in the datagram, sent plain
+            listAllAuctionsCommunication._conditional = false;
+            response = listAllAuctionsCommunication.encodeResponse();
+        }
+        if (IsCacheable(listAllAuctionsCommunication._status)) {
+            _cache.store(ListAllAuctionsKey(listAllAuctionsCommunication),
+                         generation.auctions, response.str(), result);
+        }
+    }
     receiver.log(Message::ServerRequestDetails("List Auctions",
                                                result));  // Display the message
 }
 
-void ShowRecordCommand::handle(MessageSource &message,
-                               std::stringstream &response, Server &receiver) {
-    ShowRecordCommunication
-        showRecordCommunication;  // Initialize the show record communication
-                                  // object
+void ListAllAuctionsCommand::handle(MessageSource &message,
+                                    MessageBuffer &response, Server &receiver) {
+    ListAllAuctionsCommunication
+        listAllAuctionsCommunication;  // Initialize the list all auctions
+                                       // communication object
+    const CachedResponse *cached = NULL;
+    DatabaseGeneration generation = receiver._database->getGeneration();
+    std::string result = execute(message, listAllAuctionsCommunication,
+                                 receiver, generation, cached);
+    RequestTimer::markCurrent(MetricPhase::Database);
+    if (cached != NULL) {  // Send the response encoded before
+        response.write(cached->response.data(), cached->response.size());
+    } else {
+        listAllAuctionsCommunication.encodeResponse(
+            response);  // Encode the response
+        if (response.overflowed() &&
+            listAllAuctionsCommunication._conditional) {
+            // The generation does not fit in the datagram, sent plain
+            response.clear();
+            listAllAuctionsCommunication._conditional = false;
+            listAllAuctionsCommunication.encodeResponse(response);
+        }
+        if (IsCacheable(listAllAuctionsCommunication._status) &&
+            !response.overflowed()) {
+            _cache.store(ListAllAuctionsKey(listAllAuctionsCommunication),
+                         generation.auctions,
+                         std::string(response.data(), response.size()),
+                         result);
+        }
+    }
+    receiver.log(Message::ServerRequestDetails("List Auctions",
+                                               result));  // Display the message
+}
+
+std::string ShowRecordCommand::execute(
+    MessageSource &message, ShowRecordCommunication &showRecordCommunication,
+    Server &receiver) {
     std::string result;
     try {
         showRecordCommunication.decodeRequest(message);  // Decode the request
-        AuctionStartInfo auctionStartInfo =
-            receiver._database->getAuctionStartInfo(
-                showRecordCommunication._aid);  // Get the auction start info
+        RequestTimer::markCurrent(MetricPhase::Decode);
+        if (showRecordCommunication._conditional &&
+            showRecordCommunication._knownGeneration != 0) {
+            uint64_t generation = receiver._database->getRecordGeneration(
+                showRecordCommunication._aid);
+            if (generation == showRecordCommunication._knownGeneration) {
+                // The client has the record already
+                showRecordCommunication._generation = generation;
+                showRecordCommunication._status = PROTOCOL_UNCHANGED_STATUS;
+                return "Record Unchanged";
+            }
+        }
+        AuctionRecord record = receiver._database->getAuctionRecord(
+            showRecordCommunication._aid,
+            PROTOCOL_MAX_RECORD_BIDS);  // Get the record with the last 50
+                                        // bids, all at once
+        AuctionStartInfo &auctionStartInfo = record.startInfo;
 
         showRecordCommunication._hostUid =
             auctionStartInfo.uid;  // Set the host uid
@@ -289,49 +590,36 @@ void ShowRecordCommand::handle(MessageSource &message,
             auctionStartInfo.startValue;  // Set the start value
         showRecordCommunication._timeActive =
             (int)auctionStartInfo.timeActive;  // Set the time active
-        showRecordCommunication._assetFname = receiver._database->getAssetName(
-            showRecordCommunication._aid);  // Set the asset filename
+        showRecordCommunication._assetFname =
+            record.assetName;  // Set the asset filename
         showRecordCommunication._startDateTime =
             auctionStartInfo.startTime;  // Set the start date time
 
-        std::vector<AuctionBidInfo> auctionBidInfo =
-            receiver._database->getAuctionBids(
-                showRecordCommunication._aid);  // Get the auction bids
-        long unsigned int size = auctionBidInfo.size();
-        long unsigned int i = 0;
-        if (size >
-            50) {  // If there are more than 50 bids, only show the last 50
-            i = size - 50;
-        }
-        for (; i < size; i++) {  // Set the bids
+        for (auto &bid : record.bids) {  // Set the bids
             showRecordCommunication._bidderUids.push_back(
-                auctionBidInfo[i].uid);  // Set the bidder uids
+                bid.uid);  // Set the bidder uids
             showRecordCommunication._bidValues.push_back(
-                auctionBidInfo[i].bidValue);  // Set the bid values
+                bid.bidValue);  // Set the bid values
             showRecordCommunication._bidDateTime.push_back(
-                auctionBidInfo[i].bidTime);  // Set the bid date time
-            int bidSecTime = (int)difftime(auctionBidInfo[i].bidTime,
-                                           auctionStartInfo.startTime);
+                bid.bidTime);  // Set the bid date time
+            int bidSecTime =
+                (int)difftime(bid.bidTime, auctionStartInfo.startTime);
             showRecordCommunication._bidSecTimes.push_back(
                 bidSecTime);  // Set the bid sec times
         }
 
-        if (receiver._database->hasAuctionEnded(
-                showRecordCommunication
-                    ._aid)) {  // Check if the auction has ended
-
-            AuctionEndInfo auctionEndInfo =
-                receiver._database->getAuctionEndInfo(
-                    showRecordCommunication._aid);  // Get the auction end info
+        if (record.ended) {  // Check if the auction has ended
             showRecordCommunication._hasEnded = true;  // Set the has ended flag
             showRecordCommunication._endDateTime =
-                auctionEndInfo.endTime;  // Set the end date time
-            int endSecTime = (int)difftime(auctionEndInfo.endTime,
+                record.endInfo.endTime;  // Set the end date time
+            int endSecTime = (int)difftime(record.endInfo.endTime,
                                            auctionStartInfo.startTime);
             showRecordCommunication._endSecTime =
                 endSecTime;  // Set the end sec time
         }
 
+        showRecordCommunication._generation =
+            record.generation;  // Set the generation of the record
         showRecordCommunication._status = "OK";  // Set the status to OK
         result = "Record Shown";
     } catch (AuctionException const
@@ -343,11 +631,34 @@ void ShowRecordCommand::handle(MessageSource &message,
         showRecordCommunication._status = "ERR";
         result = "Protocol Error";
     }
+
+    return result;
+}
+
+void ShowRecordCommand::handle(MessageSource &message,
+                               std::stringstream &response, Server &receiver) {
+    ShowRecordCommunication
+        showRecordCommunication;  // Initialize the show record communication
+                                  // object
+    std::string result = execute(message, showRecordCommunication, receiver);
+    RequestTimer::markCurrent(MetricPhase::Database);
     response = showRecordCommunication.encodeResponse();  // Encode the response
     receiver.log(Message::ServerRequestDetails("Show Record",
                                                result));  // Display the message
 }
 
+void ShowRecordCommand::handle(MessageSource &message,
+                               MessageBuffer &response, Server &receiver) {
+    ShowRecordCommunication
+        showRecordCommunication;  // Initialize the show record communication
+                                  // object
+    std::string result = execute(message, showRecordCommunication, receiver);
+    RequestTimer::markCurrent(MetricPhase::Database);
+    showRecordCommunication.encodeResponse(response);  // Encode the response
+    receiver.log(Message::ServerRequestDetails("Show Record",
+                                               result));  // Display the message
+}
+
 void OpenCommand::handle(MessageSource &message, std::stringstream &response,
                          Server &receiver) {
     OpenAuctionCommunication
@@ -355,14 +666,33 @@ void OpenCommand::handle(MessageSource &message, std::stringstream &response,
                                    // object
     std::string result;
     try {
-        openAuctionCommunication.decodeRequest(message);  // Decode the request
+        // The asset goes straight to a temporary file in the database, the
+        // event loop writes it there as it arrives
+        std::shared_ptr<AssetUpload> upload = AssetUpload::takeReceived();
+        bool received = (upload != nullptr);
+        if (!received) {
+            upload = receiver._database->createUpload();
+        }
+        openAuctionCommunication.decodeRequestHeader(message);
+        // Rejected before the asset is read, if too many are being received,
+        // unless the event loop reserved it when the header arrived
+        UploadReservation reservation(
+            receiver.getAdmission(),
+            (size_t)openAuctionCommunication._fileSize);
+        if (received) {
+            openAuctionCommunication.decodeRequestEnd(message);
+        } else {
+            openAuctionCommunication.decodeRequestFile(
+                message, upload->getStream());  // Decode the request
+        }
+        RequestTimer::markCurrent(MetricPhase::Decode);
         std::string aid = receiver._database->createAuction(
             openAuctionCommunication._uid, openAuctionCommunication._password,
             openAuctionCommunication._name,
             openAuctionCommunication._startValue,
             openAuctionCommunication._timeActive,
             openAuctionCommunication._fileName,
-            openAuctionCommunication._fileData);  // Create the auction
+            *upload);  // Create the auction
         openAuctionCommunication._status =
             "OK";  // Set the status to OK if everything goes right
         result = "Auction Created";
@@ -379,8 +709,12 @@ void OpenCommand::handle(MessageSource &message, std::stringstream &response,
                  &e) {  // If the protocol is not valid, set the status to ERR
         openAuctionCommunication._status = "ERR";
         result = "Protocol Error";
+    } catch (AdmissionException const &e) {  // If the upload is rejected
+        openAuctionCommunication._status = "ERR";
+        result = "Upload Rejected";
     }
 
+    RequestTimer::markCurrent(MetricPhase::Database);
     response = openAuctionCommunication.encodeResponse();  // Encode the
                                                            // response
     receiver.log(Message::ServerRequestDetails(openAuctionCommunication._uid,
@@ -396,6 +730,7 @@ void CloseCommand::handle(MessageSource &message, std::stringstream &response,
     std::string result;
     try {
         closeAuctionCommunication.decodeRequest(message);  // Decode the request
+        RequestTimer::markCurrent(MetricPhase::Decode);
         receiver._database->closeAuction(
             closeAuctionCommunication._uid, closeAuctionCommunication._password,
             closeAuctionCommunication._aid);  // Close the auction
@@ -424,6 +759,7 @@ void CloseCommand::handle(MessageSource &message, std::stringstream &response,
         closeAuctionCommunication._status = "ERR";
         result = "Protocol Error";
     }
+    RequestTimer::markCurrent(MetricPhase::Database);
     response =
         closeAuctionCommunication.encodeResponse();  // Encode the response
     receiver.log(Message::ServerRequestDetails(closeAuctionCommunication._uid,
@@ -438,6 +774,7 @@ void ShowAssetCommand::handle(MessageSource &message,
     std::string result;
     try {
         showAssetCommunication.decodeRequest(message);  // Decode the request
+        RequestTimer::markCurrent(MetricPhase::Decode);
         showAssetCommunication._fileSize = receiver._database->getAuctionAsset(
             showAssetCommunication._aid, showAssetCommunication._fileName,
             showAssetCommunication._fileData);  // Get the auction asset
@@ -454,11 +791,151 @@ void ShowAssetCommand::handle(MessageSource &message,
         showAssetCommunication._status = "ERR";
         result = "Protocol Error";
     }
+    RequestTimer::markCurrent(MetricPhase::Database);
     response = showAssetCommunication.encodeResponse();  // Encode the response
     receiver.log(Message::ServerRequestDetails("Show Asset",
                                                result));  // Display the message
 }
 
+void ShowAssetCommand::handle(MessageSource &message,
+                              std::stringstream &response,
+                              FileAttachment &attachment, Server &receiver) {
+    ShowAssetCommunication showAssetCommunication;  // Initialize the show asset
+                                                    // communication object
+    std::string result;
+    int fd = -1;
+    try {
+        showAssetCommunication.decodeRequest(message);  // Decode the request
+        RequestTimer::markCurrent(MetricPhase::Decode);
+        fd = receiver._database->openAuctionAsset(
+            showAssetCommunication._aid, showAssetCommunication._fileName,
+            showAssetCommunication._fileSize);  // Open the auction asset
+        showAssetCommunication._status =
+            "OK";  // Set the status to OK if everything goes right
+        result = "Asset Shown";
+    } catch (
+        AuctionException const &e) {  // If there is a problem with the auction
+                                      // or the file, set the status to NOK
+        showAssetCommunication._status = "NOK";
+        result = "Problem With Auction Or File";
+    } catch (ProtocolException const
+                 &e) {  // If the protocol is not valid, set the status to ERR
+        showAssetCommunication._status = "ERR";
+        result = "Protocol Error";
+    }
+    if (fd != -1) {  // The attachment owns the file from now on
+        attachment.attach(fd, (size_t)showAssetCommunication._fileSize,
+                          std::string(1, PROTOCOL_MESSAGE_DELIMITER));
+    }
+    RequestTimer::markCurrent(MetricPhase::Database);
+    // Only the header, the asset is sent straight from the file
+    response = showAssetCommunication.encodeResponseHeader();
+    receiver.log(Message::ServerRequestDetails("Show Asset",
+                                               result));  // Display the message
+}
+
+/**
+ * @brief  Cuts the range requested at the end of the asset file.
+ * @param  comm The communication, with the size of the asset file.
+ * @retval true if the range starts within the file, false otherwise.
+ */
+static bool ClipRange(ShowAssetRangeCommunication &comm) {
+    if (comm._offset > comm._fileSize) {
+        return false;
+    }
+
+    comm._length = std::min(comm._length, comm._fileSize - comm._offset);
+    return true;
+}
+
+void ShowAssetRangeCommand::handle(MessageSource &message,
+                                   std::stringstream &response,
+                                   Server &receiver) {
+    ShowAssetRangeCommunication showAssetRangeCommunication;
+    std::string result;
+    try {
+        showAssetRangeCommunication.decodeRequest(message);  // Decode it
+        RequestTimer::markCurrent(MetricPhase::Decode);
+        std::stringstream asset;
+        showAssetRangeCommunication._fileSize =
+            receiver._database->getAuctionAsset(
+                showAssetRangeCommunication._aid,
+                showAssetRangeCommunication._fileName,
+                asset);  // Get the auction asset
+        if (ClipRange(showAssetRangeCommunication)) {
+            std::string data = asset.str().substr(
+                (size_t)showAssetRangeCommunication._offset,
+                (size_t)showAssetRangeCommunication._length);
+            showAssetRangeCommunication._fileData.write(
+                data.data(), (std::streamsize)data.size());
+            showAssetRangeCommunication._status = "OK";
+            result = "Asset Range Shown";
+        } else {  // If the range starts past the file, set the status to NOK
+            showAssetRangeCommunication._status = "NOK";
+            result = "Range Past The File";
+        }
+    } catch (
+        AuctionException const &e) {  // If there is a problem with the auction
+                                      // or the file, set the status to NOK
+        showAssetRangeCommunication._status = "NOK";
+        result = "Problem With Auction Or File";
+    } catch (ProtocolException const
+                 &e) {  // If the protocol is not valid, set the status to ERR
+        showAssetRangeCommunication._status = "ERR";
+        result = "Protocol Error";
+    }
+    RequestTimer::markCurrent(MetricPhase::Database);
+    // Encode the response
+    response = showAssetRangeCommunication.encodeResponse();
+    receiver.log(Message::ServerRequestDetails("Show Asset Range",
+                                               result));  // Display the message
+}
+
+void ShowAssetRangeCommand::handle(MessageSource &message,
+                                   std::stringstream &response,
+                                   FileAttachment &attachment,
+                                   Server &receiver) {
+    ShowAssetRangeCommunication showAssetRangeCommunication;
+    std::string result;
+    int fd = -1;
+    try {
+        showAssetRangeCommunication.decodeRequest(message);  // Decode it
+        RequestTimer::markCurrent(MetricPhase::Decode);
+        fd = receiver._database->openAuctionAsset(
+            showAssetRangeCommunication._aid,
+            showAssetRangeCommunication._fileName,
+            showAssetRangeCommunication._fileSize);  // Open the auction asset
+        if (ClipRange(showAssetRangeCommunication)) {
+            showAssetRangeCommunication._status = "OK";
+            result = "Asset Range Shown";
+        } else {  // If the range starts past the file, set the status to NOK
+            close(fd);
+            fd = -1;
+            showAssetRangeCommunication._status = "NOK";
+            result = "Range Past The File";
+        }
+    } catch (
+        AuctionException const &e) {  // If there is a problem with the auction
+                                      // or the file, set the status to NOK
+        showAssetRangeCommunication._status = "NOK";
+        result = "Problem With Auction Or File";
+    } catch (ProtocolException const
+                 &e) {  // If the protocol is not valid, set the status to ERR
+        showAssetRangeCommunication._status = "ERR";
+        result = "Protocol Error";
+    }
+    if (fd != -1) {  // The attachment owns the file from now on
+        attachment.attach(fd, (size_t)showAssetRangeCommunication._length,
+                          std::string(1, PROTOCOL_MESSAGE_DELIMITER),
+                          (size_t)showAssetRangeCommunication._offset);
+    }
+    RequestTimer::markCurrent(MetricPhase::Database);
+    // Only the header, the range is sent straight from the file
+    response = showAssetRangeCommunication.encodeResponseHeader();
+    receiver.log(Message::ServerRequestDetails("Show Asset Range",
+                                               result));  // Display the message
+}
+
 void BidCommand::handle(MessageSource &message, std::stringstream &response,
                         Server &receiver) {
     BidCommunication
@@ -466,6 +943,7 @@ void BidCommand::handle(MessageSource &message, std::stringstream &response,
     std::string result;
     try {
         bidCommunication.decodeRequest(message);  // Decode the request
+        RequestTimer::markCurrent(MetricPhase::Decode);
         receiver._database->bidAuction(
             bidCommunication._uid, bidCommunication._password,
             bidCommunication._aid, bidCommunication._value);  // Bid the auction
@@ -497,11 +975,50 @@ void BidCommand::handle(MessageSource &message, std::stringstream &response,
         bidCommunication._status = "ERR";
         result = "Protocol Error";
     }
+    RequestTimer::markCurrent(MetricPhase::Database);
     response = bidCommunication.encodeResponse();  // Encode the response
     receiver.log(Message::ServerRequestDetails(bidCommunication._uid, "Bid",
                                                result));  // Display the message
 }
 
+void StatsCommand::handle(MessageSource &message, std::stringstream &response,
+                          Server &receiver) {
+    std::string result;
+    try {
+        if (message.get() != '\n') {  // The command has no arguments
+            throw ProtocolMessageErrorException();
+        }
+        RequestTimer::markCurrent(MetricPhase::Decode);
+        response << "RST OK\n" << receiver.getMetrics().report();
+        result = "Metrics Reported";
+    } catch (ProtocolException const
+                 &e) {  // If the protocol is not valid, set the status to ERR
+        response << "RST ERR\n";
+        result = "Protocol Error";
+    }
+    receiver.log(Message::ServerRequestDetails("Stats",
+                                               result));  // Display the message
+}
+
+void KeepAliveCommand::handle(MessageSource &message,
+                              std::stringstream &response, Server &receiver) {
+    KeepAliveCommunication keepAliveCommunication;
+    std::string result;
+    try {
+        keepAliveCommunication.decodeRequest(message);  // Decode the request
+        RequestTimer::markCurrent(MetricPhase::Decode);
+        keepAliveCommunication._status = "OK";
+        result = "Connection Kept Alive";
+    } catch (ProtocolException const
+                 &e) {  // If the protocol is not valid, set the status to ERR
+        keepAliveCommunication._status = "ERR";
+        result = "Protocol Error";
+    }
+    response = keepAliveCommunication.encodeResponse();  // Encode the response
+    receiver.log(Message::ServerRequestDetails("Keep-alive",
+                                               result));  // Display the message
+}
+
 void protocolError(std::stringstream &response) {
     std::string str =
         PROTOCOL_ERROR_IDENTIFIER;  // The protocol error identifier
@@ -510,4 +1027,17 @@ void protocolError(std::stringstream &response) {
         response.put(c);
     }
     response.put('\n');  // Writes a newline character to the response stream
-}
\ No newline at end of file
+}
+
+void protocolError(MessageBuffer &response) {
+    std::string_view str = PROTOCOL_ERROR_IDENTIFIER "\n";
+
+    response.write(str.data(), str.size());
+}
+
+bool isErrorResponse(const std::string &response) {
+    // Either the bare error identifier or a response identifier and ERR
+    return response.size() > 3 &&
+           (response.compare(0, 4, PROTOCOL_ERROR_IDENTIFIER "\n") == 0 ||
+            response.compare(3, 5, " " PROTOCOL_ERROR_IDENTIFIER "\n") == 0);
+}
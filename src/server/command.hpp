@@ -11,12 +11,16 @@
 
 #include <iostream>
 #include <memory>
+#include <set>
 #include <sstream>
+#include <stdexcept>
 #include <unordered_map>
 
 #include "config.hpp"
 #include "messages.hpp"
+#include "metrics.hpp"
 #include "protocol.hpp"
+#include "schema.hpp"
 #include "server.hpp"
 
 /**
@@ -38,6 +42,43 @@ class CommandHandler {
     virtual void handle(MessageSource &message, std::stringstream &response,
                         Server &receiver) = 0;
 
+    /**
+     * @brief Handles a command message whose response may end with a file
+     * sent straight from the disk.
+     *
+     * Handlers without such responses leave the attachment empty, which is
+     * what this default does.
+     *
+     * @param message The command message to handle.
+     * @param response The response stream to write the command response to.
+     * @param attachment The file sent after the response stream.
+     * @param receiver The server instance that received the command.
+     */
+    virtual void handle(MessageSource &message, std::stringstream &response,
+                        FileAttachment &attachment, Server &receiver) {
+        (void)attachment;
+        handle(message, response, receiver);
+    }
+
+    /**
+     * @brief Handles a command message, writing the response to a buffer.
+     *
+     * The handlers of the frequent UDP commands encode straight to the
+     * buffer, this default copies the response stream to it.
+     *
+     * @param message The command message to handle.
+     * @param response The buffer to write the command response to.
+     * @param receiver The server instance that received the command.
+     */
+    virtual void handle(MessageSource &message, MessageBuffer &response,
+                        Server &receiver) {
+        std::stringstream stream;
+        handle(message, stream, receiver);
+
+        std::string str = stream.str();
+        response.write(str.data(), str.size());
+    }
+
     std::string _code; /**< The code associated with the command. */
 
   protected:
@@ -49,26 +90,112 @@ class CommandHandler {
     CommandHandler(std::string code) : _code{code} {}
 };
 
+/**
+ * @brief The slots of the commands in the tables of the CommandManager.
+ */
+enum CommandSlot : size_t {
+    LoginSlot,
+    LogoutSlot,
+    UnregisterSlot,
+    OpenSlot,
+    CloseSlot,
+    ListUserAuctionsSlot,
+    ListUserBidsSlot,
+    ListAllAuctionsSlot,
+    ShowAssetSlot,
+    ShowAssetRangeSlot,
+    BidSlot,
+    ShowRecordSlot,
+    KeepAliveSlot,
+    StatsSlot,
+    UnknownSlot, /**< Not a command, and the number of slots. */
+};
+
+/**
+ * @brief  Gets the slot of a command, resolved by a switch over the packed
+ * codes, that the compiler turns into a jump table or a few comparisons.
+ * @param  code The packed code of the command.
+ * @retval the slot, UnknownSlot if there is no such command.
+ */
+constexpr CommandSlot GetCommandSlot(uint32_t code) {
+    switch (code) {
+        case PackCode("LIN"):
+            return LoginSlot;
+        case PackCode("LOU"):
+            return LogoutSlot;
+        case PackCode("UNR"):
+            return UnregisterSlot;
+        case PackCode("OPA"):
+            return OpenSlot;
+        case PackCode("CLS"):
+            return CloseSlot;
+        case PackCode("LMA"):
+            return ListUserAuctionsSlot;
+        case PackCode("LMB"):
+            return ListUserBidsSlot;
+        case PackCode("LST"):
+            return ListAllAuctionsSlot;
+        case PackCode("SAS"):
+            return ShowAssetSlot;
+        case PackCode("SAR"):
+            return ShowAssetRangeSlot;
+        case PackCode("BID"):
+            return BidSlot;
+        case PackCode("SRC"):
+            return ShowRecordSlot;
+        case PackCode("KAL"):
+            return KeepAliveSlot;
+        case PackCode("STA"):
+            return StatsSlot;
+        default:
+            return UnknownSlot;
+    }
+}
+
+static_assert(GetCommandSlot(PackCode(PROTOCOL_ERROR_IDENTIFIER)) ==
+                  UnknownSlot,
+              "Error responses are never handled as commands");
+
 /**
  * @brief Manages command handlers and dispatches commands to the appropriate
  * handler.
  */
 class CommandManager {
   private:
-    std::unordered_map<std::string, std::shared_ptr<CommandHandler>>
-        _handlersUDP = {}; /**< The map of UDP command handlers. */
-    std::unordered_map<std::string, std::shared_ptr<CommandHandler>>
-        _handlersTCP = {}; /**< The map of TCP command handlers. */
+    std::shared_ptr<CommandHandler>
+        _handlersUDP[UnknownSlot]; /**< The UDP command handlers, by slot. */
+    std::shared_ptr<CommandHandler>
+        _handlersTCP[UnknownSlot]; /**< The TCP command handlers, by slot. */
+
+    /**
+     * @brief Reads the code of a command and finds its handler.
+     *
+     * @param message The command message, read past the code.
+     * @param isTCP Specifies whether the command is for TCP or UDP.
+     * @return The handler, NULL if the code could not be read or there is no
+     * such command.
+     */
+    CommandHandler *findHandler(MessageSource &message, bool isTCP);
 
   public:
     /**
      * @brief Registers a command handler.
      *
+     * The code of the handler must be one of those of GetCommandSlot(),
+     * otherwise std::invalid_argument is thrown.
+     *
      * @param handler The command handler to register.
      * @param isTCP Specifies whether the command is for TCP or UDP.
      */
     void registerCommand(std::shared_ptr<CommandHandler> handler, bool isTCP);
 
+    /**
+     * @brief Adds the code of every command registered to the metrics.
+     *
+     * @param metrics The metrics.
+     */
+    void registerMetrics(Metrics &metrics);
+
     /**
      * @brief Reads and handles a command message.
      *
@@ -76,9 +203,70 @@ class CommandManager {
      * @param response The response stream to write the command response to.
      * @param receiver The server instance that received the command.
      * @param isTCP Specifies whether the command is for TCP or UDP.
+     * @param attachment Where TCP handlers may attach a file to send after the
+     * response, NULL to have every response in the response stream.
      */
     void readCommand(MessageSource &message, std::stringstream &response,
-                     Server &receiver, bool isTCP);
+                     Server &receiver, bool isTCP,
+                     FileAttachment *attachment = NULL);
+
+    /**
+     * @brief Reads and handles a UDP command message, writing the response to
+     * a buffer.
+     *
+     * @param message The command message to handle.
+     * @param response The buffer to write the command response to.
+     * @param receiver The server instance that received the command.
+     */
+    void readCommand(MessageSource &message, MessageBuffer &response,
+                     Server &receiver);
+};
+
+/**
+ * @brief A list response, encoded once and sent again for as long as the
+ * generation of the state it lists is current.
+ */
+struct CachedResponse {
+    uint64_t generation;   /**< The generation it was built in. */
+    std::string response;  /**< The encoded response. */
+    std::string result;    /**< The result logged when it is sent. */
+};
+
+/**
+ * @brief Cache of the list responses of a command, by UID.
+ *
+ * Every server process keeps its own cache, checked against the generation
+ * shared by all of them. Each command checks the counter of the state it
+ * lists, so LST and LMA are kept across bids, and LMB is not. The list
+ * commands are only handled by the UDP servers, which are single threaded,
+ * so the cache needs no lock.
+ */
+class ResponseCache {
+  private:
+    std::unordered_map<std::string, CachedResponse>
+        _entries; /**< The responses, by UID, "" or "G" for LST. */
+
+  public:
+    /**
+     * @brief Finds a response that is still current.
+     *
+     * @param key The UID of the request, "" for LST, "G" if conditional.
+     * @param generation The current generation of the state listed.
+     * @return The response, NULL if there is none or it is out of date.
+     */
+    const CachedResponse *find(const std::string &key, uint64_t generation);
+
+    /**
+     * @brief Stores a response, replacing the previous one.
+     *
+     * @param key The UID of the request, "" for LST, "G" if conditional.
+     * @param generation The generation of the state listed, read before the
+     * response was built.
+     * @param response The encoded response.
+     * @param result The result logged when it is sent.
+     */
+    void store(const std::string &key, uint64_t generation,
+               std::string response, std::string result);
 };
 
 /**
@@ -148,6 +336,24 @@ class UnregisterCommand : public CommandHandler {
  * @brief Command handler for the "LMA" command.
  */
 class ListUserAuctionsCommand : public CommandHandler {
+  private:
+    ResponseCache _cache; /**< The responses encoded before. */
+
+    /**
+     * @brief Runs the "LMA" command, filling in the response.
+     *
+     * @param message The command message to handle.
+     * @param communication The list user auctions communication.
+     * @param receiver The server instance that received the command.
+     * @param generation The generation read before the auctions.
+     * @param cached Set to the cached response, if it is still current.
+     * @return The result to log.
+     */
+    std::string execute(MessageSource &message,
+                        ListUserAuctionsCommunication &communication,
+                        Server &receiver, DatabaseGeneration generation,
+                        const CachedResponse *&cached);
+
   public:
     /**
      * @brief Constructs a ListUserAuctionsCommand object.
@@ -163,12 +369,41 @@ class ListUserAuctionsCommand : public CommandHandler {
      */
     void handle(MessageSource &message, std::stringstream &response,
                 Server &receiver);
+
+    /**
+     * @brief Handles the "LMA" command, encoding the response without
+     * allocating.
+     *
+     * @param message The command message to handle.
+     * @param response The buffer to write the command response to.
+     * @param receiver The server instance that received the command.
+     */
+    void handle(MessageSource &message, MessageBuffer &response,
+                Server &receiver);
 };
 
 /**
  * @brief Command handler for the "LMB" command.
  */
 class ListUserBidsCommand : public CommandHandler {
+  private:
+    ResponseCache _cache; /**< The responses encoded before. */
+
+    /**
+     * @brief Runs the "LMB" command, filling in the response.
+     *
+     * @param message The command message to handle.
+     * @param communication The list user bids communication.
+     * @param receiver The server instance that received the command.
+     * @param generation The generation read before the auctions.
+     * @param cached Set to the cached response, if it is still current.
+     * @return The result to log.
+     */
+    std::string execute(MessageSource &message,
+                        ListUserBidsCommunication &communication,
+                        Server &receiver, DatabaseGeneration generation,
+                        const CachedResponse *&cached);
+
   public:
     /**
      * @brief Constructs a ListUserBidsCommand object.
@@ -184,12 +419,41 @@ class ListUserBidsCommand : public CommandHandler {
      */
     void handle(MessageSource &message, std::stringstream &response,
                 Server &receiver);
+
+    /**
+     * @brief Handles the "LMB" command, encoding the response without
+     * allocating.
+     *
+     * @param message The command message to handle.
+     * @param response The buffer to write the command response to.
+     * @param receiver The server instance that received the command.
+     */
+    void handle(MessageSource &message, MessageBuffer &response,
+                Server &receiver);
 };
 
 /**
  * @brief Command handler for the "LST" command.
  */
 class ListAllAuctionsCommand : public CommandHandler {
+  private:
+    ResponseCache _cache; /**< The responses encoded before. */
+
+    /**
+     * @brief Runs the "LST" command, filling in the response.
+     *
+     * @param message The command message to handle.
+     * @param communication The list all auctions communication.
+     * @param receiver The server instance that received the command.
+     * @param generation The generation read before the auctions.
+     * @param cached Set to the cached response, if it is still current.
+     * @return The result to log.
+     */
+    std::string execute(MessageSource &message,
+                        ListAllAuctionsCommunication &communication,
+                        Server &receiver, DatabaseGeneration generation,
+                        const CachedResponse *&cached);
+
   public:
     /**
      * @brief Constructs a ListAllAuctionsCommand object.
@@ -205,12 +469,36 @@ class ListAllAuctionsCommand : public CommandHandler {
      */
     void handle(MessageSource &message, std::stringstream &response,
                 Server &receiver);
+
+    /**
+     * @brief Handles the "LST" command, encoding the response without
+     * allocating.
+     *
+     * @param message The command message to handle.
+     * @param response The buffer to write the command response to.
+     * @param receiver The server instance that received the command.
+     */
+    void handle(MessageSource &message, MessageBuffer &response,
+                Server &receiver);
 };
 
 /**
  * @brief Command handler for the "SRC" command.
  */
 class ShowRecordCommand : public CommandHandler {
+  private:
+    /**
+     * @brief Runs the "SRC" command, filling in the response.
+     *
+     * @param message The command message to handle.
+     * @param communication The show record communication.
+     * @param receiver The server instance that received the command.
+     * @return The result to log.
+     */
+    std::string execute(MessageSource &message,
+                        ShowRecordCommunication &communication,
+                        Server &receiver);
+
   public:
     /**
      * @brief Constructs a ShowRecordCommand object.
@@ -226,6 +514,17 @@ class ShowRecordCommand : public CommandHandler {
      */
     void handle(MessageSource &message, std::stringstream &response,
                 Server &receiver);
+
+    /**
+     * @brief Handles the "SRC" command, encoding the response without
+     * allocating.
+     *
+     * @param message The command message to handle.
+     * @param response The buffer to write the command response to.
+     * @param receiver The server instance that received the command.
+     */
+    void handle(MessageSource &message, MessageBuffer &response,
+                Server &receiver);
 };
 
 /**
@@ -289,6 +588,52 @@ class ShowAssetCommand : public CommandHandler {
      */
     void handle(MessageSource &message, std::stringstream &response,
                 Server &receiver);
+
+    /**
+     * @brief Handles the "SAS" command, attaching the asset file instead of
+     * copying it to the response.
+     *
+     * @param message The command message to handle.
+     * @param response The response stream to write the response header to.
+     * @param attachment The attachment that receives the asset file.
+     * @param receiver The server instance that received the command.
+     */
+    void handle(MessageSource &message, std::stringstream &response,
+                FileAttachment &attachment, Server &receiver);
+};
+
+/**
+ * @brief Command handler for the "SAR" command, that sends a byte range of
+ * the asset of an auction.
+ */
+class ShowAssetRangeCommand : public CommandHandler {
+  public:
+    /**
+     * @brief Constructs a ShowAssetRangeCommand object.
+     */
+    ShowAssetRangeCommand() : CommandHandler("SAR"){};
+
+    /**
+     * @brief Handles the "SAR" command.
+     *
+     * @param message The command message to handle.
+     * @param response The response stream to write the command response to.
+     * @param receiver The server instance that received the command.
+     */
+    void handle(MessageSource &message, std::stringstream &response,
+                Server &receiver);
+
+    /**
+     * @brief Handles the "SAR" command, attaching the range of the asset file
+     * instead of copying it to the response.
+     *
+     * @param message The command message to handle.
+     * @param response The response stream to write the response header to.
+     * @param attachment The attachment that receives the asset file.
+     * @param receiver The server instance that received the command.
+     */
+    void handle(MessageSource &message, std::stringstream &response,
+                FileAttachment &attachment, Server &receiver);
 };
 
 /**
@@ -312,6 +657,53 @@ class BidCommand : public CommandHandler {
                 Server &receiver);
 };
 
+/**
+ * @brief Command handler for the "STA" admin command, that reports the
+ * metrics of the server.
+ */
+class StatsCommand : public CommandHandler {
+  public:
+    /**
+     * @brief Constructs a StatsCommand object.
+     */
+    StatsCommand() : CommandHandler("STA"){};
+
+    /**
+     * @brief Handles the "STA" command.
+     *
+     * @param message The command message to handle.
+     * @param response The response stream to write the command response to.
+     * @param receiver The server instance that received the command.
+     */
+    void handle(MessageSource &message, std::stringstream &response,
+                Server &receiver);
+};
+
+/**
+ * @brief Command handler for the "KAL" command, that keeps the TCP connection
+ * open for more requests.
+ *
+ * The handler only answers the request, the TCP servers keep a connection
+ * open once its request is PROTOCOL_KEEPALIVE_REQUEST.
+ */
+class KeepAliveCommand : public CommandHandler {
+  public:
+    /**
+     * @brief Constructs a KeepAliveCommand object.
+     */
+    KeepAliveCommand() : CommandHandler("KAL"){};
+
+    /**
+     * @brief Handles the "KAL" command.
+     *
+     * @param message The command message to handle.
+     * @param response The response stream to write the command response to.
+     * @param receiver The server instance that received the command.
+     */
+    void handle(MessageSource &message, std::stringstream &response,
+                Server &receiver);
+};
+
 /**
  * @brief Writes a protocol error response to the response stream.
  *
@@ -319,4 +711,20 @@ class BidCommand : public CommandHandler {
  */
 void protocolError(std::stringstream &response);
 
+/**
+ * @brief Writes a protocol error response to the response buffer.
+ *
+ * @param response The response buffer to write the error response to.
+ */
+void protocolError(MessageBuffer &response);
+
+/**
+ * @brief Checks if a response reports a protocol error, after which the rest
+ * of a kept alive connection can not be trusted to start with a request.
+ *
+ * @param response The response.
+ * @return true if its status is ERR, false otherwise.
+ */
+bool isErrorResponse(const std::string &response);
+
 #endif
\ No newline at end of file
@@ -1,135 +1,513 @@
 #include "database.hpp"
+#include "asset.hpp"
+#include "checkpoint.hpp"
+#include "expiry.hpp"
+#include "index.hpp"
+#include "journal.hpp"
+#include "lock.hpp"
+#include "session.hpp"
+#include "uring.hpp"
+
+/**
+ * @brief  Returns a NUL padded field of a record as a string.
+ * @param  field The field.
+ * @param  size The size of the field.
+ */
+static std::string FieldToString(const char *field, size_t size) {
+    return std::string(field, strnlen(field, size));
+}
 
-Database::Database(std::string path) {
-    _core = std::make_unique<DatabaseCore>(path);
-    _lock = std::make_unique<DatabaseLock>(path);
+/**
+ * @brief  Copies a string to a field of a record, NUL padded if it is shorter
+ * and cut if it is longer. The record must have been zeroed.
+ * @param  field The field.
+ * @param  size The size of the field.
+ * @param  source The string.
+ */
+static void CopyField(char *field, size_t size, const std::string &source) {
+    memcpy(field, source.data(), std::min(source.size(), size));
 }
 
-bool Database::loginUser(std::string uid, std::string password) {
-    lock();
+/**
+ * @brief  Creates a zeroed journal record.
+ * @param  operation The change recorded.
+ * @param  uid The UID of the user making it.
+ * @param  aid The AID of the auction it is made to, empty for none.
+ * @retval the record.
+ */
+static JournalRecord MakeRecord(JournalOperation operation, std::string uid,
+                                std::string aid) {
+    JournalRecord record;
+
+    memset(&record, 0, sizeof(record));
+    record.operation = operation;
+    CopyField(record.uid, sizeof(record.uid), uid);
+    CopyField(record.aid, sizeof(record.aid), aid);
+
+    return record;
+}
 
-    if (!_core->userExists(uid)) {
-        _core->createUser(uid, password);
-        _core->setLoggedIn(uid);
-        unlock();
-        return true;
+/**
+ * @brief  Syncs a file or directory to the disk.
+ * @param  path The path of the file or directory.
+ */
+static void SyncPath(fs::path path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1 || fsync(fd) == -1) {
+        if (fd != -1) {
+            close(fd);
+        }
+        throw DatabaseException("Could not sync " + path.string());
     }
 
-    if (!_core->isUserRegistered(uid)) {
-        _core->registerUser(uid, password);
-        _core->setLoggedIn(uid);
-        unlock();
-        return true;
+    close(fd);
+}
+
+Database::Database(std::string path, BidStorage bidStorage,
+                   size_t syncInterval, bool journaled) {
+    _core = std::make_unique<DatabaseCore>(path, bidStorage, syncInterval);
+    _locks = std::make_unique<LockManager>();
+    _index = std::make_unique<AuctionIndex>();
+    _sessions = std::make_unique<SessionTable>();
+    _assets = std::make_unique<AssetCache>();
+    _expiry = std::make_unique<ExpiryScheduler>();
+    _checkpoint = std::make_unique<IndexCheckpoint>(
+        fs::path(path) / "INDEX", *_index, *_sessions, journaled);
+
+    std::vector<JournalRecord> records;
+
+    if (journaled) {
+        _journal = std::make_unique<Journal>(fs::path(path) / "JOURNAL");
+
+        // Finishes the changes a crash cut short
+        records = _journal->recover();
+        for (auto &record : records) {
+            replay(record);
+        }
+        _journal->setIndexCheckpoint(_checkpoint.get());
+    }
+
+    // The server has not forked yet, no locks needed
+    if (_checkpoint->load()) {
+        // Written when the journal was last emptied, the entries of the
+        // changes journaled since are read again
+        for (auto &record : records) {
+            std::string uid = FieldToString(record.uid, sizeof(record.uid));
+            std::string aid = FieldToString(record.aid, sizeof(record.aid));
+
+            if (!uid.empty()) {
+                _sessions->loadUser(*_core, uid);
+            }
+            if (!aid.empty()) {
+                _index->loadAuction(*_core, aid);
+            }
+        }
+    } else {
+        _index->load(*_core);
+        _sessions->load(*_core);
+    }
+
+    // The deadlines are not stored, they are rebuilt from the start info
+    for (auto &aid : _index->getAll()) {
+        if (_index->hasEnded(aid)) {
+            continue;
+        }
+
+        AuctionStartInfo startInfo = _index->getStartInfo(aid);
+        time_t deadline = startInfo.startTime + startInfo.timeActive;
+
+        // Auto closes are not journaled, it may have ended after the
+        // checkpoint was written
+        if (deadline < time(NULL)) {
+            _index->loadAuction(*_core, aid);
+            if (_index->hasEnded(aid)) {
+                continue;
+            }
+        }
+
+        _expiry->schedule(AidStrToInt(aid), deadline);
+    }
+
+    if (journaled) {  // Writes the checkpoint, then starts a new journal
+        _journal->reset();
+    } else {
+        _checkpoint->write();
+    }
+}
+
+Database::~Database() {}
+
+void Database::setMetrics(Metrics *metrics) {
+    _locks->setMetrics(metrics);
+}
+
+void Database::setShard(int shard, int shards) {
+    if (shards < 1 || shard < 0 || shard >= shards) {
+        throw DatabaseException("Invalid shard " + std::to_string(shard) +
+                                "/" + std::to_string(shards));
+    }
+
+    _shard = shard;
+    _shards = shards;
+}
+
+void Database::setAssetCacheSize(size_t bytes) {
+    _assets->setBudget(bytes);
+}
+
+void Database::setIoRing(bool enabled) {
+    _core->setLinkedWrites(enabled);
+}
+
+JournalEntry Database::journal(JournalRecord &record) {
+    if (_journal == NULL) {
+        return JournalEntry(NULL, 0);
+    }
+
+    return _journal->append(record, [this, record]() mutable {
+        repair(record);
+    });
+}
+
+void Database::replay(JournalRecord &record) {
+    std::string uid = FieldToString(record.uid, sizeof(record.uid));
+    std::string aid = FieldToString(record.aid, sizeof(record.aid));
+
+    switch (record.operation) {
+        case JournalOperation::Login: {
+            std::string password =
+                FieldToString(record.password, sizeof(record.password));
+
+            if (!_core->userExists(uid)) {
+                _core->createUser(uid, password);
+            } else if (!_core->isUserRegistered(uid)) {
+                _core->registerUser(uid, password);
+            }
+            _core->setLoggedIn(uid);
+            break;
+        }
+        case JournalOperation::Logout:
+            if (_core->userExists(uid)) {
+                _core->setLoggedOut(uid);
+            }
+            break;
+        case JournalOperation::Unregister:
+            if (_core->userExists(uid)) {
+                _core->unregisterUser(uid);
+            }
+            break;
+        case JournalOperation::CreateAuction: {
+            if (!_core->hasAuctionStarted(aid)) {  // Cut short, made again
+                _core->removeAuction(aid);
+
+                AuctionStartInfo info;
+                info.uid = uid;
+                info.name = FieldToString(record.name, sizeof(record.name));
+                info.startValue = record.value;
+                info.startTime = (time_t)record.time;
+                info.timeActive = (time_t)record.timeActive;
+                _core->createAuction(aid, info);
+            }
+
+            std::vector<std::string> hosted = _core->getUserHostedAuctions(uid);
+            if (std::find(hosted.begin(), hosted.end(), aid) == hosted.end()) {
+                _core->addUserHostedAuction(uid, aid);
+            }
+            break;
+        }
+        case JournalOperation::Bid: {
+            _core->addUserBid(uid, aid);
+
+            // Bid values always increase, the last one tells if it was made
+            std::vector<AuctionBidInfo> last =
+                _core->getAuctionLastBids(aid, 1);
+            if (last.empty() || last.back().bidValue < record.value) {
+                AuctionBidInfo bidInfo;
+                bidInfo.uid = uid;
+                bidInfo.bidValue = record.value;
+                bidInfo.bidTime = (time_t)record.time;
+                _core->addAuctionBid(aid, bidInfo);
+            } else if (_core->getAuctionBidSummary(aid).maxBid < record.value) {
+                // Made, but not counted by the summary, which is rebuilt
+                std::vector<AuctionBidInfo> bids = _core->getAuctionBids(aid);
+                AuctionBidSummary summary;
+                summary.maxBid = _core->getAuctionStartInfo(aid).startValue - 1;
+                summary.bidCount = (int)bids.size();
+                for (auto &bid : bids) {
+                    summary.maxBid = std::max(summary.maxBid, bid.bidValue);
+                }
+                _core->setAuctionBidSummary(aid, summary);
+            }
+            break;
+        }
+        case JournalOperation::CloseAuction:
+            if (!_core->hasAuctionEnded(aid)) {
+                AuctionEndInfo endInfo;
+                endInfo.endTime = (time_t)record.time;
+                _core->endAuction(aid, endInfo);
+            }
+            break;
+        default:
+            break;
     }
+}
+
+void Database::repair(JournalRecord &record) {
+    std::string uid = FieldToString(record.uid, sizeof(record.uid));
+    std::string aid = FieldToString(record.aid, sizeof(record.aid));
+
+    replay(record);
+
+    // The tables are read again from the files the replay finished
+    if (!uid.empty()) {
+        _sessions->loadUser(*_core, uid);
+    }
+    if (!aid.empty()) {
+        _index->loadAuction(*_core, aid);
+    }
+
+    if (record.operation == JournalOperation::CreateAuction &&
+        _index->contains(aid) && !_index->hasEnded(aid)) {
+        _expiry->schedule(AidStrToInt(aid),
+                          (time_t)(record.time + record.timeActive));
+    }
+}
 
-    if (_core->getUserPassword(uid) != password) {
-        unlock();
+thread_local std::shared_ptr<AssetUpload> AssetUpload::_received;
+
+AssetUpload::AssetUpload(fs::path directory) {
+    std::string name = (directory / "UPLOAD_XXXXXX").string();
+
+    int fd = mkstemp(name.data());  // Creates a file with a unique name
+    if (fd == -1) {
+        throw DatabaseException("Could not create the upload file");
+    }
+    fchmod(fd, 0644);  // The permissions the assets always had, not 0600
+    close(fd);
+
+    _path = name;
+    _file.open(_path, std::ios::binary | std::ios::trunc);
+}
+
+AssetUpload::~AssetUpload() {
+    _file.close();
+
+    std::error_code error;  // Nothing to do if it was already renamed
+    fs::remove(_path, error);
+}
+
+std::ofstream &AssetUpload::getStream() {
+    return _file;
+}
+
+fs::path AssetUpload::finish() {
+    _file.close();
+
+    if (_file.fail()) {
+        throw DatabaseException("Could not write the upload file");
+    }
+
+    return _path;
+}
+
+void AssetUpload::setReceived(std::shared_ptr<AssetUpload> upload) {
+    _received = std::move(upload);
+}
+
+std::shared_ptr<AssetUpload> AssetUpload::takeReceived() {
+    return std::move(_received);
+}
+
+bool Database::loginUser(std::string uid, std::string password) {
+    LockGuard userGuard = _locks->lockUser(uid, LockMode::Exclusive);
+
+    bool exists = _sessions->exists(uid);
+    bool registered = _sessions->isRegistered(uid);
+
+    if (registered && !_sessions->checkPassword(uid, password)) {
         throw LoginException();
     }
 
+    if (_sessions->isLoggedIn(uid)) {
+        return false;  // Nothing changes, nothing to journal
+    }
+
+    CheckpointChange change(*_checkpoint);
+
+    JournalRecord record = MakeRecord(JournalOperation::Login, uid, "");
+    CopyField(record.password, sizeof(record.password), password);
+    JournalEntry entry = journal(record);
+    entry.sync();  // On the disk before any file is changed
+
+    if (!exists) {
+        _core->createUser(uid, password);
+    } else if (!registered) {
+        _core->registerUser(uid, password);
+    }
     _core->setLoggedIn(uid);
-    unlock();
 
-    return false;
+    if (!registered) {
+        _sessions->setRegistered(uid, password);
+    }
+    _sessions->setLoggedIn(uid);
+
+    userGuard.unlock();
+    entry.commit();
+
+    return !registered;
 }
 
 void Database::logoutUser(std::string uid, std::string password) {
-    lock();
+    LockGuard userGuard = _locks->lockUser(uid, LockMode::Exclusive);
 
     if (!checkUserRegistered(uid)) {
-        unlock();
         throw UnregisteredException();
     }
 
     if (!checkLoggedIn(uid, password)) {
-        unlock();
         throw LoginException();
     }
 
+    CheckpointChange change(*_checkpoint);
+
+    JournalRecord record = MakeRecord(JournalOperation::Logout, uid, "");
+    JournalEntry entry = journal(record);
+    entry.sync();  // On the disk before any file is changed
+
     _core->setLoggedOut(uid);
+    _sessions->setLoggedOut(uid);
 
-    unlock();
+    userGuard.unlock();
+    entry.commit();
 }
 
 void Database::unregisterUser(std::string uid, std::string password) {
-    lock();
+    LockGuard userGuard = _locks->lockUser(uid, LockMode::Exclusive);
 
     if (!checkUserRegistered(uid)) {
-        unlock();
         throw UnregisteredException();
     }
 
     if (!checkLoggedIn(uid, password)) {
-        unlock();
         throw LoginException();
     }
 
+    CheckpointChange change(*_checkpoint);
+
+    JournalRecord record = MakeRecord(JournalOperation::Unregister, uid, "");
+    JournalEntry entry = journal(record);
+    entry.sync();  // On the disk before any file is changed
+
     _core->unregisterUser(uid);
+    _sessions->setUnregistered(uid);
 
-    unlock();
+    userGuard.unlock();
+    entry.commit();
 }
 
 void Database::handleAutoClosing(std::string aid) {
-    if (_core->hasAuctionEnded(aid)) {
+    if (_index->hasEnded(aid)) {
         return;
     }
 
-    AuctionStartInfo startInfo = _core->getAuctionStartInfo(aid);
+    AuctionStartInfo startInfo = _index->getStartInfo(aid);
     if (startInfo.startTime + startInfo.timeActive < time(NULL)) {
         AuctionEndInfo endInfo;
         endInfo.endTime = startInfo.startTime + startInfo.timeActive;
         _core->endAuction(aid, endInfo);
+        _index->endAuction(aid, endInfo);
     }
 }
 
-bool Database::checkUserRegistered(std::string uid) {
-    if (!_core->userExists(uid)) {
-        return false;
-    }
+bool Database::isAuctionActive(std::string aid) {
+    LockGuard auctionGuard = _locks->lockAuction(aid, LockMode::Shared);
 
-    if (!_core->isUserRegistered(uid)) {
-        return false;
+    if (!_index->contains(aid)) {
+        throw AuctionException();
     }
 
-    return true;
+    // Ended by the expiry scheduler as soon as its time is up
+    return !_index->hasEnded(aid);
 }
 
-bool Database::checkLoggedIn(std::string uid, std::string password) {
-    if (!checkUserRegistered(uid)) {
-        return false;
+DatabaseGeneration Database::getGeneration() {
+    return _index->getGeneration();
+}
+
+uint64_t Database::getRecordGeneration(std::string aid) {
+    LockGuard auctionGuard = _locks->lockAuction(aid, LockMode::Shared);
+
+    if (!_index->contains(aid)) {
+        throw AuctionException();
     }
 
-    if (_core->getUserPassword(uid) != password) {
-        return false;
+    return _index->getRecordGeneration(aid);
+}
+
+bool Database::isUserLoggedIn(std::string uid) {
+    LockGuard userGuard = _locks->lockUser(uid, LockMode::Shared);
+
+    return _sessions->isLoggedIn(uid);
+}
+
+void Database::runExpiryScheduler() {
+    time_t nextCheckpoint = time(NULL) + DATABASE_CHECKPOINT_INTERVAL;
+
+    while (1) {
+        int expired = _expiry->waitExpired(nextCheckpoint);
+
+        if (expired == -1) {
+            nextCheckpoint = time(NULL) + DATABASE_CHECKPOINT_INTERVAL;
+
+            // With a journal, it is written whenever the journal is emptied
+            if (_journal == NULL) {
+                _checkpoint->write();
+            }
+            continue;
+        }
+
+        std::string aid = AidIntToStr(expired);
+
+        LockGuard auctionGuard = _locks->lockAuction(aid, LockMode::Exclusive);
+
+        if (_index->contains(aid)) {  // Unless the database was wiped
+            handleAutoClosing(aid);
+        }
     }
+}
 
-    bool loggedIn = _core->isUserLoggedIn(uid);
+bool Database::checkUserRegistered(std::string uid) {
+    return _sessions->isRegistered(uid);
+}
 
-    return loggedIn;
+bool Database::checkLoggedIn(std::string uid, std::string password) {
+    // Kept by the session table, the user files are never read
+    return _sessions->checkPassword(uid, password) &&
+           _sessions->isLoggedIn(uid);
 }
 
 std::map<std::string, std::string> Database::getAllAuctions() {
-    lock();
+    std::vector<std::string> auctions;
 
-    std::vector<std::string> auctions = _core->getAllAuctions();
+    {
+        LockGuard globalGuard = _locks->lockGlobal(LockMode::Shared);
+        auctions = _index->getAll();
+    }
 
     std::map<std::string, std::string> auctionsMap;
 
     for (auto &auction : auctions) {
-        handleAutoClosing(auction);
-        auctionsMap[auction] = (_core->hasAuctionEnded(auction) ? "0" : "1");
+        auctionsMap[auction] = (isAuctionActive(auction) ? "1" : "0");
     }
 
-    unlock();
-
     return auctionsMap;
 }
 
 std::map<std::string, std::string> Database::getUserAuctions(std::string uid) {
-    lock();
+    LockGuard userGuard = _locks->lockUser(uid, LockMode::Shared);
 
-    if (!_core->userExists(uid) || !_core->isUserLoggedIn(uid)) {
-        unlock();
+    if (!_sessions->isLoggedIn(uid)) {
         throw LoginException();
     }
 
@@ -138,20 +516,16 @@ std::map<std::string, std::string> Database::getUserAuctions(std::string uid) {
     std::map<std::string, std::string> auctionsMap;
 
     for (auto &auction : auctions) {
-        handleAutoClosing(auction);
-        auctionsMap[auction] = (_core->hasAuctionEnded(auction) ? "0" : "1");
+        auctionsMap[auction] = (isAuctionActive(auction) ? "1" : "0");
     }
 
-    unlock();
-
     return auctionsMap;
 }
 
 std::map<std::string, std::string> Database::getUserBids(std::string uid) {
-    lock();
+    LockGuard userGuard = _locks->lockUser(uid, LockMode::Shared);
 
-    if (!_core->userExists(uid) || !_core->isUserLoggedIn(uid)) {
-        unlock();
+    if (!_sessions->isLoggedIn(uid)) {
         throw LoginException();
     }
 
@@ -160,40 +534,55 @@ std::map<std::string, std::string> Database::getUserBids(std::string uid) {
     std::map<std::string, std::string> auctionsMap;
 
     for (auto &auction : auctions) {
-        handleAutoClosing(auction);
-        auctionsMap[auction] = (_core->hasAuctionEnded(auction) ? "0" : "1");
+        auctionsMap[auction] = (isAuctionActive(auction) ? "1" : "0");
     }
 
-    unlock();
-
     return auctionsMap;
 }
 
 std::string Database::generateAid() {
-    std::vector<std::string> auctions = _core->getAllAuctions();
-
-    if (auctions.size() == 0) {
-        return "001";
-    }
+    int aid = _index->getLastAid() + 1;
 
-    std::string last = auctions.back();
+    // Skips to the next AID of the shard, the others belong to other servers
+    aid += ((_shard - aid) % _shards + _shards) % _shards;
 
-    return AidIntToStr(AidStrToInt(last) + 1);
+    return AidIntToStr(aid);
 }
 
 std::string Database::createAuction(std::string uid, std::string password,
                                     std::string name, int startValue,
                                     time_t timeActive, std::string fileName,
                                     std::stringstream &file) {
-    lock();
+    std::unique_ptr<AssetUpload> upload = createUpload();
+
+    upload->getStream() << file.rdbuf();
+
+    return createAuction(uid, password, name, startValue, timeActive, fileName,
+                         *upload);
+}
+
+std::unique_ptr<AssetUpload> Database::createUpload() {
+    return std::make_unique<AssetUpload>(_core->getUploadsPath());
+}
+
+std::string Database::createAuction(std::string uid, std::string password,
+                                    std::string name, int startValue,
+                                    time_t timeActive, std::string fileName,
+                                    AssetUpload &upload) {
+    fs::path uploadPath = upload.finish();
+
+    LockGuard userGuard = _locks->lockUser(uid, LockMode::Exclusive);
 
     if (!checkLoggedIn(uid, password)) {
-        unlock();
         throw LoginException();
     }
 
+    LockGuard globalGuard = _locks->lockGlobal(LockMode::Exclusive);
+
     std::string aid = generateAid();
 
+    LockGuard auctionGuard = _locks->lockAuction(aid, LockMode::Exclusive);
+
     AuctionStartInfo info;
 
     info.uid = uid;
@@ -202,64 +591,80 @@ std::string Database::createAuction(std::string uid, std::string password,
     info.timeActive = timeActive;
     info.startTime = time(NULL);
 
+    CheckpointChange change(*_checkpoint);
+
+    JournalRecord record =
+        MakeRecord(JournalOperation::CreateAuction, uid, aid);
+    CopyField(record.name, sizeof(record.name), name);
+    CopyField(record.fileName, sizeof(record.fileName), fileName);
+    record.value = startValue;
+    record.time = (int64_t)info.startTime;
+    record.timeActive = (int64_t)timeActive;
+    JournalEntry entry = journal(record);
+    entry.sync();  // On the disk before any file is changed
+
     _core->createAuction(aid, info);
+    _index->addAuction(aid, info);
+    _expiry->schedule(AidStrToInt(aid), info.startTime + info.timeActive);
+
+    // The AID is taken, the asset is moved without blocking other auctions
+    globalGuard.unlock();
 
     _core->addUserHostedAuction(uid, aid);
 
-    _core->getAuctionFilePath(aid);
+    if (_journal != NULL) {  // The asset is not in the journal, it is synced
+        SyncPath(uploadPath);
+    }
+
+    _core->storeAsset(uploadPath, aid, fileName);
 
-    std::ofstream auctionFile(_core->getAuctionFilePath(aid) / fileName);
+    if (_journal != NULL) {
+        SyncPath(_core->getAuctionFilePath(aid));
+    }
 
-    auctionFile << file.rdbuf();
+    auctionGuard.unlock();
+    userGuard.unlock();
+    entry.commit();
 
-    unlock();
     return aid;
 }
 
 int Database::getAuctionCurrentMaxValue(std::string aid) {
-    std::vector<AuctionBidInfo> bids = _core->getAuctionBids(aid);
-
-    if (bids.size() == 0) {
-        return (_core->getAuctionStartInfo(aid).startValue - 1);
-    }
-
-    return bids.back().bidValue;
+    // Kept by the index from the bid summary, the bids are never read
+    return _index->getMaxBid(aid);
 }
 
 std::string Database::getAuctionOwner(std::string aid) {
-    AuctionStartInfo info = _core->getAuctionStartInfo(aid);
+    AuctionStartInfo info = _index->getStartInfo(aid);
 
     return info.uid;
 }
 
 void Database::bidAuction(std::string uid, std::string password,
                           std::string aid, int value) {
-    lock();
+    LockGuard userGuard = _locks->lockUser(uid, LockMode::Exclusive);
 
     if (!checkLoggedIn(uid, password)) {
-        unlock();
         throw LoginException();
     }
 
-    if (!_core->auctionExists(aid)) {
-        unlock();
+    LockGuard auctionGuard = _locks->lockAuction(aid, LockMode::Exclusive);
+
+    if (!_index->contains(aid)) {
         throw AuctionException();
     }
 
     handleAutoClosing(aid);
 
-    if (_core->hasAuctionEnded(aid)) {
-        unlock();
+    if (_index->hasEnded(aid)) {
         throw AuctionEndedException();
     }
 
     if (getAuctionOwner(aid) == uid) {
-        unlock();
         throw AuctionOwnerException();
     }
 
     if (value <= getAuctionCurrentMaxValue(aid)) {
-        unlock();
         throw BidValueException();
     }
 
@@ -269,168 +674,285 @@ void Database::bidAuction(std::string uid, std::string password,
     bidInfo.bidValue = value;
     bidInfo.bidTime = time(NULL);
 
+    CheckpointChange change(*_checkpoint);
+
+    JournalRecord record = MakeRecord(JournalOperation::Bid, uid, aid);
+    record.value = value;
+    record.time = (int64_t)bidInfo.bidTime;
+    JournalEntry entry = journal(record);
+    entry.sync();  // On the disk before any file is changed
+
     _core->addUserBid(uid, aid);
 
     _core->addAuctionBid(aid, bidInfo);
+    _index->addBid(aid, bidInfo);
 
-    unlock();
+    auctionGuard.unlock();
+    userGuard.unlock();
+    entry.commit();
 }
 
-int Database::getAuctionAsset(std::string aid, std::string &fileName,
-                              std::stringstream &file) {
-    lock();
+std::shared_ptr<CachedAsset> Database::getCachedAsset(std::string aid) {
+    std::shared_ptr<CachedAsset> asset = _assets->get(aid);
 
-    if (!_core->auctionExists(aid)) {
-        unlock();
-        throw AuctionException();
+    if (asset != NULL) {  // The asset never changes once cached
+        return asset;
     }
 
     if (fs::is_empty(_core->getAuctionFilePath(aid))) {
-        unlock();
         throw AuctionException();
     }
 
-    handleAutoClosing(aid);
+    std::string fileName = _core->getAuctionFileName(aid);
+    fs::path assetPath = _core->getAuctionFilePath(aid) / fileName;
+
+    int fd = open(assetPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        throw AuctionException();
+    }
+
+    struct stat assetStat;
+    if (fstat(fd, &assetStat) == -1) {
+        close(fd);
+        throw AuctionException();
+    }
 
-    fileName = _core->getAuctionFileName(aid);
-    std::ifstream auctionAsset(_core->getAuctionFilePath(aid) / fileName);
-    file << auctionAsset.rdbuf();
-    int size = (int)fs::file_size(_core->getAuctionFilePath(aid) / fileName);
+    // Assets are never changed, the size stays right after the lock is gone
+    asset = std::make_shared<CachedAsset>(fileName, fd,
+                                          (size_t)assetStat.st_size);
+    _assets->put(aid, asset);
 
-    unlock();
-    return size;
+    return asset;
 }
 
-std::string Database::getAssetName(std::string aid) {
-    lock();
+int Database::getAuctionAsset(std::string aid, std::string &fileName,
+                              std::stringstream &file) {
+    LockGuard auctionGuard = _locks->lockAuction(aid, LockMode::Shared);
 
-    if (!_core->auctionExists(aid)) {
-        unlock();
+    if (!_index->contains(aid)) {
         throw AuctionException();
     }
 
-    std::string name = _core->getAuctionFileName(aid);
+    std::shared_ptr<CachedAsset> asset = getCachedAsset(aid);
+    fileName = asset->getFileName();
 
-    unlock();
-    return name;
+    if (asset->getData() != NULL) {
+        file.write(asset->getData(), (std::streamsize)asset->getSize());
+    } else {  // Empty, or could not be mapped
+        std::ifstream auctionAsset(_core->getAuctionFilePath(aid) / fileName);
+        file << auctionAsset.rdbuf();
+    }
+
+    return (int)asset->getSize();
+}
+
+int Database::openAuctionAsset(std::string aid, std::string &fileName,
+                               int &fileSize) {
+    LockGuard auctionGuard = _locks->lockAuction(aid, LockMode::Shared);
+
+    if (!_index->contains(aid)) {
+        throw AuctionException();
+    }
+
+    std::shared_ptr<CachedAsset> asset = getCachedAsset(aid);
+
+    int fd = asset->duplicate();  // The cache keeps its own
+    if (fd == -1) {
+        throw AuctionException();
+    }
+
+    fileName = asset->getFileName();
+    fileSize = (int)asset->getSize();
+
+    return fd;
 }
 
 void Database::closeAuction(std::string uid, std::string password,
                             std::string aid) {
-    lock();
+    LockGuard userGuard = _locks->lockUser(uid, LockMode::Shared);
 
     if (!checkLoggedIn(uid, password)) {
-        unlock();
         throw LoginException();
     }
 
-    if (!_core->auctionExists(aid)) {
-        unlock();
+    LockGuard auctionGuard = _locks->lockAuction(aid, LockMode::Exclusive);
+
+    if (!_index->contains(aid)) {
         throw AuctionException();
     }
 
     handleAutoClosing(aid);
 
-    if (_core->hasAuctionEnded(aid)) {
-        unlock();
+    if (_index->hasEnded(aid)) {
         throw AuctionEndedException();
     }
 
     if (getAuctionOwner(aid) != uid) {
-        unlock();
         throw AuctionOwnerException();
     }
 
     AuctionEndInfo endInfo;
     endInfo.endTime = time(NULL);
 
+    CheckpointChange change(*_checkpoint);
+
+    JournalRecord record =
+        MakeRecord(JournalOperation::CloseAuction, uid, aid);
+    record.time = (int64_t)endInfo.endTime;
+    JournalEntry entry = journal(record);
+    entry.sync();  // On the disk before any file is changed
+
     _core->endAuction(aid, endInfo);
+    _index->endAuction(aid, endInfo);
 
-    unlock();
+    auctionGuard.unlock();
+    userGuard.unlock();
+    entry.commit();
 }
 
-AuctionStartInfo Database::getAuctionStartInfo(std::string aid) {
-    lock();
+AuctionRecord Database::getAuctionRecord(std::string aid, size_t maxBids) {
+    LockGuard auctionGuard = _locks->lockAuction(aid, LockMode::Shared);
 
-    if (!_core->auctionExists(aid)) {
-        unlock();
+    if (!_index->contains(aid)) {
         throw AuctionException();
     }
 
-    AuctionStartInfo info = _core->getAuctionStartInfo(aid);
+    AuctionRecord record;
 
-    handleAutoClosing(aid);
+    record.startInfo = _index->getStartInfo(aid);
+    record.assetName = _core->getAuctionFileName(aid);
+    record.bids = _core->getAuctionLastBids(aid, maxBids);
+    record.ended = _index->hasEnded(aid);
+
+    if (record.ended) {
+        record.endInfo = _index->getEndInfo(aid);
+    }
+    record.generation = _index->getRecordGeneration(aid);
 
-    unlock();
-    return info;
+    return record;
 }
 
-std::vector<AuctionBidInfo> Database::getAuctionBids(std::string aid) {
-    lock();
+void Database::wipe() {
+    LockGuard globalGuard = _locks->lockGlobal(LockMode::Exclusive);
 
-    if (!_core->auctionExists(aid)) {
-        unlock();
-        throw AuctionException();
-    }
+    _core->wipe();
+    _core->guaranteeBaseStructure();
+    _checkpoint->invalidate();  // Its file was removed too
 
-    std::vector<AuctionBidInfo> bids = _core->getAuctionBids(aid);
+    if (_journal != NULL) {  // Its file was removed with everything else
+        _journal->reopen();
+    }
+    _index->clear();
+    _sessions->clear();
+    _assets->clear();
+    _expiry->clear();
+}
 
-    unlock();
-    return bids;
+/**
+ * @brief  Fills in the header of a binary record.
+ * @param  header The header.
+ * @param  type The kind of the record.
+ */
+static void InitializeHeader(RecordHeader &header, RecordType type) {
+    memcpy(header.magic, DATABASE_RECORD_MAGIC, sizeof(header.magic));
+    header.version = DATABASE_RECORD_VERSION;
+    header.type = type;
 }
 
-AuctionEndInfo Database::getAuctionEndInfo(std::string aid) {
-    lock();
+/**
+ * @brief  Writes a binary record file, replacing whatever it had.
+ * @param  path The path of the file.
+ * @param  record The record.
+ * @param  linked Whether to write it through io_uring.
+ */
+template <typename Record>
+static void WriteRecord(fs::path path, Record &record, bool linked) {
+    FileBatch batch(linked);
 
-    if (!_core->auctionExists(aid)) {
-        unlock();
-        throw AuctionException();
+    batch.writeFile(path.string(), &record, sizeof(record));
+
+    if (!batch.run()) {
+        throw DatabaseException("Could not write a record file");
     }
+}
 
-    if (!_core->hasAuctionEnded(aid)) {
-        unlock();
-        throw AuctionEndedException();
+/**
+ * @brief  Reads a binary record file with a single read.
+ * @param  path The path of the file.
+ * @param  type The kind of record the file must have.
+ * @param  record The record read.
+ * @param  missing The message of the exception thrown if there is no file.
+ * @retval true if the record was read, false if the file is in the text format
+ * of the older servers and has to be parsed instead.
+ */
+template <typename Record>
+static bool ReadRecord(fs::path path, RecordType type, Record &record,
+                       const char *missing) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        throw DatabaseException(missing);
+    }
+
+    ssize_t n = pread(fd, &record, sizeof(record), 0);
+    close(fd);
+
+    if (n < (ssize_t)sizeof(RecordHeader) ||
+        memcmp(record.header.magic, DATABASE_RECORD_MAGIC,
+               sizeof(record.header.magic)) != 0) {
+        return false;
     }
 
-    AuctionEndInfo info = _core->getAuctionEndInfo(aid);
+    if (record.header.version != DATABASE_RECORD_VERSION ||
+        record.header.type != type || n != (ssize_t)sizeof(record)) {
+        throw DatabaseException("Unsupported or corrupted record file");
+    }
 
-    unlock();
-    return info;
+    return true;
 }
 
-bool Database::hasAuctionEnded(std::string aid) {
-    lock();
+DatabaseCore::DatabaseCore(std::string path, BidStorage bidStorage,
+                           size_t syncInterval)
+    : _bidStorage(bidStorage), _syncInterval(syncInterval) {
+    _path = std::make_unique<fs::path>(path);
 
-    if (!_core->auctionExists(aid)) {
-        unlock();
-        throw AuctionException();
-    }
+    *_path = fs::absolute(*_path);
 
-    bool res = _core->hasAuctionEnded(aid);
+    // Anonymous shared mapping, inherited by every process forked afterwards
+    void *structure = mmap(NULL, sizeof(DatabaseStructure),
+                           PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                           -1, 0);
 
-    unlock();
-    return res;
-}
+    if (structure == MAP_FAILED) {
+        throw DatabaseException("Could not allocate the database structure");
+    }
 
-void Database::lock() {
-    _lock->lock();
-}
+    _structure = (DatabaseStructure *)structure;
 
-void Database::unlock() {
-    _lock->unlock();
-}
+    guaranteeBaseStructure();
 
-void Database::wipe() {
-    _core->wipe();
-    _core->guaranteeBaseStructure();
+    // Uploads interrupted by a crash belong to no auction
+    for (auto &upload : fs::directory_iterator(*_path / "UPLOADS")) {
+        fs::remove(upload.path());
+    }
 }
 
-DatabaseCore::DatabaseCore(std::string path) {
-    _path = std::make_unique<fs::path>(path);
+DatabaseCore::~DatabaseCore() {
+    munmap(_structure, sizeof(DatabaseStructure));
+}
 
-    *_path = fs::absolute(*_path);
+/**
+ * @brief  Gets the index of a user or auction in the table of the
+ * directories validated.
+ * @param  id The UID or AID.
+ * @param  size The number of digits of the ID.
+ * @retval the index, -1 if the ID is not valid.
+ */
+static int StructureIndex(const std::string &id, size_t size) {
+    if (id.length() != size || !isNumeric(id)) {
+        return -1;
+    }
 
-    guaranteeBaseStructure();
+    return std::stoi(id);
 }
 
 void DatabaseCore::guaranteeBaseStructure() {
@@ -461,10 +983,34 @@ void DatabaseCore::guaranteeBaseStructure() {
     } else {
         fs::create_directory(auctionsPath);
     }
+
+    fs::path uploadsPath = *_path / "UPLOADS";
+    if (fs::exists(uploadsPath)) {
+        if (!fs::is_directory(uploadsPath)) {
+            throw std::runtime_error(
+                "Database uploads path is not a directory");
+        }
+    } else {
+        fs::create_directory(uploadsPath);
+    }
+
+    fs::path assetsPath = *_path / "ASSETS";
+    if (fs::exists(assetsPath)) {
+        if (!fs::is_directory(assetsPath)) {
+            throw std::runtime_error("Database assets path is not a directory");
+        }
+    } else {
+        fs::create_directory(assetsPath);
+    }
 }
 
 void DatabaseCore::guaranteeUserStructure(std::string uid) {
-    guaranteeBaseStructure();
+    int index = StructureIndex(uid, PROTOCOL_UID_SIZE);
+
+    // User directories are never removed, once checked they stay valid
+    if (index != -1 && _structure->users[index]) {
+        return;
+    }
 
     fs::path userPath = *_path / "USERS" / uid;
 
@@ -495,10 +1041,18 @@ void DatabaseCore::guaranteeUserStructure(std::string uid) {
     } else {
         fs::create_directory(biddedPath);
     }
+
+    if (index != -1) {
+        _structure->users[index] = true;
+    }
 }
 
 void DatabaseCore::guaranteeAuctionStructure(std::string aid) {
-    guaranteeBaseStructure();
+    int index = StructureIndex(aid, PROTOCOL_AID_SIZE);
+
+    if (index != -1 && _structure->auctions[index]) {
+        return;
+    }
 
     fs::path auctionPath = *_path / "AUCTIONS" / aid;
 
@@ -529,17 +1083,21 @@ void DatabaseCore::guaranteeAuctionStructure(std::string aid) {
     } else {
         fs::create_directory(filePath);
     }
+
+    if (index != -1) {
+        _structure->auctions[index] = true;
+    }
 }
 
 void DatabaseCore::wipe() {
     if (fs::exists(*_path)) {
         fs::remove_all(*_path);
     }
+
+    memset(_structure, 0, sizeof(DatabaseStructure));
 }
 
 void DatabaseCore::createUser(std::string uid, std::string password) {
-    guaranteeBaseStructure();
-
     fs::path userPath = *_path / "USERS" / uid;
 
     if (fs::exists(userPath)) {
@@ -564,8 +1122,6 @@ void DatabaseCore::createUser(std::string uid, std::string password) {
 }
 
 bool DatabaseCore::userExists(std::string uid) {
-    guaranteeBaseStructure();
-
     fs::path userPath = *_path / "USERS" / uid;
 
     bool exists = fs::exists(userPath);
@@ -574,8 +1130,6 @@ bool DatabaseCore::userExists(std::string uid) {
 }
 
 bool DatabaseCore::isUserRegistered(std::string uid) {
-    guaranteeBaseStructure();
-
     fs::path userPath = *_path / "USERS" / uid;
 
     if (!fs::exists(userPath)) {
@@ -590,8 +1144,6 @@ bool DatabaseCore::isUserRegistered(std::string uid) {
 }
 
 void DatabaseCore::setLoggedIn(std::string uid) {
-    guaranteeBaseStructure();
-
     fs::path userPath = *_path / "USERS" / uid;
 
     if (!fs::exists(userPath)) {
@@ -616,8 +1168,6 @@ void DatabaseCore::setLoggedOut(std::string uid) {
 }
 
 bool DatabaseCore::isUserLoggedIn(std::string uid) {
-    guaranteeBaseStructure();
-
     fs::path userPath = *_path / "USERS" / uid;
 
     if (!fs::exists(userPath)) {
@@ -632,8 +1182,6 @@ bool DatabaseCore::isUserLoggedIn(std::string uid) {
 }
 
 void DatabaseCore::registerUser(std::string uid, std::string password) {
-    guaranteeBaseStructure();
-
     fs::path userPath = *_path / "USERS" / uid;
 
     if (!fs::exists(userPath)) {
@@ -652,8 +1200,6 @@ void DatabaseCore::registerUser(std::string uid, std::string password) {
 }
 
 std::string DatabaseCore::getUserPassword(std::string uid) {
-    guaranteeBaseStructure();
-
     fs::path userPath = *_path / "USERS" / uid;
 
     if (!fs::exists(userPath)) {
@@ -676,8 +1222,6 @@ std::string DatabaseCore::getUserPassword(std::string uid) {
 }
 
 void DatabaseCore::unregisterUser(std::string uid) {
-    guaranteeBaseStructure();
-
     fs::path userPath = *_path / "USERS" / uid;
 
     if (!fs::exists(userPath)) {
@@ -756,33 +1300,53 @@ std::vector<std::string> DatabaseCore::getUserBids(std::string uid) {
 }
 
 void DatabaseCore::createAuction(std::string aid, AuctionStartInfo &startInfo) {
-    guaranteeBaseStructure();
-
     fs::path auctionPath = *_path / "AUCTIONS" / aid;
 
     if (fs::exists(auctionPath)) {
         throw DatabaseException("Auction already exists");
     }
 
-    fs::create_directory(auctionPath);
+    // Every file of the auction is created by a single chain of operations
+    FileBatch batch(_linkedWrites);
+
+    batch.createDirectory(auctionPath.string());
 
     fs::path bidsPath = auctionPath / "BIDS";
 
-    fs::create_directory(bidsPath);
+    batch.createDirectory(bidsPath.string());
 
     fs::path filePath = auctionPath / "FILE";
 
-    fs::create_directory(filePath);
+    batch.createDirectory(filePath.string());
 
     fs::path fileStartedPath = auctionPath / ("START_" + aid);
 
-    std::ofstream fileStarted(fileStartedPath);
+    StartRecord record;
+    memset(&record, 0, sizeof(record));
+    InitializeHeader(record.header, RecordType::Start);
+    memcpy(record.uid, startInfo.uid.data(),
+           std::min(startInfo.uid.size(), sizeof(record.uid) - 1));
+    memcpy(record.name, startInfo.name.data(),
+           std::min(startInfo.name.size(), sizeof(record.name) - 1));
+    record.startValue = startInfo.startValue;
+    record.startTime = (int64_t)startInfo.startTime;
+    record.timeActive = (int64_t)startInfo.timeActive;
+
+    batch.writeFile(fileStartedPath.string(), &record, sizeof(record));
+
+    if (_bidStorage == BidStorage::Log) {  // The log marks the auction's format
+        batch.writeFile((auctionPath / "BIDS.log").string(), NULL, 0);
+    }
 
-    fileStarted << startInfo.uid << std::endl;
-    fileStarted << startInfo.name << std::endl;
-    fileStarted << startInfo.startValue << std::endl;
-    fileStarted << startInfo.startTime << std::endl;
-    fileStarted << startInfo.timeActive << std::endl;
+    AuctionBidSummary summary;
+    summary.maxBid = startInfo.startValue - 1;
+    summary.bidCount = 0;
+
+    queueBidSummary(batch, aid, summary);
+
+    if (!batch.run()) {
+        throw DatabaseException("Could not create the auction files");
+    }
 }
 
 AuctionBidInfo DatabaseCore::getAuctionBidInfo(std::string aid,
@@ -791,14 +1355,18 @@ AuctionBidInfo DatabaseCore::getAuctionBidInfo(std::string aid,
 
     fs::path bidPath = *_path / "AUCTIONS" / aid / "BIDS" / value;
 
-    if (!fs::exists(bidPath)) {
-        throw DatabaseException("Bid does not exist");
+    BidRecord record;
+    AuctionBidInfo bidInfo;
+
+    if (ReadRecord(bidPath, RecordType::Bid, record, "Bid does not exist")) {
+        bidInfo.uid = FieldToString(record.bid.uid, sizeof(record.bid.uid));
+        bidInfo.bidValue = record.bid.bidValue;
+        bidInfo.bidTime = (time_t)record.bid.bidTime;
+        return bidInfo;
     }
 
     std::ifstream bidFile(bidPath);
 
-    AuctionBidInfo bidInfo;
-
     bidFile >> bidInfo.uid;
     bidFile >> bidInfo.bidValue;
     bidFile >> bidInfo.bidTime;
@@ -807,8 +1375,17 @@ AuctionBidInfo DatabaseCore::getAuctionBidInfo(std::string aid,
 }
 
 std::vector<AuctionBidInfo> DatabaseCore::getAuctionBids(std::string aid) {
+    return getAuctionLastBids(aid, SIZE_MAX);
+}
+
+std::vector<AuctionBidInfo> DatabaseCore::getAuctionLastBids(std::string aid,
+                                                             size_t count) {
     guaranteeAuctionStructure(aid);
 
+    if (usesBidLog(aid)) {
+        return readBidLog(aid, count);
+    }
+
     fs::path bidsPath = *_path / "AUCTIONS" / aid / "BIDS";
 
     std::vector<std::string> bidsStr;
@@ -819,18 +1396,161 @@ std::vector<AuctionBidInfo> DatabaseCore::getAuctionBids(std::string aid) {
 
     std::sort(bidsStr.begin(), bidsStr.end());
 
+    // Only the last files are opened, bid values always increase
+    size_t first = (bidsStr.size() > count) ? bidsStr.size() - count : 0;
+
     std::vector<AuctionBidInfo> bids;
 
-    for (auto &bid : bidsStr) {
-        bids.push_back(getAuctionBidInfo(aid, bid));
+    for (size_t i = first; i < bidsStr.size(); i++) {
+        bids.push_back(getAuctionBidInfo(aid, bidsStr[i]));
     }
 
     return bids;
 }
 
-bool DatabaseCore::auctionExists(std::string aid) {
-    guaranteeBaseStructure();
+bool DatabaseCore::usesBidLog(std::string aid) {
+    return fs::exists(*_path / "AUCTIONS" / aid / "BIDS.log");
+}
+
+std::vector<AuctionBidInfo> DatabaseCore::readBidLog(std::string aid,
+                                                     size_t count) {
+    fs::path logPath = *_path / "AUCTIONS" / aid / "BIDS.log";
+
+    int fd = open(logPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        throw DatabaseException("Could not open the bid log");
+    }
+
+    struct stat logStat;
+    if (fstat(fd, &logStat) == -1) {
+        close(fd);
+        throw DatabaseException("Could not read the bid log");
+    }
+
+    // A record cut short by a crash is ignored
+    size_t total = (size_t)logStat.st_size / sizeof(BidLogRecord);
+    size_t n = std::min(total, count);
+
+    std::vector<BidLogRecord> records(n);
+    size_t size = n * sizeof(BidLogRecord);
+    size_t done = 0;
+    off_t offset = (off_t)((total - n) * sizeof(BidLogRecord));
+
+    while (done < size) {  // A single read unless it is interrupted
+        ssize_t r = pread(fd, (char *)records.data() + done, size - done,
+                          offset + (off_t)done);
+        if (r <= 0) {
+            close(fd);
+            throw DatabaseException("Could not read the bid log");
+        }
+        done += (size_t)r;
+    }
+
+    close(fd);
+
+    std::vector<AuctionBidInfo> bids;
+
+    for (auto &record : records) {
+        AuctionBidInfo bidInfo;
+        bidInfo.uid = FieldToString(record.uid, sizeof(record.uid));
+        bidInfo.bidValue = record.bidValue;
+        bidInfo.bidTime = (time_t)record.bidTime;
+        bids.push_back(bidInfo);
+    }
+
+    return bids;
+}
+
+void DatabaseCore::appendBidLog(std::string aid, AuctionBidInfo &bidInfo,
+                                FileBatch &batch) {
+    fs::path logPath = *_path / "AUCTIONS" / aid / "BIDS.log";
+
+    BidLogRecord record;
+    memset(&record, 0, sizeof(record));
+    memcpy(record.uid, bidInfo.uid.data(),
+           std::min(bidInfo.uid.size(), (size_t)PROTOCOL_UID_SIZE));
+    record.bidValue = bidInfo.bidValue;
+    record.bidTime = (int64_t)bidInfo.bidTime;
+
+    if (_syncInterval == 0) {  // Nothing to sync, appended with the batch
+        batch.writeFile(logPath.string(), &record, sizeof(record),
+                        O_WRONLY | O_APPEND);
+        return;
+    }
+
+    int fd = open(logPath.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (fd == -1) {
+        throw DatabaseException("Could not open the bid log");
+    }
+
+    if (write(fd, &record, sizeof(record)) != (ssize_t)sizeof(record)) {
+        close(fd);
+        throw DatabaseException("Could not write to the bid log");
+    }
+
+    struct stat logStat;
+    if (_syncInterval > 0 && fstat(fd, &logStat) == 0) {
+        // Sync every syncInterval-th record, so at most syncInterval - 1 bids
+        // of an auction can be lost on a crash, whatever process wrote them
+        size_t records = (size_t)logStat.st_size / sizeof(BidLogRecord);
+        if (records % _syncInterval == 0) {
+            fdatasync(fd);
+        }
+    }
+
+    close(fd);
+}
 
+size_t DatabaseCore::convertToBidLog(std::string aid) {
+    guaranteeAuctionStructure(aid);
+
+    if (usesBidLog(aid)) {
+        return 0;
+    }
+
+    fs::path auctionPath = *_path / "AUCTIONS" / aid;
+    fs::path temporaryPath = auctionPath / "BIDS.log.tmp";
+
+    std::vector<AuctionBidInfo> bids = getAuctionBids(aid);
+
+    {
+        std::ofstream bidLog(temporaryPath, std::ios::binary | std::ios::trunc);
+
+        for (auto &bid : bids) {
+            BidLogRecord record;
+            memset(&record, 0, sizeof(record));
+            memcpy(record.uid, bid.uid.data(),
+                   std::min(bid.uid.size(), (size_t)PROTOCOL_UID_SIZE));
+            record.bidValue = bid.bidValue;
+            record.bidTime = (int64_t)bid.bidTime;
+            bidLog.write((char *)&record, sizeof(record));
+        }
+
+        if (!bidLog.good()) {
+            throw DatabaseException("Could not write the bid log");
+        }
+    }
+
+    // The log has to be on the disk before the bid files are removed
+    int fd = open(temporaryPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1 || fsync(fd) == -1) {
+        if (fd != -1) {
+            close(fd);
+        }
+        throw DatabaseException("Could not sync the bid log");
+    }
+    close(fd);
+
+    fs::rename(temporaryPath, auctionPath / "BIDS.log");
+
+    for (auto &bid : fs::directory_iterator(auctionPath / "BIDS")) {
+        fs::remove(bid.path());
+    }
+
+    return bids.size();
+}
+
+bool DatabaseCore::auctionExists(std::string aid) {
     fs::path auctionPath = *_path / "AUCTIONS" / aid;
 
     bool exists = fs::exists(auctionPath);
@@ -845,14 +1565,21 @@ AuctionStartInfo DatabaseCore::getAuctionStartInfo(std::string aid) {
 
     fs::path fileStartedPath = auctionPath / ("START_" + aid);
 
-    if (!fs::exists(fileStartedPath)) {
-        throw DatabaseException("Auction has not started");
+    StartRecord record;
+    AuctionStartInfo startInfo;
+
+    if (ReadRecord(fileStartedPath, RecordType::Start, record,
+                   "Auction has not started")) {
+        startInfo.uid = FieldToString(record.uid, sizeof(record.uid));
+        startInfo.name = FieldToString(record.name, sizeof(record.name));
+        startInfo.startValue = record.startValue;
+        startInfo.startTime = (time_t)record.startTime;
+        startInfo.timeActive = (time_t)record.timeActive;
+        return startInfo;
     }
 
     std::ifstream fileStarted(fileStartedPath);
 
-    AuctionStartInfo startInfo;
-
     fileStarted >> startInfo.uid;
     fileStarted >> startInfo.name;
     fileStarted >> startInfo.startValue;
@@ -873,9 +1600,29 @@ void DatabaseCore::endAuction(std::string aid, AuctionEndInfo endInfo) {
         throw DatabaseException("Auction already ended");
     }
 
-    std::ofstream endAuctionFile(endAuctionPath);
+    EndRecord record;
+    memset(&record, 0, sizeof(record));
+    InitializeHeader(record.header, RecordType::End);
+    record.endTime = (int64_t)endInfo.endTime;
 
-    endAuctionFile << endInfo.endTime << std::endl;
+    WriteRecord(endAuctionPath, record, _linkedWrites);
+}
+
+bool DatabaseCore::hasAuctionStarted(std::string aid) {
+    fs::path auctionPath = *_path / "AUCTIONS" / aid;
+
+    bool exists = fs::exists(auctionPath / ("START_" + aid));
+
+    return exists;
+}
+
+void DatabaseCore::removeAuction(std::string aid) {
+    fs::remove_all(*_path / "AUCTIONS" / aid);
+
+    int index = StructureIndex(aid, PROTOCOL_AID_SIZE);
+    if (index != -1) {
+        _structure->auctions[index] = false;
+    }
 }
 
 bool DatabaseCore::hasAuctionEnded(std::string aid) {
@@ -897,19 +1644,105 @@ AuctionEndInfo DatabaseCore::getAuctionEndInfo(std::string aid) {
 
     fs::path fileEndedPath = auctionPath / ("END_" + aid);
 
-    if (!fs::exists(fileEndedPath)) {
-        throw DatabaseException("Auction has not started");
+    EndRecord record;
+    AuctionEndInfo endInfo;
+
+    if (ReadRecord(fileEndedPath, RecordType::End, record,
+                   "Auction has not ended")) {
+        endInfo.endTime = (time_t)record.endTime;
+        return endInfo;
     }
 
     std::ifstream fileEnded(fileEndedPath);
 
-    AuctionEndInfo endInfo;
-
     fileEnded >> endInfo.endTime;
 
     return endInfo;
 }
 
+fs::path DatabaseCore::getUploadsPath() {
+    return *_path / "UPLOADS";
+}
+
+/**
+ * @brief  Names a file after the hash and size of its contents.
+ * @param  path The path of the file.
+ * @retval the name, the 64 bit FNV-1a hash in hexadecimal, a dash and the
+ * size.
+ */
+static std::string ContentName(fs::path path) {
+    std::ifstream file(path, std::ios::binary);
+    char buffer[PROTOCOL_FILE_CHUNK_SIZE];
+    uint64_t hash = 14695981039346656037ULL;
+    size_t size = 0;
+
+    while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0) {
+        for (std::streamsize i = 0; i < file.gcount(); i++) {
+            hash = (hash ^ (unsigned char)buffer[i]) * 1099511628211ULL;
+        }
+        size += (size_t)file.gcount();
+    }
+
+    if (file.bad()) {
+        throw DatabaseException("Could not read " + path.string());
+    }
+
+    char name[40];
+    snprintf(name, sizeof(name), "%016llx-%zu", (unsigned long long)hash,
+             size);
+    return name;
+}
+
+/**
+ * @brief  Checks if two files have the same contents.
+ * @param  first The path of the first file.
+ * @param  second The path of the second file.
+ * @retval true if the contents are the same, false otherwise.
+ */
+static bool SameContents(fs::path first, fs::path second) {
+    std::ifstream firstFile(first, std::ios::binary);
+    std::ifstream secondFile(second, std::ios::binary);
+    char firstBuffer[PROTOCOL_FILE_CHUNK_SIZE];
+    char secondBuffer[PROTOCOL_FILE_CHUNK_SIZE];
+
+    while (1) {
+        firstFile.read(firstBuffer, sizeof(firstBuffer));
+        secondFile.read(secondBuffer, sizeof(secondBuffer));
+
+        if (firstFile.gcount() != secondFile.gcount() || firstFile.bad() ||
+            secondFile.bad()) {
+            return false;
+        }
+        if (firstFile.gcount() == 0) {
+            return true;
+        }
+        if (memcmp(firstBuffer, secondBuffer, (size_t)firstFile.gcount()) !=
+            0) {
+            return false;
+        }
+    }
+}
+
+void DatabaseCore::storeAsset(fs::path uploadPath, std::string aid,
+                              std::string fileName) {
+    fs::path assetPath = getAuctionFilePath(aid) / fileName;
+    fs::path storedPath = *_path / "ASSETS" / ContentName(uploadPath);
+
+    if (!fs::exists(storedPath)) {
+        fs::rename(uploadPath, storedPath);
+    } else if (!SameContents(uploadPath, storedPath)) {
+        fs::rename(uploadPath, assetPath);  // The hashes collide, not shared
+        return;
+    }
+
+    std::error_code error;
+    fs::create_hard_link(storedPath, assetPath, error);
+
+    if (error) {  // Too many links to the stored one, the auction gets a copy
+        fs::copy_file(storedPath, assetPath);
+    }
+}
+
 fs::path DatabaseCore::getAuctionFilePath(std::string aid) {
     guaranteeAuctionStructure(aid);
 
@@ -938,8 +1771,6 @@ std::string DatabaseCore::getAuctionFileName(std::string aid) {
 }
 
 std::vector<std::string> DatabaseCore::getAllAuctions() {
-    guaranteeBaseStructure();
-
     fs::path auctionPath = *_path / "AUCTIONS";
 
     std::vector<std::string> auctions;
@@ -952,45 +1783,128 @@ std::vector<std::string> DatabaseCore::getAllAuctions() {
     return auctions;
 }
 
+std::vector<std::string> DatabaseCore::getAllUsers() {
+    fs::path usersPath = *_path / "USERS";
+
+    std::vector<std::string> users;
+
+    for (auto &user : fs::directory_iterator(usersPath)) {
+        users.push_back(user.path().filename().string());
+    }
+
+    std::sort(users.begin(), users.end());
+    return users;
+}
+
 void DatabaseCore::addAuctionBid(std::string aid, AuctionBidInfo &bidInfo) {
     guaranteeAuctionStructure(aid);
 
-    fs::path bidPath =
-        *_path / "AUCTIONS" / aid / "BIDS" / BidValueToString(bidInfo.bidValue);
+    AuctionBidSummary summary = getAuctionBidSummary(aid);
+    // The bid and the summary are written by a single chain of operations
+    FileBatch batch(_linkedWrites);
+
+    if (usesBidLog(aid)) {
+        if (bidInfo.bidValue <= summary.maxBid) {
+            throw DatabaseException("Bid already exists");
+        }
+
+        appendBidLog(aid, bidInfo, batch);
+    } else {
+        fs::path bidPath = *_path / "AUCTIONS" / aid / "BIDS" /
+                           BidValueToString(bidInfo.bidValue);
 
-    if (fs::exists(bidPath)) {
-        throw DatabaseException("Bid already exists");
+        if (fs::exists(bidPath)) {
+            throw DatabaseException("Bid already exists");
+        }
+
+        BidRecord record;
+        memset(&record, 0, sizeof(record));
+        InitializeHeader(record.header, RecordType::Bid);
+        memcpy(record.bid.uid, bidInfo.uid.data(),
+               std::min(bidInfo.uid.size(), (size_t)PROTOCOL_UID_SIZE));
+        record.bid.bidValue = bidInfo.bidValue;
+        record.bid.bidTime = (int64_t)bidInfo.bidTime;
+
+        batch.writeFile(bidPath.string(), &record, sizeof(record));
     }
 
-    std::ofstream bidFile(bidPath);
+    summary.maxBid = std::max(summary.maxBid, bidInfo.bidValue);
+    summary.bidCount++;
+
+    queueBidSummary(batch, aid, summary);
 
-    bidFile << bidInfo.uid << std::endl;
-    bidFile << bidInfo.bidValue << std::endl;
-    bidFile << bidInfo.bidTime << std::endl;
+    if (!batch.run()) {
+        throw DatabaseException("Could not write the bid");
+    }
 }
 
-DatabaseLock::DatabaseLock(std::string name) {
-    // Unlink the semaphore if it already exists, to guarantee that the
-    // initialized value is correct
-    sem_unlink(name.c_str());
+AuctionBidSummary DatabaseCore::getAuctionBidSummary(std::string aid) {
+    guaranteeAuctionStructure(aid);
 
-    // Create the semaphore
-    _lock = sem_open(name.c_str(), O_CREAT, 0644, 1);
-}
+    fs::path summaryPath = *_path / "AUCTIONS" / aid / ("SUMMARY_" + aid);
 
-DatabaseLock::~DatabaseLock() {
-    // Close the semaphore
-    sem_close(_lock);
+    AuctionBidSummary summary;
+
+    if (!fs::exists(summaryPath)) {
+        // Build the summary of an auction created by an older server
+        std::vector<AuctionBidInfo> bids = getAuctionBids(aid);
+
+        summary.maxBid = getAuctionStartInfo(aid).startValue - 1;
+        summary.bidCount = (int)bids.size();
+
+        for (auto &bid : bids) {
+            summary.maxBid = std::max(summary.maxBid, bid.bidValue);
+        }
+
+        setAuctionBidSummary(aid, summary);
+        return summary;
+    }
+
+    SummaryRecord record;
+
+    if (ReadRecord(summaryPath, RecordType::Summary, record,
+                   "Auction has no summary")) {
+        summary.maxBid = record.maxBid;
+        summary.bidCount = record.bidCount;
+        return summary;
+    }
+
+    std::ifstream summaryFile(summaryPath);
+
+    summaryFile >> summary.maxBid;
+    summaryFile >> summary.bidCount;
+
+    return summary;
 }
 
-void DatabaseLock::lock() {
-    // Lock the semaphore
-    sem_wait(_lock);
+void DatabaseCore::setAuctionBidSummary(std::string aid,
+                                        AuctionBidSummary &summary) {
+    guaranteeAuctionStructure(aid);
+
+    FileBatch batch(_linkedWrites);
+
+    queueBidSummary(batch, aid, summary);
+
+    if (!batch.run()) {
+        throw DatabaseException("Could not write a record file");
+    }
 }
 
-void DatabaseLock::unlock() {
-    // Unlock the semaphore
-    sem_post(_lock);
+void DatabaseCore::queueBidSummary(FileBatch &batch, std::string aid,
+                                   AuctionBidSummary &summary) {
+    fs::path auctionPath = *_path / "AUCTIONS" / aid;
+    fs::path summaryPath = auctionPath / ("SUMMARY_" + aid);
+    fs::path temporaryPath = auctionPath / ("SUMMARY_" + aid + ".tmp");
+
+    SummaryRecord record;
+    memset(&record, 0, sizeof(record));
+    InitializeHeader(record.header, RecordType::Summary);
+    record.maxBid = summary.maxBid;
+    record.bidCount = summary.bidCount;
+
+    batch.writeFile(temporaryPath.string(), &record, sizeof(record));
+    // Atomically replace the old one
+    batch.rename(temporaryPath.string(), summaryPath.string());
 }
 
 int AidStrToInt(std::string aid) {
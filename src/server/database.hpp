@@ -12,50 +12,26 @@
 #include <vector>
 
 #include <fcntl.h>
-#include <semaphore.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "config.hpp"
 #include "utils.hpp"
 
 namespace fs = std::filesystem;
 
-/**
- * @brief The DatabaseLock class represents a lock for the database.
- *
- * This class provides a mechanism to lock and unlock a database to ensure
- * exclusive access during critical sections of code.
- */
-class DatabaseLock {
-  private:
-    sem_t *_lock;
-
-  public:
-    /**
-     * @brief Constructs a new DatabaseLock object with the specified name.
-     *
-     * @param name The name of the database lock.
-     */
-    DatabaseLock(std::string name);
-
-    /**
-     * @brief Destroys the DatabaseLock object and releases any associated
-     * resources.
-     */
-    ~DatabaseLock();
+struct JournalRecord;
 
-    /**
-     * @brief Locks the database.
-     *
-     * This function blocks until the lock is acquired.
-     */
-    void lock();
-
-    /**
-     * @brief Unlocks the database.
-     *
-     * This function releases the lock, allowing other threads to acquire it.
-     */
-    void unlock();
-};
+class AssetCache;
+class AuctionIndex;
+class CachedAsset;
+class ExpiryScheduler;
+class IndexCheckpoint;
+class Journal;
+class JournalEntry;
+class LockManager;
+class Metrics;
+class SessionTable;
 
 /**
  * @brief Structure that contains the start info of an auction.
@@ -93,6 +69,201 @@ struct AuctionBidInfo {
     time_t bidTime;
 };
 
+/**
+ * @brief Structure that contains the summary of the bids of an auction.
+ *
+ * This structure is used to represent the content of the SUMMARY_XXX file on
+ * the database, kept up to date by every bid so that the bids never need to be
+ * read to validate a new one.
+ */
+struct AuctionBidSummary {
+    int maxBid;  // The highest bid, the start value minus 1 without bids
+    int bidCount;
+};
+
+/**
+ * @brief Structure that contains everything shown by the record of an
+ * auction, read at once so that no change is seen halfway.
+ */
+struct AuctionRecord {
+    AuctionStartInfo startInfo;
+    std::string assetName;
+    std::vector<AuctionBidInfo> bids;  // The last bids, the oldest first
+    bool ended;
+    AuctionEndInfo endInfo;  // Only set if ended
+    uint64_t generation;     // The generation of the record
+};
+
+/**
+ * @brief The generation of the state listed by LST, LMA and LMB.
+ *
+ * The counters only grow, so a response built while the counters it depends
+ * on were the same is still up to date. LST and LMA only depend on the
+ * auctions, LMB on both.
+ */
+struct DatabaseGeneration {
+    uint64_t auctions;  // Bumped when an auction is created or ended
+    uint64_t bids;      // Bumped when a bid is made
+};
+
+/**
+ * @brief Fixed size record of a bid in the bid log of an auction.
+ *
+ * The BIDS.log file of an auction is the sequence of these records in the
+ * order the bids were made, so the n-th bid is at offset n * sizeof(record).
+ */
+struct BidLogRecord {
+    char uid[PROTOCOL_UID_SIZE + 2];  // The bidder's UID, NUL padded
+    int32_t bidValue;                 // The bid value
+    int32_t reserved;                 // Always 0, keeps bidTime aligned
+    int64_t bidTime;                  // The time of the bid
+};
+
+static_assert(sizeof(BidLogRecord) == 24, "Bid log records must be 24 bytes");
+
+/**
+ * @brief The kinds of the binary record files of an auction.
+ */
+enum class RecordType : uint16_t {
+    Start = 1,   /**< The START_XXX file. */
+    End = 2,     /**< The END_XXX file. */
+    Bid = 3,     /**< A file of the BIDS directory. */
+    Summary = 4, /**< The SUMMARY_XXX file. */
+};
+
+/**
+ * @brief Header of every binary record file.
+ *
+ * Files written by older servers are text, and never start with the magic, so
+ * either format is told apart from the first bytes of a file.
+ */
+struct RecordHeader {
+    char magic[4];     // Always DATABASE_RECORD_MAGIC
+    uint16_t version;  // The version of the format, DATABASE_RECORD_VERSION
+    RecordType type;   // The kind of record that follows
+};
+
+/**
+ * @brief Binary record of the START_XXX file of an auction.
+ */
+struct StartRecord {
+    RecordHeader header;
+    char uid[PROTOCOL_UID_SIZE + 2];           // NUL padded
+    char name[PROTOCOL_AUCTIONNAME_SIZE + 6];  // NUL padded
+    int32_t startValue;
+    int32_t reserved;  // Always 0, keeps the times aligned
+    int64_t startTime;
+    int64_t timeActive;
+};
+
+/**
+ * @brief Binary record of the END_XXX file of an auction.
+ */
+struct EndRecord {
+    RecordHeader header;
+    int64_t endTime;
+};
+
+/**
+ * @brief Binary record of a bid file of the BIDS directory of an auction.
+ */
+struct BidRecord {
+    RecordHeader header;
+    BidLogRecord bid;
+};
+
+/**
+ * @brief Binary record of the SUMMARY_XXX file of an auction.
+ */
+struct SummaryRecord {
+    RecordHeader header;
+    int32_t maxBid;
+    int32_t bidCount;
+};
+
+// Every field is naturally aligned, so the records can be read in place
+static_assert(sizeof(RecordHeader) == 8, "Record headers must be 8 bytes");
+static_assert(sizeof(StartRecord) == 56, "Start records must be 56 bytes");
+static_assert(sizeof(EndRecord) == 16, "End records must be 16 bytes");
+static_assert(sizeof(BidRecord) == 32, "Bid records must be 32 bytes");
+static_assert(sizeof(SummaryRecord) == 16, "Summary records must be 16 bytes");
+
+/**
+ * @brief The ways the bids of an auction can be stored.
+ */
+enum class BidStorage {
+    Files, /**< One file per bid in the BIDS directory. */
+    Log,   /**< Fixed size records appended to the BIDS.log file. */
+};
+
+/**
+ * @brief Temporary file that receives an uploaded asset before its auction
+ * exists.
+ *
+ * The file lives in the UPLOADS directory of the database, on the same file
+ * system as the auctions, so it can be renamed into place atomically. It is
+ * removed on destruction unless it was renamed.
+ */
+class AssetUpload {
+  private:
+    // The file of the request handled by the thread, already received
+    static thread_local std::shared_ptr<AssetUpload> _received;
+    fs::path _path;       // The temporary file
+    std::ofstream _file;  // The stream writing to it
+
+  public:
+    /**
+     * @brief  Creates a new temporary file.
+     * @param  directory The directory of the temporary file.
+     */
+    AssetUpload(fs::path directory);
+
+    /**
+     * @brief  Removes the temporary file, if it is still there.
+     */
+    ~AssetUpload();
+
+    AssetUpload(const AssetUpload &) = delete;
+    AssetUpload &operator=(const AssetUpload &) = delete;
+
+    /**
+     * @brief  Gets the stream that writes to the temporary file.
+     * @retval the stream.
+     */
+    std::ofstream &getStream();
+
+    /**
+     * @brief  Closes the temporary file, checking that it was fully written.
+     * @retval the path of the temporary file.
+     */
+    fs::path finish();
+
+    /**
+     * @brief  Sets the file of the request handled by the thread, received
+     * before the request was parsed, which its handler then takes instead
+     * of reading it.
+     * @param  upload The file, empty for none.
+     */
+    static void setReceived(std::shared_ptr<AssetUpload> upload);
+
+    /**
+     * @brief  Takes the file set by setReceived.
+     * @retval the file, empty if there was none.
+     */
+    static std::shared_ptr<AssetUpload> takeReceived();
+};
+
+class FileBatch;
+
+/**
+ * @brief The shared memory table of the directories already validated, so
+ * that their structure is only checked once.
+ */
+struct DatabaseStructure {
+    bool auctions[DATABASE_MAX_AUCTIONS];  // By AID, whether it was checked
+    bool users[DATABASE_MAX_USERS];        // By UID, whether it was checked
+};
+
 /**
  * @brief Class that represents the core functionality of the database.
  *
@@ -104,29 +275,82 @@ struct AuctionBidInfo {
 class DatabaseCore {
   private:
     std::unique_ptr<fs::path> _path;
+    BidStorage _bidStorage;  // The bid storage of the new auctions
+    size_t _syncInterval;    // Every how many bids the logs are synced
+    bool _linkedWrites = false;  // Whether the files go through io_uring
+    DatabaseStructure *_structure;  // Shared by the processes
+
+    /**
+     * @brief  Reads the last records of a bid log.
+     * @param  aid The auction's AID.
+     * @param  count The maximum number of records to read.
+     * @retval a vector of structures, each containing the information of a
+     * single bid, in the order the bids were made.
+     */
+    std::vector<AuctionBidInfo> readBidLog(std::string aid, size_t count);
+
+    /**
+     * @brief  Appends a bid to a bid log, syncing it if the policy says so.
+     * Unless it is synced, the append is only added to a batch.
+     * @param  aid The auction's AID.
+     * @param  bidInfo Structure containing the info of the bid.
+     * @param  batch The batch of the files written along with it.
+     */
+    void appendBidLog(std::string aid, AuctionBidInfo &bidInfo,
+                      FileBatch &batch);
+
+    /**
+     * @brief  Adds the writing of the bid summary of an auction to a batch,
+     * to a temporary file renamed over the old one.
+     * @param  batch The batch.
+     * @param  aid The auction's AID.
+     * @param  summary Structure containing the bid summary.
+     */
+    void queueBidSummary(FileBatch &batch, std::string aid,
+                         AuctionBidSummary &summary);
 
   public:
     /**
      * @brief  Constructor of the core, just initializes and creates the base
      * structure.
      * @param  path the path of the database directory.
+     * @param  bidStorage the bid storage used by the auctions created from
+     * now on, the existing ones keep theirs.
+     * @param  syncInterval with bid logs, the log is synced to the disk every
+     * syncInterval bids; 0 leaves the syncing to the system.
      */
-    DatabaseCore(std::string path);
+    DatabaseCore(std::string path, BidStorage bidStorage = BidStorage::Files,
+                 size_t syncInterval = 0);
+
+    /**
+     * @brief  Destructor of the core, unmaps the directories validated.
+     */
+    ~DatabaseCore();
+
+    /**
+     * @brief  Sets whether the files of each change are written as a chain
+     * of linked io_uring operations, with a single system call, when the
+     * kernel supports it.
+     * @param  linked Whether to write them through io_uring.
+     */
+    void setLinkedWrites(bool linked) { _linkedWrites = linked; }
 
     /**
      * @brief  Guarantees that the base structure of the db still exists.
+     * Checked by the constructor, and to be called again after a wipe.
      */
     void guaranteeBaseStructure();
 
     /**
      * @brief  Guarantees that the structure of the directory of a specific user
-     * still exists.
+     * still exists, the first time it is called for the user.
      */
     void guaranteeUserStructure(std::string uid);
 
     /**
      * @brief  Guarantees that the structure of the directory of a specific
-     * auction still exists.
+     * auction still exists, the first time it is called for the auction
+     * since it was last removed.
      */
     void guaranteeAuctionStructure(std::string aid);
 
@@ -251,6 +475,20 @@ class DatabaseCore {
      */
     AuctionStartInfo getAuctionStartInfo(std::string aid);
 
+    /**
+     * @brief  Checks if the START file of an auction was written, the last
+     * step of its creation.
+     * @param  aid The auction's AID.
+     * @retval true if the auction has started, false otherwise
+     */
+    bool hasAuctionStarted(std::string aid);
+
+    /**
+     * @brief  Removes an auction, with all its files.
+     * @param  aid The auction's AID.
+     */
+    void removeAuction(std::string aid);
+
     /**
      * @brief  Sets an auction to the Ended state.
      * @param  aid The auction's AID.
@@ -272,6 +510,24 @@ class DatabaseCore {
      */
     AuctionEndInfo getAuctionEndInfo(std::string aid);
 
+    /**
+     * @brief  Gets the directory of the assets being uploaded.
+     * @retval a path object to the directory.
+     */
+    fs::path getUploadsPath();
+
+    /**
+     * @brief  Moves an uploaded asset to a specific auction.
+     *
+     * The assets are stored once in the ASSETS directory, named after the
+     * hash and size of their contents, and hard linked to every auction with
+     * the same asset, so that they share the disk and the page cache.
+     * @param  uploadPath The path of the uploaded asset.
+     * @param  aid The auction's AID.
+     * @param  fileName The name of the asset file.
+     */
+    void storeAsset(fs::path uploadPath, std::string aid, std::string fileName);
+
     /**
      * @brief  Gets a specific auction's asset file path.
      * @param  aid The auction's AID.
@@ -303,46 +559,182 @@ class DatabaseCore {
     std::vector<AuctionBidInfo> getAuctionBids(std::string aid);
 
     /**
-     * @brief  Adds a specific bid to a specific auction.
+     * @brief  Gets the last bids from a specific auction.
+     *
+     * With a bid log this is a single read from the tail of the log.
+     * @param  aid The auction's AID.
+     * @param  count The maximum number of bids.
+     * @retval a vector of structures, each containing the information of a
+     * single bid, oldest first.
+     */
+    std::vector<AuctionBidInfo> getAuctionLastBids(std::string aid,
+                                                   size_t count);
+
+    /**
+     * @brief  Checks if the bids of an auction are stored in a bid log.
+     * @param  aid The auction's AID.
+     * @retval true if the auction has a bid log, false if it uses bid files.
+     */
+    bool usesBidLog(std::string aid);
+
+    /**
+     * @brief  Moves the bid files of an auction to a new bid log.
+     *
+     * The log is written to a temporary file and renamed into place before
+     * the bid files are removed. The database must not be in use.
+     * @param  aid The auction's AID.
+     * @retval the number of bids moved.
+     */
+    size_t convertToBidLog(std::string aid);
+
+    /**
+     * @brief  Adds a specific bid to a specific auction, updating the bid
+     * summary of the auction.
      * @param  aid The auction's AID.
      * @param  bidInfo Structure containing the info of the bid.
      */
     void addAuctionBid(std::string aid, AuctionBidInfo &bidInfo);
 
+    /**
+     * @brief  Gets the bid summary of a specific auction.
+     *
+     * Auctions created before the summaries existed get theirs built from
+     * the bids the first time.
+     * @param  aid The auction's AID.
+     * @retval a structure containing the highest bid and the number of bids.
+     */
+    AuctionBidSummary getAuctionBidSummary(std::string aid);
+
+    /**
+     * @brief  Replaces the bid summary of a specific auction.
+     *
+     * The summary is written to a temporary file renamed over the old one, so
+     * it is never seen half written.
+     * @param  aid The auction's AID.
+     * @param  summary Structure containing the bid summary.
+     */
+    void setAuctionBidSummary(std::string aid, AuctionBidSummary &summary);
+
     /**
      * @brief  Get's all the auctions currently in the database.
      * @retval vector containing the AIDs of all of the auctions.
      */
     std::vector<std::string> getAllAuctions();
+
+    /**
+     * @brief  Get's all the users currently in the database.
+     * @retval vector containing the UIDs of all of the users.
+     */
+    std::vector<std::string> getAllUsers();
 };
 
 /**
  * @brief Final class that represents the database.
  *
- * This class uses the DatabaseLock and DatabaseCore to implement
- * high level functions that are thread/multiprocess safe.
+ * This class uses the LockManager and DatabaseCore to implement
+ * high level functions that are thread/multiprocess safe. Each function only
+ * locks the users and auctions it touches, so independent requests run in
+ * parallel. The state of the auctions is read from an AuctionIndex, and the
+ * state of the users from a SessionTable, both written through to the disk by
+ * the same functions that change them, and auctions whose time is up are
+ * ended by a process waiting on an ExpiryScheduler.
  */
 class Database {
   private:
-    std::unique_ptr<DatabaseLock> _lock;
     std::unique_ptr<DatabaseCore> _core;
+    std::unique_ptr<LockManager> _locks;
+    std::unique_ptr<AuctionIndex> _index;
+    std::unique_ptr<SessionTable> _sessions;
+    std::unique_ptr<AssetCache> _assets;  // Of this process, not shared
+    std::unique_ptr<ExpiryScheduler> _expiry;
+    std::unique_ptr<Journal> _journal;  // NULL unless the changes are journaled
+    std::unique_ptr<IndexCheckpoint> _checkpoint;  // Of the index and sessions
+    int _shard = 0;   // The index of the shard of the auctions of this server
+    int _shards = 1;  // The number of shards the auctions are spread across
+
+    /**
+     * @brief  Appends the record of a change to the journal, if there is one,
+     * before the change is made.
+     * @param  record The record.
+     * @retval the entry to sync before the change is made, and to commit
+     * once it is made.
+     */
+    JournalEntry journal(JournalRecord &record);
+
+    /**
+     * @brief  Makes the change of a journal record again, skipping the steps
+     * that were already done before a crash.
+     * @param  record The record.
+     */
+    void replay(JournalRecord &record);
+
+    /**
+     * @brief  Makes the change of a journal record again after it failed,
+     * reading its entries of the tables again. The locks of the change must
+     * still be held.
+     * @param  record The record.
+     */
+    void repair(JournalRecord &record);
+
+    /**
+     * @brief  Gets the asset of an auction from the cache, opening and
+     * caching it first if needed.
+     *
+     * This function requires the auction lock to be held.
+     * @param  aid Auction's AID.
+     * @retval the asset.
+     */
+    std::shared_ptr<CachedAsset> getCachedAsset(std::string aid);
 
   public:
     /**
-     * @brief  Basic constructor, initializes the core and lock.
+     * @brief  Basic constructor, initializes the core and locks, replays the
+     * journal and loads the auction index and sessions from their checkpoint,
+     * or from the whole database directory if it is not valid.
      * @param  path Path of the directory with the contents of the database.
+     * @param  bidStorage The bid storage of the auctions created.
+     * @param  syncInterval Every how many bids a bid log is synced, 0 for
+     * never.
+     * @param  journaled Whether the changes are recorded in a write-ahead
+     * journal, so that they are on the disk once acknowledged.
+     */
+    Database(std::string path, BidStorage bidStorage = BidStorage::Files,
+             size_t syncInterval = 0, bool journaled = false);
+
+    /**
+     * @brief  Destructor, releases the core, locks, index and scheduler.
+     */
+    ~Database();
+
+    /**
+     * @brief  Sets where the time waited for the database locks is recorded.
+     * @param  metrics The metrics, NULL to stop recording.
      */
-    Database(std::string path);
+    void setMetrics(Metrics *metrics);
 
     /**
-     * @brief  Locks the db.
+     * @brief  Sets the shard of the auctions this database owns, when they
+     * are spread across several servers. Only the AIDs congruent to the
+     * shard, modulo the number of shards, are generated, so the shards share
+     * the 1000 AIDs of the protocol instead of adding to them.
+     * @param  shard The index of the shard, from 0 to shards - 1.
+     * @param  shards The number of shards.
      */
-    void lock();
+    void setShard(int shard, int shards);
 
     /**
-     * @brief  Unlocks the db.
+     * @brief  Sets how many bytes of recently requested assets each process
+     * keeps open and mapped.
+     * @param  bytes The byte budget, 0 to open the assets every time.
      */
-    void unlock();
+    void setAssetCacheSize(size_t bytes);
+
+    /**
+     * @brief  Sets whether the record files are written through io_uring,
+     * each change as one chain of linked operations.
+     * @param  enabled Whether to write them through io_uring.
+     */
+    void setIoRing(bool enabled);
 
     /**
      * @brief  Handles the whole process of login of a user.
@@ -372,15 +764,58 @@ class Database {
      * @brief  Checks if the given auction is already closed, and closes if that
      * is needed.
      *
-     * This function is not thread safe.
+     * This function requires the auction lock to be held exclusively.
      * @param  aid Auction's AID.
      */
     void handleAutoClosing(std::string aid);
 
+    /**
+     * @brief  Checks if an auction is still active.
+     *
+     * This function locks the auction, so it must not be already held.
+     * @param  aid Auction's AID.
+     * @retval true if the auction is active, false if it has ended.
+     */
+    bool isAuctionActive(std::string aid);
+
+    /**
+     * @brief  Gets the current generation of the auctions and bids.
+     *
+     * The generation must be read before the state that depends on it.
+     * @retval the generation.
+     */
+    DatabaseGeneration getGeneration();
+
+    /**
+     * @brief  Gets the current generation of the record of an auction.
+     *
+     * This function locks the auction, so it must not be already held.
+     * @param  aid Auction's AID.
+     * @retval the generation.
+     */
+    uint64_t getRecordGeneration(std::string aid);
+
+    /**
+     * @brief  Checks if a user exists and is logged in.
+     * @param  uid User's UID.
+     * @retval true if the user is logged in, false otherwise.
+     */
+    bool isUserLoggedIn(std::string uid);
+
+    /**
+     * @brief  Ends every auction as soon as its time is up, writing its END
+     * file, so that reading the auctions never has to. Without a journal, the
+     * checkpoint of the index and sessions is also written every
+     * DATABASE_CHECKPOINT_INTERVAL seconds, if they changed.
+     *
+     * This function never returns, it is run by a process of its own.
+     */
+    void runExpiryScheduler();
+
     /**
      * @brief  Checks if a given user is logged in and his password is correct.
      *
-     * This function is not thread safe.
+     * This function requires the user lock to be held.
      * @param  uid User's UID.
      * @param  password User's password.
      * @retval true if user is logged in, false otherwise.
@@ -390,7 +825,7 @@ class Database {
     /**
      * @brief  Checks if a given user is registered.
      *
-     * This function is not thread safe.
+     * This function requires the user lock to be held.
      * @param  uid User's UID.
      * @retval true if user is registered in, false otherwise.
      */
@@ -417,9 +852,10 @@ class Database {
     std::map<std::string, std::string> getUserBids(std::string uid);
 
     /**
-     * @brief  Generates a new AID (1 more than the previous max).
+     * @brief  Generates a new AID, the first one of the shard after the
+     * previous max.
      *
-     * This function is not thread safe.
+     * This function requires the global lock to be held exclusively.
      * @retval new AID as a string.
      */
     std::string generateAid();
@@ -440,11 +876,34 @@ class Database {
                               time_t timeActive, std::string fileName,
                               std::stringstream &file);
 
+    /**
+     * @brief  Handles the creation of an auction whose asset file was already
+     * written to a temporary file, which is renamed into the auction.
+     * @param  uid Auction Host's UID.
+     * @param  password Auction Host's password.
+     * @param  name Auction's name.
+     * @param  startValue Auction's start value.
+     * @param  timeActive Auction's max time active.
+     * @param  fileName Auction's asset file name.
+     * @param  upload Temporary file with the auction's asset file content.
+     * @retval the auction's AID in string format.
+     */
+    std::string createAuction(std::string uid, std::string password,
+                              std::string name, int startValue,
+                              time_t timeActive, std::string fileName,
+                              AssetUpload &upload);
+
+    /**
+     * @brief  Creates a temporary file to upload an auction's asset file to.
+     * @retval the temporary file.
+     */
+    std::unique_ptr<AssetUpload> createUpload();
+
     /**
      * @brief  Gets the auction's max bid value, if the auction has no bids,
      * the value will be the start value minus 1.
      *
-     * This function is not thread safe.
+     * This function requires the auction lock to be held.
      * @param  aid Auction's AID.
      * @retval auction's max bid value
      */
@@ -453,7 +912,7 @@ class Database {
     /**
      * @brief  Gets a specific auction's host UID.
      *
-     * This function is not thread safe.
+     * This function requires the auction lock to be held.
      * @param  aid Auction's AID.
      * @retval auction's host UID.
      */
@@ -480,12 +939,15 @@ class Database {
                         std::stringstream &file);
 
     /**
-     * @brief  Gets the name of and auction's asset file.
-     * @note
+     * @brief  Opens an auction's asset file, so that it can be sent without
+     * reading it to memory.
      * @param  aid Auction's AID.
-     * @retval asset file name.
+     * @param  fileName String to which the file name will be written.
+     * @param  fileSize Integer to which the file size will be written.
+     * @retval file descriptor of the asset file, owned by the caller.
      */
-    std::string getAssetName(std::string aid);
+    int openAuctionAsset(std::string aid, std::string &fileName,
+                         int &fileSize);
 
     /**
      * @brief  Handles the process of closing an auction.
@@ -497,36 +959,15 @@ class Database {
     void closeAuction(std::string uid, std::string password, std::string aid);
 
     /**
-     * @brief  Gets the auction start information in order to help handling the
-     * show record process.
-     * @param  aid Auction's AID.
-     * @retval structure containing the start information.
-     */
-    AuctionStartInfo getAuctionStartInfo(std::string aid);
-
-    /**
-     * @brief  Gets the auction's bids information in order to help handling the
-     * show record process.
-     * @param  aid Auction's AID.
-     * @retval vector of structures each containing the bid's information.
-     */
-    std::vector<AuctionBidInfo> getAuctionBids(std::string aid);
-
-    /**
-     * @brief  Gets the auction end information in order to help handling the
-     * show record process.
-     * @param  aid Auction's AID.
-     * @retval structure containing the end information.
-     */
-    AuctionEndInfo getAuctionEndInfo(std::string aid);
-
-    /**
-     * @brief  Checks if an auction has ended in order to help the show record
-     * process.
+     * @brief  Gets the record of an auction for the show record process.
+     *
+     * The auction is locked once for the whole record, so it is a consistent
+     * snapshot, and only the tail of the bids is read.
      * @param  aid Auction's AID.
-     * @retval true if auction has ended, false otherwise.
+     * @param  maxBids The maximum number of bids, the last ones are kept.
+     * @retval structure containing the record.
      */
-    bool hasAuctionEnded(std::string aid);
+    AuctionRecord getAuctionRecord(std::string aid, size_t maxBids);
 
     void wipe();
 };
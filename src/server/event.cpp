@@ -0,0 +1,835 @@
+/**
+ * @file event.cpp
+ * @brief Implementation of the event-driven TCP front end.
+ */
+#include "event.hpp"
+
+// Ids reserved for the listening socket and the wake eventfd on the epoll
+#define EVENT_LISTENER_ID (0)
+#define EVENT_WAKE_ID (1)
+
+// The maximum number of reads done on a connection per event, so that a fast
+// uploader does not starve the other connections
+#define EVENT_MAX_READS_PER_EVENT (16)
+
+// The most bytes the loop buffers for a connection, the files of OPA
+// requests are written to disk as they arrive
+#define EVENT_MAX_REQUEST_SIZE   \
+    (SERVER_EVENT_MAX_HEADER_SIZE + \
+     EVENT_MAX_READS_PER_EVENT * SOCKETS_TCP_READ_CHUNK_SIZE)
+
+WorkerPool::WorkerPool(size_t threads) {
+    sigset_t blocked, previous;
+
+    // Block SIGINT while creating the threads, they inherit the signal mask
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+
+    for (size_t i = 0; i < threads; i++) {
+        _threads.emplace_back(&WorkerPool::run, this);
+    }
+
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);  // Restore the signal mask
+}
+
+WorkerPool::~WorkerPool() {
+    stop();
+}
+
+void WorkerPool::run() {
+    while (1) {
+        std::function<void()> job;
+
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            // Wait until there is a job or the pool is stopping
+            _condition.wait(lock,
+                            [this] { return _stopping || !_jobs.empty(); });
+
+            if (_jobs.empty()) {  // Only happens when stopping
+                return;
+            }
+
+            job = std::move(_jobs.front());
+            _jobs.pop_front();
+        }
+
+        job();
+    }
+}
+
+void WorkerPool::submit(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        _jobs.push_back(std::move(job));
+    }
+    _condition.notify_one();
+}
+
+void WorkerPool::stop() {
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        _stopping = true;
+    }
+    _condition.notify_all();
+
+    for (auto &thread : _threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    _threads.clear();
+}
+
+TcpEventServer::TcpEventServer(TcpServer &listener, CommandManager &manager,
+                               Server &server, size_t workers, bool ring)
+    : _listener(listener), _manager(manager), _server(server), _pool(workers) {
+    _listener.setNonBlocking();
+
+    if (ring) {
+        try {
+            _ring = std::make_unique<IoRing>(SERVER_URING_EVENT_ENTRIES);
+            _readBuffers = std::make_unique<char[]>(
+                SERVER_EVENT_MAX_EVENTS * SOCKETS_TCP_READ_CHUNK_SIZE);
+        } catch (IoRingException const &e) {
+            _ring.reset();  // Falls back to reading and writing directly
+        }
+    }
+
+    _epollFd = epoll_create1(EPOLL_CLOEXEC);  // Create the epoll instance
+    if (_epollFd == -1) {
+        throw SocketSetupException();
+    }
+
+    // Create the eventfd the workers use to signal finished responses
+    _wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_wakeFd == -1) {
+        ::close(_epollFd);
+        throw SocketSetupException();
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+
+    event.data.u64 = EVENT_LISTENER_ID;  // Watch for new connections
+    if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, _listener.getFd(), &event) == -1) {
+        throw SocketSetupException();
+    }
+
+    event.data.u64 = EVENT_WAKE_ID;  // Watch for finished responses
+    if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, _wakeFd, &event) == -1) {
+        throw SocketSetupException();
+    }
+}
+
+TcpEventServer::~TcpEventServer() {
+    _pool.stop();  // Wait for the workers before closing their connections
+
+    for (auto &connection : _connections) {
+        ::close(connection.second->fd);
+        _server.getAdmission().closeSession(connection.second->ip);
+    }
+    _connections.clear();
+
+    ::close(_wakeFd);
+    ::close(_epollFd);
+}
+
+void TcpEventServer::run() {
+    struct epoll_event events[SERVER_EVENT_MAX_EVENTS];
+    time_t lastSweep = time(NULL);
+
+    while (1) {
+        // Wake up at least once a second to close idle connections
+        int n = epoll_wait(_epollFd, events, SERVER_EVENT_MAX_EVENTS, 1000);
+
+        if (n == -1) {
+            // Interrupted by SIGINT, stop the server just like the fork mode
+            throw SocketCommunicationException();
+        }
+
+        for (int i = 0; i < n; i++) {
+            uint64_t id = events[i].data.u64;
+
+            if (id == EVENT_LISTENER_ID) {
+                acceptConnections();
+                continue;
+            }
+
+            if (id == EVENT_WAKE_ID) {
+                collectResponses();
+                continue;
+            }
+
+            if (events[i].events & EPOLLIN) {
+                auto connection = _connections.find(id);
+                if (connection != _connections.end() && _ring) {
+                    queueRead(*connection->second);
+                } else if (connection != _connections.end()) {
+                    readConnection(*connection->second);
+                }
+            }
+
+            if (events[i].events & EPOLLOUT) {
+                auto connection = _connections.find(id);
+                if (connection != _connections.end()) {
+                    flush(*connection->second);
+                }
+            }
+
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                auto connection = _connections.find(id);
+                if (connection == _connections.end()) {
+                    continue;
+                }
+
+                if (connection->second->busy) {
+                    // Stop watching it, the worker result gets discarded
+                    epoll_ctl(_epollFd, EPOLL_CTL_DEL, connection->second->fd,
+                              NULL);
+                    connection->second->hungUp = true;
+                } else {
+                    closeConnection(*connection->second);
+                }
+            }
+        }
+
+        if (_ring) {  // Every operation queued above, in one system call
+            completeIo();
+        }
+
+        if (time(NULL) != lastSweep) {
+            lastSweep = time(NULL);
+            closeIdleConnections();
+        }
+    }
+}
+
+void TcpEventServer::acceptConnections() {
+    while (1) {
+        struct sockaddr_in client;
+        socklen_t clientSize;
+
+        int fd = _listener.tryAcceptConnection(client, clientSize);
+
+        if (fd == -1) {  // No more pending connections
+            return;
+        }
+
+        std::string ip = AddressToIP(client);
+
+        if (!_server.getAdmission().openSession(ip)) {
+            // Rejected before reading anything, too many sessions or requests
+            RejectConnection(fd);
+            _server.log(Message::ServerRequestDetails("Admission", "Rejected"));
+            continue;
+        }
+
+        try {
+            SetNonBlocking(fd);
+        } catch (SocketSetupException const &e) {
+            ::close(fd);
+            _server.getAdmission().closeSession(ip);
+            continue;
+        }
+
+        auto connection = std::make_unique<TcpConnection>();
+        connection->fd = fd;
+        connection->id = _nextId++;
+        connection->ip = ip;
+        connection->port = AddressToPort(client);
+        connection->lastActivity = time(NULL);
+
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.u64 = connection->id;
+
+        if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &event) == -1) {
+            ::close(fd);
+            _server.getAdmission().closeSession(ip);
+            continue;
+        }
+
+        _connections.insert({connection->id, std::move(connection)});
+    }
+    _server.push();
+}
+
+void TcpEventServer::readConnection(TcpConnection &connection) {
+    if (connection.busy) {  // The request was already handed to a worker
+        return;
+    }
+
+    char buffer[SOCKETS_TCP_READ_CHUNK_SIZE];
+
+    for (int i = 0; i < EVENT_MAX_READS_PER_EVENT &&
+                    connection.input.size() <= EVENT_MAX_REQUEST_SIZE;
+         i++) {
+        ssize_t n = read(connection.fd, buffer, SOCKETS_TCP_READ_CHUNK_SIZE);
+
+        if (n > 0) {
+            connection.input.append(buffer, (size_t)n);
+            connection.lastActivity = time(NULL);
+            continue;
+        }
+
+        if (n == 0) {  // The client will not send anything else
+            connection.eof = true;
+            break;
+        }
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        }
+
+        if (errno != EINTR) {
+            closeConnection(connection);
+            return;
+        }
+    }
+
+    handleInput(connection);
+}
+
+void TcpEventServer::queueRead(TcpConnection &connection, bool retry) {
+    if (connection.busy || connection.ioPending) {
+        return;
+    }
+
+    if (connection.input.size() > EVENT_MAX_REQUEST_SIZE) {
+        handleInput(connection);  // Nothing else is read
+        return;
+    }
+
+    // Every connection is reported at most once per iteration, so each read
+    // gets a buffer of its own, which an interrupted read keeps
+    if (!retry) {
+        connection.readSlot = _readsQueued++;
+    }
+    char *buffer =
+        &_readBuffers[connection.readSlot * SOCKETS_TCP_READ_CHUNK_SIZE];
+
+    // Never waits for data, like the reads of the non-blocking socket
+    while (!_ring->prepareRecv(connection.fd, buffer,
+                               SOCKETS_TCP_READ_CHUNK_SIZE, MSG_DONTWAIT,
+                               connection.id << 1)) {
+        _ring->submit();  // The queue is full, make room
+    }
+    connection.ioPending = true;
+}
+
+void TcpEventServer::queueSend(TcpConnection &connection) {
+    if (connection.ioPending) {
+        return;
+    }
+
+    while (!_ring->prepareSend(
+        connection.fd, connection.output.data() + connection.outputSent,
+        connection.output.size() - connection.outputSent, MSG_DONTWAIT,
+        connection.id << 1 | 1)) {
+        _ring->submit();  // The queue is full, make room
+    }
+    connection.ioPending = true;
+}
+
+void TcpEventServer::completeIo() {
+    // The completions may queue the sends of what is left of the responses
+    while (_ring->getQueued() > 0 || _ring->getInFlight() > 0) {
+        if (!_ring->submit(1)) {
+            throw SocketCommunicationException();
+        }
+
+        _ring->reap([this](uint64_t data, int result) {
+            handleCompletion(data, result);
+        });
+    }
+
+    _readsQueued = 0;
+}
+
+void TcpEventServer::handleCompletion(uint64_t data, int result) {
+    auto found = _connections.find(data >> 1);
+
+    if (found == _connections.end()) {
+        return;
+    }
+
+    TcpConnection &connection = *found->second;
+    connection.ioPending = false;
+
+    if (connection.closing) {  // Closed while the operation was in flight
+        closeConnection(connection);
+        return;
+    }
+
+    if (result == -EAGAIN || result == -EWOULDBLOCK) {
+        if (data & 1) {
+            watch(connection, EPOLLOUT);  // Continue once there is room
+        }
+        return;  // A read waits for the next event
+    }
+
+    if (result == -EINTR) {
+        if (data & 1) {
+            flush(connection);
+        } else {
+            queueRead(connection, true);
+        }
+        return;
+    }
+
+    if (result < 0) {
+        closeConnection(connection);  // The client is gone
+        return;
+    }
+
+    if (data & 1) {
+        connection.outputSent += (size_t)result;
+        connection.lastActivity = time(NULL);
+        flush(connection);
+        return;
+    }
+
+    if (result > 0) {
+        const char *buffer =
+            &_readBuffers[connection.readSlot * SOCKETS_TCP_READ_CHUNK_SIZE];
+        connection.input.append(buffer, (size_t)result);
+        connection.lastActivity = time(NULL);
+    } else {  // The client will not send anything else
+        connection.eof = true;
+    }
+
+    handleInput(connection);
+}
+
+void TcpEventServer::handleInput(TcpConnection &connection) {
+    if (!connection.asset && !receiveHeader(connection)) {
+        return;
+    }
+
+    if (connection.asset) {  // The file of an OPA request is being received
+        receiveFile(connection);
+        return;
+    }
+
+    size_t length = TcpRequestLength(connection.input);
+
+    if (length == 0 && (connection.eof ||
+                        connection.input.size() > EVENT_MAX_REQUEST_SIZE)) {
+        // The request will never be complete, let the handlers reply with
+        // the error, just as the fork mode does with a truncated request
+        length = connection.input.size();
+    }
+
+    if (length > 0) {
+        if (admit(connection)) {
+            dispatch(connection, length);
+        }
+    } else if (connection.eof) {  // Closed without sending anything
+        closeConnection(connection);
+    }
+}
+
+bool TcpEventServer::receiveHeader(TcpConnection &connection) {
+    size_t headerLength, fileSize;
+
+    if (!TcpUploadHeader(connection.input, headerLength, fileSize)) {
+        return true;  // Not the complete header of an OPA request
+    }
+
+    if (!admit(connection)) {
+        return false;
+    }
+
+    try {
+        connection.upload = std::make_shared<UploadReservation>(
+            _server.getAdmission(), fileSize);
+        connection.asset = _server._database->createUpload();
+    } catch (AdmissionException const &e) {
+        // Rejected before the file is received
+        _server.log(
+            Message::ServerRequestDetails("Admission", "Upload Rejected"));
+        reject(connection);
+        return false;
+    } catch (DatabaseException const &e) {
+        connection.upload.reset();
+        _server.log(Message::ServerRequestDetails("Upload", e.what()));
+        reject(connection);
+        return false;
+    }
+
+    // Only the header is kept for the handler, the file goes to the upload
+    connection.header = connection.input.substr(0, headerLength);
+    connection.input.erase(0, headerLength);
+    connection.fileLeft = fileSize;
+    return true;
+}
+
+void TcpEventServer::receiveFile(TcpConnection &connection) {
+    size_t n = std::min(connection.fileLeft, connection.input.size());
+
+    connection.asset->getStream().write(connection.input.data(),
+                                        (std::streamsize)n);
+    connection.input.erase(0, n);
+    connection.fileLeft -= n;
+
+    // The handler reads the header and the delimiter after the file, or
+    // replies with the error, just as the fork mode does with a truncated
+    // request, if the client stopped sending before it
+    if ((connection.fileLeft == 0 && !connection.input.empty()) ||
+        connection.eof) {
+        size_t length = connection.header.size() +
+                        std::min(connection.input.size(), (size_t)1);
+        connection.input.insert(0, connection.header);
+        std::string().swap(connection.header);
+        dispatch(connection, length);
+    }
+}
+
+bool TcpEventServer::admit(TcpConnection &connection) {
+    // The first request was admitted along with the session
+    if (connection.requests++ == 0 ||
+        _server.getAdmission().admitRequest(connection.ip)) {
+        return true;
+    }
+
+    // Rejected before parsing
+    _server.log(Message::ServerRequestDetails("Admission", "Rejected"));
+    reject(connection);
+    return false;
+}
+
+void TcpEventServer::reject(TcpConnection &connection) {
+    // Ends the session once the error is sent
+    _server.push();
+    std::string().swap(connection.input);
+    connection.keepAlive = false;
+    connection.output = PROTOCOL_ERROR_IDENTIFIER "\n";
+    connection.outputSent = 0;
+    flush(connection);
+}
+
+void TcpEventServer::dispatch(TcpConnection &connection, size_t length) {
+    connection.busy = true;
+    watch(connection, 0);  // Only one request is handled at a time
+
+    std::string request = connection.input.substr(0, length);
+
+    if (!connection.keepAlive && request == PROTOCOL_KEEPALIVE_REQUEST) {
+        connection.keepAlive = true;
+        SetNoDelay(connection.fd);
+    }
+
+    if (connection.keepAlive) {  // The requests pipelined after it are kept
+        connection.input.erase(0, length);
+    } else {
+        std::string().swap(connection.input);  // Release the buffer memory
+    }
+
+    uint64_t id = connection.id;
+    std::string ip = connection.ip;
+    std::string port = connection.port;
+    // Held until the request is handled, the next one reserves its own
+    std::shared_ptr<UploadReservation> upload = std::move(connection.upload);
+    std::shared_ptr<AssetUpload> asset = std::move(connection.asset);
+
+    _pool.submit([this, id, ip, port, request, upload, asset]() mutable {
+        std::string output;
+        auto attachment = std::make_unique<FileAttachment>();
+
+        // The OPA handler takes the bytes reserved and the file received by
+        // the loop
+        UploadReservation::setCovered(upload ? upload->getBytes() : 0);
+        AssetUpload::setReceived(std::move(asset));
+
+        try {
+            _server.log(Message::ServerConnectionDetails(ip, port, "TCP"));
+
+            // Times the request, but for the send left to the event loop
+            RequestTimer timer(_server.getMetrics());
+            std::stringstream message(request);
+            StreamMessage streamMessage(message);
+            std::stringstream response;  // Initialize the response stream
+            _manager.readCommand(streamMessage, response, _server, true,
+                                 attachment.get());  // Read the command,
+                                                     // handle it and write
+                                                     // the response
+            output = response.str();
+            timer.mark(MetricPhase::Encode);
+            timer.setBytes(request.size(),
+                           output.size() + attachment->getSize());
+            timer.finish();
+        } catch (std::exception const &e) {
+            // The fork mode loses the child process, here only the session
+            output.clear();
+            _server.log("Session ended prematurely.");
+        }
+        UploadReservation::setCovered(0);
+        AssetUpload::setReceived(nullptr);  // Unless the handler took it
+        upload.reset();  // Released before the client can send another
+        _server.push();
+
+        {
+            std::lock_guard<std::mutex> guard(_completedMutex);
+            _completed.push_back(
+                {id, std::move(output), std::move(attachment)});
+        }
+
+        uint64_t one = 1;
+        if (write(_wakeFd, &one, sizeof(one)) == -1) {
+            // The counter can only overflow after 2^64 responses
+        }
+    });
+}
+
+void TcpEventServer::collectResponses() {
+    uint64_t count;
+    if (read(_wakeFd, &count, sizeof(count)) == -1) {
+        // Nothing to read, another wake up already collected the responses
+    }
+
+    std::vector<TcpResponse> completed;
+
+    {
+        std::lock_guard<std::mutex> guard(_completedMutex);
+        completed.swap(_completed);
+    }
+
+    for (auto &response : completed) {
+        auto connection = _connections.find(response.id);
+
+        if (connection == _connections.end()) {
+            continue;
+        }
+
+        TcpConnection &current = *connection->second;
+        current.busy = false;
+        current.lastActivity = time(NULL);
+
+        if (response.output.empty() || current.hungUp) {
+            closeConnection(current);
+            continue;
+        }
+
+        // The rest of the session is lost after a protocol error
+        current.keepAlive =
+            current.keepAlive && !isErrorResponse(response.output);
+        current.output = std::move(response.output);
+        current.outputSent = 0;
+        current.attachment = std::move(response.attachment);
+        flush(current);
+    }
+}
+
+void TcpEventServer::flush(TcpConnection &connection) {
+    if (_ring && connection.outputSent < connection.output.size()) {
+        queueSend(connection);  // Continues once the send completes
+        return;
+    }
+
+    while (connection.outputSent < connection.output.size()) {
+        ssize_t n = write(connection.fd,
+                          connection.output.data() + connection.outputSent,
+                          connection.output.size() - connection.outputSent);
+
+        if (n > 0) {
+            connection.outputSent += (size_t)n;
+            connection.lastActivity = time(NULL);
+            continue;
+        }
+
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            watch(connection, EPOLLOUT);  // Continue once there is room
+            return;
+        }
+
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+
+        closeConnection(connection);  // The client is gone
+        return;
+    }
+
+    if (connection.attachment && connection.attachment->isAttached()) {
+        FileAttachment &attachment = *connection.attachment;
+
+        while (attachment._sent < attachment._size) {
+            ssize_t n = attachment.sendTo(connection.fd);
+
+            if (n > 0) {
+                connection.lastActivity = time(NULL);
+                continue;
+            }
+
+            if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                watch(connection, EPOLLOUT);  // Continue once there is room
+                return;
+            }
+
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+
+            closeConnection(connection);  // The client is gone
+            return;
+        }
+
+        // The file was sent, what is left is the trailer
+        connection.output = std::move(attachment._trailer);
+        connection.outputSent = 0;
+        connection.attachment.reset();  // Closes the file
+        flush(connection);
+        return;
+    }
+
+    if (!connection.keepAlive) {
+        closeConnection(connection);  // The whole response was sent
+        return;
+    }
+
+    std::string().swap(connection.output);
+    connection.outputSent = 0;
+    watch(connection, EPOLLIN | EPOLLRDHUP);
+    handleInput(connection);  // A request may already be buffered
+}
+
+void TcpEventServer::watch(TcpConnection &connection, uint32_t events) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.u64 = connection.id;
+
+    epoll_ctl(_epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+}
+
+void TcpEventServer::closeConnection(TcpConnection &connection) {
+    if (connection.ioPending) {  // The ring still uses its socket and buffer
+        epoll_ctl(_epollFd, EPOLL_CTL_DEL, connection.fd, NULL);
+        connection.closing = true;
+        return;
+    }
+
+    epoll_ctl(_epollFd, EPOLL_CTL_DEL, connection.fd, NULL);
+    ::close(connection.fd);
+    _server.getAdmission().closeSession(connection.ip);
+    _connections.erase(connection.id);  // Destroys the connection state
+}
+
+void TcpEventServer::closeIdleConnections() {
+    time_t now = time(NULL);
+    std::vector<uint64_t> idle;
+
+    for (auto &connection : _connections) {
+        if (!connection.second->busy &&
+            now - connection.second->lastActivity > SOCKETS_TCP_TIMEOUT) {
+            idle.push_back(connection.first);
+        }
+    }
+
+    for (auto id : idle) {
+        closeConnection(*_connections[id]);
+    }
+}
+
+/**
+ * @brief  Finds the Fsize field of the header of an OPA request.
+ * @param  buffer The bytes received so far, starting with "OPA ".
+ * @param  end Set to the position right after the header, to the length of
+ * a malformed request, or to 0 if the header is not complete yet.
+ * @retval the field, empty unless the header is complete.
+ */
+static std::string OpenFileSizeField(const std::string &buffer, size_t &end) {
+    // OPA UID password name start_value timeactive Fname Fsize data, the
+    // data starts after the eighth space
+    size_t fieldStart = 0;
+    size_t spaces = 0;
+    size_t position = 0;
+
+    for (; position < buffer.size() && spaces < 8; position++) {
+        if (position > SERVER_EVENT_MAX_HEADER_SIZE) {
+            end = buffer.size();  // The header is too big to be valid
+            return "";
+        }
+
+        if (buffer[position] == PROTOCOL_MESSAGE_DELIMITER) {
+            end = position + 1;  // Delimiter before the data, malformed
+            return "";
+        }
+
+        if (buffer[position] == ' ') {
+            spaces++;
+            if (spaces < 8) {
+                fieldStart = position + 1;
+            }
+        }
+    }
+
+    if (spaces < 8) {  // The header is not complete yet
+        end = 0;
+        return "";
+    }
+
+    end = position;
+    return buffer.substr(fieldStart, position - 1 - fieldStart);
+}
+
+/**
+ * @brief  Checks if the Fsize field of an OPA request is valid.
+ * @param  fileSize The field.
+ * @retval true if it is valid, false otherwise.
+ */
+static bool IsValidFileSize(const std::string &fileSize) {
+    return !fileSize.empty() && fileSize.size() <= PROTOCOL_FSIZE_SIZE &&
+           isNumeric(fileSize) &&
+           std::stoul(fileSize) <= PROTOCOL_MAX_FILE_SIZE;
+}
+
+size_t TcpRequestLength(const std::string &buffer) {
+    if (buffer.compare(0, 4, "OPA ") != 0) {
+        // Every request but OPA ends at the first delimiter
+        size_t delimiter = buffer.find(PROTOCOL_MESSAGE_DELIMITER);
+
+        if (delimiter != std::string::npos) {
+            return delimiter + 1;
+        }
+
+        return (buffer.size() > SERVER_EVENT_MAX_HEADER_SIZE) ? buffer.size()
+                                                              : 0;
+    }
+
+    size_t position;
+    std::string fileSize = OpenFileSizeField(buffer, position);
+
+    if (position == 0) {  // The header is not complete yet
+        return 0;
+    }
+
+    if (!IsValidFileSize(fileSize)) {
+        return position;  // Let the handler reject the header
+    }
+
+    size_t length = position + std::stoul(fileSize) + 1;  // Data + delimiter
+
+    return (buffer.size() >= length) ? length : 0;
+}
+
+bool TcpUploadHeader(const std::string &buffer, size_t &headerLength,
+                     size_t &fileSize) {
+    if (buffer.compare(0, 4, "OPA ") != 0) {
+        return false;
+    }
+
+    std::string field = OpenFileSizeField(buffer, headerLength);
+
+    if (headerLength == 0 || !IsValidFileSize(field)) {
+        return false;
+    }
+
+    fileSize = std::stoul(field);
+    return true;
+}
@@ -0,0 +1,315 @@
+/**
+ * @file event.hpp
+ * @brief Header file for the event-driven TCP front end.
+ *
+ * This file contains the declaration of the WorkerPool and TcpEventServer
+ * classes, used by the epoll and uring server modes as an alternative to
+ * forking a process for every accepted connection.
+ */
+#ifndef __EVENT_HPP__
+#define __EVENT_HPP__
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "command.hpp"
+#include "config.hpp"
+#include "network.hpp"
+#include "server.hpp"
+#include "uring.hpp"
+
+/**
+ * @brief Fixed size pool of threads that execute submitted jobs in order.
+ */
+class WorkerPool {
+  private:
+    std::vector<std::thread> _threads;        // The worker threads
+    std::deque<std::function<void()>> _jobs;  // The jobs waiting for a worker
+    std::mutex _mutex;                        // Guards the job queue
+    std::condition_variable _condition;       // Signals new jobs or stopping
+    bool _stopping = false;  // Flag indicating whether the pool is stopping
+
+    /**
+     * @brief  Main loop of each worker, runs jobs until the pool stops.
+     */
+    void run();
+
+  public:
+    /**
+     * @brief  Starts the worker threads.
+     *
+     * The threads are started with SIGINT blocked, so that the signal is
+     * always delivered to the thread running the event loop.
+     * @param  threads The number of worker threads.
+     */
+    WorkerPool(size_t threads);
+
+    /**
+     * @brief  Stops the pool, waiting for the running jobs to finish.
+     */
+    ~WorkerPool();
+
+    /**
+     * @brief  Queues a job to be run by one of the workers.
+     * @param  job The job.
+     */
+    void submit(std::function<void()> job);
+
+    /**
+     * @brief  Stops the workers once the queued jobs are done.
+     */
+    void stop();
+};
+
+/**
+ * @brief State of a connection handled by the event loop.
+ */
+struct TcpConnection {
+    int fd;                  // The file descriptor of the connection
+    uint64_t id;             // Unique id, fds get reused after being closed
+    std::string ip;          // The IP address of the client
+    std::string port;        // The port of the client
+    std::string input;       // The bytes of the requests received so far
+    std::string output;      // The bytes of the response still to be sent
+    size_t outputSent = 0;   // The number of bytes of the output already sent
+    time_t lastActivity;     // The last time there was progress on the socket
+    bool busy = false;       // Whether a worker is handling the request
+    bool eof = false;        // Whether the client has stopped sending
+    bool hungUp = false;     // Whether the socket failed while it was busy
+    bool keepAlive = false;  // Whether the connection outlives its response
+    size_t requests = 0;     // The number of requests dispatched
+    bool ioPending = false;  // Whether a ring operation on it is in flight
+    bool closing = false;    // Whether it is closed once that one completes
+    size_t readSlot = 0;     // The read buffer of the ring receive
+    std::unique_ptr<FileAttachment> attachment;  // Sent after the output
+    std::shared_ptr<UploadReservation> upload;   // Of the OPA being received
+    std::shared_ptr<AssetUpload> asset;  // The file of the OPA being received
+    std::string header;                  // The header of that OPA request
+    size_t fileLeft = 0;  // The bytes of the file still to be received
+};
+
+/**
+ * @brief Response produced by a worker for a connection.
+ */
+struct TcpResponse {
+    uint64_t id;         // The id of the connection
+    std::string output;  // The response, empty if the session has to end
+    std::unique_ptr<FileAttachment> attachment;  // Sent after the output
+};
+
+/**
+ * @brief Event-driven TCP server.
+ *
+ * A single thread multiplexes every connection with epoll, buffering
+ * requests without blocking until they are complete. Complete requests are
+ * handed to a WorkerPool that runs CommandManager::readCommand, and the
+ * responses are written back by the event loop. A slow client thus only
+ * holds a buffer, never a process or a worker. The file of an OPA request is
+ * written to its upload as it arrives, the buffer only ever holds the
+ * header. The requests of a kept alive connection are handled one at a
+ * time, so the responses go out in order.
+ *
+ * With a ring, epoll only reports readiness: the receives and sends of every
+ * connection ready in an iteration are queued and submitted with a single
+ * system call, and their completions reaped before waiting again. Each
+ * connection has at most one operation in flight.
+ */
+class TcpEventServer {
+  private:
+    TcpServer &_listener;      // The listening server socket
+    CommandManager &_manager;  // The command manager that handles requests
+    Server &_server;           // The server state
+    WorkerPool _pool;          // The workers that handle complete requests
+    int _epollFd;              // The epoll instance
+    int _wakeFd;               // Eventfd used by the workers to wake the loop
+    uint64_t _nextId = 2;      // The next connection id, 0 and 1 are reserved
+    std::unordered_map<uint64_t, std::unique_ptr<TcpConnection>>
+        _connections;  // The open connections, by id
+
+    std::mutex _completedMutex;  // Guards the completed responses
+    std::vector<TcpResponse> _completed;  // The responses of the workers
+
+    std::unique_ptr<IoRing> _ring;  // The ring of the sockets, NULL for none
+    std::unique_ptr<char[]> _readBuffers;  // One per event of an iteration
+    size_t _readsQueued = 0;  // The read buffers used in this iteration
+
+    /**
+     * @brief  Accepts every pending connection.
+     */
+    void acceptConnections();
+
+    /**
+     * @brief  Reads everything available on a connection.
+     * @param  connection The connection.
+     */
+    void readConnection(TcpConnection &connection);
+
+    /**
+     * @brief  Queues a receive on a connection in the ring.
+     * @param  connection The connection.
+     * @param  retry Whether it retries an interrupted receive, which reuses
+     * its read buffer.
+     */
+    void queueRead(TcpConnection &connection, bool retry = false);
+
+    /**
+     * @brief  Queues a send of the pending output of a connection in the
+     * ring.
+     * @param  connection The connection.
+     */
+    void queueSend(TcpConnection &connection);
+
+    /**
+     * @brief  Submits the operations queued in the ring and handles their
+     * completions, until none is left in flight.
+     */
+    void completeIo();
+
+    /**
+     * @brief  Handles the completion of a receive or a send.
+     * @param  data The data of the completion, the id of the connection and
+     * whether it was a send.
+     * @param  result The result of the operation.
+     */
+    void handleCompletion(uint64_t data, int result);
+
+    /**
+     * @brief  Hands the next request buffered on a connection to the workers
+     * once it is complete, closing the connection if it never will be.
+     * @param  connection The connection.
+     */
+    void handleInput(TcpConnection &connection);
+
+    /**
+     * @brief  Starts receiving the file of the OPA request buffered on a
+     * connection, once its header is received, reserving its bytes. If it
+     * is rejected the connection is closed without reading the file.
+     * @param  connection The connection.
+     * @retval true unless the request was rejected.
+     */
+    bool receiveHeader(TcpConnection &connection);
+
+    /**
+     * @brief  Writes the file bytes buffered on a connection to the upload
+     * of its OPA request, handing the request to the workers once the file
+     * and the byte after it are received.
+     * @param  connection The connection.
+     */
+    void receiveFile(TcpConnection &connection);
+
+    /**
+     * @brief  Admits the next request of a connection, or rejects it.
+     * @param  connection The connection.
+     * @retval true if the request was admitted, false if it was rejected.
+     */
+    bool admit(TcpConnection &connection);
+
+    /**
+     * @brief  Replies with an error and closes the connection once it is
+     * sent, dropping what was buffered.
+     * @param  connection The connection.
+     */
+    void reject(TcpConnection &connection);
+
+    /**
+     * @brief  Hands the request of a connection to the workers.
+     * @param  connection The connection.
+     * @param  length The length of the request in the input buffer.
+     */
+    void dispatch(TcpConnection &connection, size_t length);
+
+    /**
+     * @brief  Moves the responses finished by the workers to their
+     * connections.
+     */
+    void collectResponses();
+
+    /**
+     * @brief  Writes as much of the pending output and attachment as the
+     * socket accepts. Once everything was sent the connection is closed, or
+     * its next request handled if it is kept alive.
+     * @param  connection The connection.
+     */
+    void flush(TcpConnection &connection);
+
+    /**
+     * @brief  Changes the events the loop waits for on a connection.
+     * @param  connection The connection.
+     * @param  events The epoll events.
+     */
+    void watch(TcpConnection &connection, uint32_t events);
+
+    /**
+     * @brief  Closes a connection and forgets its state, once its ring
+     * operation completes if it has one in flight.
+     * @param  connection The connection.
+     */
+    void closeConnection(TcpConnection &connection);
+
+    /**
+     * @brief  Closes the idle connections that are not being handled.
+     */
+    void closeIdleConnections();
+
+  public:
+    /**
+     * @brief  Creates the epoll instance and starts the workers.
+     * @param  listener The listening server socket.
+     * @param  manager The command manager that handles the requests.
+     * @param  server The server state.
+     * @param  workers The number of worker threads.
+     * @param  ring Whether the sockets are read and written through a ring.
+     */
+    TcpEventServer(TcpServer &listener, CommandManager &manager,
+                   Server &server, size_t workers, bool ring = false);
+
+    /**
+     * @brief  Closes every connection and stops the workers.
+     */
+    ~TcpEventServer();
+
+    /**
+     * @brief  Runs the event loop.
+     *
+     * This function only returns by throwing a SocketCommunicationException,
+     * when the loop is interrupted by a signal.
+     */
+    void run();
+};
+
+/**
+ * @brief  Finds the length of the first complete request in a buffer.
+ *
+ * Requests end with a delimiter, except OPA whose file data may contain it,
+ * so for OPA the length is taken from the Fsize field of its header.
+ * Malformed requests are reported as complete so that the command handlers
+ * reply with the corresponding error.
+ * @param  buffer The bytes received so far.
+ * @retval The request length, or 0 if the request is not complete yet.
+ */
+size_t TcpRequestLength(const std::string &buffer);
+
+/**
+ * @brief  Finds the header of the OPA request at the start of a buffer.
+ * @param  buffer The bytes received so far.
+ * @param  headerLength Set to the length of the header, up to the file.
+ * @param  fileSize Set to the Fsize field.
+ * @retval true if the buffer starts with the complete and valid header of an
+ * OPA request, false otherwise.
+ */
+bool TcpUploadHeader(const std::string &buffer, size_t &headerLength,
+                     size_t &fileSize);
+
+#endif
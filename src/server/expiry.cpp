@@ -0,0 +1,137 @@
+/**
+ * @file expiry.cpp
+ * @brief Implementation of the auction expiry scheduler.
+ */
+#include "expiry.hpp"
+
+#include "database.hpp"
+
+ExpiryScheduler::ExpiryScheduler() {
+    // Anonymous shared mapping, inherited by every process forked afterwards
+    void *table = mmap(NULL, sizeof(ExpiryTable), PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (table == MAP_FAILED) {
+        throw DatabaseException("Could not allocate the expiry scheduler");
+    }
+
+    _table = (ExpiryTable *)table;
+    _table->size = 0;
+
+    pthread_mutexattr_t mutexAttributes;
+    pthread_condattr_t condAttributes;
+
+    pthread_mutexattr_init(&mutexAttributes);
+    pthread_mutexattr_setpshared(&mutexAttributes, PTHREAD_PROCESS_SHARED);
+    pthread_condattr_init(&condAttributes);
+    pthread_condattr_setpshared(&condAttributes, PTHREAD_PROCESS_SHARED);
+
+    bool failed = pthread_mutex_init(&_table->mutex, &mutexAttributes) != 0 ||
+                  pthread_cond_init(&_table->changed, &condAttributes) != 0;
+
+    pthread_mutexattr_destroy(&mutexAttributes);
+    pthread_condattr_destroy(&condAttributes);
+
+    if (failed) {
+        munmap(_table, sizeof(ExpiryTable));
+        throw DatabaseException("Could not initialize the expiry scheduler");
+    }
+}
+
+ExpiryScheduler::~ExpiryScheduler() {
+    // The mutex is not destroyed, other processes may still be using it
+    munmap(_table, sizeof(ExpiryTable));
+}
+
+void ExpiryScheduler::siftUp(size_t index) {
+    ExpiryEntry *heap = _table->heap;
+
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+
+        if (heap[parent].deadline <= heap[index].deadline) {
+            break;
+        }
+
+        std::swap(heap[parent], heap[index]);
+        index = parent;
+    }
+}
+
+void ExpiryScheduler::siftDown(size_t index) {
+    ExpiryEntry *heap = _table->heap;
+
+    while (1) {
+        size_t earliest = index;
+        size_t left = 2 * index + 1;
+        size_t right = left + 1;
+
+        if (left < _table->size &&
+            heap[left].deadline < heap[earliest].deadline) {
+            earliest = left;
+        }
+        if (right < _table->size &&
+            heap[right].deadline < heap[earliest].deadline) {
+            earliest = right;
+        }
+
+        if (earliest == index) {
+            break;
+        }
+
+        std::swap(heap[earliest], heap[index]);
+        index = earliest;
+    }
+}
+
+void ExpiryScheduler::schedule(int aid, time_t deadline) {
+    pthread_mutex_lock(&_table->mutex);
+
+    if (_table->size == DATABASE_MAX_AUCTIONS) {  // Every AID is scheduled
+        pthread_mutex_unlock(&_table->mutex);
+        return;
+    }
+
+    size_t index = _table->size++;
+    _table->heap[index].deadline = deadline;
+    _table->heap[index].aid = aid;
+    siftUp(index);
+
+    if (index == 0 || _table->heap[0].aid == aid) {  // The first to expire
+        pthread_cond_signal(&_table->changed);
+    }
+
+    pthread_mutex_unlock(&_table->mutex);
+}
+
+int ExpiryScheduler::waitExpired(time_t until) {
+    pthread_mutex_lock(&_table->mutex);
+
+    // An auction ends once the current time is past its deadline
+    while (_table->size == 0 || _table->heap[0].deadline >= time(NULL)) {
+        if (time(NULL) >= until) {
+            pthread_mutex_unlock(&_table->mutex);
+            return -1;
+        }
+
+        struct timespec wakeup = {until, 0};
+        if (_table->size > 0) {
+            wakeup.tv_sec = std::min(until, _table->heap[0].deadline + 1);
+        }
+        pthread_cond_timedwait(&_table->changed, &_table->mutex, &wakeup);
+    }
+
+    int aid = _table->heap[0].aid;
+    _table->heap[0] = _table->heap[--_table->size];
+    siftDown(0);
+
+    pthread_mutex_unlock(&_table->mutex);
+
+    return aid;
+}
+
+void ExpiryScheduler::clear() {
+    pthread_mutex_lock(&_table->mutex);
+    _table->size = 0;
+    pthread_mutex_unlock(&_table->mutex);
+}
@@ -0,0 +1,93 @@
+/**
+ * @file expiry.hpp
+ * @brief Header file for the auction expiry scheduler.
+ *
+ * This file contains the declaration of the ExpiryScheduler class, that keeps
+ * the deadlines of the active auctions in a min-heap shared by all the server
+ * processes, so that a single process ends every auction when its time is up.
+ */
+#ifndef __EXPIRY_HPP__
+#define __EXPIRY_HPP__
+
+#include <ctime>
+
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "config.hpp"
+
+/**
+ * @brief Entry of the scheduler, the deadline of a single auction.
+ */
+struct ExpiryEntry {
+    time_t deadline;  // The last second in which the auction is active
+    int aid;          // The auction's AID
+};
+
+/**
+ * @brief The shared memory table of the scheduler.
+ */
+struct ExpiryTable {
+    pthread_mutex_t mutex;   // Guards the heap
+    pthread_cond_t changed;  // Signaled when an earlier deadline is added
+    size_t size;             // The number of entries in the heap
+    ExpiryEntry heap[DATABASE_MAX_AUCTIONS];  // Ordered by deadline
+};
+
+/**
+ * @brief Min-heap of the deadlines of the active auctions.
+ *
+ * The table is mapped as shared memory before the server forks, so the
+ * auctions scheduled by any process wake the one waiting for the deadlines.
+ * Entries are never removed early: an auction closed by its host is simply
+ * found already ended once its deadline is due.
+ */
+class ExpiryScheduler {
+  private:
+    ExpiryTable *_table;  // The shared table
+
+    /**
+     * @brief  Moves an entry up the heap until its parent is due earlier.
+     * @param  index The index of the entry.
+     */
+    void siftUp(size_t index);
+
+    /**
+     * @brief  Moves an entry down the heap until its children are due later.
+     * @param  index The index of the entry.
+     */
+    void siftDown(size_t index);
+
+  public:
+    /**
+     * @brief  Maps the shared memory table, initially empty.
+     */
+    ExpiryScheduler();
+
+    /**
+     * @brief  Unmaps the shared memory table.
+     */
+    ~ExpiryScheduler();
+
+    /**
+     * @brief  Schedules the end of an auction.
+     * @param  aid The auction's AID.
+     * @param  deadline The last second in which the auction is active.
+     */
+    void schedule(int aid, time_t deadline);
+
+    /**
+     * @brief  Blocks until the deadline of an auction has passed and removes
+     * it from the heap, or until a given time.
+     * @param  until The time after which it stops waiting.
+     * @retval the AID of the auction, -1 if none expired in time.
+     */
+    int waitExpired(time_t until);
+
+    /**
+     * @brief  Removes every entry.
+     */
+    void clear();
+};
+
+#endif
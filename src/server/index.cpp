@@ -0,0 +1,237 @@
+/**
+ * @file index.cpp
+ * @brief Implementation of the in-memory auction index.
+ */
+#include "index.hpp"
+
+#include <ctime>
+
+/**
+ * @brief  Copies a string to a fixed size field, truncating it if needed.
+ * @param  destination The field.
+ * @param  size The size of the field, including the terminator.
+ * @param  source The string.
+ */
+static void CopyField(char *destination, size_t size, std::string source) {
+    size_t length = std::min(source.size(), size - 1);
+
+    memcpy(destination, source.data(), length);
+    destination[length] = '\0';
+}
+
+AuctionIndex::AuctionIndex() {
+    // Anonymous shared mapping, inherited by every process forked afterwards
+    void *table = mmap(NULL, sizeof(AuctionIndexTable), PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (table == MAP_FAILED) {
+        throw DatabaseException("Could not allocate the auction index");
+    }
+
+    _table = (AuctionIndexTable *)table;
+    clear();
+
+    // Generations sent to the clients before a restart never look current
+    uint64_t start = (uint64_t)time(NULL) << 20;
+
+    _table->auctionsGeneration = start;
+    _table->bidsGeneration = start;
+    _table->recordsGeneration = start;
+}
+
+AuctionIndex::~AuctionIndex() {
+    munmap(_table, sizeof(AuctionIndexTable));
+}
+
+AuctionIndexEntry &AuctionIndex::getEntry(std::string aid) {
+    if (!contains(aid)) {
+        throw AuctionException();
+    }
+
+    return _table->entries[AidStrToInt(aid)];
+}
+
+void AuctionIndex::touch(AuctionIndexEntry &entry) {
+    entry.generation =
+        __atomic_add_fetch(&_table->recordsGeneration, 1, __ATOMIC_RELAXED);
+}
+
+void AuctionIndex::load(DatabaseCore &core) {
+    clear();
+
+    for (auto &aid : core.getAllAuctions()) {
+        if (aid.length() != PROTOCOL_AID_SIZE || !isNumeric(aid)) {
+            continue;  // Not an auction directory
+        }
+
+        loadAuction(core, aid);
+    }
+}
+
+void AuctionIndex::loadAuction(DatabaseCore &core, std::string aid) {
+    int index = AidStrToInt(aid);
+
+    if (!core.hasAuctionStarted(aid)) {
+        memset(&_table->entries[index], 0, sizeof(AuctionIndexEntry));
+        __atomic_add_fetch(&_table->auctionsGeneration, 1, __ATOMIC_RELEASE);
+        return;
+    }
+
+    AuctionStartInfo startInfo = core.getAuctionStartInfo(aid);
+    addAuction(aid, startInfo);
+
+    AuctionBidSummary summary = core.getAuctionBidSummary(aid);
+    setBidSummary(aid, summary);
+
+    if (core.hasAuctionEnded(aid)) {
+        endAuction(aid, core.getAuctionEndInfo(aid));
+    }
+}
+
+void AuctionIndex::clear() {
+    DatabaseGeneration generation = getGeneration();
+
+    uint64_t records = _table->recordsGeneration;
+
+    memset(_table, 0, sizeof(AuctionIndexTable));
+
+    // Kept across clears, the responses of before must never look current
+    _table->auctionsGeneration = generation.auctions + 1;
+    _table->bidsGeneration = generation.bids + 1;
+    _table->recordsGeneration = records + 1;
+}
+
+AuctionIndexEntry AuctionIndex::copyEntry(int aid) {
+    AuctionIndexEntry &entry = _table->entries[aid];
+    bool ended = __atomic_load_n(&entry.ended, __ATOMIC_ACQUIRE);
+    AuctionIndexEntry copy = entry;
+
+    copy.ended = ended;  // Read first, the end time was set before it
+
+    return copy;
+}
+
+void AuctionIndex::restoreEntry(int aid, AuctionIndexEntry &entry) {
+    _table->entries[aid] = entry;
+
+    if (entry.exists) {
+        _table->lastAid = std::max(_table->lastAid, aid);
+    }
+    // Kept, it was written with every change, but never reused
+    _table->recordsGeneration =
+        std::max(_table->recordsGeneration, entry.generation);
+    __atomic_add_fetch(&_table->auctionsGeneration, 1, __ATOMIC_RELEASE);
+}
+
+DatabaseGeneration AuctionIndex::getGeneration() {
+    DatabaseGeneration generation;
+
+    generation.auctions =
+        __atomic_load_n(&_table->auctionsGeneration, __ATOMIC_ACQUIRE);
+    generation.bids =
+        __atomic_load_n(&_table->bidsGeneration, __ATOMIC_ACQUIRE);
+
+    return generation;
+}
+
+uint64_t AuctionIndex::getRecordGeneration(std::string aid) {
+    return getEntry(aid).generation;
+}
+
+bool AuctionIndex::contains(std::string aid) {
+    if (aid.length() != PROTOCOL_AID_SIZE || !isNumeric(aid)) {
+        return false;
+    }
+
+    return _table->entries[AidStrToInt(aid)].exists;
+}
+
+std::vector<std::string> AuctionIndex::getAll() {
+    std::vector<std::string> auctions;
+
+    for (int aid = 0; aid <= _table->lastAid; aid++) {
+        if (_table->entries[aid].exists) {
+            auctions.push_back(AidIntToStr(aid));
+        }
+    }
+
+    return auctions;
+}
+
+int AuctionIndex::getLastAid() {
+    return _table->lastAid;
+}
+
+void AuctionIndex::addAuction(std::string aid, AuctionStartInfo &startInfo) {
+    int index = AidStrToInt(aid);
+    AuctionIndexEntry &entry = _table->entries[index];
+
+    memset(&entry, 0, sizeof(entry));
+    entry.exists = true;
+    CopyField(entry.uid, sizeof(entry.uid), startInfo.uid);
+    CopyField(entry.name, sizeof(entry.name), startInfo.name);
+    entry.startValue = startInfo.startValue;
+    entry.startTime = startInfo.startTime;
+    entry.timeActive = startInfo.timeActive;
+    entry.maxBid = startInfo.startValue - 1;
+    touch(entry);
+
+    _table->lastAid = std::max(_table->lastAid, index);
+    __atomic_add_fetch(&_table->auctionsGeneration, 1, __ATOMIC_RELEASE);
+}
+
+void AuctionIndex::endAuction(std::string aid, AuctionEndInfo endInfo) {
+    AuctionIndexEntry &entry = getEntry(aid);
+
+    entry.endTime = endInfo.endTime;
+    touch(entry);
+    __atomic_store_n(&entry.ended, true, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&_table->auctionsGeneration, 1, __ATOMIC_RELEASE);
+}
+
+void AuctionIndex::addBid(std::string aid, AuctionBidInfo &bidInfo) {
+    AuctionIndexEntry &entry = getEntry(aid);
+
+    entry.maxBid = std::max(entry.maxBid, bidInfo.bidValue);
+    entry.bidCount++;
+    touch(entry);
+    __atomic_add_fetch(&_table->bidsGeneration, 1, __ATOMIC_RELEASE);
+}
+
+void AuctionIndex::setBidSummary(std::string aid, AuctionBidSummary &summary) {
+    AuctionIndexEntry &entry = getEntry(aid);
+
+    entry.maxBid = summary.maxBid;
+    entry.bidCount = summary.bidCount;
+    touch(entry);
+}
+
+AuctionStartInfo AuctionIndex::getStartInfo(std::string aid) {
+    AuctionIndexEntry &entry = getEntry(aid);
+
+    AuctionStartInfo startInfo;
+
+    startInfo.uid = entry.uid;
+    startInfo.name = entry.name;
+    startInfo.startValue = entry.startValue;
+    startInfo.startTime = entry.startTime;
+    startInfo.timeActive = entry.timeActive;
+
+    return startInfo;
+}
+
+bool AuctionIndex::hasEnded(std::string aid) {
+    return getEntry(aid).ended;
+}
+
+AuctionEndInfo AuctionIndex::getEndInfo(std::string aid) {
+    AuctionEndInfo endInfo;
+
+    endInfo.endTime = getEntry(aid).endTime;
+
+    return endInfo;
+}
+
+int AuctionIndex::getMaxBid(std::string aid) {
+    return getEntry(aid).maxBid;
+}
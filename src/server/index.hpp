@@ -0,0 +1,221 @@
+/**
+ * @file index.hpp
+ * @brief Header file for the in-memory auction index.
+ *
+ * This file contains the declaration of the AuctionIndex class, that keeps a
+ * copy of the state of every auction in memory shared by all the server
+ * processes.
+ */
+#ifndef __INDEX_HPP__
+#define __INDEX_HPP__
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include "config.hpp"
+#include "database.hpp"
+
+/**
+ * @brief Entry of the index, with everything known about a single auction.
+ *
+ * Entries live in shared memory, so they only hold fixed size fields. The
+ * highest bid of an auction without bids is its start value minus 1.
+ */
+struct AuctionIndexEntry {
+    bool exists;                               // Whether the auction exists
+    bool ended;                                // Whether it has ended
+    char uid[PROTOCOL_UID_SIZE + 1];           // The host's UID
+    char name[PROTOCOL_AUCTIONNAME_SIZE + 1];  // The auction's name
+    int startValue;                            // The start value
+    time_t startTime;                          // The start time
+    time_t timeActive;                         // The maximum time active
+    time_t endTime;                            // The end time, if ended
+    int maxBid;                                // The highest bid value
+    int bidCount;                              // The number of bids
+    uint64_t generation;  // The records generation of its last change
+};
+
+/**
+ * @brief The shared memory table of the index, addressed by AID.
+ */
+struct AuctionIndexTable {
+    int lastAid;  // The highest AID in use, 0 when there are no auctions
+    uint64_t auctionsGeneration;  // Bumped when an auction starts or ends
+    uint64_t bidsGeneration;      // Bumped when a bid is made
+    uint64_t recordsGeneration;   // Bumped when the record of one changes
+    AuctionIndexEntry entries[DATABASE_MAX_AUCTIONS];
+};
+
+/**
+ * @brief In-memory index of the auctions.
+ *
+ * The index is loaded once from the database directory, which stays the
+ * source of truth, and then updated by the Database every time it writes an
+ * auction to the disk. The table is mapped as shared memory before the server
+ * forks, so every process sees the updates of the others. Like DatabaseCore,
+ * this class is not thread safe: the Database guards each entry with the lock
+ * of its auction, and the set of auctions with the global lock.
+ */
+class AuctionIndex {
+  private:
+    AuctionIndexTable *_table;  // The shared table
+
+    /**
+     * @brief  Gets the entry of an existing auction.
+     * @param  aid The auction's AID.
+     * @retval reference to the entry.
+     */
+    AuctionIndexEntry &getEntry(std::string aid);
+
+    /**
+     * @brief  Moves the record of an auction on to a new generation.
+     * @param  entry The entry of the auction.
+     */
+    void touch(AuctionIndexEntry &entry);
+
+  public:
+    /**
+     * @brief  Maps the shared memory table, initially empty, with the
+     * generations starting from the current time.
+     */
+    AuctionIndex();
+
+    /**
+     * @brief  Unmaps the shared memory table.
+     */
+    ~AuctionIndex();
+
+    /**
+     * @brief  Rebuilds the index from the contents of the database directory.
+     * @param  core The core of the database.
+     */
+    void load(DatabaseCore &core);
+
+    /**
+     * @brief  Reads a single auction again from the database directory,
+     * removing it from the index if it was never started.
+     * @param  core The core of the database.
+     * @param  aid The auction's AID.
+     */
+    void loadAuction(DatabaseCore &core, std::string aid);
+
+    /**
+     * @brief  Removes every auction from the index, moving on to a new
+     * generation.
+     */
+    void clear();
+
+    /**
+     * @brief  Copies the entry of an AID, whether the auction exists or not.
+     * An auction being ended meanwhile is copied as ended only once its end
+     * time is set.
+     * @param  aid The AID in int form.
+     * @retval the entry.
+     */
+    AuctionIndexEntry copyEntry(int aid);
+
+    /**
+     * @brief  Sets the entry of an AID, as copied by copyEntry.
+     * @param  aid The AID in int form.
+     * @param  entry The entry.
+     */
+    void restoreEntry(int aid, AuctionIndexEntry &entry);
+
+    /**
+     * @brief  Gets the generation of the auctions and bids, that every
+     * change to them bumps.
+     *
+     * Unlike the rest of the index, this needs no lock.
+     * @retval the generation.
+     */
+    DatabaseGeneration getGeneration();
+
+    /**
+     * @brief  Gets the generation of the record of an auction, that every
+     * change to what its record shows moves on, and that is never reused,
+     * even by a server started afterwards.
+     * @param  aid The auction's AID.
+     * @retval the generation.
+     */
+    uint64_t getRecordGeneration(std::string aid);
+
+    /**
+     * @brief  Checks if the auction exists.
+     * @param  aid The auction's AID.
+     * @retval true if the auction exists, false otherwise.
+     */
+    bool contains(std::string aid);
+
+    /**
+     * @brief  Gets all the auctions in the index.
+     * @retval vector containing the AIDs of the auctions in ascending order.
+     */
+    std::vector<std::string> getAll();
+
+    /**
+     * @brief  Gets the highest AID in use.
+     * @retval the AID in int form, 0 if there are no auctions.
+     */
+    int getLastAid();
+
+    /**
+     * @brief  Adds a newly created auction.
+     * @param  aid The auction's AID.
+     * @param  startInfo Structure containing the start information.
+     */
+    void addAuction(std::string aid, AuctionStartInfo &startInfo);
+
+    /**
+     * @brief  Sets an auction to the ended state.
+     * @param  aid The auction's AID.
+     * @param  endInfo Structure containing the end information.
+     */
+    void endAuction(std::string aid, AuctionEndInfo endInfo);
+
+    /**
+     * @brief  Adds a bid to an auction.
+     * @param  aid The auction's AID.
+     * @param  bidInfo Structure containing the info of the bid.
+     */
+    void addBid(std::string aid, AuctionBidInfo &bidInfo);
+
+    /**
+     * @brief  Sets the highest bid and number of bids of an auction.
+     * @param  aid The auction's AID.
+     * @param  summary Structure containing the bid summary.
+     */
+    void setBidSummary(std::string aid, AuctionBidSummary &summary);
+
+    /**
+     * @brief  Gets an auction's start information.
+     * @param  aid The auction's AID.
+     * @retval structure containing the start information.
+     */
+    AuctionStartInfo getStartInfo(std::string aid);
+
+    /**
+     * @brief  Checks if an auction has ended.
+     * @param  aid The auction's AID.
+     * @retval true if the auction has ended, false otherwise.
+     */
+    bool hasEnded(std::string aid);
+
+    /**
+     * @brief  Gets an auction's end information.
+     * @param  aid The auction's AID.
+     * @retval structure containing the end information.
+     */
+    AuctionEndInfo getEndInfo(std::string aid);
+
+    /**
+     * @brief  Gets an auction's highest bid value.
+     * @param  aid The auction's AID.
+     * @retval the highest bid, the start value minus 1 if there are no bids.
+     */
+    int getMaxBid(std::string aid);
+};
+
+#endif
@@ -0,0 +1,295 @@
+/**
+ * @file journal.cpp
+ * @brief Implementation of the write-ahead journal of the database.
+ */
+#include "journal.hpp"
+
+#include "checkpoint.hpp"
+#include "database.hpp"
+
+/**
+ * @brief  Computes the checksum of a record, of every byte after the field.
+ * @param  record The record.
+ * @retval the FNV-1a hash of the bytes.
+ */
+static uint32_t Checksum(JournalRecord &record) {
+    const unsigned char *bytes = (const unsigned char *)&record;
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = sizeof(record.checksum); i < sizeof(record); i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief  Opens a journal file for appending, creating it if needed.
+ * @param  path The journal file.
+ * @retval the file descriptor.
+ */
+static int OpenJournal(fs::path path) {
+    int fd = open(path.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+
+    if (fd == -1) {
+        throw DatabaseException("Could not open the journal");
+    }
+
+    return fd;
+}
+
+JournalEntry::JournalEntry(Journal *journal, uint64_t end,
+                           std::function<void()> repair)
+    : _journal(journal), _end(end), _repair(std::move(repair)) {}
+
+JournalEntry::~JournalEntry() {
+    if (_journal == NULL) {
+        return;
+    }
+
+    if (!_synced) {  // Failed before the change was started
+        _journal->drop();
+        return;
+    }
+
+    try {
+        if (!_repair) {
+            throw DatabaseException("The change cannot be repaired");
+        }
+        _repair();  // Finished as the next start would
+    } catch (std::exception const &e) {
+        _journal->fail();
+        return;
+    }
+
+    _journal->commit(_end);  // The record is on the disk, it cannot throw
+}
+
+void JournalEntry::sync() {
+    if (_journal != NULL) {
+        _journal->sync(_end);
+        _synced = true;
+    }
+}
+
+void JournalEntry::commit() {
+    Journal *journal = _journal;
+
+    _journal = NULL;  // Done, whether the sync succeeds or not
+
+    if (journal != NULL) {
+        journal->commit(_end);
+    }
+}
+
+Journal::Journal(fs::path path) : _path(path) {
+    // Anonymous shared mapping, inherited by every process forked afterwards
+    void *state = mmap(NULL, sizeof(JournalState), PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (state == MAP_FAILED) {
+        throw DatabaseException("Could not allocate the journal");
+    }
+
+    _state = (JournalState *)state;
+    memset(_state, 0, sizeof(JournalState));
+
+    pthread_mutexattr_t mutexAttributes;
+    pthread_condattr_t condAttributes;
+
+    pthread_mutexattr_init(&mutexAttributes);
+    pthread_mutexattr_setpshared(&mutexAttributes, PTHREAD_PROCESS_SHARED);
+    pthread_condattr_init(&condAttributes);
+    pthread_condattr_setpshared(&condAttributes, PTHREAD_PROCESS_SHARED);
+
+    bool failed = pthread_mutex_init(&_state->mutex, &mutexAttributes) != 0 ||
+                  pthread_cond_init(&_state->synced, &condAttributes) != 0;
+
+    pthread_mutexattr_destroy(&mutexAttributes);
+    pthread_condattr_destroy(&condAttributes);
+
+    if (failed) {
+        munmap(_state, sizeof(JournalState));
+        throw DatabaseException("Could not initialize the journal");
+    }
+
+    _fd = OpenJournal(_path);
+}
+
+Journal::~Journal() {
+    // The mutex is not destroyed, other processes may still be using it
+    close(_fd);
+    munmap(_state, sizeof(JournalState));
+}
+
+void Journal::setIndexCheckpoint(IndexCheckpoint *checkpoint) {
+    _indexCheckpoint = checkpoint;
+}
+
+std::vector<JournalRecord> Journal::recover() {
+    std::vector<JournalRecord> records;
+    JournalRecord record;
+    off_t offset = 0;
+
+    while (pread(_fd, &record, sizeof(record), offset) ==
+           (ssize_t)sizeof(record)) {
+        if (record.version != DATABASE_JOURNAL_VERSION ||
+            record.checksum != Checksum(record)) {
+            break;  // Cut short by a crash, nothing after it was committed
+        }
+
+        records.push_back(record);
+        offset += (off_t)sizeof(record);
+    }
+
+    return records;
+}
+
+void Journal::reset() {
+    pthread_mutex_lock(&_state->mutex);
+
+    try {
+        checkpoint();
+    } catch (DatabaseException const &e) {
+        pthread_mutex_unlock(&_state->mutex);
+        throw;
+    }
+
+    pthread_mutex_unlock(&_state->mutex);
+}
+
+void Journal::reopen() {
+    pthread_mutex_lock(&_state->mutex);
+
+    close(_fd);
+    _fd = OpenJournal(_path);
+    _state->size = 0;
+    _state->failed = false;  // Nothing of before is left to replay
+    _state->damaged = false;
+
+    pthread_mutex_unlock(&_state->mutex);
+}
+
+void Journal::checkpoint() {
+    // Every journaled change is in the files, which are synced all at once
+    if (syncfs(_fd) == -1) {
+        throw DatabaseException("Could not checkpoint the journal");
+    }
+
+    // The tables are only loaded from the checkpoint along with the journal
+    // that follows it, an older one is removed if it cannot be replaced
+    if (_indexCheckpoint != NULL) {
+        _indexCheckpoint->write();
+    }
+
+    if (ftruncate(_fd, 0) == -1) {
+        throw DatabaseException("Could not checkpoint the journal");
+    }
+
+    _state->size = 0;
+    _state->durable = _state->appended;
+    _state->damaged = false;
+}
+
+JournalEntry Journal::append(JournalRecord &record,
+                             std::function<void()> repair) {
+    record.version = DATABASE_JOURNAL_VERSION;
+    record.checksum = Checksum(record);
+
+    pthread_mutex_lock(&_state->mutex);
+
+    if (write(_fd, &record, sizeof(record)) != (ssize_t)sizeof(record)) {
+        // A partial record would shift every record appended after it, the
+        // journal is then emptied as soon as no change is unfinished
+        if (ftruncate(_fd, (off_t)_state->size) == -1) {
+            _state->damaged = true;
+        }
+        pthread_mutex_unlock(&_state->mutex);
+        throw DatabaseException("Could not write to the journal");
+    }
+
+    _state->size += sizeof(record);
+    _state->appended += sizeof(record);
+    _state->pending++;
+
+    uint64_t end = _state->appended;
+
+    pthread_mutex_unlock(&_state->mutex);
+
+    return JournalEntry(this, end, std::move(repair));
+}
+
+void Journal::waitDurable(uint64_t end) {
+    while (_state->durable < end) {
+        if (_state->syncing) {  // Joins the batch being synced, or the next
+            pthread_cond_wait(&_state->synced, &_state->mutex);
+            continue;
+        }
+
+        // Syncs every record appended so far, the others wait for it
+        uint64_t target = _state->appended;
+        _state->syncing = true;
+
+        pthread_mutex_unlock(&_state->mutex);
+        int result = fdatasync(_fd);
+        pthread_mutex_lock(&_state->mutex);
+
+        _state->syncing = false;
+
+        if (result == -1) {
+            pthread_cond_broadcast(&_state->synced);
+            pthread_mutex_unlock(&_state->mutex);
+            throw DatabaseException("Could not sync the journal");
+        }
+
+        _state->durable = std::max(_state->durable, target);
+
+        pthread_cond_broadcast(&_state->synced);
+    }
+}
+
+void Journal::sync(uint64_t end) {
+    pthread_mutex_lock(&_state->mutex);
+
+    waitDurable(end);
+
+    pthread_mutex_unlock(&_state->mutex);
+}
+
+void Journal::commit(uint64_t end) {
+    pthread_mutex_lock(&_state->mutex);
+
+    _state->pending--;
+
+    waitDurable(end);
+
+    if ((_state->size >= DATABASE_JOURNAL_CHECKPOINT_SIZE ||
+         _state->damaged) &&
+        _state->pending == 0 && !_state->failed) {
+        try {
+            checkpoint();
+        } catch (DatabaseException const &e) {
+            // The journal is kept as it is, and emptied by a later commit
+        }
+    }
+
+    pthread_mutex_unlock(&_state->mutex);
+}
+
+void Journal::drop() {
+    pthread_mutex_lock(&_state->mutex);
+
+    _state->pending--;
+
+    pthread_mutex_unlock(&_state->mutex);
+}
+
+void Journal::fail() {
+    pthread_mutex_lock(&_state->mutex);
+
+    _state->pending--;
+    _state->failed = true;
+
+    pthread_mutex_unlock(&_state->mutex);
+}
@@ -0,0 +1,235 @@
+/**
+ * @file journal.hpp
+ * @brief Header file for the write-ahead journal of the database.
+ *
+ * This file contains the declaration of the Journal and JournalEntry classes,
+ * that record every change of the database before it is made, so that the
+ * changes acknowledged to the clients survive a crash and the ones cut short
+ * by it are finished on the next start.
+ */
+#ifndef __JOURNAL_HPP__
+#define __JOURNAL_HPP__
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "config.hpp"
+
+namespace fs = std::filesystem;
+
+/**
+ * @brief The changes of the database recorded in the journal.
+ */
+enum class JournalOperation : uint16_t {
+    Login = 1,         /**< A user logged in, registering if needed. */
+    Logout = 2,        /**< A user logged out. */
+    Unregister = 3,    /**< A user unregistered. */
+    CreateAuction = 4, /**< An auction was opened. */
+    Bid = 5,           /**< A bid was made. */
+    CloseAuction = 6,  /**< An auction was closed by its host. */
+};
+
+/**
+ * @brief Fixed size record of a change in the journal.
+ *
+ * The fields an operation does not use are 0. A record cut short by a crash,
+ * or never written at all, fails the checksum.
+ */
+struct JournalRecord {
+    uint32_t checksum;                         // Of every byte after it
+    uint16_t version;                          // DATABASE_JOURNAL_VERSION
+    JournalOperation operation;                // The change recorded
+    char uid[PROTOCOL_UID_SIZE + 2];           // NUL padded
+    char password[PROTOCOL_PASSWORD_SIZE];     // Not NUL terminated
+    char aid[PROTOCOL_AID_SIZE + 1];           // NUL padded
+    int32_t value;                             // The bid or start value
+    char name[PROTOCOL_AUCTIONNAME_SIZE + 6];  // NUL padded
+    char fileName[PROTOCOL_FNAME_SIZE + 8];    // NUL padded
+    int64_t time;                              // Of the bid, start or end
+    int64_t timeActive;                        // Seconds an auction is active
+    char reserved[32];                         // Always 0, pads to 128 bytes
+};
+
+static_assert(sizeof(JournalRecord) == 128,
+              "Journal records must be 128 bytes");
+
+/**
+ * @brief The shared memory state of the journal.
+ */
+struct JournalState {
+    pthread_mutex_t mutex;  // Guards the state and the appends
+    pthread_cond_t synced;  // Broadcast when a batch is on the disk
+    uint64_t appended;      // The bytes appended since the server started
+    uint64_t durable;       // The bytes of those known to be on the disk
+    uint64_t size;          // The size of the journal file
+    size_t pending;         // Entries appended whose changes are unfinished
+    bool syncing;           // Whether a process is syncing a batch
+    bool failed;            // Whether a change failed and was not repaired
+    bool damaged;           // Whether a partial record ends the journal
+};
+
+class IndexCheckpoint;
+class Journal;
+
+/**
+ * @brief A change recorded in the journal, while it is being made.
+ *
+ * The entry is synced before the change is made to the database, and
+ * committed after it, for the journal to be checkpointed again. An entry
+ * destroyed uncommitted, by an exception, repairs its change while the locks
+ * of the change are still held, making it again from the record as the next
+ * start would. Only if that fails too is the change marked as failed, and the
+ * journal then kept until the next start replays it. A change that failed
+ * before its record was synced was never started, and is left as it is.
+ */
+class JournalEntry {
+  private:
+    Journal *_journal;  // NULL without a journal, or once done
+    uint64_t _end;      // The journal position right after the record
+    std::function<void()> _repair;  // Makes the change again from the record
+    bool _synced = false;           // Whether the record is on the disk
+
+  public:
+    /**
+     * @brief  Creates the entry of a record already appended.
+     * @param  journal The journal, NULL for none.
+     * @param  end The journal position right after the record.
+     * @param  repair Makes the change again from the record, if it fails.
+     */
+    JournalEntry(Journal *journal, uint64_t end,
+                 std::function<void()> repair = nullptr);
+
+    /**
+     * @brief  Repairs the change, unless it was committed or never started,
+     * marking it as failed if it cannot be repaired.
+     */
+    ~JournalEntry();
+
+    /**
+     * @brief  Blocks until the record is on the disk, before its change is
+     * made, so that no change reaches the disk without its record.
+     */
+    void sync();
+
+    /**
+     * @brief  Marks the change as made, once the record is on the disk.
+     */
+    void commit();
+
+    JournalEntry(const JournalEntry &) = delete;
+    JournalEntry &operator=(const JournalEntry &) = delete;
+};
+
+/**
+ * @brief Write-ahead journal of the changes of the database.
+ *
+ * Records are appended by every process under a process shared mutex, and
+ * synced in groups before their changes are made: the first process to wait
+ * for its record syncs the journal for every record appended until then,
+ * while the others wait for it, so concurrent changes share a single sync.
+ * The files of the changes themselves are never synced, but for the assets;
+ * once the journal grows past DATABASE_JOURNAL_CHECKPOINT_SIZE and no change
+ * is unfinished, the whole file system is synced, the checkpoint of the
+ * in-memory tables written and the journal emptied.
+ */
+class Journal {
+  private:
+    fs::path _path;        // The journal file
+    int _fd = -1;          // Opened for appending, shared by the processes
+    JournalState *_state;  // The shared state
+    IndexCheckpoint *_indexCheckpoint = NULL;  // Written before emptying it
+
+    /**
+     * @brief  Syncs the file system, writes the checkpoint of the tables and
+     * empties the journal. The mutex must be held and no change may be
+     * unfinished.
+     */
+    void checkpoint();
+
+    /**
+     * @brief  Blocks until a record is on the disk, syncing it if no other
+     * process is. The mutex must be held, and is released if it throws.
+     * @param  end The journal position right after the record.
+     */
+    void waitDurable(uint64_t end);
+
+  public:
+    /**
+     * @brief  Opens the journal file, creating it if needed, and maps the
+     * shared state.
+     * @param  path The journal file.
+     */
+    Journal(fs::path path);
+
+    /**
+     * @brief  Closes the journal file and unmaps the shared state.
+     */
+    ~Journal();
+
+    /**
+     * @brief  Sets the checkpoint of the in-memory tables written every time
+     * the journal is emptied, which then only holds the changes after it.
+     * @param  checkpoint The checkpoint, NULL for none.
+     */
+    void setIndexCheckpoint(IndexCheckpoint *checkpoint);
+
+    /**
+     * @brief  Reads the records of the journal, up to the first one cut short
+     * by a crash.
+     * @retval the records, in the order they were appended.
+     */
+    std::vector<JournalRecord> recover();
+
+    /**
+     * @brief  Empties the journal once the recovered records were replayed.
+     */
+    void reset();
+
+    /**
+     * @brief  Reopens the journal file, after the database was wiped.
+     */
+    void reopen();
+
+    /**
+     * @brief  Appends a record, before its change is made.
+     * @param  record The record, whose checksum and version are filled in.
+     * @param  repair Makes the change again from the record, if it fails.
+     * @retval the entry of the change.
+     */
+    JournalEntry append(JournalRecord &record,
+                        std::function<void()> repair = nullptr);
+
+    /**
+     * @brief  Blocks until a record is on the disk, syncing it if no other
+     * process is.
+     * @param  end The journal position right after the record.
+     */
+    void sync(uint64_t end);
+
+    /**
+     * @brief  Marks a change as made, once its record is on the disk, and
+     * empties the journal if it is due and no change is unfinished.
+     * @param  end The journal position right after the record.
+     */
+    void commit(uint64_t end);
+
+    /**
+     * @brief  Marks a change as never started.
+     */
+    void drop();
+
+    /**
+     * @brief  Marks a change as failed, the journal is then kept until the
+     * next start replays it.
+     */
+    void fail();
+};
+
+#endif
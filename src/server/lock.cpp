@@ -0,0 +1,109 @@
+/**
+ * @file lock.cpp
+ * @brief Implementation of the database locks.
+ */
+#include "lock.hpp"
+
+#include "database.hpp"
+
+/**
+ * @brief  Initializes a process shared, writer preferring read-write lock.
+ * @param  lock The lock.
+ */
+static void InitializeLock(pthread_rwlock_t *lock) {
+    pthread_rwlockattr_t attributes;
+
+    pthread_rwlockattr_init(&attributes);
+    pthread_rwlockattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+    pthread_rwlockattr_setkind_np(&attributes,
+                                  PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+
+    if (pthread_rwlock_init(lock, &attributes) != 0) {
+        pthread_rwlockattr_destroy(&attributes);
+        throw DatabaseException("Could not initialize the database locks");
+    }
+
+    pthread_rwlockattr_destroy(&attributes);
+}
+
+LockGuard::LockGuard(pthread_rwlock_t *lock, LockMode mode, Metrics *metrics)
+    : _lock(lock) {
+    uint64_t start = (metrics != NULL) ? Metrics::now() : 0;
+
+    switch (mode) {
+        case LockMode::Shared:
+            pthread_rwlock_rdlock(_lock);
+            break;
+        case LockMode::Exclusive:
+            pthread_rwlock_wrlock(_lock);
+            break;
+        default:
+            break;
+    }
+
+    if (metrics != NULL) {
+        metrics->recordLockWait(Metrics::now() - start);
+    }
+}
+
+LockGuard::~LockGuard() {
+    unlock();
+}
+
+void LockGuard::unlock() {
+    if (_lock != NULL) {
+        pthread_rwlock_unlock(_lock);
+        _lock = NULL;
+    }
+}
+
+LockManager::LockManager() {
+    // Anonymous shared mapping, inherited by every process forked afterwards
+    void *table = mmap(NULL, sizeof(LockTable), PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (table == MAP_FAILED) {
+        throw DatabaseException("Could not allocate the database locks");
+    }
+
+    _table = (LockTable *)table;
+
+    InitializeLock(&_table->global);
+
+    for (auto &lock : _table->auctions) {
+        InitializeLock(&lock);
+    }
+
+    for (auto &lock : _table->users) {
+        InitializeLock(&lock);
+    }
+}
+
+LockManager::~LockManager() {
+    // The locks are not destroyed, other processes may still be using them
+    munmap(_table, sizeof(LockTable));
+}
+
+void LockManager::setMetrics(Metrics *metrics) {
+    _metrics = metrics;
+}
+
+LockGuard LockManager::lockGlobal(LockMode mode) {
+    return LockGuard(&_table->global, mode, _metrics);
+}
+
+LockGuard LockManager::lockAuction(std::string aid, LockMode mode) {
+    size_t index = 0;  // Malformed AIDs, that exist nowhere, share a lock
+
+    if (aid.length() == PROTOCOL_AID_SIZE && isNumeric(aid)) {
+        index = (size_t)std::stoi(aid);
+    }
+
+    return LockGuard(&_table->auctions[index], mode, _metrics);
+}
+
+LockGuard LockManager::lockUser(std::string uid, LockMode mode) {
+    size_t index = std::hash<std::string>{}(uid) % DATABASE_USER_LOCKS;
+
+    return LockGuard(&_table->users[index], mode, _metrics);
+}
@@ -0,0 +1,128 @@
+/**
+ * @file lock.hpp
+ * @brief Header file for the database locks.
+ *
+ * This file contains the declaration of the LockGuard and LockManager classes,
+ * that protect the database with one lock per auction, one lock per group of
+ * users and a global lock for the creation of auctions.
+ */
+#ifndef __LOCK_HPP__
+#define __LOCK_HPP__
+
+#include <functional>
+#include <string>
+
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "config.hpp"
+#include "metrics.hpp"
+
+/**
+ * @brief The ways a lock can be held.
+ */
+enum class LockMode {
+    Shared,    /**< Held by any number of readers at the same time. */
+    Exclusive, /**< Held by a single writer. */
+};
+
+/**
+ * @brief The shared memory table with every lock of the database.
+ */
+struct LockTable {
+    pthread_rwlock_t global;  // Guards the generation of AIDs
+    pthread_rwlock_t auctions[DATABASE_MAX_AUCTIONS];  // One per AID
+    pthread_rwlock_t users[DATABASE_USER_LOCKS];       // Indexed by UID hash
+};
+
+/**
+ * @brief Holds a lock for as long as the object lives.
+ *
+ * Releasing the lock on destruction guarantees that an exception thrown in a
+ * critical section never leaves the database locked.
+ */
+class LockGuard {
+  private:
+    pthread_rwlock_t *_lock;  // The lock held, NULL once released
+
+  public:
+    /**
+     * @brief  Acquires a lock, blocking until it is available.
+     * @param  lock The lock.
+     * @param  mode The mode in which the lock is held.
+     * @param  metrics Where the time waited is recorded, NULL for nowhere.
+     */
+    LockGuard(pthread_rwlock_t *lock, LockMode mode, Metrics *metrics = NULL);
+
+    /**
+     * @brief  Releases the lock, unless it was already released.
+     */
+    ~LockGuard();
+
+    /**
+     * @brief  Releases the lock before the guard is destroyed.
+     */
+    void unlock();
+
+    LockGuard(const LockGuard &) = delete;
+    LockGuard &operator=(const LockGuard &) = delete;
+};
+
+/**
+ * @brief Owns the locks of the database.
+ *
+ * The locks are process shared read-write locks, mapped as shared memory
+ * before the server forks so that they work across processes and threads
+ * alike. Writers are preferred, so a stream of readers cannot starve a bid.
+ *
+ * To avoid deadlocks, the locks are always acquired in the same order: first
+ * the user lock, then the global lock and finally the auction locks, one
+ * auction at a time.
+ */
+class LockManager {
+  private:
+    LockTable *_table;         // The shared table
+    Metrics *_metrics = NULL;  // Where the lock waits are recorded
+
+  public:
+    /**
+     * @brief  Maps the shared memory table and initializes the locks.
+     */
+    LockManager();
+
+    /**
+     * @brief  Unmaps the shared memory table.
+     */
+    ~LockManager();
+
+    /**
+     * @brief  Sets where the time waited for the locks is recorded.
+     * @param  metrics The metrics, NULL to stop recording.
+     */
+    void setMetrics(Metrics *metrics);
+
+    /**
+     * @brief  Locks the creation of auctions.
+     * @param  mode Exclusive to create an auction, shared to list them.
+     * @retval guard holding the lock.
+     */
+    LockGuard lockGlobal(LockMode mode);
+
+    /**
+     * @brief  Locks a single auction.
+     * @param  aid The auction's AID.
+     * @param  mode Exclusive to change the auction, shared to read it.
+     * @retval guard holding the lock.
+     */
+    LockGuard lockAuction(std::string aid, LockMode mode);
+
+    /**
+     * @brief  Locks a single user, along with the others sharing its lock.
+     * @param  uid The user's UID.
+     * @param  mode Exclusive to change the user, shared to read it.
+     * @retval guard holding the lock.
+     */
+    LockGuard lockUser(std::string uid, LockMode mode);
+};
+
+#endif
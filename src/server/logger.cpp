@@ -0,0 +1,271 @@
+/**
+ * @file logger.cpp
+ * @brief Implementation of the asynchronous logger.
+ */
+#include "logger.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include <fcntl.h>
+
+/**
+ * @brief The asynchronous loggers, that forked children reset. Only changed
+ * before the server forks, while it has a single thread.
+ */
+static std::vector<AsyncLogger *> Loggers;
+
+/**
+ * @brief  Resets every asynchronous logger in a forked child.
+ */
+static void ResetLoggersAfterFork() {
+    for (auto logger : Loggers) {
+        logger->resetAfterFork();
+    }
+}
+
+AsyncLogger::AsyncLogger(LogTarget target, std::string path)
+    : _target(target) {
+    switch (_target) {
+        case LogTarget::Stdout:
+            _fd = STDOUT_FILENO;
+            break;
+        case LogTarget::File:
+            _fd = open(path.c_str(),
+                       O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (_fd == -1) {
+                throw std::runtime_error("Could not open the log file");
+            }
+            break;
+        case LogTarget::Syslog:
+            openlog("AS", LOG_PID | LOG_NDELAY, LOG_DAEMON);
+            break;
+        default:
+            break;
+    }
+
+    _records = std::make_unique<LogRecord[]>(SERVER_LOG_RECORDS);
+    for (size_t i = 0; i < SERVER_LOG_RECORDS; i++) {
+        _records[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    if (Loggers.empty()) {
+        pthread_atfork(NULL, NULL, ResetLoggersAfterFork);
+    }
+    Loggers.push_back(this);
+}
+
+AsyncLogger::~AsyncLogger() {
+    flush();
+
+    if (_started.load(std::memory_order_acquire)) {
+        _stopping.store(true, std::memory_order_release);
+        push();
+
+        // The writer is detached, it is waited for until it stops
+        for (int i = 0; i < 1000 && _started.load(std::memory_order_acquire);
+             i++) {
+            usleep(1000);
+        }
+    }
+
+    Loggers.erase(std::find(Loggers.begin(), Loggers.end(), this));
+
+    if (_target == LogTarget::File) {
+        close(_fd);
+    }
+}
+
+void AsyncLogger::startWriter() {
+    std::lock_guard<std::mutex> guard(_startMutex);
+
+    if (_started.load(std::memory_order_acquire)) {
+        return;  // Started by another thread in the meantime
+    }
+
+    _wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    // Detached, so that the object of a thread never outlives its process
+    std::thread(&AsyncLogger::runWriter, this).detach();
+    _started.store(true, std::memory_order_release);
+}
+
+void AsyncLogger::runWriter() {
+    std::unique_ptr<char[]> batch = std::make_unique<char[]>(
+        SERVER_LOG_BATCH_SIZE);
+    time_t formattedSecond = -1;
+    char formattedTime[32] = "";  // The time of the second last formatted
+
+    while (!_stopping.load(std::memory_order_acquire)) {
+        size_t used = 0;
+        size_t count = 0;
+
+        size_t dropped = _dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0) {
+            used += (size_t)snprintf(batch.get(), SERVER_LOG_BATCH_SIZE,
+                                     "[LOG] %zu messages dropped\n", dropped);
+        }
+
+        while (1) {
+            LogRecord &record = _records[_tail % SERVER_LOG_RECORDS];
+
+            if (record.sequence.load(std::memory_order_acquire) != _tail + 1) {
+                break;  // Not logged yet
+            }
+
+            if (SERVER_LOG_BATCH_SIZE - used < SERVER_LOG_RECORD_SIZE + 64) {
+                writeBatch(batch.get(), used);  // Full, make room
+                used = 0;
+            }
+
+            if (record.time.tv_sec != formattedSecond) {  // Once per second
+                struct tm localTime;
+                localtime_r(&record.time.tv_sec, &localTime);
+                strftime(formattedTime, sizeof(formattedTime),
+                         "%Y-%m-%d %H:%M:%S", &localTime);
+                formattedSecond = record.time.tv_sec;
+            }
+
+            used += (size_t)snprintf(batch.get() + used,
+                                     SERVER_LOG_BATCH_SIZE - used,
+                                     "[%s.%06ld] [LOG] %.*s\n", formattedTime,
+                                     record.time.tv_nsec / 1000,
+                                     (int)record.length, record.text);
+
+            // Free for the message logged a whole ring later
+            record.sequence.store(_tail + SERVER_LOG_RECORDS,
+                                  std::memory_order_release);
+            _tail++;
+            count++;
+        }
+
+        if (used > 0) {
+            writeBatch(batch.get(), used);
+        }
+        if (count > 0) {
+            _written.fetch_add(count, std::memory_order_release);
+            continue;  // More may have been logged while writing
+        }
+
+        // Nothing to write, sleep until woken up by push()
+        _sleeping.store(true, std::memory_order_seq_cst);
+        if (_records[_tail % SERVER_LOG_RECORDS].sequence.load(
+                std::memory_order_seq_cst) != _tail + 1) {
+            struct pollfd wake = {_wakeFd, POLLIN, 0};
+            uint64_t value;
+
+            poll(&wake, 1, SERVER_LOG_IDLE_TIMEOUT);
+            if (read(_wakeFd, &value, sizeof(value)) == -1) {
+                // Woken up by the timeout, the counter was never written
+            }
+        }
+        _sleeping.store(false, std::memory_order_relaxed);
+    }
+
+    _started.store(false, std::memory_order_release);
+}
+
+void AsyncLogger::writeBatch(const char *batch, size_t size) {
+    if (_target == LogTarget::Syslog) {
+        // The system logger takes one message at a time, without newlines
+        const char *line = batch;
+        while (line < batch + size) {
+            size_t left = (size_t)(batch + size - line);
+            const char *end = (const char *)memchr(line, '\n', left);
+            syslog(LOG_INFO, "%.*s", (int)(end - line), line);
+            line = end + 1;
+        }
+        return;
+    }
+
+    // Whole lines at once, so that the processes appending never interleave
+    while (size > 0) {
+        ssize_t n = write(_fd, batch, size);
+
+        if (n <= 0) {
+            return;  // Nowhere to log the failure to log
+        }
+
+        batch += n;
+        size -= (size_t)n;
+    }
+}
+
+void AsyncLogger::log(std::string message) {
+    if (!_started.load(std::memory_order_acquire)) {
+        startWriter();  // First message of the process
+    }
+
+    size_t position = _head.load(std::memory_order_relaxed);
+    LogRecord *record;
+
+    while (1) {
+        record = &_records[position % SERVER_LOG_RECORDS];
+        size_t sequence = record->sequence.load(std::memory_order_acquire);
+
+        if (sequence == position) {  // Free, claim it
+            if (_head.compare_exchange_weak(position, position + 1,
+                                            std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (sequence < position) {  // Not written yet, the ring is full
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {  // Claimed by another thread
+            position = _head.load(std::memory_order_relaxed);
+        }
+    }
+
+    clock_gettime(CLOCK_REALTIME, &record->time);
+    record->length = std::min(message.size(), sizeof(record->text));
+    memcpy(record->text, message.data(), record->length);
+    record->sequence.store(position + 1, std::memory_order_release);
+}
+
+void AsyncLogger::push() {
+    if (_sleeping.load(std::memory_order_seq_cst)) {
+        uint64_t one = 1;
+        if (write(_wakeFd, &one, sizeof(one)) == -1) {
+            // Already woken up, the counter is full
+        }
+    }
+}
+
+void AsyncLogger::flush() {
+    if (!_started.load(std::memory_order_acquire)) {
+        return;  // Nothing was logged by this process
+    }
+
+    size_t logged = _head.load(std::memory_order_acquire);
+
+    push();
+    for (int i = 0; i < 1000 &&
+                    _written.load(std::memory_order_acquire) < logged;
+         i++) {
+        usleep(1000);
+        push();
+    }
+}
+
+void AsyncLogger::resetAfterFork() {
+    size_t head = _head.load(std::memory_order_relaxed);
+
+    // The records of the parent are left to its writer, freed here
+    for (size_t position = _tail; position != head; position++) {
+        _records[position % SERVER_LOG_RECORDS].sequence.store(
+            position + SERVER_LOG_RECORDS, std::memory_order_relaxed);
+    }
+
+    _tail = head;
+    _written.store(head, std::memory_order_relaxed);
+    _dropped.store(0, std::memory_order_relaxed);
+    _started.store(false, std::memory_order_relaxed);
+    _sleeping.store(false, std::memory_order_relaxed);
+    _stopping.store(false, std::memory_order_relaxed);
+    new (&_startMutex) std::mutex();  // It may have been held by a thread
+
+    if (_wakeFd != -1) {
+        close(_wakeFd);  // The parent's, the writer makes its own
+        _wakeFd = -1;
+    }
+}
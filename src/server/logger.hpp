@@ -0,0 +1,128 @@
+/**
+ * @file logger.hpp
+ * @brief Header file for the asynchronous logger.
+ *
+ * This file contains the declaration of the AsyncLogger class, the logging
+ * strategy that keeps the writing of the messages off the request threads.
+ */
+#ifndef __LOGGER_HPP__
+#define __LOGGER_HPP__
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.hpp"
+#include "server.hpp"
+
+/**
+ * @brief The places an asynchronous logger can write to.
+ */
+enum class LogTarget {
+    Stdout, /**< The standard output. */
+    File,   /**< A file, appended to. */
+    Syslog, /**< The system logger. */
+};
+
+/**
+ * @brief Record of the ring of an asynchronous logger, a message and when it
+ * was logged.
+ */
+struct LogRecord {
+    std::atomic<size_t> sequence;       // The position it can be used at
+    struct timespec time;               // When the message was logged
+    size_t length;                      // The length of the message
+    char text[SERVER_LOG_RECORD_SIZE];  // The message, not NUL terminated
+};
+
+/**
+ * @brief Logger that hands the messages to a writer thread.
+ *
+ * Logging copies the message and a timestamp to a bounded lock-free ring, and
+ * a background thread formats and writes them in batches, so logging never
+ * blocks a request. Messages logged while the ring is full are dropped and
+ * counted. Each process has its own ring and writer: the writer is started by
+ * the first message of a process, and a forked child forgets the messages of
+ * its parent, the parent's writer writing them.
+ */
+class AsyncLogger : public Logger {
+  private:
+    LogTarget _target;                      // Where the messages go
+    int _fd = -1;                           // The file written, unless syslog
+    std::unique_ptr<LogRecord[]> _records;  // The ring
+    std::atomic<size_t> _head{0};  // The position of the next record logged
+    size_t _tail = 0;              // The position of the next record written
+    std::atomic<size_t> _written{0};  // The number of records written
+    std::atomic<size_t> _dropped{0};  // The records dropped since reported
+    std::atomic<bool> _started{false};   // Whether the writer is running
+    std::atomic<bool> _sleeping{false};  // Whether the writer waits for more
+    std::atomic<bool> _stopping{false};  // Whether the writer must stop
+    std::mutex _startMutex;              // Guards the start of the writer
+    int _wakeFd = -1;                    // Wakes the writer up
+
+    /**
+     * @brief  Starts the writer of the current process, unless it runs.
+     */
+    void startWriter();
+
+    /**
+     * @brief  Writes the records as they are logged, until stopped.
+     */
+    void runWriter();
+
+    /**
+     * @brief  Writes a batch of formatted lines to the target.
+     * @param  batch The lines.
+     * @param  size The size of the lines.
+     */
+    void writeBatch(const char *batch, size_t size);
+
+  public:
+    /**
+     * @brief  Creates a logger, opening its target.
+     * @param  target Where the messages go.
+     * @param  path The file written to, for the file target.
+     */
+    AsyncLogger(LogTarget target, std::string path = "");
+
+    /**
+     * @brief  Writes the pending messages and stops the writer.
+     */
+    ~AsyncLogger();
+
+    /**
+     * @brief  Adds a message to the ring, without blocking.
+     * @param  message The message.
+     */
+    void log(std::string message);
+
+    /**
+     * @brief  Wakes the writer up, if it waits for messages.
+     */
+    void push();
+
+    /**
+     * @brief  Waits until every message logged is written, for at most a
+     * second.
+     */
+    void flush();
+
+    /**
+     * @brief  Forgets the messages of the parent process in a forked child,
+     * whose writer is not running.
+     *
+     * This function is called by the fork handler, in a single thread.
+     */
+    void resetAfterFork();
+};
+
+#endif
@@ -0,0 +1,244 @@
+/**
+ * @file metrics.cpp
+ * @brief Implementation of the server metrics.
+ */
+#include "metrics.hpp"
+
+#include <sstream>
+
+#include "database.hpp"
+
+thread_local RequestTimer *RequestTimer::_current = NULL;
+
+/**
+ * @brief  Adds to a counter of the shared table.
+ * @param  counter The counter.
+ * @param  value The value added.
+ */
+static void Add(uint64_t &counter, uint64_t value) {
+    __atomic_fetch_add(&counter, value, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief  Reads a counter of the shared table.
+ * @param  counter The counter.
+ * @retval the value of the counter.
+ */
+static uint64_t Load(const uint64_t &counter) {
+    return __atomic_load_n(&counter, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief  Gets the bucket of a latency, exact below 2 * sub buckets and
+ * split in sub buckets per power of 2 above.
+ * @param  value The latency.
+ * @retval the index of the bucket.
+ */
+static size_t BucketOf(uint64_t value) {
+    const int subBits = __builtin_ctz(SERVER_METRICS_SUB_BUCKETS);
+
+    if (value < 2 * SERVER_METRICS_SUB_BUCKETS) {
+        return (size_t)value;
+    }
+
+    int exponent = 63 - __builtin_clzll(value);  // At least subBits + 1
+    size_t sub = (size_t)(value >> (exponent - subBits)) &
+                 (SERVER_METRICS_SUB_BUCKETS - 1);
+    size_t index = 2 * SERVER_METRICS_SUB_BUCKETS +
+                   (size_t)(exponent - subBits - 1) *
+                       SERVER_METRICS_SUB_BUCKETS +
+                   sub;
+
+    return std::min(index, (size_t)SERVER_METRICS_BUCKETS - 1);
+}
+
+/**
+ * @brief  Gets the latency in the middle of a bucket.
+ * @param  index The index of the bucket.
+ * @retval the latency.
+ */
+static uint64_t ValueOf(size_t index) {
+    if (index < 2 * SERVER_METRICS_SUB_BUCKETS) {
+        return index;
+    }
+
+    size_t offset = index - 2 * SERVER_METRICS_SUB_BUCKETS;
+    int shift = (int)(offset / SERVER_METRICS_SUB_BUCKETS) + 1;
+    uint64_t sub = offset % SERVER_METRICS_SUB_BUCKETS;
+    uint64_t lower = (SERVER_METRICS_SUB_BUCKETS + sub) << shift;
+
+    return lower + ((uint64_t)1 << shift) / 2;
+}
+
+/**
+ * @brief  Gets a percentile of a histogram.
+ * @param  histogram The histogram.
+ * @param  percentile The percentile, between 0 and 100.
+ * @retval the latency, 0 if the histogram is empty.
+ */
+static uint64_t Percentile(const LatencyHistogram &histogram,
+                           unsigned percentile) {
+    uint64_t count = 0;
+    uint64_t buckets[SERVER_METRICS_BUCKETS];
+
+    // Counted from the buckets, which other processes may still be updating
+    for (size_t i = 0; i < SERVER_METRICS_BUCKETS; i++) {
+        buckets[i] = Load(histogram.buckets[i]);
+        count += buckets[i];
+    }
+
+    uint64_t rank = (count * percentile + 99) / 100;  // Rounded up
+    uint64_t seen = 0;
+
+    for (size_t i = 0; i < SERVER_METRICS_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank && seen > 0) {
+            return ValueOf(i);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief  Writes the median and 99th percentile of a histogram.
+ * @param  out The stream to write to.
+ * @param  name The name of the histogram.
+ * @param  histogram The histogram.
+ */
+static void WritePercentiles(std::ostream &out, std::string name,
+                             const LatencyHistogram &histogram) {
+    out << " " << name << "=" << Percentile(histogram, 50) << "/"
+        << Percentile(histogram, 99);
+}
+
+Metrics::Metrics() {
+    // Anonymous shared mapping, inherited by every process forked afterwards
+    void *table = mmap(NULL, sizeof(MetricsTable), PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (table == MAP_FAILED) {
+        throw DatabaseException("Could not allocate the metrics");
+    }
+
+    _table = (MetricsTable *)table;
+    addCommand(PROTOCOL_ERROR_IDENTIFIER);  // Always the first command
+}
+
+Metrics::~Metrics() {
+    munmap(_table, sizeof(MetricsTable));
+}
+
+void Metrics::addCommand(std::string code) {
+    if (_table->commandCount == SERVER_METRICS_MAX_COMMANDS) {
+        return;  // Counted as ERR
+    }
+
+    CommandMetrics &command = _table->commands[_table->commandCount++];
+    size_t length = std::min(code.size(), sizeof(command.code) - 1);
+    memcpy(command.code, code.data(), length);  // Always NUL terminated
+    command.code[length] = '\0';
+}
+
+CommandMetrics &Metrics::getCommand(std::string_view code) {
+    for (size_t i = 1; i < _table->commandCount; i++) {
+        if (code == _table->commands[i].code) {
+            return _table->commands[i];
+        }
+    }
+
+    return _table->commands[0];
+}
+
+void Metrics::recordLockWait(uint64_t nanoseconds) {
+    record(_table->lockWait, nanoseconds);
+}
+
+void Metrics::record(LatencyHistogram &histogram, uint64_t nanoseconds) {
+    Add(histogram.count, 1);
+    Add(histogram.total, nanoseconds);
+    Add(histogram.buckets[BucketOf(nanoseconds)], 1);
+}
+
+uint64_t Metrics::now() {
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (uint64_t)time.tv_sec * 1000000000 + (uint64_t)time.tv_nsec;
+}
+
+std::string Metrics::report() {
+    static const char *phaseNames[METRICS_PHASES] = {"decode", "database",
+                                                     "encode", "send"};
+    std::stringstream out;
+
+    for (size_t i = 0; i < _table->commandCount; i++) {
+        CommandMetrics &command = _table->commands[i];
+
+        out << command.code << " requests=" << Load(command.requests)
+            << " in=" << Load(command.bytesIn)
+            << " out=" << Load(command.bytesOut);
+        WritePercentiles(out, "total", command.latency);
+        for (size_t phase = 0; phase < METRICS_PHASES; phase++) {
+            WritePercentiles(out, phaseNames[phase], command.phases[phase]);
+        }
+        out << "\n";
+    }
+
+    out << "LCK waits=" << Load(_table->lockWait.count);
+    WritePercentiles(out, "wait", _table->lockWait);
+    out << "\n";
+
+    return out.str();
+}
+
+RequestTimer::RequestTimer(Metrics &metrics) : _metrics(metrics) {
+    _start = Metrics::now();
+    _last = _start;
+    memset(_phases, 0, sizeof(_phases));
+    _current = this;
+}
+
+RequestTimer::~RequestTimer() {
+    if (_current == this) {
+        _current = NULL;
+    }
+}
+
+void RequestTimer::mark(MetricPhase phase) {
+    uint64_t time = Metrics::now();
+
+    _phases[(size_t)phase] += time - _last;
+    _last = time;
+}
+
+void RequestTimer::setBytes(size_t bytesIn, size_t bytesOut) {
+    _bytesIn = bytesIn;
+    _bytesOut = bytesOut;
+}
+
+void RequestTimer::finish() {
+    CommandMetrics &command = _metrics.getCommand(_code);
+
+    Add(command.requests, 1);
+    Add(command.bytesIn, _bytesIn);
+    Add(command.bytesOut, _bytesOut);
+    Metrics::record(command.latency, Metrics::now() - _start);
+
+    for (size_t phase = 0; phase < METRICS_PHASES; phase++) {
+        Metrics::record(command.phases[phase], _phases[phase]);
+    }
+}
+
+void RequestTimer::markCurrent(MetricPhase phase) {
+    if (_current != NULL) {
+        _current->mark(phase);
+    }
+}
+
+void RequestTimer::setCurrentCommand(std::string code) {
+    if (_current != NULL) {
+        _current->_code = code;
+    }
+}
@@ -0,0 +1,191 @@
+/**
+ * @file metrics.hpp
+ * @brief Header file for the server metrics.
+ *
+ * This file contains the declaration of the Metrics and RequestTimer classes,
+ * that count the requests of every command along with their latencies, in
+ * memory shared by all the server processes.
+ */
+#ifndef __METRICS_HPP__
+#define __METRICS_HPP__
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <sys/mman.h>
+#include <time.h>
+
+#include "config.hpp"
+
+/**
+ * @brief The phases a request goes through, timed separately.
+ */
+enum class MetricPhase {
+    Decode,   /**< Reading and parsing the request. */
+    Database, /**< Running the request against the database. */
+    Encode,   /**< Writing the response. */
+    Send,     /**< Sending the response. */
+};
+
+#define METRICS_PHASES (4)  // The number of values of MetricPhase.
+
+/**
+ * @brief Histogram of latencies, in nanoseconds.
+ *
+ * Like an HDR histogram, every power of 2 is split in the same number of
+ * linear buckets, so the error of a percentile is bounded relative to it.
+ */
+struct LatencyHistogram {
+    uint64_t count;                            // The number of latencies
+    uint64_t total;                            // Their sum
+    uint64_t buckets[SERVER_METRICS_BUCKETS];  // Their distribution
+};
+
+/**
+ * @brief The metrics of a single command code.
+ */
+struct CommandMetrics {
+    char code[4];                             // The code, NUL terminated
+    uint64_t requests;                        // The number of requests
+    uint64_t bytesIn;                         // The bytes of the requests
+    uint64_t bytesOut;                        // The bytes of the responses
+    LatencyHistogram latency;                 // The whole requests
+    LatencyHistogram phases[METRICS_PHASES];  // Each of their phases
+};
+
+/**
+ * @brief The shared memory table of the metrics.
+ */
+struct MetricsTable {
+    size_t commandCount;  // The number of commands in use
+    CommandMetrics commands[SERVER_METRICS_MAX_COMMANDS];
+    LatencyHistogram lockWait;  // The waits for the database locks
+};
+
+/**
+ * @brief Metrics of the server, updated without locks.
+ *
+ * The table is mapped as shared memory before the server forks and every
+ * counter is updated atomically, so every process and thread can record
+ * metrics at once, while any of them reads the whole table. The commands are
+ * added before the server forks, unknown codes are counted as ERR.
+ */
+class Metrics {
+  private:
+    MetricsTable *_table;  // The shared table
+
+  public:
+    /**
+     * @brief  Maps the shared memory table, with only the ERR command.
+     */
+    Metrics();
+
+    /**
+     * @brief  Unmaps the shared memory table.
+     */
+    ~Metrics();
+
+    /**
+     * @brief  Adds a command, whose requests are counted from then on.
+     * @param  code The code of the command.
+     */
+    void addCommand(std::string code);
+
+    /**
+     * @brief  Gets the metrics of a command.
+     * @param  code The code of the command.
+     * @retval the metrics of the command, those of ERR if it is unknown.
+     */
+    CommandMetrics &getCommand(std::string_view code);
+
+    /**
+     * @brief  Records how long a database lock took to acquire.
+     * @param  nanoseconds The time waited.
+     */
+    void recordLockWait(uint64_t nanoseconds);
+
+    /**
+     * @brief  Records a latency in a histogram.
+     * @param  histogram The histogram.
+     * @param  nanoseconds The latency.
+     */
+    static void record(LatencyHistogram &histogram, uint64_t nanoseconds);
+
+    /**
+     * @brief  Gets the current time of the monotonic clock.
+     * @retval the time in nanoseconds.
+     */
+    static uint64_t now();
+
+    /**
+     * @brief  Formats every metric, one line per command.
+     * @retval the report.
+     */
+    std::string report();
+};
+
+/**
+ * @brief Times a request as it goes through its phases.
+ *
+ * The servers create a timer per request, which becomes the current timer of
+ * the thread, so that the commands mark the end of their phases without
+ * knowing about it. The metrics are recorded by finish().
+ */
+class RequestTimer {
+  private:
+    Metrics &_metrics;                 // Where the request is recorded
+    std::string _code = "ERR";         // The code of the command
+    uint64_t _start;                   // When the request was received
+    uint64_t _last;                    // When the previous phase ended
+    uint64_t _phases[METRICS_PHASES];  // The duration of each phase
+    size_t _bytesIn = 0;               // The bytes of the request
+    size_t _bytesOut = 0;              // The bytes of the response
+    static thread_local RequestTimer *_current;  // The timer of the thread
+
+  public:
+    /**
+     * @brief  Starts timing a request, as the current timer of the thread.
+     * @param  metrics Where the request is recorded.
+     */
+    RequestTimer(Metrics &metrics);
+
+    /**
+     * @brief  Stops being the current timer of the thread.
+     */
+    ~RequestTimer();
+
+    /**
+     * @brief  Ends a phase, which is credited with the time since the
+     * previous one ended.
+     * @param  phase The phase.
+     */
+    void mark(MetricPhase phase);
+
+    /**
+     * @brief  Sets the sizes of the request and of its response.
+     * @param  bytesIn The bytes of the request.
+     * @param  bytesOut The bytes of the response.
+     */
+    void setBytes(size_t bytesIn, size_t bytesOut);
+
+    /**
+     * @brief  Records the request in the metrics.
+     */
+    void finish();
+
+    /**
+     * @brief  Ends a phase of the current timer of the thread, if any.
+     * @param  phase The phase.
+     */
+    static void markCurrent(MetricPhase phase);
+
+    /**
+     * @brief  Sets the command code of the current timer of the thread, if
+     * any.
+     * @param  code The code of the command.
+     */
+    static void setCurrentCommand(std::string code);
+};
+
+#endif
@@ -4,13 +4,71 @@
  */
 #include "network.hpp"
 
-UdpServer::UdpServer(std::string port) {
+UdpBatch::UdpBatch()
+    : _requests(SOCKETS_UDP_BATCH_SIZE *
+                (SOCKETS_MAX_DATAGRAM_SIZE_SERVER + 1)),
+      _responses(SOCKETS_UDP_BATCH_SIZE * SOCKETS_MAX_DATAGRAM_SIZE_CLIENT) {
+    memset(_received, 0, sizeof(_received));
+    memset(_replies, 0, sizeof(_replies));
+    memset(_responseSizes, 0, sizeof(_responseSizes));
+}
+
+bool UdpBatch::isValid(size_t index) {
+    unsigned int length = _received[index].msg_len;
+
+    // One more byte than the maximum is read to detect datagrams too big
+    return length > 0 && length <= SOCKETS_MAX_DATAGRAM_SIZE_SERVER &&
+           !(_received[index].msg_hdr.msg_flags & MSG_TRUNC);
+}
+
+std::stringstream UdpBatch::getMessage(size_t index) {
+    std::stringstream message;
+
+    message.write(&_requests[index * (SOCKETS_MAX_DATAGRAM_SIZE_SERVER + 1)],
+                  (std::streamsize)_received[index].msg_len);
+
+    return message;
+}
+
+void UdpBatch::setResponse(size_t index, std::stringstream &message) {
+    message.read(&_responses[index * SOCKETS_MAX_DATAGRAM_SIZE_CLIENT],
+                 SOCKETS_MAX_DATAGRAM_SIZE_CLIENT);  // Read the message
+
+    std::streamsize n = message.gcount();  // Get the number of bytes read
+
+    _responseSizes[index] = (n > 0) ? (size_t)n : 0;
+}
+
+MessageBuffer UdpBatch::getResponseBuffer(size_t index) {
+    return MessageBuffer(&_responses[index * SOCKETS_MAX_DATAGRAM_SIZE_CLIENT],
+                         SOCKETS_MAX_DATAGRAM_SIZE_CLIENT);
+}
+
+void UdpBatch::setResponse(size_t index, MessageBuffer &message) {
+    _responseSizes[index] = message.size();  // Already in its slot
+}
+
+std::string UdpBatch::getClientIP(size_t index) {
+    return AddressToIP(_clients[index]);
+}
+
+std::string UdpBatch::getClientPort(size_t index) {
+    return AddressToPort(_clients[index]);
+}
+
+UdpServer::UdpServer(std::string port, bool reusePort) {
     _fd = socket(AF_INET, SOCK_DGRAM, 0);  // Create the socket
 
     if (_fd == -1) {  // Check for errors
         throw SocketSetupException();
     }
 
+    int enable = 1;  // Let the other workers bind to the same port
+    if (reusePort && setsockopt(_fd, SOL_SOCKET, SO_REUSEPORT, &enable,
+                                sizeof(enable)) == -1) {
+        throw SocketSetupException();
+    }
+
     // Set the socket options
     memset(&_hints, 0, sizeof(_hints));
     _hints.ai_family = AF_INET;
@@ -55,6 +113,19 @@ void UdpServer::send(std::stringstream &message) {
     }
 }
 
+void UdpServer::send(MessageBuffer &message) {
+    if (message.size() == 0) {  // Check for errors
+        throw SocketCommunicationException();
+    }
+
+    // Send the message
+    if (sendto(_fd, message.data(), message.size(), 0,
+               (struct sockaddr *)&_client,
+               _clientSize) != (ssize_t)message.size()) {
+        throw SocketCommunicationException();
+    }
+}
+
 std::stringstream UdpServer::receive() {
     char messageBuffer[SOCKETS_MAX_DATAGRAM_SIZE_SERVER +
                        1];  // The message buffer
@@ -66,18 +137,82 @@ std::stringstream UdpServer::receive() {
         throw SocketCommunicationException();
     }
 
-    if (n > SOCKETS_MAX_DATAGRAM_SIZE_SERVER) {  // Check for errors
-        throw SocketCommunicationException();
-    }
-
     std::stringstream message;
 
+    if (n > SOCKETS_MAX_DATAGRAM_SIZE_SERVER) {
+        // Too big to be a request, an empty message is answered with the
+        // protocol error instead of stopping the server
+        return message;
+    }
+
     message.write(messageBuffer,
                   (std::streamsize)n);  // Write the message to the stringstream
 
     return message;
 }
 
+size_t UdpServer::receiveBatch(UdpBatch &batch) {
+    for (size_t i = 0; i < SOCKETS_UDP_BATCH_SIZE; i++) {
+        batch._requestVectors[i].iov_base =
+            &batch._requests[i * (SOCKETS_MAX_DATAGRAM_SIZE_SERVER + 1)];
+        batch._requestVectors[i].iov_len = SOCKETS_MAX_DATAGRAM_SIZE_SERVER + 1;
+
+        memset(&batch._received[i], 0, sizeof(batch._received[i]));
+        batch._received[i].msg_hdr.msg_name = &batch._clients[i];
+        batch._received[i].msg_hdr.msg_namelen = sizeof(batch._clients[i]);
+        batch._received[i].msg_hdr.msg_iov = &batch._requestVectors[i];
+        batch._received[i].msg_hdr.msg_iovlen = 1;
+
+        batch._responseSizes[i] = 0;
+    }
+
+    // Block until the first datagram arrives, then take whatever else is
+    // already queued without waiting
+    int n = recvmmsg(_fd, batch._received, SOCKETS_UDP_BATCH_SIZE,
+                     MSG_WAITFORONE, NULL);
+
+    if (n <= 0) {
+        throw SocketCommunicationException();
+    }
+
+    batch._size = (size_t)n;
+
+    return batch._size;
+}
+
+void UdpServer::sendBatch(UdpBatch &batch) {
+    unsigned int count = 0;  // The number of replies to send
+
+    for (size_t i = 0; i < batch._size; i++) {
+        if (batch._responseSizes[i] == 0) {  // The datagram gets no reply
+            continue;
+        }
+
+        batch._responseVectors[i].iov_base =
+            &batch._responses[i * SOCKETS_MAX_DATAGRAM_SIZE_CLIENT];
+        batch._responseVectors[i].iov_len = batch._responseSizes[i];
+
+        memset(&batch._replies[count], 0, sizeof(batch._replies[count]));
+        batch._replies[count].msg_hdr.msg_name = &batch._clients[i];
+        batch._replies[count].msg_hdr.msg_namelen = sizeof(batch._clients[i]);
+        batch._replies[count].msg_hdr.msg_iov = &batch._responseVectors[i];
+        batch._replies[count].msg_hdr.msg_iovlen = 1;
+        count++;
+    }
+
+    unsigned int sent = 0;
+    while (sent < count) {
+        int n = sendmmsg(_fd, batch._replies + sent, count - sent, 0);
+
+        if (n == -1 && errno == EINTR) {
+            throw SocketCommunicationException();
+        }
+
+        // A reply that cannot be sent is dropped, the client will retry
+        sent += (n > 0) ? (unsigned int)n : 1;
+    }
+}
+
 void UdpServer::close() {
     if (!_closed) {          // Check if the socket has been closed
         ::close(_fd);        // Close the socket
@@ -97,7 +232,7 @@ std::string UdpServer::getClientPort() {
     return std::to_string(ntohs(_client.sin_port));  // Get the port number
 }
 
-TcpServer::TcpServer(std::string port) {
+TcpServer::TcpServer(std::string port, int backlog) {
     _fd = socket(AF_INET, SOCK_STREAM, 0);  // Create the socket
     if (_fd == -1) {                        // Check for errors
         throw SocketSetupException();
@@ -124,7 +259,7 @@ TcpServer::TcpServer(std::string port) {
         throw SocketSetupException();
     }
 
-    if (listen(_fd, 20) == -1) {  // Listen for connections
+    if (listen(_fd, backlog) == -1) {  // Listen for connections
         throw SocketSetupException();
     }
 }
@@ -154,6 +289,30 @@ int TcpServer::acceptConnection(struct sockaddr_in &client,
     return clientFd;
 }
 
+int TcpServer::tryAcceptConnection(struct sockaddr_in &client,
+                                   socklen_t &clientSize) {
+    socklen_t clientAddressSize = sizeof(client);
+
+    int clientFd = accept(_fd, (struct sockaddr *)&client,
+                          &clientAddressSize);  // Accept the connection
+
+    clientSize = clientAddressSize;  // Set the client address size
+
+    if (clientFd == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED ||
+            errno == EINTR) {
+            return -1;  // There is no connection ready to be accepted
+        }
+        throw SocketCommunicationException();
+    }
+
+    return clientFd;
+}
+
+void TcpServer::setNonBlocking() {
+    SetNonBlocking(_fd);
+}
+
 void TcpServer::close() {
     if (!_closed) {    // Check if the socket has been closed
         ::close(_fd);  // Close the socket
@@ -167,8 +326,8 @@ TcpSession::TcpSession(int fd, struct sockaddr_in client,
     _client = client;          // Set the client address
     _clientSize = clientSize;  // Set the client address size
 
-    struct timeval read_timeout;  // Set the read timeout
-    read_timeout.tv_sec = 5;      // Set the timeout to 5 seconds
+    struct timeval read_timeout;                // Set the read timeout
+    read_timeout.tv_sec = SOCKETS_TCP_TIMEOUT;  // Set the timeout to 5 seconds
     read_timeout.tv_usec = 0;
 
     setsockopt(_fd, SOL_SOCKET, SO_RCVTIMEO, &read_timeout,
@@ -201,6 +360,63 @@ void TcpSession::send(std::stringstream &message) {
     }
 }
 
+void TcpSession::send(FileAttachment &attachment) {
+    if (!attachment.isAttached()) {
+        return;
+    }
+
+    while (attachment._sent < attachment._size) {  // The socket is blocking
+        ssize_t n = attachment.sendTo(_fd);
+
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if (n <= 0) {  // The client is gone or the file was truncated
+            throw SocketCommunicationException();
+        }
+    }
+
+    std::stringstream trailer(attachment._trailer);
+    send(trailer);
+}
+
+FileAttachment::~FileAttachment() {
+    if (_fd != -1) {
+        ::close(_fd);
+    }
+}
+
+void FileAttachment::attach(int fd, size_t size, std::string trailer,
+                            size_t offset) {
+    if (_fd != -1) {
+        ::close(_fd);
+    }
+
+    _fd = fd;
+    _offset = offset;
+    _size = size;
+    _sent = 0;
+    _trailer = trailer;
+}
+
+bool FileAttachment::isAttached() {
+    return _fd != -1;
+}
+
+ssize_t FileAttachment::sendTo(int socket) {
+    // sendfile() leaves the file offset alone
+    off_t offset = (off_t)(_offset + _sent);
+
+    ssize_t n = sendfile(socket, _fd, &offset, _size - _sent);
+
+    if (n > 0) {
+        _sent += (size_t)n;
+    }
+
+    return n;
+}
+
 void TcpSession::close() {
     if (!_closed) {    // Check if the socket has been closed
         ::close(_fd);  // Close the socket
@@ -209,12 +425,52 @@ void TcpSession::close() {
 }
 
 std::string TcpSession::getClientIP() {
+    return AddressToIP(_client);
+}
+
+std::string TcpSession::getClientPort() {
+    return AddressToPort(_client);
+}
+
+void SetNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);  // Get the current flags
+
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        throw SocketSetupException();
+    }
+}
+
+void SetNoDelay(int fd) {
+    int enabled = 1;
+
+    // Only latency is lost if it fails, the session carries on
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+}
+
+void RejectConnection(int fd) {
+    char buffer[SOCKETS_TCP_READ_CHUNK_SIZE];
+
+    // Discard what was already received, closing a socket with unread data
+    // resets the connection before the client gets to read the reply
+    for (int i = 0; i < 4; i++) {
+        if (recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT) <= 0) {
+            break;
+        }
+    }
+
+    std::string_view reply = PROTOCOL_ERROR_IDENTIFIER "\n";
+    // Nothing is waited for, the reply fits any empty send buffer
+    send(fd, reply.data(), reply.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+    ::close(fd);
+}
+
+std::string AddressToIP(struct sockaddr_in &client) {
     char ip[INET_ADDRSTRLEN];  // The IP address buffer
-    inet_ntop(AF_INET, &_client.sin_addr, ip,
+    inet_ntop(AF_INET, &client.sin_addr, ip,
               INET_ADDRSTRLEN);  // Get the IP address
     return std::string(ip);
 }
 
-std::string TcpSession::getClientPort() {
-    return std::to_string(ntohs(_client.sin_port));  // Get the port number
+std::string AddressToPort(struct sockaddr_in &client) {
+    return std::to_string(ntohs(client.sin_port));  // Get the port number
 }
\ No newline at end of file
@@ -2,8 +2,8 @@
  * @file network.hpp
  * @brief Header file for the network program.
  *
- * This file contains the declaration of the UdpServer, TcpServer, TcpSession,
- * SocketException, and TimeoutException classes.
+ * This file contains the declaration of the UdpBatch, UdpServer, TcpServer,
+ * TcpSession, FileAttachment, SocketException, and TimeoutException classes.
  */
 
 #ifndef __NETWORK_HPP__
@@ -11,11 +11,15 @@
 
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdlib.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -23,6 +27,101 @@
 #include <iostream>
 
 #include "config.hpp"
+#include "protocol.hpp"
+
+/**
+ * @class UdpBatch
+ * @brief Holds a batch of datagrams received with a single recvmmsg() call and
+ * the responses to them, sent back with a single sendmmsg() call.
+ *
+ * Every datagram keeps its own client address, so a worker never mixes up the
+ * clients of the requests it handles in a batch.
+ */
+class UdpBatch {
+  private:
+    std::vector<char> _requests;   // The request buffers, one per datagram
+    std::vector<char> _responses;  // The response buffers, one per datagram
+    struct mmsghdr _received[SOCKETS_UDP_BATCH_SIZE];  // The received headers
+    struct mmsghdr _replies[SOCKETS_UDP_BATCH_SIZE];   // The reply headers
+    struct iovec _requestVectors[SOCKETS_UDP_BATCH_SIZE];
+    struct iovec _responseVectors[SOCKETS_UDP_BATCH_SIZE];
+    struct sockaddr_in _clients[SOCKETS_UDP_BATCH_SIZE];  // The addresses
+    size_t _responseSizes[SOCKETS_UDP_BATCH_SIZE];        // 0 means no reply
+    size_t _size = 0;  // The number of datagrams in the batch
+
+    friend class UdpServer;
+
+  public:
+    /**
+     * @brief Constructs an empty UdpBatch, allocating its buffers.
+     */
+    UdpBatch();
+
+    /**
+     * @brief Get the number of datagrams in the batch.
+     *
+     * @return size_t The number of datagrams.
+     */
+    size_t size() { return _size; }
+
+    /**
+     * @brief Checks if a datagram has an acceptable size.
+     *
+     * @param index The index of the datagram.
+     * @return True if the datagram is not empty nor too big.
+     */
+    bool isValid(size_t index);
+
+    /**
+     * @brief Get the contents of a datagram.
+     *
+     * @param index The index of the datagram.
+     * @return The datagram as a stringstream.
+     */
+    std::stringstream getMessage(size_t index);
+
+    /**
+     * @brief Sets the response to a datagram.
+     *
+     * @param index The index of the datagram.
+     * @param message The response.
+     */
+    void setResponse(size_t index, std::stringstream &message);
+
+    /**
+     * @brief Gets a buffer over the response slot of a datagram, so that
+     * the response is encoded in place.
+     *
+     * @param index The index of the datagram.
+     * @return The buffer, to be passed to setResponse() once written.
+     */
+    MessageBuffer getResponseBuffer(size_t index);
+
+    /**
+     * @brief Sets the response to a datagram to what was encoded in its
+     * response buffer.
+     *
+     * @param index The index of the datagram.
+     * @param message The buffer returned by getResponseBuffer().
+     */
+    void setResponse(size_t index, MessageBuffer &message);
+
+    /**
+     * @brief Get the IP address of the client of a datagram.
+     *
+     * @param index The index of the datagram.
+     * @return std::string The IP address of the client.
+     */
+    std::string getClientIP(size_t index);
+
+    /**
+     * @brief Get the port number of the client of a datagram.
+     *
+     * @param index The index of the datagram.
+     * @return std::string The client port number.
+     */
+    std::string getClientPort(size_t index);
+};
 
 /**
  * @class UdpServer
@@ -42,8 +141,10 @@ class UdpServer {
     /**
      * @brief Constructs a UdpServer object with the specified port.
      * @param port The port number to connect to.
+     * @param reusePort Whether other sockets may bind to the same port, with
+     * the kernel spreading the datagrams among them (SO_REUSEPORT).
      */
-    UdpServer(std::string port);
+    UdpServer(std::string port, bool reusePort = false);
 
     /**
      * @brief Destroys the UdpServer object and closes the socket.
@@ -56,12 +157,32 @@ class UdpServer {
      */
     void send(std::stringstream &message);
 
+    /**
+     * @brief Sends the message in a buffer to the client.
+     * @param message The message to send.
+     */
+    void send(MessageBuffer &message);
+
     /**
      * @brief Receives a message from the client.
      * @return The received message as a stringstream.
      */
     std::stringstream receive();
 
+    /**
+     * @brief Receives a batch of messages, blocking until there is at least
+     * one.
+     * @param batch The batch to fill, its previous contents are discarded.
+     * @return The number of messages received.
+     */
+    size_t receiveBatch(UdpBatch &batch);
+
+    /**
+     * @brief Sends the responses set on a batch to their clients.
+     * @param batch The batch.
+     */
+    void sendBatch(UdpBatch &batch);
+
     /**
      * @brief Closes the network connection.
      */
@@ -97,8 +218,9 @@ class TcpServer {
     /**
      * @brief Constructs a TcpServer object with the specified port.
      * @param port The port number to connect to.
+     * @param backlog The maximum length of the queue of pending connections.
      */
-    TcpServer(std::string port);
+    TcpServer(std::string port, int backlog = SOCKETS_TCP_BACKLOG);
 
     /**
      * @brief Destroys the TcpServer object and closes the socket.
@@ -118,6 +240,82 @@ class TcpServer {
      * connections.
      */
     int acceptConnection(struct sockaddr_in &client, socklen_t &clientSize);
+
+    /**
+     * @brief Accepts an incoming connection without blocking.
+     *
+     * This function is meant to be used once the socket was set to non
+     * blocking mode, returning -1 when there are no pending connections.
+     */
+    int tryAcceptConnection(struct sockaddr_in &client, socklen_t &clientSize);
+
+    /**
+     * @brief Sets the listening socket to non blocking mode.
+     */
+    void setNonBlocking();
+
+    /**
+     * @brief Get the file descriptor of the listening socket.
+     *
+     * @return int The file descriptor.
+     */
+    int getFd() { return _fd; }
+};
+
+/**
+ * @class FileAttachment
+ * @brief Part of a TCP response sent straight from an open file with
+ * sendfile(), so that the file is never copied to user space.
+ *
+ * The attachment goes after the rest of the response, and is followed by its
+ * trailer. The file is closed when the attachment is destroyed.
+ */
+class FileAttachment {
+  public:
+    int _fd = -1;          // The open file, -1 when there is nothing attached
+    size_t _offset = 0;    // The offset in the file of the first byte to send
+    size_t _size = 0;      // The number of bytes of the file to send
+    size_t _sent = 0;      // The number of bytes of the file already sent
+    std::string _trailer;  // The bytes sent after the file
+
+    FileAttachment() = default;
+
+    /**
+     * @brief Closes the attached file.
+     */
+    ~FileAttachment();
+
+    FileAttachment(const FileAttachment &) = delete;
+    FileAttachment &operator=(const FileAttachment &) = delete;
+
+    /**
+     * @brief Attaches an open file, taking ownership of it.
+     * @param fd The file descriptor.
+     * @param size The number of bytes to send.
+     * @param trailer The bytes sent after the file.
+     * @param offset The offset in the file of the first byte to send.
+     */
+    void attach(int fd, size_t size, std::string trailer, size_t offset = 0);
+
+    /**
+     * @brief Checks if there is a file attached.
+     * @return true if there is a file attached, false otherwise.
+     */
+    bool isAttached();
+
+    /**
+     * @brief Gets the number of bytes to send, the file and its trailer.
+     * @return The number of bytes.
+     */
+    size_t getSize() { return _size + _trailer.size(); }
+
+    /**
+     * @brief Sends as much of the file as the socket accepts with a single
+     * sendfile() call.
+     * @param socket The socket file descriptor.
+     * @return The number of bytes sent, or -1 with errno set.
+     */
+    ssize_t sendTo(int socket);
 };
 
 /**
@@ -154,6 +352,12 @@ class TcpSession {
      */
     void send(std::stringstream &message);
 
+    /**
+     * @brief Sends the attached file and its trailer to the client.
+     * @param attachment The attachment, nothing is sent if there is no file.
+     */
+    void send(FileAttachment &attachment);
+
     /**
      * @brief Receives a message from the client.
      * @return The received message as a stringstream.
@@ -180,6 +384,42 @@ class TcpSession {
     std::string getClientPort();
 };
 
+/**
+ * @brief Sets a socket file descriptor to non blocking mode.
+ * @param fd The file descriptor.
+ */
+void SetNonBlocking(int fd);
+
+/**
+ * @brief Disables Nagle's algorithm on a TCP socket, so that the responses to
+ * pipelined requests are not held back waiting for acknowledgements.
+ * @param fd The file descriptor.
+ */
+void SetNoDelay(int fd);
+
+/**
+ * @brief Rejects a TCP connection, replying with the protocol error without
+ * reading the request, and closes it.
+ * @param fd The file descriptor of the connection.
+ */
+void RejectConnection(int fd);
+
+/**
+ * @brief Get the IP address of a client address.
+ *
+ * @param client The client address.
+ * @return std::string The IP address of the client.
+ */
+std::string AddressToIP(struct sockaddr_in &client);
+
+/**
+ * @brief Get the port number of a client address.
+ *
+ * @param client The client address.
+ * @return std::string The client port number.
+ */
+std::string AddressToPort(struct sockaddr_in &client);
+
 /**
  * @class SocketException
  * @brief Represents an exception that is thrown when a network error occurs.
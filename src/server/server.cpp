@@ -7,11 +7,26 @@
  */
 #include "server.hpp"
 #include "command.hpp"
+#include "event.hpp"
+#include "logger.hpp"
+#include "uring.hpp"
 
 void UDPServer(UdpServer &udpServer, CommandManager &manager, Server &server);
 
+void UDPBatchServer(UdpServer &udpServer, CommandManager &manager,
+                    Server &server);
+
+void UDPBatchWorker(UdpServer &udpServer, CommandManager &manager,
+                    Server &server);
+
 void TCPServer(TcpServer &tcpServer, CommandManager &manager, Server &server);
 
+void TCPEventServer(TcpServer &tcpServer, CommandManager &manager,
+                    Server &server);
+
+void ExpiryServer(UdpServer &udpServer, TcpServer &tcpServer,
+                  Server &server);
+
 void handler(int sig) {
     // This is a handler used for the SIGINT command, it cannot be SIG_IGN
     // because with that handler, blocking functions don't get interrupted. With
@@ -51,27 +66,52 @@ int main(int argc, char **argv) {
     manager.registerCommand(std::make_shared<ListUserBidsCommand>(), false);
     manager.registerCommand(std::make_shared<ListAllAuctionsCommand>(), false);
     manager.registerCommand(std::make_shared<ShowAssetCommand>(), true);
+    manager.registerCommand(std::make_shared<ShowAssetRangeCommand>(), true);
     manager.registerCommand(std::make_shared<BidCommand>(), true);
     manager.registerCommand(std::make_shared<ShowRecordCommand>(), false);
+    manager.registerCommand(std::make_shared<KeepAliveCommand>(), true);
+    if (server.isAdminEnabled()) {
+        manager.registerCommand(std::make_shared<StatsCommand>(), false);
+    }
+    manager.registerMetrics(server.getMetrics());
 
     try {                                       // Try to start the server
-        UdpServer udpServer(server.getPort());  // Initialize the UDP server
-        TcpServer tcpServer(server.getPort());  // Initialize the TCP server
+        // Initialize the UDP server, the workers share its port
+        UdpServer udpServer(server.getPort(), server.getUdpWorkers() > 0);
+        // Initialize the TCP server, the event loop accepts connections fast
+        // enough to make use of the biggest backlog the system allows
+        TcpServer tcpServer(server.getPort(),
+                            server.getTcpMode() != TcpMode::Fork
+                                ? SOMAXCONN
+                                : SOCKETS_TCP_BACKLOG);
 
         // Display the server information if verbose mode is enabled
         server.logPush("Listening on port " + server.getPort());
+        if ((pid = fork()) == -1) {  // Fork the expiry process
+            exit(1);
+        } else if (pid == 0) {
+            ExpiryServer(udpServer, tcpServer, server);
+        }
         if ((pid = fork()) == -1) {  // Fork the process
             exit(1);
         } else if (pid == 0) {  // If the process is a child process
             tcpServer.close();  // Close the TCP server
             server.logPush("UDP server started");   // Display a message if
                                                     // verbose mode is enabled
-            UDPServer(udpServer, manager, server);  // Start the UDP server
+            if (server.getUdpWorkers() > 0) {
+                UDPBatchServer(udpServer, manager, server);
+            } else {
+                UDPServer(udpServer, manager, server);  // Start the UDP server
+            }
         } else {                // If the process is a parent process
             udpServer.close();  // Close the UDP server
-            server.logPush("TCP server started");   // Display a message if
-                                                    // verbose mode is enabled
-            TCPServer(tcpServer, manager, server);  // Start the TCP server
+            server.logPush("TCP server started");  // Display a message if
+                                                   // verbose mode is enabled
+            if (server.getTcpMode() != TcpMode::Fork) {
+                TCPEventServer(tcpServer, manager, server);
+            } else {
+                TCPServer(tcpServer, manager, server);  // Start the TCP server
+            }
         }
     } catch (SocketSetupException const
                  &e) {  // If the server could not connect to the sockets
@@ -93,14 +133,26 @@ Server::Server(int argc, char **argv) {
 
     std::string databasePath = "database";
     bool wipeDatabase = false;
+    BidStorage bidStorage = BidStorage::Files;
+    size_t syncInterval = 0;
+    bool journaled = false;
+    LogTarget logTarget = LogTarget::Stdout;
+    std::string logPath;
+    int shard = 0;
+    int shards = 1;
+    size_t assetCacheSize = SERVER_ASSET_CACHE_SIZE;
+    double rateLimit = SERVER_RATE_LIMIT;
+    double rateBurst = SERVER_RATE_BURST;
+
+    _workers = std::max(std::thread::hardware_concurrency(), 1u);
 
-    while ((c = (char)getopt(argc, argv, "p:vrd:")) != -1) {
+    while ((c = (char)getopt(argc, argv, "p:vrd:m:w:u:b:s:jal:S:c:R:")) != -1) {
         switch (c) {
             case 'p':  // Sets the port
                 _port = optarg;
                 break;
             case 'v':  // Sets the verbosity
-                _loggers.push_back(std::make_shared<Logger>());
+                _verbose = true;
                 break;
             case 'r':
                 wipeDatabase = true;  // Sets the wipe db option to true
@@ -108,14 +160,106 @@ Server::Server(int argc, char **argv) {
             case 'd':
                 databasePath = optarg;  // Sets the new database path
                 break;
+            case 'm':  // Sets the TCP mode, anything unknown means fork
+                if (std::string(optarg) == "epoll") {
+                    _tcpMode = TcpMode::Epoll;
+                } else if (std::string(optarg) == "uring") {
+                    _tcpMode = TcpMode::Uring;
+                } else {
+                    _tcpMode = TcpMode::Fork;
+                }
+                break;
+            case 'w':  // Sets the number of worker threads of the epoll mode
+                if (atoi(optarg) > 0) {
+                    _workers = (size_t)atoi(optarg);
+                }
+                break;
+            case 'u':  // Sets the number of UDP worker processes
+                if (atoi(optarg) > 0) {
+                    _udpWorkers = (size_t)atoi(optarg);
+                }
+                break;
+            case 'b':  // Sets the bid storage of new auctions
+                bidStorage = (std::string(optarg) == "log") ? BidStorage::Log
+                                                            : BidStorage::Files;
+                break;
+            case 's':  // Sets every how many bids a bid log is synced
+                if (atoi(optarg) >= 0) {
+                    syncInterval = (size_t)atoi(optarg);
+                }
+                break;
+            case 'j':  // Journals the changes of the database
+                journaled = true;
+                break;
+            case 'a':  // Enables the admin commands
+                _admin = true;
+                break;
+            case 'l':  // Sets where the verbose mode logs to, and enables it
+                if (std::string(optarg) == "syslog") {
+                    logTarget = LogTarget::Syslog;
+                } else {
+                    logTarget = LogTarget::File;
+                    logPath = optarg;
+                }
+                _verbose = true;
+                break;
+            case 'S':  // Sets the shard of the auctions, as index/count
+                if (sscanf(optarg, "%d/%d", &shard, &shards) != 2 ||
+                    shards < 1 || shards > DATABASE_MAX_AUCTIONS ||
+                    shard < 0 || shard >= shards) {
+                    std::cout << "Invalid shard " << optarg
+                              << ", expected index/count." << std::endl;
+                    exit(1);
+                }
+                break;
+            case 'c':  // Sets the bytes of assets cached by each process
+                if (atoll(optarg) >= 0) {
+                    assetCacheSize = (size_t)atoll(optarg);
+                }
+                break;
+            case 'R':  // Sets the requests per second of each client
+                switch (sscanf(optarg, "%lf/%lf", &rateLimit, &rateBurst)) {
+                    case 1:  // The burst defaults to two seconds of requests
+                        rateBurst = 2 * rateLimit;
+                        break;
+                    case 2:
+                        break;
+                    default:
+                        rateLimit = -1;
+                        break;
+                }
+                if (rateLimit < 0 || (rateLimit > 0 && rateBurst < 1)) {
+                    std::cout << "Invalid rate " << optarg
+                              << ", expected rate or rate/burst." << std::endl;
+                    exit(1);
+                }
+                break;
             default:
                 break;
         }
     }
 
-    _database = std::make_unique<Database>(databasePath);
+    if (_verbose) {  // Logged off the request threads
+        _loggers.push_back(std::make_shared<AsyncLogger>(logTarget, logPath));
+    }
+
+    _database = std::make_unique<Database>(databasePath, bidStorage,
+                                           syncInterval, journaled);
     // Initialize the database in path
 
+    _metrics = std::make_unique<Metrics>();  // Before forking, to be shared
+    _database->setMetrics(_metrics.get());
+    _admission = std::make_unique<AdmissionControl>(rateLimit, rateBurst);
+    _database->setShard(shard, shards);
+    _database->setAssetCacheSize(assetCacheSize);
+
+    if (_tcpMode == TcpMode::Uring && !IoRing::isSupported()) {
+        std::cout << "io_uring is not available, using epoll." << std::endl;
+        _tcpMode = TcpMode::Epoll;
+    }
+    // The record files are written as linked chains along with the sockets
+    _database->setIoRing(_tcpMode == TcpMode::Uring);
+
     if (wipeDatabase) {
         _database->wipe();
     }
@@ -127,24 +271,52 @@ void Server::ShowInfo() {
 }
 
 void Server::log(std::string message) {
-    for (auto x : _loggers) {
+    for (auto &x : _loggers) {
         x->log(message);
     }
 }
 
 void Server::push() {
-    for (auto x : _loggers) {
+    for (auto &x : _loggers) {
         x->push();
     }
 }
 
 void Server::logPush(std::string message) {
-    for (auto x : _loggers) {
+    for (auto &x : _loggers) {
         x->logPush(message);
     }
 }
 
+void Server::flush() {
+    for (auto &x : _loggers) {
+        x->flush();
+    }
+}
+
+void ExpiryServer(UdpServer &udpServer, TcpServer &tcpServer,
+                  Server &server) {
+    udpServer.close();  // The process only ends auctions
+    tcpServer.close();
+
+    signal(SIGINT, SIG_DFL);  // Waiting on the scheduler is not interrupted
+    prctl(PR_SET_PDEATHSIG, SIGTERM);  // Stops with the TCP server
+
+    server.logPush("Expiry scheduler started");
+    while (1) {
+        try {
+            server._database->runExpiryScheduler();
+        } catch (std::exception const &e) {
+            server.logPush("Could not end an auction or write the "
+                           "checkpoint: " + std::string(e.what()));
+        }
+    }
+}
+
 void UDPServer(UdpServer &udpServer, CommandManager &manager, Server &server) {
+    char responseData[SOCKETS_MAX_DATAGRAM_SIZE_CLIENT];  // Reused every time
+    MessageBuffer response(responseData, sizeof(responseData));
+
     while (1) {
         std::stringstream message =
             udpServer.receive();  // Receive a message from the client
@@ -152,16 +324,127 @@ void UDPServer(UdpServer &udpServer, CommandManager &manager, Server &server) {
             Message::ServerConnectionDetails(  // Display the client information
                                                // if verbose mode is enabled
                 udpServer.getClientIP(), udpServer.getClientPort(), "UDP"));
+        response.clear();  // Empty the response buffer
+        if (!server.getAdmission().admitRequest(udpServer.getClientIP())) {
+            // Rejected before parsing, the client sends too many requests
+            protocolError(response);
+            udpServer.send(response);
+            server.log(Message::ServerRequestDetails("Admission", "Rejected"));
+            server.push();
+            continue;
+        }
+        RequestTimer timer(server.getMetrics());  // Times the request
         StreamMessage streamMessage(message);  // Initialize the stream message
-        std::stringstream response;            // Initialize the response stream
         manager.readCommand(
-            streamMessage, response, server,
-            false);  // Read the command, handle it and write the response
+            streamMessage, response,
+            server);  // Read the command, handle it and write the response
+        if (response.overflowed()) {  // Never send a truncated response
+            response.clear();
+            protocolError(response);
+        }
+        timer.mark(MetricPhase::Encode);
         udpServer.send(response);  // Send the response to the client
+        timer.mark(MetricPhase::Send);
+        timer.setBytes(streamMessage.getBytesReceived(), response.size());
+        timer.finish();
         server.push();
     }
 }
 
+void UDPBatchServer(UdpServer &udpServer, CommandManager &manager,
+                    Server &server) {
+    for (size_t i = 1; i < server.getUdpWorkers(); i++) {
+        pid_t pid;
+        if ((pid = fork()) == -1) {  // Fork the process
+            exit(1);
+        } else if (pid == 0) {  // If the process is a child process
+            // Bind a socket of its own, so that the kernel spreads the
+            // datagrams among the workers instead of waking all of them
+            udpServer.close();
+            UdpServer workerServer(server.getPort(), true);
+            UDPBatchWorker(workerServer, manager, server);
+        }
+    }
+
+    UDPBatchWorker(udpServer, manager, server);
+}
+
+void UDPBatchWorker(UdpServer &udpServer, CommandManager &manager,
+                    Server &server) {
+    UdpBatch batch;  // Reused by every iteration
+
+    while (1) {
+        size_t n = udpServer.receiveBatch(batch);  // Receive the messages
+
+        for (size_t i = 0; i < n; i++) {
+            if (!batch.isValid(i)) {  // Too big to be a request, ignore it
+                continue;
+            }
+
+            std::string ip = batch.getClientIP(i);
+            server.log(Message::ServerConnectionDetails(
+                ip, batch.getClientPort(i), "UDP"));
+            // The response is encoded straight into the batch
+            MessageBuffer response = batch.getResponseBuffer(i);
+            if (!server.getAdmission().admitRequest(ip)) {
+                // Rejected before parsing, the client sends too many requests
+                protocolError(response);
+                batch.setResponse(i, response);
+                server.log(
+                    Message::ServerRequestDetails("Admission", "Rejected"));
+                continue;
+            }
+            // Times the request, but for the send shared by the whole batch
+            RequestTimer timer(server.getMetrics());
+            std::stringstream message = batch.getMessage(i);
+            StreamMessage streamMessage(message);  // Initialize the message
+            manager.readCommand(
+                streamMessage, response,
+                server);  // Read the command, handle it and write the response
+            if (response.overflowed()) {  // Never send a truncated response
+                response.clear();
+                protocolError(response);
+            }
+            batch.setResponse(i, response);
+            timer.mark(MetricPhase::Encode);
+            timer.setBytes(streamMessage.getBytesReceived(), response.size());
+            timer.finish();
+        }
+
+        udpServer.sendBatch(batch);  // Send every response at once
+        server.push();
+    }
+}
+
+/**
+ * @brief  Checks if the next request of a TCP session asks to keep it open.
+ * @param  message The message source of the session.
+ * @retval true if it is the keep-alive request, false otherwise.
+ */
+static bool IsKeepAliveRequest(TcpMessage &message) {
+    try {
+        return message.peek(PROTOCOL_KEEPALIVE_REQUEST);
+    } catch (ProtocolException const &e) {
+        return false;  // Closed, the command handlers reply with the error
+    }
+}
+
+/**
+ * @brief  Waits for the next request of a kept alive TCP session.
+ * @param  message The message source of the session.
+ * @retval true if a request follows, false if the client closed the session
+ * or left it idle for SOCKETS_TCP_TIMEOUT seconds.
+ */
+static bool HasNextRequest(TcpMessage &message) {
+    try {
+        message.get();
+        message.unget();
+        return true;
+    } catch (ProtocolException const &e) {
+        return false;
+    }
+}
+
 void TCPServer(TcpServer &tcpServer, CommandManager &manager, Server &server) {
     while (1) {
         struct sockaddr_in client;
@@ -169,6 +452,15 @@ void TCPServer(TcpServer &tcpServer, CommandManager &manager, Server &server) {
         // Accept a connection from the client, storing its information in
         // client and clientSize
         int fd = tcpServer.acceptConnection(client, clientSize);
+        std::string ip = AddressToIP(client);
+
+        if (!server.getAdmission().openSession(ip)) {
+            // Rejected before forking, too many sessions or requests
+            RejectConnection(fd);
+            server.logPush(
+                Message::ServerRequestDetails("Admission", "Rejected"));
+            continue;
+        }
 
         TcpSession session(fd, client,
                            clientSize);  // Initialize the TCP session
@@ -186,25 +478,79 @@ void TCPServer(TcpServer &tcpServer, CommandManager &manager, Server &server) {
 
             try {
                 TcpMessage message(session._fd);  // Initialize the TCP message
-                std::stringstream response;  // Initialize the response stream
-                manager.readCommand(message, response, server,
-                                    true);  // Read the command, handle it and
-                                            // write the response
-                session.send(response);     // Send the response to the client
+                bool keepAlive = false;  // Whether more requests may follow
+                bool first = true;  // Admitted along with the session
+
+                do {
+                    if (!first && !server.getAdmission().admitRequest(ip)) {
+                        // Rejected before parsing, ending the session
+                        std::stringstream response;
+                        protocolError(response);
+                        session.send(response);
+                        server.log(Message::ServerRequestDetails("Admission",
+                                                                 "Rejected"));
+                        break;
+                    }
+                    first = false;
+
+                    if (!keepAlive && IsKeepAliveRequest(message)) {
+                        keepAlive = true;
+                        SetNoDelay(session._fd);
+                    }
+
+                    RequestTimer timer(server.getMetrics());  // Times it
+                    size_t bytesIn = message.getBytesReceived();
+                    std::stringstream response;  // The response stream
+                    FileAttachment attachment;   // Filled in by SAS
+                    manager.readCommand(message, response, server, true,
+                                        &attachment);  // Read the command,
+                                                       // handle it and write
+                                                       // the response
+                    timer.mark(MetricPhase::Encode);
+                    size_t bytesOut =
+                        (size_t)response.tellp() + attachment.getSize();
+                    // The rest of the session is lost after a protocol error
+                    keepAlive = keepAlive && !isErrorResponse(response.str());
+                    session.send(response);    // Send the response
+                    session.send(attachment);  // Send the file, if any
+                    timer.mark(MetricPhase::Send);
+                    // Bytes read ahead count for the request that read them
+                    timer.setBytes(message.getBytesReceived() - bytesIn,
+                                   bytesOut);
+                    timer.finish();
+                } while (keepAlive && HasNextRequest(message));
             } catch (SocketCommunicationException const &e) {
                 server.log("Session ended prematurely.");
+            } catch (std::exception const &e) {
+                // Any other failure ends the session too, which has to be
+                // closed for the client to open new ones
+                server.log("Session ended prematurely.");
             }
-            server.push();
+            server.getAdmission().closeSession(ip);
+            server.flush();  // Nothing is written once the process exits
             exit(0);  // Exit the child process
         }
     }
 }
 
+void TCPEventServer(TcpServer &tcpServer, CommandManager &manager,
+                    Server &server) {
+    TcpEventServer eventServer(tcpServer, manager, server,
+                               server.getWorkers(),
+                               server.getTcpMode() == TcpMode::Uring);
+
+    server.logPush("Event loop started with " +
+                   std::to_string(server.getWorkers()) + " workers");
+    eventServer.run();  // Only returns by throwing when interrupted
+}
+
 void Logger::log(std::string message) {
+    std::lock_guard<std::mutex> guard(_mutex);
     _messages.push_back(message);
 }
 
 void Logger::push() {
+    std::lock_guard<std::mutex> guard(_mutex);
     time_t currentTime = std::time(nullptr);
     std::tm *currentTm = std::localtime(&currentTime);
     for (auto message : _messages) {
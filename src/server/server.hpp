@@ -9,12 +9,17 @@
 
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <thread>
 
 #include <signal.h>
+#include <sys/prctl.h>
 #include <unistd.h>
 
+#include "admission.hpp"
 #include "config.hpp"
 #include "database.hpp"
+#include "metrics.hpp"
 #include "network.hpp"
 
 /**
@@ -24,24 +29,42 @@
 class Logger {
   private:
     std::vector<std::string> _messages;
+    std::mutex _mutex;  // Guards the queue when the server runs worker threads
 
   public:
+    virtual ~Logger() = default;
+
     /**
      * @brief  Adds message to the log queue.
      * @param  message message
      */
-    void log(std::string message);
+    virtual void log(std::string message);
 
     /**
      * @brief  Pushes the queue of messages to the logging target.
      */
-    void push();
+    virtual void push();
 
     /**
      * @brief  Adds a message to the queue and immediatly pushes the queue.
      * @param  message:
      */
     void logPush(std::string message);
+
+    /**
+     * @brief  Pushes the queue and waits until every message reached the
+     * logging target, before the process exits.
+     */
+    virtual void flush() { push(); }
+};
+
+/**
+ * @brief The ways the server can handle TCP connections.
+ */
+enum class TcpMode {
+    Fork,  /**< Forks a process per accepted connection. */
+    Epoll, /**< Event loop that hands complete requests to worker threads. */
+    Uring, /**< The event loop, with the socket I/O batched through io_uring. */
 };
 
 /**
@@ -54,6 +77,15 @@ class Server {
     bool _verbose =
         false; /**< Flag indicating whether to display verbose output. */
     std::vector<std::shared_ptr<Logger>> _loggers;
+    TcpMode _tcpMode = TcpMode::Fork; /**< The TCP connection handling mode. */
+    size_t _workers = 1; /**< The number of worker threads in epoll mode. */
+    size_t _udpWorkers =
+        0; /**< The number of UDP worker processes, 0 for a single recvfrom
+              loop. */
+    bool _admin = false; /**< Whether the admin commands are enabled. */
+    std::unique_ptr<Metrics> _metrics; /**< The metrics of every process. */
+    std::unique_ptr<AdmissionControl>
+        _admission; /**< The admission control of every process. */
 
   public:
     std::unique_ptr<Database> _database; /**< The database. */
@@ -75,12 +107,60 @@ class Server {
 
     void logPush(std::string message);
 
+    /**
+     * @brief Waits until every message logged reached the logging targets.
+     */
+    void flush();
+
     /**
      * @brief Get the port number.
      *
      * @return std::string The port number.
      */
     std::string getPort() { return _port; }
+
+    /**
+     * @brief Get the TCP connection handling mode.
+     *
+     * @return TcpMode The TCP mode.
+     */
+    TcpMode getTcpMode() { return _tcpMode; }
+
+    /**
+     * @brief Get the number of worker threads used by the epoll mode.
+     *
+     * @return size_t The number of worker threads.
+     */
+    size_t getWorkers() { return _workers; }
+
+    /**
+     * @brief Get the number of UDP worker processes.
+     *
+     * @return size_t The number of UDP workers, 0 if batching is disabled.
+     */
+    size_t getUdpWorkers() { return _udpWorkers; }
+
+    /**
+     * @brief Check if the admin commands are enabled.
+     *
+     * @return bool true if they are enabled, false otherwise.
+     */
+    bool isAdminEnabled() { return _admin; }
+
+    /**
+     * @brief Get the metrics, shared by every process of the server.
+     *
+     * @return Metrics& The metrics.
+     */
+    Metrics &getMetrics() { return *_metrics; }
+
+    /**
+     * @brief Get the admission control, shared by every process of the
+     * server.
+     *
+     * @return AdmissionControl& The admission control.
+     */
+    AdmissionControl &getAdmission() { return *_admission; }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,182 @@
+/**
+ * @file session.cpp
+ * @brief Implementation of the in-memory session table.
+ */
+#include "session.hpp"
+
+#include <sys/random.h>
+
+/**
+ * @brief  Hashes a password, as kept in the session table.
+ * @param  salt The salt of the entry.
+ * @param  password The password.
+ * @param  hash Where the SHA-256 hash of the salt and password is written.
+ */
+static void PasswordHash(const uint8_t salt[DATABASE_PASSWORD_SALT_SIZE],
+                         const std::string &password,
+                         uint8_t hash[SHA256_DIGEST_SIZE]) {
+    std::string salted((const char *)salt, DATABASE_PASSWORD_SALT_SIZE);
+
+    salted += password;
+    Sha256(salted.data(), salted.size(), hash);
+}
+
+SessionTable::SessionTable() {
+    // Anonymous shared mapping, inherited by every process forked afterwards.
+    // It starts zeroed, and only the pages of the users seen are ever touched
+    void *table = mmap(NULL, sizeof(SessionTableData), PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (table == MAP_FAILED) {
+        throw DatabaseException("Could not allocate the session table");
+    }
+
+    _table = (SessionTableData *)table;
+}
+
+SessionTable::~SessionTable() {
+    munmap(_table, sizeof(SessionTableData));
+}
+
+SessionEntry *SessionTable::getEntry(std::string uid) {
+    if (uid.length() != PROTOCOL_UID_SIZE || !isNumeric(uid)) {
+        return NULL;
+    }
+
+    return &_table->entries[stoi(uid)];
+}
+
+void SessionTable::load(DatabaseCore &core) {
+    clear();
+
+    for (auto &uid : core.getAllUsers()) {
+        if (getEntry(uid) == NULL) {
+            continue;  // Not a user directory
+        }
+
+        loadUser(core, uid);
+    }
+}
+
+void SessionTable::loadUser(DatabaseCore &core, std::string uid) {
+    SessionEntry *entry = getEntry(uid);
+
+    if (entry == NULL) {
+        throw DatabaseException("Invalid UID " + uid);
+    }
+
+    if (!core.userExists(uid)) {
+        memset(entry, 0, sizeof(SessionEntry));
+        return;
+    }
+
+    if (!core.isUserRegistered(uid)) {
+        setUnregistered(uid);
+        return;
+    }
+
+    setRegistered(uid, core.getUserPassword(uid));
+
+    if (core.isUserLoggedIn(uid)) {
+        setLoggedIn(uid);
+    }
+}
+
+void SessionTable::clear() {
+    // Frees the pages for every process, which read zeros from then on,
+    // instead of touching the whole table
+    if (madvise(_table, sizeof(SessionTableData), MADV_REMOVE) == -1) {
+        memset(_table, 0, sizeof(SessionTableData));
+    }
+}
+
+SessionEntry SessionTable::copyEntry(int uid) {
+    return _table->entries[uid];
+}
+
+void SessionTable::restoreEntry(int uid, SessionEntry &entry) {
+    _table->entries[uid] = entry;
+}
+
+bool SessionTable::exists(std::string uid) {
+    SessionEntry *entry = getEntry(uid);
+
+    return entry != NULL && entry->state != SessionState::Absent;
+}
+
+bool SessionTable::isRegistered(std::string uid) {
+    SessionEntry *entry = getEntry(uid);
+
+    return entry != NULL && (entry->state == SessionState::LoggedOut ||
+                             entry->state == SessionState::LoggedIn);
+}
+
+bool SessionTable::isLoggedIn(std::string uid) {
+    SessionEntry *entry = getEntry(uid);
+
+    return entry != NULL && entry->state == SessionState::LoggedIn;
+}
+
+bool SessionTable::checkPassword(std::string uid, std::string password) {
+    if (!isRegistered(uid) || password.length() != PROTOCOL_PASSWORD_SIZE) {
+        return false;
+    }
+
+    SessionEntry *entry = getEntry(uid);
+    uint8_t hash[SHA256_DIGEST_SIZE];
+    uint8_t difference = 0;
+
+    PasswordHash(entry->salt, password, hash);
+
+    // Every byte is compared, the time taken tells nothing of the hash
+    for (size_t i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        difference |= (uint8_t)(hash[i] ^ entry->passwordHash[i]);
+    }
+
+    return difference == 0;
+}
+
+void SessionTable::setRegistered(std::string uid, std::string password) {
+    SessionEntry *entry = getEntry(uid);
+
+    if (entry == NULL) {
+        throw DatabaseException("Invalid UID " + uid);
+    }
+
+    if (getrandom(entry->salt, sizeof(entry->salt), 0) !=
+        (ssize_t)sizeof(entry->salt)) {
+        throw DatabaseException("Could not draw the salt of " + uid);
+    }
+
+    // Passwords of other sizes never match, the protocol only sends full ones
+    PasswordHash(entry->salt, password, entry->passwordHash);
+    entry->state = SessionState::LoggedOut;
+}
+
+void SessionTable::setUnregistered(std::string uid) {
+    SessionEntry *entry = getEntry(uid);
+
+    if (entry == NULL) {
+        throw DatabaseException("Invalid UID " + uid);
+    }
+
+    memset(entry->salt, 0, sizeof(entry->salt));
+    memset(entry->passwordHash, 0, sizeof(entry->passwordHash));
+    entry->state = SessionState::Unregistered;
+}
+
+void SessionTable::setLoggedIn(std::string uid) {
+    if (!isRegistered(uid)) {
+        throw DatabaseException("User is not registered");
+    }
+
+    getEntry(uid)->state = SessionState::LoggedIn;
+}
+
+void SessionTable::setLoggedOut(std::string uid) {
+    if (!isRegistered(uid)) {
+        throw DatabaseException("User is not registered");
+    }
+
+    getEntry(uid)->state = SessionState::LoggedOut;
+}
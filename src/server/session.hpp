@@ -0,0 +1,174 @@
+/**
+ * @file session.hpp
+ * @brief Header file for the in-memory session table.
+ *
+ * This file contains the declaration of the SessionTable class, that keeps
+ * the login state and password hash of every user in memory shared by all the
+ * server processes.
+ */
+#ifndef __SESSION_HPP__
+#define __SESSION_HPP__
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <sys/mman.h>
+
+#include "config.hpp"
+#include "database.hpp"
+#include "sha256.hpp"
+
+/**
+ * @brief The states a user can be in.
+ */
+enum class SessionState : uint8_t {
+    Absent,       /**< The user does not exist, the zeroed state. */
+    Unregistered, /**< The user exists, but has no password. */
+    LoggedOut,    /**< The user is registered and logged out. */
+    LoggedIn,     /**< The user is registered and logged in. */
+};
+
+/**
+ * @brief Entry of the session table, with the state of a single user.
+ */
+struct SessionEntry {
+    SessionState state;                         // The state of the user
+    uint8_t salt[DATABASE_PASSWORD_SALT_SIZE];  // Drawn when registered
+    uint8_t passwordHash[SHA256_DIGEST_SIZE];   // Of the salt and password
+};
+
+/**
+ * @brief The shared memory table of the sessions, addressed by UID.
+ */
+struct SessionTableData {
+    SessionEntry entries[DATABASE_MAX_USERS];
+};
+
+/**
+ * @brief In-memory table of the sessions of the users.
+ *
+ * Like the AuctionIndex, the table is loaded once from the database
+ * directory, which stays the source of truth, and then updated by the
+ * Database every time it writes a user to the disk, so checking a login
+ * never touches the disk. The table is mapped as shared memory before the
+ * server forks. It is not thread safe: the Database guards each entry with
+ * the lock of its user.
+ *
+ * Only salted SHA-256 hashes of the passwords are kept, so neither the
+ * shared memory nor the checkpoint holds a password. Every registration
+ * draws a new random salt, and a login is checked by comparing, in constant
+ * time, the hash of the password sent with that salt.
+ */
+class SessionTable {
+  private:
+    SessionTableData *_table;  // The shared table
+
+    /**
+     * @brief  Gets the entry of a user.
+     * @param  uid The user's UID.
+     * @retval pointer to the entry, NULL if the UID is not valid.
+     */
+    SessionEntry *getEntry(std::string uid);
+
+  public:
+    /**
+     * @brief  Maps the shared memory table, initially empty.
+     */
+    SessionTable();
+
+    /**
+     * @brief  Unmaps the shared memory table.
+     */
+    ~SessionTable();
+
+    /**
+     * @brief  Rebuilds the table from the contents of the database directory.
+     * @param  core The core of the database.
+     */
+    void load(DatabaseCore &core);
+
+    /**
+     * @brief  Reads a single user again from the database directory.
+     * @param  core The core of the database.
+     * @param  uid The user's UID.
+     */
+    void loadUser(DatabaseCore &core, std::string uid);
+
+    /**
+     * @brief  Removes every user from the table, releasing its pages.
+     */
+    void clear();
+
+    /**
+     * @brief  Copies the entry of a UID, whether the user exists or not.
+     * @param  uid The UID in int form.
+     * @retval the entry.
+     */
+    SessionEntry copyEntry(int uid);
+
+    /**
+     * @brief  Sets the entry of a UID, as copied by copyEntry.
+     * @param  uid The UID in int form.
+     * @param  entry The entry.
+     */
+    void restoreEntry(int uid, SessionEntry &entry);
+
+    /**
+     * @brief  Checks if the user exists.
+     * @param  uid The user's UID.
+     * @retval true if the user exists, false otherwise.
+     */
+    bool exists(std::string uid);
+
+    /**
+     * @brief  Checks if the user is registered.
+     * @param  uid The user's UID.
+     * @retval true if the user is registered, false otherwise.
+     */
+    bool isRegistered(std::string uid);
+
+    /**
+     * @brief  Checks if the user is logged in.
+     * @param  uid The user's UID.
+     * @retval true if the user is logged in, false otherwise.
+     */
+    bool isLoggedIn(std::string uid);
+
+    /**
+     * @brief  Checks if the password of a registered user matches.
+     * @param  uid The user's UID.
+     * @param  password The password.
+     * @retval true if the user is registered with the password, false
+     * otherwise.
+     */
+    bool checkPassword(std::string uid, std::string password);
+
+    /**
+     * @brief  Sets a user as registered and logged out, creating it if needed.
+     * @param  uid The user's UID.
+     * @param  password The user's password.
+     */
+    void setRegistered(std::string uid, std::string password);
+
+    /**
+     * @brief  Sets a user as existing without a password, creating it if
+     * needed.
+     * @param  uid The user's UID.
+     */
+    void setUnregistered(std::string uid);
+
+    /**
+     * @brief  Sets a registered user as logged in.
+     * @param  uid The user's UID.
+     */
+    void setLoggedIn(std::string uid);
+
+    /**
+     * @brief  Sets a registered user as logged out.
+     * @param  uid The user's UID.
+     */
+    void setLoggedOut(std::string uid);
+};
+
+#endif
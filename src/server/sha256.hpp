@@ -0,0 +1,25 @@
+/**
+ * @file sha256.hpp
+ * @brief Header file for the SHA-256 hash function.
+ *
+ * This file contains the declaration of Sha256, used to keep the passwords
+ * of the session table as salted hashes.
+ */
+#ifndef __SHA256_HPP__
+#define __SHA256_HPP__
+
+#include <cstddef>
+#include <cstdint>
+
+#define SHA256_DIGEST_SIZE (32)  // The size of a SHA-256 digest in bytes
+
+/**
+ * @brief  Computes the SHA-256 digest of some bytes, as in FIPS 180-4.
+ * @param  data The bytes.
+ * @param  size The number of bytes.
+ * @param  digest Where the digest is written.
+ */
+void Sha256(const void *data, size_t size,
+            uint8_t digest[SHA256_DIGEST_SIZE]);
+
+#endif
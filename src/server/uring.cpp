@@ -0,0 +1,444 @@
+/**
+ * @file uring.cpp
+ * @brief Implementation of the io_uring backend of the server.
+ */
+#include "uring.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define URING_FILE_SLOT (0)  // The direct descriptor of the files written
+
+IoRing::IoRing(unsigned entries, unsigned files) : _entries(entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    // The kernel must not interrupt the blocking calls of the thread, such
+    // as epoll_wait, to run the completions, which are only reaped by it
+    params.flags = IORING_SETUP_COOP_TASKRUN;
+    _fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (_fd == -1 && errno == EINVAL) {  // Older than the flag
+        memset(&params, 0, sizeof(params));
+        _fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    }
+    if (_fd == -1) {  // Too old a kernel, or disabled by the system
+        throw IoRingException();
+    }
+
+    _sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cqRingSize =
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    _sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    _sqRing = mmap(NULL, _sqRingSize, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+    _cqRing = mmap(NULL, _cqRingSize, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+    void *sqes = mmap(NULL, _sqesSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+
+    if (_sqRing == MAP_FAILED || _cqRing == MAP_FAILED || sqes == MAP_FAILED) {
+        _sqRing = (_sqRing == MAP_FAILED) ? NULL : _sqRing;
+        _cqRing = (_cqRing == MAP_FAILED) ? NULL : _cqRing;
+        _sqes = (sqes == MAP_FAILED) ? NULL : (struct io_uring_sqe *)sqes;
+        release();
+        throw IoRingException();
+    }
+
+    _sqes = (struct io_uring_sqe *)sqes;
+
+    char *sq = (char *)_sqRing;
+    _sqHead = (unsigned *)(sq + params.sq_off.head);
+    _sqTail = (unsigned *)(sq + params.sq_off.tail);
+    _sqMask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    _sqArray = (unsigned *)(sq + params.sq_off.array);
+    _entries = params.sq_entries;
+
+    char *cq = (char *)_cqRing;
+    _cqHead = (unsigned *)(cq + params.cq_off.head);
+    _cqTail = (unsigned *)(cq + params.cq_off.tail);
+    _cqMask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    _cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    if (files > 0) {  // Empty slots, filled by the opens
+        struct io_uring_rsrc_register slots;
+        memset(&slots, 0, sizeof(slots));
+        slots.nr = files;
+        slots.flags = IORING_RSRC_REGISTER_SPARSE;
+
+        if (syscall(__NR_io_uring_register, _fd, IORING_REGISTER_FILES2,
+                    &slots, sizeof(slots)) == -1) {
+            release();
+            throw IoRingException();
+        }
+    }
+}
+
+IoRing::~IoRing() {
+    release();
+}
+
+void IoRing::release() {
+    if (_sqes != NULL) {
+        munmap(_sqes, _sqesSize);
+    }
+    if (_cqRing != NULL) {
+        munmap(_cqRing, _cqRingSize);
+    }
+    if (_sqRing != NULL) {
+        munmap(_sqRing, _sqRingSize);
+    }
+    if (_fd != -1) {
+        close(_fd);
+    }
+}
+
+bool IoRing::isSupported() {
+    static bool supported = []() {
+        // Without setting a ring up, closing it would interrupt the next
+        // blocking call of the thread. A kernel with io_uring rejects the
+        // empty ring, one without it or that disables it rejects the call
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+
+        return syscall(__NR_io_uring_setup, 0, &params) == -1 &&
+               errno == EINVAL;
+    }();
+
+    return supported;
+}
+
+IoRing *IoRing::forThread() {
+    thread_local std::unique_ptr<IoRing> ring;
+    thread_local pid_t owner = 0;  // The process the ring was set up by
+
+    if (!isSupported()) {
+        return NULL;
+    }
+
+    if (ring == NULL || owner != getpid()) {
+        // A ring inherited through fork is still the parent's, the child
+        // only drops its own mappings and descriptor of it
+        ring.reset();
+        try {
+            ring = std::make_unique<IoRing>(SERVER_URING_ENTRIES, 1);
+        } catch (IoRingException const &e) {
+            return NULL;
+        }
+        owner = getpid();
+    }
+
+    return ring.get();
+}
+
+struct io_uring_sqe *IoRing::getEntry() {
+    unsigned head = __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+    unsigned tail = *_sqTail + _queued;
+
+    if (tail - head >= _entries) {
+        return NULL;
+    }
+
+    unsigned index = tail & _sqMask;
+    struct io_uring_sqe *entry = &_sqes[index];
+
+    memset(entry, 0, sizeof(*entry));
+    _sqArray[index] = index;
+    _queued++;
+    _last = entry;
+
+    return entry;
+}
+
+void IoRing::link(bool hard) {
+    if (_last != NULL) {
+        _last->flags |= hard ? IOSQE_IO_HARDLINK : IOSQE_IO_LINK;
+    }
+}
+
+bool IoRing::prepareRecv(int fd, void *buffer, size_t size, int flags,
+                         uint64_t data) {
+    struct io_uring_sqe *entry = getEntry();
+    if (entry == NULL) {
+        return false;
+    }
+
+    entry->opcode = IORING_OP_RECV;
+    entry->fd = fd;
+    entry->addr = (uint64_t)buffer;
+    entry->len = (uint32_t)size;
+    entry->msg_flags = (uint32_t)flags;
+    entry->user_data = data;
+
+    return true;
+}
+
+bool IoRing::prepareSend(int fd, const void *buffer, size_t size, int flags,
+                         uint64_t data) {
+    struct io_uring_sqe *entry = getEntry();
+    if (entry == NULL) {
+        return false;
+    }
+
+    entry->opcode = IORING_OP_SEND;
+    entry->fd = fd;
+    entry->addr = (uint64_t)buffer;
+    entry->len = (uint32_t)size;
+    entry->msg_flags = (uint32_t)(flags | MSG_NOSIGNAL);
+    entry->user_data = data;
+
+    return true;
+}
+
+bool IoRing::prepareMkdir(const char *path, mode_t mode, uint64_t data) {
+    struct io_uring_sqe *entry = getEntry();
+    if (entry == NULL) {
+        return false;
+    }
+
+    entry->opcode = IORING_OP_MKDIRAT;
+    entry->fd = AT_FDCWD;
+    entry->addr = (uint64_t)path;
+    entry->len = mode;
+    entry->user_data = data;
+
+    return true;
+}
+
+bool IoRing::prepareOpen(const char *path, int flags, mode_t mode,
+                         unsigned slot, uint64_t data) {
+    struct io_uring_sqe *entry = getEntry();
+    if (entry == NULL) {
+        return false;
+    }
+
+    entry->opcode = IORING_OP_OPENAT;
+    entry->fd = AT_FDCWD;
+    entry->addr = (uint64_t)path;
+    entry->len = mode;
+    // A direct descriptor is never in the file table, so it takes no
+    // O_CLOEXEC
+    entry->open_flags = (uint32_t)flags;
+    entry->file_index = slot + 1;  // 0 would be a regular descriptor
+    entry->user_data = data;
+
+    return true;
+}
+
+bool IoRing::prepareWrite(unsigned slot, const void *buffer, size_t size,
+                          uint64_t data) {
+    struct io_uring_sqe *entry = getEntry();
+    if (entry == NULL) {
+        return false;
+    }
+
+    entry->opcode = IORING_OP_WRITE;
+    entry->flags = IOSQE_FIXED_FILE;
+    entry->fd = (int)slot;
+    entry->addr = (uint64_t)buffer;
+    entry->len = (uint32_t)size;
+    entry->off = (uint64_t)-1;  // At the file position, the end if appending
+    entry->user_data = data;
+
+    return true;
+}
+
+bool IoRing::prepareClose(unsigned slot, uint64_t data) {
+    struct io_uring_sqe *entry = getEntry();
+    if (entry == NULL) {
+        return false;
+    }
+
+    entry->opcode = IORING_OP_CLOSE;
+    entry->file_index = slot + 1;
+    entry->user_data = data;
+
+    return true;
+}
+
+bool IoRing::prepareRename(const char *from, const char *to, uint64_t data) {
+    struct io_uring_sqe *entry = getEntry();
+    if (entry == NULL) {
+        return false;
+    }
+
+    entry->opcode = IORING_OP_RENAMEAT;
+    entry->fd = AT_FDCWD;
+    entry->addr = (uint64_t)from;
+    entry->len = (uint32_t)AT_FDCWD;
+    entry->addr2 = (uint64_t)to;
+    entry->user_data = data;
+
+    return true;
+}
+
+bool IoRing::submit(unsigned wait) {
+    if (_queued > 0) {  // Publish the entries queued to the kernel
+        __atomic_store_n(_sqTail, *_sqTail + _queued, __ATOMIC_RELEASE);
+        _inFlight += _queued;
+    }
+
+    unsigned submitting = _queued;
+    _queued = 0;
+    _last = NULL;
+
+    while (submitting > 0 || wait > 0) {
+        int n = (int)syscall(__NR_io_uring_enter, _fd, submitting, wait,
+                             wait > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            return false;
+        }
+
+        submitting -= std::min((unsigned)n, submitting);
+        wait = 0;  // The kernel only returns once they completed
+    }
+
+    return true;
+}
+
+FileBatch::FileBatch(bool linked) {
+    _ring = linked ? IoRing::forThread() : NULL;
+}
+
+void FileBatch::createDirectory(std::string path) {
+    _operations.push_back({Kind::Directory, path, "", "", 0});
+}
+
+void FileBatch::writeFile(std::string path, const void *data, size_t size,
+                          int flags) {
+    _operations.push_back(
+        {Kind::Write, path, "", std::string((const char *)data, size), flags});
+}
+
+void FileBatch::rename(std::string from, std::string to) {
+    _operations.push_back({Kind::Rename, from, to, "", 0});
+}
+
+bool FileBatch::run() {
+    bool done = (_ring != NULL) ? runLinked() : runDirectly();
+
+    _operations.clear();
+    return done;
+}
+
+bool FileBatch::runDirectly() {
+    for (auto &operation : _operations) {
+        switch (operation.kind) {
+            case Kind::Directory:
+                if (mkdir(operation.path.c_str(), 0755) == -1 &&
+                    errno != EEXIST) {
+                    return false;
+                }
+                break;
+            case Kind::Write: {
+                int fd = open(operation.path.c_str(),
+                              operation.flags | O_CLOEXEC, 0644);
+                if (fd == -1) {
+                    return false;
+                }
+
+                ssize_t n =
+                    write(fd, operation.data.data(), operation.data.size());
+                close(fd);
+
+                if (n != (ssize_t)operation.data.size()) {
+                    return false;
+                }
+                break;
+            }
+            case Kind::Rename:
+                if (::rename(operation.path.c_str(),
+                             operation.target.c_str()) == -1) {
+                    return false;
+                }
+                break;
+            default:
+                return false;
+        }
+    }
+
+    return true;
+}
+
+bool FileBatch::runLinked() {
+    bool done = true;
+    size_t next = 0;
+
+    while (next < _operations.size() && done) {
+        // As many operations as the queue holds are linked into one chain,
+        // the expected result of each entry is kept in its data
+        while (next < _operations.size()) {
+            Operation &operation = _operations[next];
+            unsigned needed = (operation.kind == Kind::Write) ? 3 : 1;
+
+            if (_ring->getQueued() + needed > SERVER_URING_ENTRIES) {
+                break;
+            }
+
+            if (_ring->getQueued() > 0) {
+                // A directory that already exists does not stop the chain
+                _ring->link(_operations[next - 1].kind == Kind::Directory);
+            }
+
+            switch (operation.kind) {
+                case Kind::Directory:
+                    _ring->prepareMkdir(operation.path.c_str(), 0755,
+                                        (uint64_t)-EEXIST);
+                    break;
+                case Kind::Write:
+                    _ring->prepareOpen(operation.path.c_str(), operation.flags,
+                                       0644, URING_FILE_SLOT, 0);
+                    _ring->link();
+                    _ring->prepareWrite(URING_FILE_SLOT, operation.data.data(),
+                                        operation.data.size(),
+                                        operation.data.size());
+                    _ring->link();
+                    _ring->prepareClose(URING_FILE_SLOT, 0);
+                    break;
+                case Kind::Rename:
+                    _ring->prepareRename(operation.path.c_str(),
+                                         operation.target.c_str(), 0);
+                    break;
+                default:
+                    break;
+            }
+            next++;
+        }
+
+        unsigned submitted = _ring->getQueued();
+
+        if (!_ring->submit(submitted)) {
+            return false;  // Never submitted, so nothing is left in flight
+        }
+
+        size_t reaped = 0;
+        while (reaped < submitted) {
+            reaped += _ring->reap([&done](uint64_t data, int result) {
+                int64_t expected = (int64_t)data;  // -EEXIST is also fine
+
+                if (result < 0 ? result != expected
+                               : (expected > 0 && result != expected)) {
+                    done = false;
+                }
+            });
+
+            if (reaped < submitted && !_ring->submit(1)) {
+                return false;
+            }
+        }
+    }
+
+    return done;
+}
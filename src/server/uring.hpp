@@ -0,0 +1,308 @@
+/**
+ * @file uring.hpp
+ * @brief Header file for the io_uring backend of the server.
+ *
+ * This file contains the declaration of the IoRing class, a thin wrapper of
+ * the io_uring system calls that queues many operations and submits them
+ * with a single system call, and of the FileBatch class, that writes the
+ * files of a database change as one chain of linked operations.
+ */
+#ifndef __URING_HPP__
+#define __URING_HPP__
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/types.h>
+
+#include "config.hpp"
+
+/**
+ * @brief Ring of io_uring submission and completion queues.
+ *
+ * Operations are queued with the prepare methods, which return false if the
+ * submission queue is full, and are only started by submit. A ring is used
+ * by a single thread, which owns the buffers of the operations in flight
+ * until their completions are reaped.
+ */
+class IoRing {
+  private:
+    int _fd = -1;       // The ring, -1 if it could not be set up
+    unsigned _entries;  // The number of submission queue entries
+
+    void *_sqRing = NULL;  // The mapping of the submission queue
+    size_t _sqRingSize = 0;
+    void *_cqRing = NULL;  // The mapping of the completion queue
+    size_t _cqRingSize = 0;
+    struct io_uring_sqe *_sqes = NULL;  // The submission queue entries
+    size_t _sqesSize = 0;
+
+    unsigned *_sqHead;   // Advanced by the kernel as it takes entries
+    unsigned *_sqTail;   // Advanced as entries are queued
+    unsigned _sqMask;    // The mask of the indexes of the submission queue
+    unsigned *_sqArray;  // The indexes of the entries queued, in order
+    unsigned *_cqHead;   // Advanced as completions are reaped
+    unsigned *_cqTail;   // Advanced by the kernel as operations complete
+    unsigned _cqMask;    // The mask of the indexes of the completion queue
+    struct io_uring_cqe *_cqes;  // The completions
+
+    unsigned _queued = 0;    // The entries queued and not yet submitted
+    unsigned _inFlight = 0;  // The operations submitted and not yet reaped
+    struct io_uring_sqe *_last = NULL;  // The entry queued last
+
+    /**
+     * @brief  Unmaps the queues and closes the ring.
+     */
+    void release();
+
+  public:
+    /**
+     * @brief  Sets up a ring.
+     * @param  entries The number of submission queue entries.
+     * @param  files The number of direct descriptor slots, 0 for none.
+     * @throws IoRingException if the kernel does not support io_uring.
+     */
+    IoRing(unsigned entries = SERVER_URING_ENTRIES, unsigned files = 0);
+
+    /**
+     * @brief  Closes the ring, abandoning the operations in flight.
+     */
+    ~IoRing();
+
+    IoRing(const IoRing &) = delete;
+    IoRing &operator=(const IoRing &) = delete;
+
+    /**
+     * @brief  Checks once whether the kernel lets rings be set up.
+     * @retval true if io_uring can be used, false otherwise.
+     */
+    static bool isSupported();
+
+    /**
+     * @brief  Gets the ring of the calling thread, with a direct descriptor
+     * slot for the files it writes. Processes forked after it was set up get
+     * a ring of their own.
+     * @retval the ring, NULL if io_uring cannot be used.
+     */
+    static IoRing *forThread();
+
+    /**
+     * @brief  Gets a free submission queue entry, zeroed.
+     * @retval the entry, NULL if the queue is full.
+     */
+    struct io_uring_sqe *getEntry();
+
+    /**
+     * @brief  Links the entry queued last to the next one, which only starts
+     * once it completes.
+     * @param  hard Whether the next one starts even if the last one fails.
+     */
+    void link(bool hard = false);
+
+    /**
+     * @brief  Queues a receive from a socket.
+     * @param  fd The socket.
+     * @param  buffer Where the bytes are received.
+     * @param  size The size of the buffer.
+     * @param  flags The flags of the receive, as in recv().
+     * @param  data The data of the completion.
+     * @retval true if it was queued, false if the queue is full.
+     */
+    bool prepareRecv(int fd, void *buffer, size_t size, int flags,
+                     uint64_t data);
+
+    /**
+     * @brief  Queues a send to a socket, that never raises SIGPIPE.
+     * @param  fd The socket.
+     * @param  buffer The bytes sent.
+     * @param  size The number of bytes.
+     * @param  flags The flags of the send, as in send().
+     * @param  data The data of the completion.
+     * @retval true if it was queued, false if the queue is full.
+     */
+    bool prepareSend(int fd, const void *buffer, size_t size, int flags,
+                     uint64_t data);
+
+    /**
+     * @brief  Queues the creation of a directory.
+     * @param  path The path of the directory.
+     * @param  mode The permissions of the directory.
+     * @param  data The data of the completion.
+     * @retval true if it was queued, false if the queue is full.
+     */
+    bool prepareMkdir(const char *path, mode_t mode, uint64_t data);
+
+    /**
+     * @brief  Queues the opening of a file into a direct descriptor slot,
+     * used by the linked operations that follow it.
+     * @param  path The path of the file.
+     * @param  flags The flags the file is opened with.
+     * @param  mode The permissions of the file, if it is created.
+     * @param  slot The direct descriptor slot.
+     * @param  data The data of the completion.
+     * @retval true if it was queued, false if the queue is full.
+     */
+    bool prepareOpen(const char *path, int flags, mode_t mode, unsigned slot,
+                     uint64_t data);
+
+    /**
+     * @brief  Queues a write to the file in a direct descriptor slot, at its
+     * position.
+     * @param  slot The direct descriptor slot.
+     * @param  buffer The bytes written.
+     * @param  size The number of bytes.
+     * @param  data The data of the completion.
+     * @retval true if it was queued, false if the queue is full.
+     */
+    bool prepareWrite(unsigned slot, const void *buffer, size_t size,
+                      uint64_t data);
+
+    /**
+     * @brief  Queues the closing of the file in a direct descriptor slot.
+     * @param  slot The direct descriptor slot.
+     * @param  data The data of the completion.
+     * @retval true if it was queued, false if the queue is full.
+     */
+    bool prepareClose(unsigned slot, uint64_t data);
+
+    /**
+     * @brief  Queues the renaming of a file.
+     * @param  from The old path.
+     * @param  to The new path, replaced if it exists.
+     * @param  data The data of the completion.
+     * @retval true if it was queued, false if the queue is full.
+     */
+    bool prepareRename(const char *from, const char *to, uint64_t data);
+
+    /**
+     * @brief  Submits the entries queued, with a single system call.
+     * @param  wait The number of completions to wait for.
+     * @retval true if they were submitted, false otherwise.
+     */
+    bool submit(unsigned wait = 0);
+
+    /**
+     * @brief  Reaps the completions available.
+     * @param  handler Called with the data and the result of each of them.
+     * @retval the number of completions reaped.
+     */
+    template <typename Handler> size_t reap(Handler handler) {
+        unsigned head = *_cqHead;
+        unsigned tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+        size_t count = 0;
+
+        while (head != tail) {
+            struct io_uring_cqe &cqe = _cqes[head & _cqMask];
+            uint64_t data = cqe.user_data;
+            int result = cqe.res;
+
+            head++;
+            count++;
+            __atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+            _inFlight--;
+            handler(data, result);  // May queue more operations
+        }
+
+        return count;
+    }
+
+    /**
+     * @brief  Gets the number of entries queued and not yet submitted.
+     * @retval the number of entries.
+     */
+    unsigned getQueued() { return _queued; }
+
+    /**
+     * @brief  Gets the number of operations whose completion is not reaped.
+     * @retval the number of operations.
+     */
+    unsigned getInFlight() { return _inFlight; }
+};
+
+/**
+ * @brief Batch of file operations run in order, stopping at the first one
+ * that fails.
+ *
+ * With a ring, the whole batch is submitted as a chain of linked operations,
+ * each started by the kernel once the previous one is done, and the thread
+ * only waits once. Without it, the operations are run one system call at a
+ * time. Creating a directory that already exists is not a failure.
+ */
+class FileBatch {
+  private:
+    enum class Kind { Directory, Write, Rename };
+
+    struct Operation {
+        Kind kind;
+        std::string path;    // The path, the old one of a rename
+        std::string target;  // The new path of a rename
+        std::string data;    // The bytes written
+        int flags;           // The flags the file is opened with
+    };
+
+    IoRing *_ring;  // The ring of the thread, NULL to run them one by one
+    std::vector<Operation> _operations;
+
+    /**
+     * @brief  Runs the operations with a system call each.
+     * @retval true if every operation succeeded, false otherwise.
+     */
+    bool runDirectly();
+
+    /**
+     * @brief  Runs the operations as chains of linked operations.
+     * @retval true if every operation succeeded, false otherwise.
+     */
+    bool runLinked();
+
+  public:
+    /**
+     * @brief  Constructs an empty batch.
+     * @param  linked Whether to run it through the ring of the thread, when
+     * io_uring can be used.
+     */
+    FileBatch(bool linked);
+
+    /**
+     * @brief  Adds the creation of a directory.
+     * @param  path The path of the directory.
+     */
+    void createDirectory(std::string path);
+
+    /**
+     * @brief  Adds the writing of a file, opened, written and closed.
+     * @param  path The path of the file.
+     * @param  data The bytes written.
+     * @param  size The number of bytes.
+     * @param  flags The flags the file is opened with.
+     */
+    void writeFile(std::string path, const void *data, size_t size,
+                   int flags = O_WRONLY | O_CREAT | O_TRUNC);
+
+    /**
+     * @brief  Adds the renaming of a file.
+     * @param  from The old path.
+     * @param  to The new path, replaced if it exists.
+     */
+    void rename(std::string from, std::string to);
+
+    /**
+     * @brief  Runs the operations added.
+     * @retval true if every operation succeeded, false otherwise.
+     */
+    bool run();
+};
+
+/**
+ * @brief Exception thrown when a ring cannot be set up.
+ */
+class IoRingException : public std::runtime_error {
+  public:
+    IoRingException() : std::runtime_error("io_uring is not available") {}
+};
+
+#endif
@@ -0,0 +1,77 @@
+/**
+ * @file admissiontest.cpp
+ * @brief Implementation file for the tests of the admission control.
+ *
+ * This file contains the tests of the limits of the admission control: the
+ * request rate of each client, its sessions and the bytes of the uploads
+ * received at once.
+ */
+#include "admission.hpp"
+#include "test.hpp"
+
+/**
+ * @brief  Checks that each client may send its burst, and nothing after it
+ * until its bucket refills, while the default admits every request.
+ */
+static void TestRate() {
+    AdmissionControl unlimited;
+
+    for (int i = 0; i < 1000; i++) {
+        CHECK(unlimited.admitRequest("10.0.0.1"));
+    }
+
+    // A refill too slow to add a token while the test runs
+    AdmissionControl limited(0.001, 3);
+
+    CHECK(limited.admitRequest("10.0.0.1"));
+    CHECK(limited.admitRequest("10.0.0.1"));
+    CHECK(limited.admitRequest("10.0.0.1"));
+    CHECK(!limited.admitRequest("10.0.0.1"));
+    CHECK(limited.admitRequest("10.0.0.2"));  // Each client has its own
+}
+
+/**
+ * @brief  Checks the limit of the sessions a client has open at once.
+ */
+static void TestSessions() {
+    AdmissionControl admission;
+
+    for (int i = 0; i < SERVER_MAX_CLIENT_SESSIONS; i++) {
+        CHECK(admission.openSession("10.0.0.1"));
+    }
+    CHECK(!admission.openSession("10.0.0.1"));
+    CHECK(admission.openSession("10.0.0.2"));
+
+    admission.closeSession("10.0.0.1");
+    CHECK(admission.openSession("10.0.0.1"));
+}
+
+/**
+ * @brief  Checks that the uploads are rejected once their bytes reach the
+ * limit, and released by their reservations.
+ */
+static void TestUploads() {
+    AdmissionControl admission;
+
+    {
+        UploadReservation first(admission, SERVER_MAX_UPLOAD_BYTES / 2);
+        UploadReservation second(admission, SERVER_MAX_UPLOAD_BYTES / 2);
+
+        CHECK_THROWS(UploadReservation(admission, 1), AdmissionException);
+
+        // Reserved by the event loop, taken without reserving them again
+        UploadReservation::setCovered(1000);
+        UploadReservation covered(admission, 1000);
+        UploadReservation::setCovered(0);
+        CHECK(covered.getBytes() == 0);
+    }
+
+    UploadReservation whole(admission, SERVER_MAX_UPLOAD_BYTES);
+    CHECK(whole.getBytes() == SERVER_MAX_UPLOAD_BYTES);
+}
+
+void RunAdmissionTests() {
+    RunTest("admission/rate", TestRate);
+    RunTest("admission/sessions", TestSessions);
+    RunTest("admission/uploads", TestUploads);
+}
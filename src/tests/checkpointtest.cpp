@@ -0,0 +1,125 @@
+/**
+ * @file checkpointtest.cpp
+ * @brief Implementation file for the tests of the checkpoint.
+ *
+ * This file contains the tests of the checkpoint of the in-memory tables:
+ * the tables loaded from it must match the database, and a checkpoint that
+ * is damaged or outdated must never be loaded.
+ */
+#include "checkpoint.hpp"
+#include "test.hpp"
+
+/**
+ * @brief  Fills a database with a user that hosts an auction with a bid.
+ * @param  path The directory of the database.
+ * @retval the AID of the auction.
+ */
+static std::string FillDatabase(fs::path path) {
+    Database database(path.string());
+    std::stringstream file("asset");
+
+    database.loginUser("111111", "password");
+    std::string aid = database.createAuction(
+        "111111", "password", "auction", 10, 3600, "asset.txt", file);
+    database.loginUser("222222", "passwor2");
+    database.bidAuction("222222", "passwor2", aid, 50);
+
+    return aid;
+}
+
+/**
+ * @brief  Loads the checkpoint of a database into tables of its own.
+ * @param  path The directory of the database.
+ * @param  journaled Whether the database is journaled.
+ * @param  aid The AID of an auction, checked to be loaded with its bid.
+ * @retval whether the checkpoint was loaded.
+ */
+static bool LoadCheckpoint(fs::path path, bool journaled, std::string aid) {
+    AuctionIndex index;
+    SessionTable sessions;
+    IndexCheckpoint checkpoint(path / "INDEX", index, sessions, journaled);
+
+    if (!checkpoint.load()) {
+        return false;
+    }
+
+    CHECK(index.contains(aid));
+    CHECK(index.getMaxBid(aid) == 50);
+    CHECK(sessions.isRegistered("222222"));
+    CHECK(sessions.checkPassword("222222", "passwor2"));
+    CHECK(!sessions.checkPassword("222222", "password"));
+
+    return true;
+}
+
+/**
+ * @brief  Checks that a checkpoint is written at start, removed by the first
+ * change, and has the tables of the database.
+ */
+static void TestLoad() {
+    fs::path path = TestDirectory("checkpoint-load");
+    std::string aid = FillDatabase(path);
+
+    CHECK(!fs::exists(path / "INDEX"));  // Outdated by the changes
+
+    { Database database(path.string()); }
+
+    CHECK(LoadCheckpoint(path, false, aid));
+
+    Database database(path.string());
+    CHECK(database.getAuctionCurrentMaxValue(aid) == 50);
+    CHECK(database.checkLoggedIn("222222", "passwor2"));
+}
+
+/**
+ * @brief  Checks that a damaged checkpoint is ignored, the tables then being
+ * read from the whole database.
+ */
+static void TestCorruption() {
+    fs::path path = TestDirectory("checkpoint-corruption");
+    std::string aid = FillDatabase(path);
+
+    { Database database(path.string()); }
+
+    {  // Flips a byte of the entries
+        std::fstream file(path / "INDEX",
+                          std::ios::binary | std::ios::in | std::ios::out);
+        file.seekg(sizeof(CheckpointHeader) + 8);
+        char c = (char)file.get();
+        file.seekp(sizeof(CheckpointHeader) + 8);
+        file.put((char)(c ^ 0x01));
+    }
+    CHECK(!LoadCheckpoint(path, false, aid));
+
+    {
+        Database database(path.string());
+        CHECK(database.getAuctionCurrentMaxValue(aid) == 50);
+        CHECK(database.checkLoggedIn("222222", "passwor2"));
+    }
+
+    CHECK(LoadCheckpoint(path, false, aid));  // Written again at start
+
+    // Cut short
+    fs::resize_file(path / "INDEX", fs::file_size(path / "INDEX") - 1);
+    CHECK(!LoadCheckpoint(path, false, aid));
+}
+
+/**
+ * @brief  Checks that the checkpoint of a journaled database, which misses
+ * the changes of its journal, is not loaded without it.
+ */
+static void TestJournaled() {
+    fs::path path = TestDirectory("checkpoint-journaled");
+    std::string aid = FillDatabase(path);
+
+    { Database database(path.string(), BidStorage::Files, 0, true); }
+
+    CHECK(LoadCheckpoint(path, true, aid));
+    CHECK(!LoadCheckpoint(path, false, aid));
+}
+
+void RunCheckpointTests() {
+    RunTest("checkpoint/load", TestLoad);
+    RunTest("checkpoint/corruption", TestCorruption);
+    RunTest("checkpoint/journaled", TestJournaled);
+}
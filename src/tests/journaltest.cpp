@@ -0,0 +1,173 @@
+/**
+ * @file journaltest.cpp
+ * @brief Implementation file for the tests of the journal.
+ *
+ * This file contains the tests of the write-ahead journal: the changes it
+ * records are written to it directly, as if the server crashed before
+ * making them, and must be made when the database is opened again.
+ */
+#include "database.hpp"
+#include "journal.hpp"
+#include "test.hpp"
+
+/**
+ * @brief  Creates a zeroed journal record.
+ * @param  operation The change recorded.
+ * @param  uid The UID of the user making it.
+ * @param  aid The AID of the auction it is made to, empty for none.
+ * @retval the record.
+ */
+static JournalRecord MakeRecord(JournalOperation operation, std::string uid,
+                                std::string aid) {
+    JournalRecord record;
+
+    memset(&record, 0, sizeof(record));
+    record.operation = operation;
+    memcpy(record.uid, uid.data(), uid.size());
+    memcpy(record.aid, aid.data(), aid.size());
+
+    return record;
+}
+
+/**
+ * @brief  Appends a record to the journal of a database, as the server does
+ * before making the change, without making it.
+ * @param  path The directory of the database.
+ * @param  record The record.
+ */
+static void AppendRecord(fs::path path, JournalRecord &record) {
+    Journal journal(path / "JOURNAL");
+
+    JournalEntry entry = journal.append(record);
+    entry.sync();
+    entry.commit();
+}
+
+/**
+ * @brief  Opens a journaled database with a user that hosts an auction.
+ * @param  path The directory of the database.
+ * @retval the AID of the auction.
+ */
+static std::string CreateAuction(fs::path path) {
+    Database database(path.string(), BidStorage::Files, 0, true);
+    std::stringstream file("asset");
+
+    database.loginUser("111111", "password");
+    return database.createAuction("111111", "password", "auction", 10, 3600,
+                                  "asset.txt", file);
+}
+
+/**
+ * @brief  Checks that the changes journaled but never made are made when the
+ * database is opened.
+ */
+static void TestReplay() {
+    fs::path path = TestDirectory("journal-replay");
+    std::string aid = CreateAuction(path);
+
+    JournalRecord login = MakeRecord(JournalOperation::Login, "222222", "");
+    memcpy(login.password, "passwor2", sizeof(login.password));
+    AppendRecord(path, login);
+
+    JournalRecord bid = MakeRecord(JournalOperation::Bid, "222222", aid);
+    bid.value = 50;
+    bid.time = time(NULL);
+    AppendRecord(path, bid);
+
+    JournalRecord close =
+        MakeRecord(JournalOperation::CloseAuction, "111111", aid);
+    close.time = time(NULL);
+    AppendRecord(path, close);
+
+    Database database(path.string(), BidStorage::Files, 0, true);
+
+    CHECK(database.checkLoggedIn("111111", "password"));
+    CHECK(database.checkLoggedIn("222222", "passwor2"));
+    CHECK(!database.checkLoggedIn("222222", "password"));
+    CHECK(database.getAuctionCurrentMaxValue(aid) == 50);
+    CHECK(database.getUserBids("222222").count(aid) == 1);
+    CHECK(!database.isAuctionActive(aid));
+
+    AuctionRecord record = database.getAuctionRecord(aid, 1);
+    CHECK(record.ended);
+    CHECK(record.bids.size() == 1 && record.bids[0].uid == "222222");
+}
+
+/**
+ * @brief  Checks that a replayed bid is not made twice, if the crash came
+ * after it was made, and that a record cut short is ignored.
+ */
+static void TestReplayTwice() {
+    fs::path path = TestDirectory("journal-twice");
+    std::string aid = CreateAuction(path);
+
+    {
+        Database database(path.string(), BidStorage::Files, 0, true);
+        database.loginUser("222222", "passwor2");
+        database.bidAuction("222222", "passwor2", aid, 50);
+    }
+
+    // Journaled again, as if the server crashed before it was committed
+    JournalRecord bid = MakeRecord(JournalOperation::Bid, "222222", aid);
+    bid.value = 50;
+    bid.time = time(NULL);
+    AppendRecord(path, bid);
+
+    // The record of a bid the crash cut short
+    JournalRecord torn = MakeRecord(JournalOperation::Bid, "222222", aid);
+    torn.value = 60;
+    {
+        std::ofstream journal(path / "JOURNAL",
+                              std::ios::binary | std::ios::app);
+        journal.write((const char *)&torn, sizeof(torn) / 2);
+    }
+
+    Database database(path.string(), BidStorage::Files, 0, true);
+
+    CHECK(database.getAuctionCurrentMaxValue(aid) == 50);
+    CHECK(database.getAuctionRecord(aid, 10).bids.size() == 1);
+    CHECK(fs::file_size(path / "JOURNAL") == 0);  // Emptied once replayed
+}
+
+/**
+ * @brief  Checks that the change of an entry synced but never committed is
+ * repaired, and that one never synced is only dropped.
+ */
+static void TestRepair() {
+    fs::path path = TestDirectory("journal-repair");
+    Journal journal(path / "JOURNAL");
+    JournalRecord record = MakeRecord(JournalOperation::Logout, "111111", "");
+    int repairs = 0;
+
+    {
+        JournalEntry entry = journal.append(record, [&]() { repairs++; });
+    }
+    CHECK(repairs == 0);
+
+    {
+        JournalEntry entry = journal.append(record, [&]() { repairs++; });
+        entry.sync();
+    }
+    CHECK(repairs == 1);
+
+    {
+        JournalEntry entry = journal.append(record, [&]() { repairs++; });
+        entry.sync();
+        entry.commit();
+    }
+    CHECK(repairs == 1);
+
+    // A repair that fails leaves the record for the next start
+    {
+        JournalEntry entry = journal.append(
+            record, []() { throw DatabaseException("Injected failure"); });
+        entry.sync();
+    }
+    CHECK(journal.recover().size() == 4);
+}
+
+void RunJournalTests() {
+    RunTest("journal/replay", TestReplay);
+    RunTest("journal/replayTwice", TestReplayTwice);
+    RunTest("journal/repair", TestRepair);
+}
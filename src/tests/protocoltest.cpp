@@ -0,0 +1,243 @@
+/**
+ * @file protocoltest.cpp
+ * @brief Implementation file for the tests of the protocol.
+ *
+ * This file contains the round trips of the requests and responses: each is
+ * encoded as the client or server does, then decoded as the other side
+ * does, checking that every field comes back the same.
+ */
+#include "protocol.hpp"
+#include "test.hpp"
+
+/**
+ * @brief  Decodes a request as the server does, reading its identifier
+ * first.
+ * @param  data The request.
+ * @param  comm The communication that decodes it.
+ */
+template <typename Communication>
+static void DecodeRequest(std::string data, Communication &comm) {
+    std::stringstream stream(data);
+    StreamMessage message(stream);
+
+    comm.readString(message, 3);  // The server reads the identifier
+    comm.decodeRequest(message);
+}
+
+/**
+ * @brief  Decodes a response as the client does.
+ * @param  data The response.
+ * @param  comm The communication that decodes it.
+ */
+template <typename Communication>
+static void DecodeResponse(std::string data, Communication &comm) {
+    std::stringstream stream(data);
+    StreamMessage message(stream);
+
+    comm.decodeResponse(message);
+}
+
+/**
+ * @brief  Checks the round trips of the requests with credentials.
+ */
+static void TestCredentials() {
+    LoginCommunication login;
+    login._uid = "123456";
+    login._password = "abcd1234";
+
+    LoginCommunication decoded;
+    DecodeRequest(login.encodeRequest().str(), decoded);
+    CHECK(decoded._uid == "123456");
+    CHECK(decoded._password == "abcd1234");
+
+    decoded._status = "REG";
+    LoginCommunication response;
+    DecodeResponse(decoded.encodeResponse().str(), response);
+    CHECK(response._status == "REG");
+
+    // The fields are checked against the schema of the request
+    LoginCommunication invalid;
+    CHECK_THROWS(DecodeRequest("LIN 12345 abcd1234\n", invalid),
+                 ProtocolException);
+    CHECK_THROWS(DecodeRequest("LIN 123456 abcd123\n", invalid),
+                 ProtocolException);
+    CHECK_THROWS(DecodeRequest("LIN 123456 abcd1234 \n", invalid),
+                 ProtocolException);
+    CHECK_THROWS(DecodeRequest("LIN 123456 abcd1234", invalid),
+                 ProtocolException);
+
+    BidCommunication bid;
+    bid._uid = "123456";
+    bid._password = "abcd1234";
+    bid._aid = "042";
+    bid._value = 1000;
+
+    BidCommunication decodedBid;
+    DecodeRequest(bid.encodeRequest().str(), decodedBid);
+    CHECK(decodedBid._uid == "123456");
+    CHECK(decodedBid._aid == "042");
+    CHECK(decodedBid._value == 1000);
+}
+
+/**
+ * @brief  Checks the round trips of the open auction request, whose file may
+ * contain the delimiter.
+ */
+static void TestOpenAuction() {
+    std::string asset = "line\nline\n";
+
+    OpenAuctionCommunication open;
+    open._uid = "123456";
+    open._password = "abcd1234";
+    open._name = "auction";
+    open._startValue = 100;
+    open._timeActive = 3600;
+    open._fileName = "asset.txt";
+    open._fileSize = (int)asset.size();
+    open._fileData.str(asset);
+    std::string data = open.encodeRequest().str();
+
+    OpenAuctionCommunication decoded;
+    std::stringstream file;
+    {
+        std::stringstream stream(data);
+        StreamMessage message(stream);
+        decoded.readString(message, 3);
+        decoded.decodeRequest(message, file);
+    }
+    CHECK(decoded._name == "auction");
+    CHECK(decoded._startValue == 100);
+    CHECK(decoded._timeActive == 3600);
+    CHECK(decoded._fileName == "asset.txt");
+    CHECK(decoded._fileSize == (int)asset.size());
+    CHECK(file.str() == asset);
+
+    // The event loop writes the file itself, the handler reads the rest
+    std::string header = data.substr(0, data.size() - asset.size() - 1);
+    OpenAuctionCommunication received;
+    {
+        std::stringstream stream(header + "\n");
+        StreamMessage message(stream);
+        received.readString(message, 3);
+        received.decodeRequestHeader(message);
+        received.decodeRequestEnd(message);
+    }
+    CHECK(received._fileSize == (int)asset.size());
+
+    OpenAuctionCommunication truncated;
+    CHECK_THROWS(
+        {
+            std::stringstream stream(header);
+            StreamMessage message(stream);
+            truncated.readString(message, 3);
+            truncated.decodeRequestHeader(message);
+            truncated.decodeRequestEnd(message);
+        },
+        ProtocolException);
+}
+
+/**
+ * @brief  Checks the round trips of the conditional list and record queries.
+ */
+static void TestConditional() {
+    ListAllAuctionsCommunication plain;
+    ListAllAuctionsCommunication decodedPlain;
+    DecodeRequest(plain.encodeRequest().str(), decodedPlain);
+    CHECK(!decodedPlain._conditional);
+
+    ListAllAuctionsCommunication list;
+    list._conditional = true;
+    list._knownGeneration = 42;
+    std::string request = list.encodeRequest().str();
+    CHECK(request == "LST 42\n");
+
+    ListAllAuctionsCommunication decoded;
+    DecodeRequest(request, decoded);
+    CHECK(decoded._conditional);
+    CHECK(decoded._knownGeneration == 42);
+
+    decoded._status = "OK";
+    decoded._generation = 43;
+    decoded._auctions = {{"001", "1"}, {"002", "0"}};
+    ListAllAuctionsCommunication response;
+    response._conditional = true;
+    DecodeResponse(decoded.encodeResponse().str(), response);
+    CHECK(response._status == "OK");
+    CHECK(response._generation == 43);
+    CHECK(response._auctions == decoded._auctions);
+
+    decoded._status = PROTOCOL_UNCHANGED_STATUS;
+    decoded._auctions.clear();
+    std::string unchanged = decoded.encodeResponse().str();
+    ListAllAuctionsCommunication unchangedResponse;
+    unchangedResponse._conditional = true;
+    DecodeResponse(unchanged, unchangedResponse);
+    CHECK(unchangedResponse._status == PROTOCOL_UNCHANGED_STATUS);
+    CHECK(unchangedResponse._generation == 43);
+
+    // Only a conditional query may be answered as unchanged
+    ListAllAuctionsCommunication plainResponse;
+    CHECK_THROWS(DecodeResponse(unchanged, plainResponse), ProtocolException);
+
+    // Every AID does not fit a datagram, the server then sends the error
+    ListAllAuctionsCommunication full;
+    full._status = "OK";
+    full._conditional = true;
+    for (int aid = 1; aid < 1000; aid++) {
+        full._auctions[std::to_string(1000 + aid).substr(1)] = "1";
+    }
+    char data[SOCKETS_MAX_DATAGRAM_SIZE_CLIENT];
+    MessageBuffer buffer(data, sizeof(data));
+    full.encodeResponse(buffer);
+    CHECK(buffer.overflowed());
+
+    ShowRecordCommunication record;
+    record._aid = "007";
+    record._conditional = true;
+    record._knownGeneration = 5;
+    ShowRecordCommunication decodedRecord;
+    DecodeRequest(record.encodeRequest().str(), decodedRecord);
+    CHECK(decodedRecord._aid == "007");
+    CHECK(decodedRecord._conditional);
+    CHECK(decodedRecord._knownGeneration == 5);
+}
+
+/**
+ * @brief  Checks the round trips of the asset range query.
+ */
+static void TestAssetRange() {
+    ShowAssetRangeCommunication range;
+    range._aid = "001";
+    range._offset = 3;
+    range._length = 4;
+
+    ShowAssetRangeCommunication decoded;
+    DecodeRequest(range.encodeRequest().str(), decoded);
+    CHECK(decoded._aid == "001");
+    CHECK(decoded._offset == 3);
+    CHECK(decoded._length == 4);
+
+    decoded._status = "OK";
+    decoded._fileName = "asset.txt";
+    decoded._fileSize = 10;
+    decoded._fileData.str("3456");
+    ShowAssetRangeCommunication response;
+    DecodeResponse(decoded.encodeResponse().str(), response);
+    CHECK(response._status == "OK");
+    CHECK(response._fileName == "asset.txt");
+    CHECK(response._fileSize == 10);
+    CHECK(response._offset == 3);
+    CHECK(response._length == 4);
+    CHECK(response._fileData.str() == "3456");
+
+    // A range past the end of the file is never sent
+    decoded._offset = 8;
+    CHECK_THROWS(decoded.encodeResponse(), ProtocolViolationException);
+}
+
+void RunProtocolTests() {
+    RunTest("protocol/credentials", TestCredentials);
+    RunTest("protocol/openAuction", TestOpenAuction);
+    RunTest("protocol/conditional", TestConditional);
+    RunTest("protocol/assetRange", TestAssetRange);
+}
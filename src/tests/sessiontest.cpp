@@ -0,0 +1,87 @@
+/**
+ * @file sessiontest.cpp
+ * @brief Implementation file for the tests of the session table.
+ *
+ * This file contains the tests of the SHA-256 hash, against the vectors of
+ * FIPS 180-4, and of the salted password hashes of the session table.
+ */
+#include <iomanip>
+
+#include "session.hpp"
+#include "sha256.hpp"
+#include "test.hpp"
+
+/**
+ * @brief  Hashes some bytes, as hexadecimal.
+ * @param  data The bytes.
+ * @retval the hexadecimal digest.
+ */
+static std::string HexDigest(std::string data) {
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    std::stringstream hex;
+
+    Sha256(data.data(), data.size(), digest);
+
+    for (size_t i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        hex << std::hex << std::setw(2) << std::setfill('0') << (int)digest[i];
+    }
+
+    return hex.str();
+}
+
+/**
+ * @brief  Checks the digests of the test vectors, which end in one or two
+ * blocks of padding.
+ */
+static void TestSha256() {
+    CHECK(HexDigest("") ==
+          "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    CHECK(HexDigest("abc") ==
+          "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    CHECK(HexDigest("abcdbcdecdefdefgefghfghighijhijkijkljklmklmn"
+                    "lmnomnopnopq") ==
+          "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    CHECK(HexDigest(std::string(1000000, 'a')) ==
+          "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+/**
+ * @brief  Checks that the session table keeps salted hashes, never the
+ * passwords, and checks them.
+ */
+static void TestPasswords() {
+    SessionTable sessions;
+
+    sessions.setRegistered("111111", "password");
+    sessions.setRegistered("222222", "password");
+
+    CHECK(sessions.isRegistered("111111"));
+    CHECK(sessions.checkPassword("111111", "password"));
+    CHECK(!sessions.checkPassword("111111", "passwore"));
+    CHECK(!sessions.checkPassword("333333", "password"));
+
+    SessionEntry first = sessions.copyEntry(111111);
+    SessionEntry second = sessions.copyEntry(222222);
+
+    // The same password has a different hash for every user
+    CHECK(memcmp(first.salt, second.salt, sizeof(first.salt)) != 0);
+    CHECK(memcmp(first.passwordHash, second.passwordHash,
+                 sizeof(first.passwordHash)) != 0);
+    CHECK(std::string((const char *)&first, sizeof(first)).find("password") ==
+          std::string::npos);
+
+    // Registering again replaces the password
+    sessions.setUnregistered("111111");
+    CHECK(!sessions.checkPassword("111111", "password"));
+    sessions.setRegistered("111111", "passwore");
+    CHECK(sessions.checkPassword("111111", "passwore"));
+    CHECK(!sessions.checkPassword("111111", "password"));
+
+    sessions.clear();
+    CHECK(!sessions.exists("222222"));
+}
+
+void RunSessionTests() {
+    RunTest("session/sha256", TestSha256);
+    RunTest("session/passwords", TestPasswords);
+}
@@ -0,0 +1,72 @@
+/**
+ * @file test.cpp
+ * @brief Implementation file for the tests.
+ *
+ * This file contains the main function of the test target, which runs every
+ * suite and exits with a non-zero status if any check failed.
+ */
+#include "test.hpp"
+
+#include <iostream>
+
+#include <unistd.h>
+
+static std::string CurrentTest;  // The name of the test running
+static int Failures = 0;         // The checks failed by every test
+static bool TestFailed = false;  // Whether the running test failed
+
+// The directory of the directories of the tests
+static fs::path TestRoot =
+    fs::temp_directory_path() / ("as-test-" + std::to_string(getpid()));
+
+void Check(bool passed, const char *text, const char *file, int line) {
+    if (passed) {
+        return;
+    }
+
+    std::cerr << file << ":" << line << ": " << CurrentTest
+              << ": check failed: " << text << std::endl;
+    Failures++;
+    TestFailed = true;
+}
+
+void RunTest(std::string name, std::function<void()> test) {
+    CurrentTest = name;
+    TestFailed = false;
+
+    try {
+        test();
+    } catch (std::exception const &e) {
+        std::cerr << name << ": threw: " << e.what() << std::endl;
+        Failures++;
+        TestFailed = true;
+    }
+
+    std::cout << (TestFailed ? "FAIL " : "ok   ") << name << std::endl;
+}
+
+fs::path TestDirectory(std::string name) {
+    fs::path path = TestRoot / name;
+
+    fs::remove_all(path);
+    fs::create_directories(path);
+
+    return path;
+}
+
+int main() {
+    RunProtocolTests();
+    RunJournalTests();
+    RunCheckpointTests();
+    RunSessionTests();
+    RunAdmissionTests();
+
+    fs::remove_all(TestRoot);
+
+    if (Failures > 0) {
+        std::cerr << Failures << " checks failed" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file test.hpp
+ * @brief Header file for the tests.
+ *
+ * This file contains the declarations of the helpers shared by the tests and
+ * of the suites run by the test target.
+ */
+#ifndef __TEST_HPP__
+#define __TEST_HPP__
+
+#include <filesystem>
+#include <functional>
+#include <string>
+
+namespace fs = std::filesystem;
+
+// Records a failure, with its location, unless the condition holds
+#define CHECK(condition) Check((condition), #condition, __FILE__, __LINE__)
+
+// Records a failure unless the statement throws the exception
+#define CHECK_THROWS(statement, exception)                        \
+    do {                                                          \
+        bool thrown = false;                                      \
+        try {                                                     \
+            statement;                                            \
+        } catch (exception const &e) {                            \
+            thrown = true;                                        \
+        }                                                         \
+        Check(thrown, #statement " throws " #exception, __FILE__, \
+              __LINE__);                                          \
+    } while (0)
+
+/**
+ * @brief  Records the result of a check of the running test.
+ * @param  passed Whether the check passed.
+ * @param  text The condition checked.
+ * @param  file The file of the check.
+ * @param  line The line of the check.
+ */
+void Check(bool passed, const char *text, const char *file, int line);
+
+/**
+ * @brief  Runs a test, counting it as failed if it throws.
+ * @param  name The name of the test.
+ * @param  test The test.
+ */
+void RunTest(std::string name, std::function<void()> test);
+
+/**
+ * @brief  Creates an empty directory for a test, removed by the next call or
+ * when the tests end.
+ * @param  name The name of the directory.
+ * @retval the path of the directory.
+ */
+fs::path TestDirectory(std::string name);
+
+/**
+ * @brief  Runs the round trips of the requests and responses of the protocol.
+ */
+void RunProtocolTests();
+
+/**
+ * @brief  Runs the replays of the journal and the repairs of its entries.
+ */
+void RunJournalTests();
+
+/**
+ * @brief  Runs the loads of the checkpoint of the tables.
+ */
+void RunCheckpointTests();
+
+/**
+ * @brief  Runs the checks of the password hashes of the session table.
+ */
+void RunSessionTests();
+
+/**
+ * @brief  Runs the checks of the limits of the admission control.
+ */
+void RunAdmissionTests();
+
+#endif
@@ -0,0 +1,541 @@
+/**
+ * @file bench.cpp
+ * @brief Implementation file for the load generator.
+ *
+ * This file contains the main function of the tool that loads an auction
+ * server with a mix of requests sent by many threads, the same way the user
+ * client sends them, and reports the throughput and latency percentiles of
+ * every operation of the mix.
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "network.hpp"
+#include "protocol.hpp"
+
+/**
+ * @brief The operations a mix is made of.
+ */
+enum class BenchOperation {
+    Login,  // Logs in a random user, registering it the first time
+    Bid,    // Outbids every other thread on the same auction
+    Asset,  // Downloads the asset of the auction
+    List,   // Lists all the auctions
+};
+
+#define BENCH_OPERATIONS (4)  // The number of operations of BenchOperation
+
+/**
+ * @brief The names of the operations, as given in a mix.
+ */
+static const char *OperationNames[BENCH_OPERATIONS] = {"login", "bid", "sas",
+                                                       "lst"};
+
+/**
+ * @brief The settings of a run, shared by every thread.
+ */
+struct BenchSettings {
+    std::string hostname = DEFAULT_HOSTNAME;
+    std::string port = DEFAULT_PORT;
+    int threads = BENCH_DEFAULT_THREADS;
+    int duration = BENCH_DEFAULT_DURATION;  // In seconds
+    long requests = 0;                      // In total, 0 for no limit
+    int assetSize = BENCH_DEFAULT_ASSET_SIZE;
+    int pipeline = 0;  // TCP requests sent at once over a kept alive
+                       // connection, 0 for a connection per request
+    int weights[BENCH_OPERATIONS] = {};  // The share of each operation
+    std::string aid;                     // The auction bid on and downloaded
+};
+
+/**
+ * @brief The requests of an operation sent by a thread.
+ */
+struct OperationResults {
+    std::vector<uint64_t> latencies;         // In nanoseconds
+    std::map<std::string, size_t> statuses;  // The count of every status
+    size_t failures = 0;                     // Requests without a response
+};
+
+/**
+ * @brief A request of an operation, waiting to be sent.
+ */
+struct BenchRequest {
+    BenchOperation operation;
+    std::unique_ptr<ProtocolCommunication> comm;
+    std::string *status;  // The status decoded from the response, in comm
+};
+
+/**
+ * @brief The requests sent by a thread, per operation.
+ */
+struct ThreadResults {
+    OperationResults operations[BENCH_OPERATIONS];
+};
+
+static std::atomic<long> SentRequests(0);  // Requests sent by every thread
+static std::atomic<int> BidValue(0);       // The last value bid
+
+/**
+ * @brief  Sends a request and decodes its response, as the client does.
+ * @param  comm The communication.
+ * @param  settings The settings of the run.
+ */
+static void Transmit(ProtocolCommunication &comm, BenchSettings &settings) {
+    std::stringstream request = comm.encodeRequest();
+    std::stringstream response;
+
+    if (comm.isTcp()) {
+        TcpClient tcpClient(settings.hostname, settings.port);
+        tcpClient.send(request);
+        response = tcpClient.receive();
+    } else {
+        UdpClient udpClient(settings.hostname, settings.port);
+        udpClient.send(request);
+        response = udpClient.receive();
+    }
+
+    StreamMessage message(response);
+    comm.decodeResponse(message);
+}
+
+/**
+ * @brief  Returns the UID of the bidder that is a thread.
+ * @param  thread The index of the thread.
+ * @return The UID.
+ */
+static std::string BidderUid(int thread) {
+    return std::to_string(BENCH_BIDDER_UID + thread);
+}
+
+/**
+ * @brief  Builds the request of an operation.
+ * @param  operation The operation.
+ * @param  thread The index of the thread sending it.
+ * @param  random The random generator of the thread.
+ * @param  settings The settings of the run.
+ * @return The request.
+ */
+static BenchRequest Prepare(BenchOperation operation, int thread,
+                            std::mt19937 &random, BenchSettings &settings) {
+    switch (operation) {
+        case BenchOperation::Login: {
+            std::uniform_int_distribution<int> users(0, BENCH_LOGIN_USERS - 1);
+            auto comm = std::make_unique<LoginCommunication>();
+            comm->_uid = std::to_string(BENCH_LOGIN_UID + users(random));
+            comm->_password = BENCH_PASSWORD;
+            std::string *status = &comm->_status;
+            return {operation, std::move(comm), status};
+        }
+        case BenchOperation::Bid: {
+            auto comm = std::make_unique<BidCommunication>();
+            comm->_uid = BidderUid(thread);
+            comm->_password = BENCH_PASSWORD;
+            comm->_aid = settings.aid;
+            // Past the largest value the bids keep being refused
+            comm->_value = std::min(++BidValue, BENCH_MAX_BID_VALUE);
+            std::string *status = &comm->_status;
+            return {operation, std::move(comm), status};
+        }
+        case BenchOperation::Asset: {
+            auto comm = std::make_unique<ShowAssetCommunication>();
+            comm->_aid = settings.aid;
+            std::string *status = &comm->_status;
+            return {operation, std::move(comm), status};
+        }
+        case BenchOperation::List:
+        default: {
+            auto comm = std::make_unique<ListAllAuctionsCommunication>();
+            std::string *status = &comm->_status;
+            return {operation, std::move(comm), status};
+        }
+    }
+}
+
+/**
+ * @brief  Records the latency of a request.
+ * @param  operation The results of its operation.
+ * @param  start When the request was sent.
+ */
+static void Record(OperationResults &operation,
+                   std::chrono::steady_clock::time_point start) {
+    auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start);
+    operation.latencies.push_back((uint64_t)latency.count());
+}
+
+/**
+ * @brief  Sends TCP requests at once over a kept alive connection, opening it
+ * first if needed, then decodes their responses in order. Each latency is
+ * timed from the moment they were all sent.
+ * @param  batch The requests.
+ * @param  session The connection, reset when it fails.
+ * @param  settings The settings of the run.
+ * @param  results The results of the thread.
+ */
+static void Pipeline(std::vector<BenchRequest *> &batch,
+                     std::unique_ptr<TcpClient> &session,
+                     BenchSettings &settings, ThreadResults &results) {
+    auto start = std::chrono::steady_clock::now();
+    size_t done = 0;
+
+    try {
+        if (session == nullptr) {
+            session = std::make_unique<TcpClient>(settings.hostname,
+                                                  settings.port);
+            session->keepAlive();
+        }
+
+        std::stringstream requests;
+        for (auto request : batch) {
+            requests << request->comm->encodeRequest().rdbuf();
+        }
+        session->send(requests);
+
+        for (; done < batch.size(); done++) {
+            BenchRequest &request = *batch[done];
+            OperationResults &operation =
+                results.operations[(int)request.operation];
+
+            request.comm->decodeResponse(session->getResponses());
+            operation.statuses[*request.status]++;
+            Record(operation, start);
+        }
+    } catch (std::exception const &e) {
+        session.reset();  // The rest of the batch is lost with the connection
+
+        for (; done < batch.size(); done++) {
+            OperationResults &operation =
+                results.operations[(int)batch[done]->operation];
+
+            operation.failures++;
+            Record(operation, start);
+        }
+    }
+}
+
+/**
+ * @brief  Logs a user in, throwing if it can not be.
+ * @param  uid The UID of the user.
+ * @param  settings The settings of the run.
+ */
+static void Login(std::string uid, BenchSettings &settings) {
+    LoginCommunication comm;
+    comm._uid = uid;
+    comm._password = BENCH_PASSWORD;
+    Transmit(comm, settings);
+
+    if (comm._status != "OK" && comm._status != "REG") {
+        throw std::runtime_error("Could not log in user " + uid);
+    }
+}
+
+/**
+ * @brief  Opens the auction bid on and downloaded by the threads.
+ * @param  settings The settings of the run, that receive its AID.
+ */
+static void OpenAuction(BenchSettings &settings) {
+    Login(BENCH_OWNER_UID, settings);
+
+    OpenAuctionCommunication comm;
+    comm._uid = BENCH_OWNER_UID;
+    comm._password = BENCH_PASSWORD;
+    comm._name = "bench";
+    comm._startValue = 1;
+    comm._timeActive = BENCH_AUCTION_TIME;
+    comm._fileName = "bench.dat";
+    comm._fileSize = settings.assetSize;
+
+    for (int i = 0; i < settings.assetSize; i++) {
+        comm._fileData.put((char)('a' + i % 26));
+    }
+
+    Transmit(comm, settings);
+
+    if (comm._status != "OK") {
+        throw std::runtime_error("Could not open the auction");
+    }
+
+    settings.aid = comm._aid;
+}
+
+/**
+ * @brief  Sends requests of the mix until the run is over.
+ * @param  thread The index of the thread.
+ * @param  settings The settings of the run.
+ * @param  results The results of the thread.
+ */
+static void Worker(int thread, BenchSettings &settings,
+                   ThreadResults &results) {
+    std::mt19937 random((unsigned int)thread);
+    std::discrete_distribution<int> mix(settings.weights,
+                                        settings.weights + BENCH_OPERATIONS);
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::seconds(settings.duration);
+    size_t depth = (size_t)std::max(settings.pipeline, 1);
+    std::unique_ptr<TcpClient> session;  // Kept alive with a pipeline
+    bool finished = false;
+
+    while (!finished && std::chrono::steady_clock::now() < deadline) {
+        std::vector<BenchRequest> requests;
+        std::vector<BenchRequest *> pipelined;
+
+        while (requests.size() < depth) {
+            if (settings.requests > 0 && SentRequests++ >= settings.requests) {
+                finished = true;
+                break;
+            }
+
+            int index = mix(random);
+            requests.push_back(
+                Prepare((BenchOperation)index, thread, random, settings));
+        }
+
+        for (auto &request : requests) {
+            if (settings.pipeline > 0 && request.comm->isTcp()) {
+                pipelined.push_back(&request);
+                continue;
+            }
+
+            OperationResults &operation =
+                results.operations[(int)request.operation];
+            auto start = std::chrono::steady_clock::now();
+
+            try {
+                Transmit(*request.comm, settings);
+                operation.statuses[*request.status]++;
+            } catch (std::exception const &e) {
+                operation.failures++;  // Timed out or refused, still timed
+            }
+
+            Record(operation, start);
+        }
+
+        if (!pipelined.empty()) {
+            Pipeline(pipelined, session, settings, results);
+        }
+    }
+}
+
+/**
+ * @brief  Parses a mix, a comma separated list of operations, each optionally
+ * followed by a colon and its weight.
+ * @param  mix The mix.
+ * @param  settings The settings receiving the weights.
+ * @return Whether the mix is valid.
+ */
+static bool ParseMix(std::string mix, BenchSettings &settings) {
+    std::stringstream stream(mix);
+    std::string item;
+
+    while (std::getline(stream, item, ',')) {
+        size_t colon = item.find(':');
+        std::string name = item.substr(0, colon);
+        int weight = 1;
+
+        if (colon != std::string::npos) {
+            std::string value = item.substr(colon + 1);
+            if (value.empty() || value.length() > 3 || !isNumeric(value)) {
+                return false;
+            }
+            weight = std::stoi(value);
+        }
+
+        const char **end = OperationNames + BENCH_OPERATIONS;
+        const char **found = std::find(OperationNames, end, name);
+        if (found == end) {
+            return false;
+        }
+
+        settings.weights[found - OperationNames] += weight;
+    }
+
+    int total = 0;
+    for (auto weight : settings.weights) {
+        total += weight;
+    }
+
+    return total > 0;
+}
+
+/**
+ * @brief  Returns a percentile of sorted latencies, in microseconds.
+ * @param  latencies The latencies, sorted.
+ * @param  percentile The percentile, between 0 and 100.
+ * @return The percentile.
+ */
+static double Percentile(std::vector<uint64_t> &latencies, double percentile) {
+    if (latencies.empty()) {
+        return 0;
+    }
+
+    size_t rank = (size_t)(percentile / 100 * (double)latencies.size());
+    size_t index = std::min(rank, latencies.size() - 1);
+
+    return (double)latencies[index] / 1000;
+}
+
+/**
+ * @brief  Prints the results of an operation.
+ * @param  name The name of the operation.
+ * @param  results The results of the operation over every thread.
+ * @param  elapsed The seconds the run took.
+ */
+static void Report(std::string name, OperationResults &results,
+                   double elapsed) {
+    std::vector<uint64_t> &latencies = results.latencies;
+    std::sort(latencies.begin(), latencies.end());
+
+    std::cout << std::left << std::setw(6) << name << std::right
+              << std::setw(10) << latencies.size() << std::setw(10)
+              << (double)latencies.size() / elapsed << std::setw(10)
+              << Percentile(latencies, 50) << std::setw(10)
+              << Percentile(latencies, 90) << std::setw(10)
+              << Percentile(latencies, 99) << std::setw(10)
+              << Percentile(latencies, 100) << " ";
+
+    for (auto &status : results.statuses) {
+        std::cout << " " << status.first << "=" << status.second;
+    }
+
+    if (results.failures > 0) {
+        std::cout << " failed=" << results.failures;
+    }
+
+    std::cout << std::endl;
+}
+
+int main(int argc, char **argv) {
+    BenchSettings settings;
+    std::string mix = "login,bid,sas,lst";
+    char c;
+
+    try {
+        while ((c = (char)getopt(argc, argv, "n:p:t:d:c:m:s:k:")) != -1) {
+            switch (c) {
+                case 'n':
+                    settings.hostname = optarg;  // Sets the server hostname
+                    break;
+                case 'p':
+                    settings.port = optarg;  // Sets the server port
+                    break;
+                case 't':
+                    settings.threads = std::stoi(optarg);  // Sets the threads
+                    break;
+                case 'd':
+                    settings.duration = std::stoi(optarg);  // Sets the seconds
+                    break;
+                case 'c':
+                    settings.requests = std::stol(optarg);  // Sets the count
+                    break;
+                case 'm':
+                    mix = optarg;  // Sets the mix of operations
+                    break;
+                case 's':
+                    settings.assetSize = std::stoi(optarg);  // Sets the size
+                    break;
+                case 'k':
+                    settings.pipeline = std::stoi(optarg);  // Sets the depth
+                    break;
+                default:
+                    throw std::invalid_argument(optarg != NULL ? optarg : "");
+            }
+        }
+
+        if (!ParseMix(mix, settings) || settings.threads <= 0 ||
+            settings.threads > BENCH_MAX_THREADS || settings.duration <= 0 ||
+            settings.assetSize <= 0 ||
+            settings.assetSize > PROTOCOL_MAX_FILE_SIZE ||
+            settings.pipeline < 0 || settings.pipeline > BENCH_MAX_PIPELINE) {
+            throw std::invalid_argument(mix);
+        }
+    } catch (std::exception const &e) {
+        std::cout << "Usage: " << argv[0]
+                  << " [-n ASIP] [-p ASport] [-t threads] [-d seconds]"
+                  << " [-c requests] [-m mix] [-s size] [-k depth]"
+                  << std::endl;
+        return 1;
+    }
+
+    try {
+        // Every thread bidding on the auction has a user of its own
+        if (settings.weights[(int)BenchOperation::Bid] > 0 ||
+            settings.weights[(int)BenchOperation::Asset] > 0) {
+            OpenAuction(settings);
+        }
+
+        if (settings.weights[(int)BenchOperation::Bid] > 0) {
+            for (int thread = 0; thread < settings.threads; thread++) {
+                Login(BidderUid(thread), settings);
+            }
+        }
+    } catch (std::exception const &e) {
+        std::cerr << "Could not set up the benchmark: " << e.what()
+                  << std::endl;
+        return 1;
+    }
+
+    std::vector<ThreadResults> results((size_t)settings.threads);
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+
+    for (int thread = 0; thread < settings.threads; thread++) {
+        workers.emplace_back(Worker, thread, std::ref(settings),
+                             std::ref(results[(size_t)thread]));
+    }
+
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    // The threads are merged per operation and over every operation
+    OperationResults merged[BENCH_OPERATIONS];
+    OperationResults total;
+
+    for (auto &thread : results) {
+        for (int i = 0; i < BENCH_OPERATIONS; i++) {
+            OperationResults &from = thread.operations[i];
+
+            for (auto &to : {&merged[i], &total}) {
+                to->latencies.insert(to->latencies.end(),
+                                     from.latencies.begin(),
+                                     from.latencies.end());
+                for (auto &status : from.statuses) {
+                    to->statuses[status.first] += status.second;
+                }
+                to->failures += from.failures;
+            }
+        }
+    }
+
+    std::cout << "Mix " << mix << " with " << settings.threads
+              << " threads for " << std::fixed << std::setprecision(1)
+              << elapsed.count() << " s" << std::endl;
+    std::cout << std::left << std::setw(6) << "OP" << std::right
+              << std::setw(10) << "REQUESTS" << std::setw(10) << "REQ/S"
+              << std::setw(10) << "P50 US" << std::setw(10) << "P90 US"
+              << std::setw(10) << "P99 US" << std::setw(10) << "MAX US"
+              << "  STATUSES" << std::endl;
+
+    for (int i = 0; i < BENCH_OPERATIONS; i++) {
+        if (settings.weights[i] > 0) {
+            Report(OperationNames[i], merged[i], elapsed.count());
+        }
+    }
+
+    Report("all", total, elapsed.count());
+
+    return 0;
+}
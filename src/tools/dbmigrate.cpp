@@ -0,0 +1,62 @@
+/**
+ * @file dbmigrate.cpp
+ * @brief Implementation file for the database migration tool.
+ *
+ * This file contains the main function of the tool that moves the bids of
+ * every auction in a database from one file per bid to a bid log. The server
+ * must not be running on the database while it is migrated.
+ */
+#include <iostream>
+
+#include <unistd.h>
+
+#include "database.hpp"
+
+int main(int argc, char **argv) {
+    std::string databasePath = "database";
+    char c;
+
+    while ((c = (char)getopt(argc, argv, "d:")) != -1) {
+        switch (c) {
+            case 'd':
+                databasePath = optarg;  // Sets the database path
+                break;
+            default:
+                std::cout << "Usage: " << argv[0] << " [-d DBpath]"
+                          << std::endl;
+                return 1;
+        }
+    }
+
+    try {
+        DatabaseCore core(databasePath);
+        size_t auctions = 0;
+        size_t bids = 0;
+
+        for (auto &aid : core.getAllAuctions()) {
+            if (aid.length() != PROTOCOL_AID_SIZE || !isNumeric(aid)) {
+                continue;  // Not an auction directory
+            }
+
+            if (core.usesBidLog(aid)) {
+                continue;  // Already migrated
+            }
+
+            size_t moved = core.convertToBidLog(aid);
+            std::cout << "Auction " << aid << ": " << moved << " bids"
+                      << std::endl;
+
+            auctions++;
+            bids += moved;
+        }
+
+        std::cout << "Migrated " << auctions << " auctions with " << bids
+                  << " bids" << std::endl;
+    } catch (std::exception const &e) {
+        std::cerr << "Could not migrate the database: " << e.what()
+                  << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,540 @@
+/**
+ * @file microbench.cpp
+ * @brief Implementation file for the microbenchmarks.
+ *
+ * This file contains the main function of the tool that times the protocol
+ * helpers, the decoding of every request with the encoding of its response
+ * and the calls of the database core on synthetic databases. Every result is
+ * printed as a line of JSON or CSV, so that runs can be compared over time.
+ */
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <unistd.h>
+
+#include "database.hpp"
+#include "protocol.hpp"
+
+/**
+ * @brief The settings of a run.
+ */
+struct MicrobenchSettings {
+    std::string databasePath = "microbench";  // Removed after the run
+    std::vector<int> sizes = {1000, 10000, 100000};  // Bids per database
+    int minTime = MICROBENCH_MIN_TIME;  // In milliseconds, per benchmark
+    bool csv = false;                   // Whether CSV is printed, not JSON
+    std::string filter;                 // The benchmarks run contain it
+    std::string label;                  // Printed with every result
+};
+
+static MicrobenchSettings Settings;
+
+static volatile size_t Sink;  // Keeps the results from being optimized out
+
+/**
+ * @brief  Prints the result of a benchmark.
+ * @param  name The name of the benchmark.
+ * @param  size The size of its input, 0 when it has none.
+ * @param  iterations The number of operations timed.
+ * @param  nanoseconds The time they took.
+ */
+static void Record(std::string name, int size, uint64_t iterations,
+                   uint64_t nanoseconds) {
+    double perOperation = (double)nanoseconds / (double)iterations;
+
+    if (Settings.csv) {
+        std::cout << Settings.label << "," << name << "," << size << ","
+                  << iterations << "," << perOperation << std::endl;
+    } else {
+        std::cout << "{\"label\":\"" << Settings.label << "\",\"benchmark\":\""
+                  << name << "\",\"size\":" << size
+                  << ",\"iterations\":" << iterations
+                  << ",\"ns_per_op\":" << perOperation << "}" << std::endl;
+    }
+}
+
+/**
+ * @brief  Returns whether a benchmark is selected by the filter.
+ * @param  name The name of the benchmark.
+ */
+static bool Selected(std::string name) {
+    return name.find(Settings.filter) != std::string::npos;
+}
+
+/**
+ * @brief  Returns the nanoseconds elapsed since a time.
+ * @param  start The time.
+ */
+static uint64_t Elapsed(std::chrono::steady_clock::time_point start) {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               elapsed)
+        .count();
+}
+
+/**
+ * @brief  Runs batches of a benchmark for the minimum time, then prints it.
+ * @param  name The name of the benchmark.
+ * @param  size The size of its input, 0 when it has none.
+ * @param  batch Runs a batch of operations, returning how many it ran.
+ */
+static void Run(std::string name, int size, std::function<size_t()> batch) {
+    if (!Selected(name)) {
+        return;
+    }
+
+    uint64_t minTime = (uint64_t)Settings.minTime * 1000000;
+    uint64_t iterations = 0;
+
+    batch();  // Warms up the caches and the allocator
+
+    auto start = std::chrono::steady_clock::now();
+    do {
+        iterations += batch();
+    } while (Elapsed(start) < minTime);
+
+    Record(name, size, iterations, Elapsed(start));
+}
+
+/**
+ * @brief  Times a reader of the protocol on a message of many fields.
+ * @param  name The name of the benchmark.
+ * @param  write Writes a field to a message.
+ * @param  read Reads a field from a message.
+ */
+static void RunReader(
+    std::string name,
+    std::function<void(ProtocolCommunication &, std::stringstream &)> write,
+    std::function<void(ProtocolCommunication &, MessageSource &)> read) {
+    LoginCommunication comm;  // Any communication has the helpers
+    std::stringstream text;
+
+    for (int i = 0; i < MICROBENCH_FIELDS; i++) {
+        write(comm, text);
+        comm.writeSpace(text);
+    }
+
+    std::string data = text.str();
+
+    Run(name, 0, [&]() {
+        std::stringstream stream(data);
+        StreamMessage message(stream);
+
+        for (int i = 0; i < MICROBENCH_FIELDS; i++) {
+            read(comm, message);
+            comm.readSpace(message);
+        }
+
+        return (size_t)MICROBENCH_FIELDS;
+    });
+}
+
+/**
+ * @brief  Times a writer of the protocol, writing many fields to a message.
+ * @param  name The name of the benchmark.
+ * @param  write Writes a field to a message.
+ */
+static void RunWriter(
+    std::string name,
+    std::function<void(ProtocolCommunication &, std::stringstream &)> write) {
+    LoginCommunication comm;
+
+    Run(name, 0, [&]() {
+        std::stringstream text;
+
+        for (int i = 0; i < MICROBENCH_FIELDS; i++) {
+            write(comm, text);
+            comm.writeSpace(text);
+        }
+
+        Sink = Sink + (size_t)text.tellp();
+        return (size_t)MICROBENCH_FIELDS;
+    });
+}
+
+/**
+ * @brief  Times the decoding of a request, as the server does, followed by
+ * the encoding of its response.
+ * @param  name The name of the benchmark.
+ * @param  size The size of the request or response, 0 when it has none.
+ * @param  request The communication encoding the request.
+ * @param  respond Fills in the response of the decoded communication.
+ */
+template <typename Communication>
+static void RunCommunication(std::string name, int size,
+                             Communication &request,
+                             std::function<void(Communication &)> respond) {
+    std::string data = request.encodeRequest().str();
+
+    Run(name, size, [&]() {
+        for (int i = 0; i < MICROBENCH_MESSAGES; i++) {
+            std::stringstream stream(data);
+            StreamMessage message(stream);
+            Communication comm;
+
+            comm.readString(message, 3);  // The server reads the identifier
+            comm.decodeRequest(message);
+            respond(comm);
+            Sink = Sink + (size_t)comm.encodeResponse().tellp();
+        }
+
+        return (size_t)MICROBENCH_MESSAGES;
+    });
+}
+
+/**
+ * @brief  Times the readers and writers of the protocol.
+ */
+static void RunProtocolHelpers() {
+    using Comm = ProtocolCommunication;
+    using Stream = std::stringstream;
+    using Source = MessageSource;
+    time_t now = time(NULL);
+
+    RunReader(
+        "protocol/readNumber",
+        [](Comm &c, Stream &s) { c.writeNumber(s, 123456); },
+        [](Comm &c, Source &m) { Sink = Sink + (size_t)c.readNumber(m); });
+    RunReader(
+        "protocol/readString",
+        [](Comm &c, Stream &s) { c.writeString(s, "abcdefghij"); },
+        [](Comm &c, Source &m) { Sink = Sink + c.readString(m).size(); });
+    RunReader(
+        "protocol/readUid", [](Comm &c, Stream &s) { c.writeUid(s, "123456"); },
+        [](Comm &c, Source &m) { Sink = Sink + c.readUid(m).size(); });
+    RunReader(
+        "protocol/readPassword",
+        [](Comm &c, Stream &s) { c.writePassword(s, "abcd1234"); },
+        [](Comm &c, Source &m) { Sink = Sink + c.readPassword(m).size(); });
+    RunReader(
+        "protocol/readAid", [](Comm &c, Stream &s) { c.writeAid(s, "123"); },
+        [](Comm &c, Source &m) { Sink = Sink + c.readAid(m).size(); });
+    RunReader(
+        "protocol/readFileName",
+        [](Comm &c, Stream &s) { c.writeFileName(s, "asset_file.txt"); },
+        [](Comm &c, Source &m) { Sink = Sink + c.readFileName(m).size(); });
+    RunReader(
+        "protocol/readAuctionName",
+        [](Comm &c, Stream &s) { c.writeAuctionName(s, "auction"); },
+        [](Comm &c, Source &m) { Sink = Sink + c.readAuctionName(m).size(); });
+    RunReader(
+        "protocol/readDateTime",
+        [now](Comm &c, Stream &s) { c.writeDateTime(s, now); },
+        [](Comm &c, Source &m) { Sink = Sink + (size_t)c.readDateTime(m); });
+
+    RunWriter("protocol/writeNumber",
+              [](Comm &c, Stream &s) { c.writeNumber(s, 123456); });
+    RunWriter("protocol/writeString",
+              [](Comm &c, Stream &s) { c.writeString(s, "abcdefghij"); });
+    RunWriter("protocol/writeUid",
+              [](Comm &c, Stream &s) { c.writeUid(s, "123456"); });
+    RunWriter("protocol/writeAid",
+              [](Comm &c, Stream &s) { c.writeAid(s, "123"); });
+    RunWriter("protocol/writeDateTime",
+              [now](Comm &c, Stream &s) { c.writeDateTime(s, now); });
+}
+
+/**
+ * @brief  Times the decoding of every request with the encoding of its
+ * response.
+ */
+static void RunCommunications() {
+    time_t now = time(NULL);
+
+    LoginCommunication login;
+    login._uid = "123456";
+    login._password = "abcd1234";
+    RunCommunication<LoginCommunication>(
+        "communication/LIN", 0, login,
+        [](LoginCommunication &c) { c._status = "OK"; });
+
+    LogoutCommunication logout;
+    logout._uid = "123456";
+    logout._password = "abcd1234";
+    RunCommunication<LogoutCommunication>(
+        "communication/LOU", 0, logout,
+        [](LogoutCommunication &c) { c._status = "OK"; });
+
+    UnregisterCommunication unregister;
+    unregister._uid = "123456";
+    unregister._password = "abcd1234";
+    RunCommunication<UnregisterCommunication>(
+        "communication/UNR", 0, unregister,
+        [](UnregisterCommunication &c) { c._status = "OK"; });
+
+    // The lists have as many auctions as fit a datagram
+    std::map<std::string, std::string> auctions;
+    for (int aid = 1; aid <= MICROBENCH_LIST_AUCTIONS; aid++) {
+        auctions[AidIntToStr(aid)] = (aid % 2 == 0) ? "1" : "0";
+    }
+
+    ListUserAuctionsCommunication userAuctions;
+    userAuctions._uid = "123456";
+    RunCommunication<ListUserAuctionsCommunication>(
+        "communication/LMA", MICROBENCH_LIST_AUCTIONS, userAuctions,
+        [&](ListUserAuctionsCommunication &c) {
+            c._status = "OK";
+            c._auctions = auctions;
+        });
+
+    ListUserBidsCommunication userBids;
+    userBids._uid = "123456";
+    RunCommunication<ListUserBidsCommunication>(
+        "communication/LMB", MICROBENCH_LIST_AUCTIONS, userBids,
+        [&](ListUserBidsCommunication &c) {
+            c._status = "OK";
+            c._bids = auctions;
+        });
+
+    ListAllAuctionsCommunication allAuctions;
+    RunCommunication<ListAllAuctionsCommunication>(
+        "communication/LST", MICROBENCH_LIST_AUCTIONS, allAuctions,
+        [&](ListAllAuctionsCommunication &c) {
+            c._status = "OK";
+            c._auctions = auctions;
+        });
+
+    ShowRecordCommunication record;
+    record._aid = "001";
+    RunCommunication<ShowRecordCommunication>(
+        "communication/SRC", PROTOCOL_MAX_RECORD_BIDS, record,
+        [now](ShowRecordCommunication &c) {
+            c._status = "OK";
+            c._hostUid = "123456";
+            c._auctionName = "auction";
+            c._assetFname = "asset_file.txt";
+            c._startValue = 100;
+            c._startDateTime = now;
+            c._timeActive = 3600;
+            for (int i = 0; i < PROTOCOL_MAX_RECORD_BIDS; i++) {
+                c._bidderUids.push_back("654321");
+                c._bidValues.push_back(101 + i);
+                c._bidDateTime.push_back(now);
+                c._bidSecTimes.push_back(i);
+            }
+        });
+
+    std::string asset(MICROBENCH_ASSET_SIZE, 'a');
+
+    OpenAuctionCommunication open;
+    open._uid = "123456";
+    open._password = "abcd1234";
+    open._name = "auction";
+    open._startValue = 100;
+    open._timeActive = 3600;
+    open._fileName = "asset_file.txt";
+    open._fileSize = MICROBENCH_ASSET_SIZE;
+    open._fileData.str(asset);
+    RunCommunication<OpenAuctionCommunication>(
+        "communication/OPA", MICROBENCH_ASSET_SIZE, open,
+        [](OpenAuctionCommunication &c) {
+            c._status = "OK";
+            c._aid = "001";
+        });
+
+    CloseAuctionCommunication close;
+    close._uid = "123456";
+    close._password = "abcd1234";
+    close._aid = "001";
+    RunCommunication<CloseAuctionCommunication>(
+        "communication/CLS", 0, close,
+        [](CloseAuctionCommunication &c) { c._status = "OK"; });
+
+    ShowAssetCommunication showAsset;
+    showAsset._aid = "001";
+    RunCommunication<ShowAssetCommunication>(
+        "communication/SAS", MICROBENCH_ASSET_SIZE, showAsset,
+        [&](ShowAssetCommunication &c) {
+            c._status = "OK";
+            c._fileName = "asset_file.txt";
+            c._fileSize = MICROBENCH_ASSET_SIZE;
+            c._fileData.str(asset);
+        });
+
+    BidCommunication bid;
+    bid._uid = "123456";
+    bid._password = "abcd1234";
+    bid._aid = "001";
+    bid._value = 1000;
+    RunCommunication<BidCommunication>(
+        "communication/BID", 0, bid,
+        [](BidCommunication &c) { c._status = "ACC"; });
+}
+
+/**
+ * @brief  Times the database core on a synthetic database.
+ *
+ * The database has an auction with every bid, besides an empty auction per
+ * 100 bids, up to the number of AIDs.
+ * @param  storage The bid storage of the auctions.
+ * @param  bids The number of bids.
+ */
+static void RunDatabase(BidStorage storage, int bids) {
+    std::string prefix = "core/";
+    prefix += (storage == BidStorage::Log) ? "log/" : "files/";
+
+    std::vector<std::string> names = {"addAuctionBid", "getAuctionBids",
+                                      "getAuctionLastBids",
+                                      "getAuctionBidSummary", "getAllAuctions"};
+
+    // Filling the database is slow, it is skipped if nothing would use it
+    if (std::none_of(names.begin(), names.end(), [&](std::string &name) {
+            return Selected(prefix + name);
+        })) {
+        return;
+    }
+
+    fs::path path = fs::path(Settings.databasePath) / std::to_string(bids);
+    fs::remove_all(path);
+
+    DatabaseCore core(path.string(), storage);
+
+    AuctionStartInfo startInfo;
+    startInfo.uid = "123456";
+    startInfo.name = "auction";
+    startInfo.startValue = 1;
+    startInfo.startTime = time(NULL);
+    startInfo.timeActive = 3600;
+
+    int auctions = std::min(bids / 100 + 1, DATABASE_MAX_AUCTIONS - 1);
+    for (int aid = 1; aid <= auctions; aid++) {
+        core.createAuction(AidIntToStr(aid), startInfo);
+    }
+
+    std::string aid = AidIntToStr(1);
+
+    // Filling the database is the benchmark of the bids added
+    auto start = std::chrono::steady_clock::now();
+
+    for (int value = 1; value <= bids; value++) {
+        AuctionBidInfo bidInfo;
+        bidInfo.uid = "654321";
+        bidInfo.bidValue = value;
+        bidInfo.bidTime = time(NULL);
+        core.addAuctionBid(aid, bidInfo);
+    }
+
+    if (Selected(prefix + "addAuctionBid")) {
+        Record(prefix + "addAuctionBid", bids, (uint64_t)bids, Elapsed(start));
+    }
+
+    Run(prefix + "getAuctionBids", bids, [&]() {
+        Sink = Sink + core.getAuctionBids(aid).size();
+        return (size_t)1;
+    });
+
+    Run(prefix + "getAuctionLastBids", bids, [&]() {
+        Sink = Sink +
+               core.getAuctionLastBids(aid, PROTOCOL_MAX_RECORD_BIDS).size();
+        return (size_t)1;
+    });
+
+    Run(prefix + "getAuctionBidSummary", bids, [&]() {
+        Sink = Sink + (size_t)core.getAuctionBidSummary(aid).bidCount;
+        return (size_t)1;
+    });
+
+    Run(prefix + "getAllAuctions", bids, [&]() {
+        Sink = Sink + core.getAllAuctions().size();
+        return (size_t)1;
+    });
+
+    fs::remove_all(path);
+}
+
+/**
+ * @brief  Parses a comma separated list of bid counts.
+ * @param  list The list.
+ * @return Whether the list is valid.
+ */
+static bool ParseSizes(std::string list) {
+    std::stringstream stream(list);
+    std::string item;
+
+    Settings.sizes.clear();
+
+    while (std::getline(stream, item, ',')) {
+        // The values of the bids have 6 digits, and start at 1
+        if (item.empty() || item.length() > 6 || !isNumeric(item) ||
+            std::stoi(item) == 0) {
+            return false;
+        }
+        Settings.sizes.push_back(std::stoi(item));
+    }
+
+    return !Settings.sizes.empty();
+}
+
+int main(int argc, char **argv) {
+    std::string format = "json";
+    char c;
+
+    try {
+        while ((c = (char)getopt(argc, argv, "d:b:t:f:x:l:")) != -1) {
+            switch (c) {
+                case 'd':
+                    Settings.databasePath = optarg;  // Sets the database path
+                    break;
+                case 'b':
+                    if (!ParseSizes(optarg)) {  // Sets the bids per database
+                        throw std::invalid_argument(optarg);
+                    }
+                    break;
+                case 't':
+                    Settings.minTime = std::stoi(optarg);  // Sets the time
+                    break;
+                case 'f':
+                    format = optarg;  // Sets the format of the results
+                    break;
+                case 'x':
+                    Settings.filter = optarg;  // Sets the benchmarks run
+                    break;
+                case 'l':
+                    Settings.label = optarg;  // Sets the label of the results
+                    break;
+                default:
+                    throw std::invalid_argument(optarg != NULL ? optarg : "");
+            }
+        }
+
+        if ((format != "json" && format != "csv") || Settings.minTime <= 0) {
+            throw std::invalid_argument(format);
+        }
+    } catch (std::exception const &e) {
+        std::cout << "Usage: " << argv[0]
+                  << " [-d DBpath] [-b bids] [-t milliseconds] [-f format]"
+                  << " [-x filter] [-l label]" << std::endl;
+        return 1;
+    }
+
+    Settings.csv = (format == "csv");
+    std::cout << std::fixed << std::setprecision(1);
+
+    if (Settings.csv) {
+        std::cout << "label,benchmark,size,iterations,ns_per_op" << std::endl;
+    }
+
+    try {
+        RunProtocolHelpers();
+        RunCommunications();
+
+        fs::create_directories(Settings.databasePath);
+
+        for (auto storage : {BidStorage::Files, BidStorage::Log}) {
+            for (auto bids : Settings.sizes) {
+                RunDatabase(storage, bids);
+            }
+        }
+
+        fs::remove_all(Settings.databasePath);
+    } catch (std::exception const &e) {
+        std::cerr << "Could not run the benchmarks: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}